@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+namespace Idx3Lib
+{
+	/// <summary>
+	/// Heap array of trivially copyable <c>T</c> whose first element is aligned to <c>Alignment</c> bytes
+	/// (one cache line by default). Elements are not initialized. Move-only.
+	/// </summary>
+	template<typename T, size_t Alignment = 64> requires std::is_trivially_copyable_v<T>
+	class AlignedBuffer
+	{
+	public:
+		static_assert(Alignment >= alignof(T) && (Alignment & (Alignment - 1)) == 0, "Alignment must be a power of two.");
+		AlignedBuffer() = default;
+		explicit AlignedBuffer(size_t count) { Resize(count); }
+		AlignedBuffer(const AlignedBuffer&) = delete;
+		AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+		AlignedBuffer(AlignedBuffer&& other) noexcept
+			: m_data(std::exchange(other.m_data, nullptr)), m_size(std::exchange(other.m_size, 0)), m_capacity(std::exchange(other.m_capacity, 0)) { }
+		AlignedBuffer& operator=(AlignedBuffer&& other) noexcept
+		{
+			if (this != &other)
+			{
+				Free();
+				m_data = std::exchange(other.m_data, nullptr);
+				m_size = std::exchange(other.m_size, 0);
+				m_capacity = std::exchange(other.m_capacity, 0);
+			}
+			return *this;
+		}
+		~AlignedBuffer() { Free(); }
+
+		/// <summary>Changes the element count, only reallocates when growing past the capacity.
+		/// Contents are not preserved across a reallocation.</summary>
+		///	<throws> std::bad_alloc on failure to allocate. </throws>
+		void Resize(size_t count)
+		{
+			if (count > m_capacity)
+			{
+				Free();
+				m_data = static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t{ Alignment }));
+				m_capacity = count;
+			}
+			m_size = count;
+		}
+		[[nodiscard]] T* data() noexcept { return m_data; }
+		[[nodiscard]] const T* data() const noexcept { return m_data; }
+		[[nodiscard]] size_t size() const noexcept { return m_size; }
+		[[nodiscard]] size_t capacity() const noexcept { return m_capacity; }
+		[[nodiscard]] bool empty() const noexcept { return m_size == 0; }
+		[[nodiscard]] T* begin() noexcept { return m_data; }
+		[[nodiscard]] T* end() noexcept { return m_data + m_size; }
+		[[nodiscard]] const T* begin() const noexcept { return m_data; }
+		[[nodiscard]] const T* end() const noexcept { return m_data + m_size; }
+		[[nodiscard]] T& operator[](size_t index) noexcept { return m_data[index]; }
+		[[nodiscard]] const T& operator[](size_t index) const noexcept { return m_data[index]; }
+		[[nodiscard]] std::span<T> Span() noexcept { return { m_data, m_size }; }
+		[[nodiscard]] std::span<const T> Span() const noexcept { return { m_data, m_size }; }
+	private:
+		void Free() noexcept
+		{
+			if (m_data != nullptr)
+				::operator delete(m_data, std::align_val_t{ Alignment });
+			m_data = nullptr;
+			m_size = 0;
+			m_capacity = 0;
+		}
+		T* m_data = nullptr;
+		size_t m_size = 0;
+		size_t m_capacity = 0;
+	};
+}
@@ -0,0 +1,499 @@
+#pragma once
+#include "stdafx.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "Instrumentation.hpp"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define IDX3_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace Idx3Lib
+{
+	/// <summary>How <c>AsyncFileReader</c> issues its reads.</summary>
+	enum class AsyncBackend
+	{
+		Auto,       // io_uring where the kernel allows it, pread otherwise
+		IoUring,    // Linux 5.6 or later, many reads in flight on one thread
+		PRead       // one blocking positional read at a time
+	};
+	inline const char* ToString(AsyncBackend backend) noexcept
+	{
+		switch (backend)
+		{
+		case AsyncBackend::IoUring: return "io_uring";
+		case AsyncBackend::PRead: return "pread";
+		default: return "auto";
+		}
+	}
+
+	struct AsyncReadOptions
+	{
+		AsyncBackend Backend = AsyncBackend::Auto;
+		size_t QueueDepth = 64;     // reads kept in flight at once by the io_uring backend
+	};
+
+	/// <summary>One read of <c>size</c> bytes at file offset <c>offset</c> into <c>destination</c>.</summary>
+	struct AsyncReadRequest
+	{
+		size_t offset = 0;
+		size_t size = 0;
+		std::uint8_t* destination = nullptr;
+	};
+
+	/// <summary>
+	/// Positional reads of many disjoint ranges of one file, for random access over files larger than memory.
+	/// With io_uring, <c>Read</c> keeps up to <c>QueueDepth</c> requests in flight, so a batch of scattered images costs
+	/// about one device round trip per queue's worth instead of one per image. Buffers handed to <c>RegisterBuffers</c>
+	/// are pinned by the kernel once, reads landing inside them skip the per request page mapping. The ring is set up
+	/// through the raw system calls, no liburing is needed. Where io_uring is missing, disabled or the process is not
+	/// allowed to use it, the same requests are served by pread one after another.
+	/// A reader belongs to one thread at a time.
+	/// </summary>
+	class AsyncFileReader
+	{
+	public:
+		AsyncFileReader() = default;
+		AsyncFileReader(const AsyncFileReader&) = delete;
+		AsyncFileReader& operator=(const AsyncFileReader&) = delete;
+		~AsyncFileReader() { Close(); }
+
+		/// <summary>Opens <c>path</c> for reading. Returns false if the file cannot be opened, or if io_uring was asked for
+		///	explicitly and is unavailable, see <c>ErrorMessage()</c>.</summary>
+		bool Open(const std::string& path, const AsyncReadOptions& options = {})
+		{
+			Close();
+#ifdef _WIN32
+			m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+			LARGE_INTEGER fileSize{};
+			if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &fileSize))
+				return SetError("File failed to open.");
+			m_size = static_cast<size_t>(fileSize.QuadPart);
+#else
+			m_fd = ::open(path.c_str(), O_RDONLY);
+			struct stat fileStat {};
+			if (m_fd < 0 || ::fstat(m_fd, &fileStat) != 0)
+				return SetError("File failed to open.");
+			m_size = static_cast<size_t>(fileStat.st_size);
+#endif
+			m_backend = AsyncBackend::PRead;
+			if (options.Backend != AsyncBackend::PRead)
+			{
+#ifdef IDX3_HAVE_IO_URING
+				if (m_ring.Setup(static_cast<unsigned>(std::clamp<size_t>(options.QueueDepth, 1, 4096))))
+					m_backend = AsyncBackend::IoUring;
+#endif
+				if (options.Backend == AsyncBackend::IoUring && m_backend != AsyncBackend::IoUring)
+				{
+					Close();
+					return SetError("io_uring is not available.");
+				}
+			}
+			m_errorMessage.clear();
+			return true;
+		}
+		void Close()
+		{
+#ifdef IDX3_HAVE_IO_URING
+			m_ring.Destroy();
+#endif
+			m_registered.clear();
+#ifdef _WIN32
+			if (m_file != INVALID_HANDLE_VALUE)
+				CloseHandle(m_file);
+			m_file = INVALID_HANDLE_VALUE;
+#else
+			if (m_fd >= 0)
+				::close(m_fd);
+			m_fd = -1;
+#endif
+			m_size = 0;
+		}
+		[[nodiscard]] bool IsOpen() const noexcept
+		{
+#ifdef _WIN32
+			return m_file != INVALID_HANDLE_VALUE;
+#else
+			return m_fd >= 0;
+#endif
+		}
+		[[nodiscard]] size_t Size() const noexcept { return m_size; }
+		/// <summary>The backend in use, <c>IoUring</c> or <c>PRead</c> once open.</summary>
+		[[nodiscard]] AsyncBackend Backend() const noexcept { return m_backend; }
+		[[nodiscard]] std::string_view ErrorMessage() const noexcept { return m_errorMessage; }
+
+		/// <summary>Registers <c>buffers</c> with the kernel, replacing any registered before. Reads into them then skip
+		///	pinning the destination pages on every request. The buffers must stay allocated until they are replaced or the
+		///	reader is closed. Returns false if the kernel refused (e.g. the locked memory limit), reads still work.</summary>
+		bool RegisterBuffers(std::span<const std::span<std::uint8_t>> buffers)
+		{
+			m_registered.clear();
+#ifdef IDX3_HAVE_IO_URING
+			if (m_backend == AsyncBackend::IoUring)
+			{
+				std::vector<iovec> vectors;
+				for (const auto& buffer : buffers)
+					vectors.push_back({ buffer.data(), buffer.size() });
+				if (!m_ring.RegisterBuffers(vectors))
+					return false;
+				m_registered.assign(buffers.begin(), buffers.end());
+				return true;
+			}
+#endif
+			(void)buffers;
+			return m_backend == AsyncBackend::PRead;
+		}
+
+		/// <summary>Completes every request and returns once all of them have landed. Returns false if one failed or reached
+		///	past the end of the file, see <c>ErrorMessage()</c>.</summary>
+		bool Read(std::span<const AsyncReadRequest> requests)
+		{
+			if (!IsOpen())
+				return false;
+			IDX3_PROFILE_SCOPE_ITEMS("async read", requests.size());
+			for (const auto& request : requests)
+			{
+				if (request.offset > m_size || request.size > m_size - request.offset)
+					return SetError("Read of " + std::to_string(request.size) + " bytes at offset " + std::to_string(request.offset) + " is past the end of the file.");
+			}
+#ifdef IDX3_HAVE_IO_URING
+			if (m_backend == AsyncBackend::IoUring)
+				return ReadRing(requests);
+#endif
+			for (const auto& request : requests)
+			{
+				if (!ReadAt(request.destination, request.size, request.offset))
+					return false;
+			}
+			return true;
+		}
+		/// <summary>Reads <c>size</c> bytes at <c>offset</c> into <c>destination</c> with one blocking call.</summary>
+		bool ReadAt(std::uint8_t* destination, size_t size, size_t offset)
+		{
+			while (size > 0)
+			{
+#ifdef _WIN32
+				OVERLAPPED position{};
+				position.Offset = static_cast<DWORD>(offset);
+				position.OffsetHigh = static_cast<DWORD>(static_cast<std::uint64_t>(offset) >> 32);
+				DWORD read = 0;
+				const DWORD chunk = static_cast<DWORD>(std::min<size_t>(size, 1u << 30));
+				if (!ReadFile(m_file, destination, chunk, &read, &position) || read == 0)
+					return SetError("Failed reading " + std::to_string(size) + " bytes at offset " + std::to_string(offset) + ".");
+#else
+				const ssize_t read = ::pread(m_fd, destination, size, static_cast<off_t>(offset));
+				if (read < 0 && errno == EINTR)
+					continue;
+				if (read <= 0)
+					return SetError("Failed reading " + std::to_string(size) + " bytes at offset " + std::to_string(offset) + ".");
+#endif
+				destination += read;
+				size -= static_cast<size_t>(read);
+				offset += static_cast<size_t>(read);
+			}
+			return true;
+		}
+	private:
+#ifdef IDX3_HAVE_IO_URING
+		/// <summary>Submission and completion rings of one io_uring instance, mapped from the kernel.</summary>
+		class Ring
+		{
+		public:
+			Ring() = default;
+			Ring(const Ring&) = delete;
+			Ring& operator=(const Ring&) = delete;
+			~Ring() { Destroy(); }
+
+			bool Setup(unsigned entries)
+			{
+				io_uring_params params{};
+				m_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+				if (m_fd < 0)
+					return false;
+				m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+				m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+				const bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+				if (singleMap)
+					m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+				m_sqRing = ::mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+				if (m_sqRing == MAP_FAILED)
+					return Fail();
+				m_cqRing = singleMap ? m_sqRing : ::mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+				if (m_cqRing == MAP_FAILED)
+					return Fail();
+				m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+				void* sqes = ::mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+				if (sqes == MAP_FAILED)
+					return Fail();
+				m_sqes = static_cast<io_uring_sqe*>(sqes);
+				auto* sq = static_cast<std::uint8_t*>(m_sqRing);
+				auto* cq = static_cast<std::uint8_t*>(m_cqRing);
+				m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+				m_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+				m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+				m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+				m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+				m_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+				m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+				m_entries = params.sq_entries;
+				//plain and fixed buffer reads arrived in different kernels, a kernel without them cannot serve us.
+				return Supports(IORING_OP_READ) && Supports(IORING_OP_READ_FIXED) ? true : Fail();
+			}
+			void Destroy()
+			{
+				if (m_sqes != nullptr)
+					::munmap(m_sqes, m_sqesSize);
+				if (m_cqRing != nullptr && m_cqRing != MAP_FAILED && m_cqRing != m_sqRing)
+					::munmap(m_cqRing, m_cqRingSize);
+				if (m_sqRing != nullptr && m_sqRing != MAP_FAILED)
+					::munmap(m_sqRing, m_sqRingSize);
+				if (m_fd >= 0)
+					::close(m_fd);
+				m_sqes = nullptr;
+				m_sqRing = m_cqRing = nullptr;
+				m_fd = -1;
+				m_entries = 0;
+				m_pending = 0;
+			}
+			[[nodiscard]] unsigned Entries() const noexcept { return m_entries; }
+
+			bool RegisterBuffers(const std::vector<iovec>& buffers)
+			{
+				::syscall(__NR_io_uring_register, m_fd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+				return buffers.empty() || ::syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_BUFFERS, buffers.data(), static_cast<unsigned>(buffers.size())) == 0;
+			}
+
+			/// <summary>Queues a read, <c>bufferIndex</c> selects a registered buffer holding the destination or is -1.</summary>
+			void PrepareRead(int fd, std::uint8_t* destination, unsigned size, size_t offset, int bufferIndex, std::uint64_t userData) noexcept
+			{
+				const unsigned tail = *m_sqTail;
+				const unsigned index = tail & m_sqMask;
+				io_uring_sqe& sqe = m_sqes[index];
+				std::memset(&sqe, 0, sizeof(sqe));
+				sqe.opcode = bufferIndex < 0 ? IORING_OP_READ : IORING_OP_READ_FIXED;
+				sqe.fd = fd;
+				sqe.addr = reinterpret_cast<std::uint64_t>(destination);
+				sqe.len = size;
+				sqe.off = offset;
+				sqe.buf_index = static_cast<std::uint16_t>(std::max(bufferIndex, 0));
+				sqe.user_data = userData;
+				m_sqArray[index] = index;
+				std::atomic_ref<unsigned>(*m_sqTail).store(tail + 1, std::memory_order_release);
+				m_pending++;
+			}
+			/// <summary>Submits what was prepared and waits for at least <c>waitFor</c> completions. Returns a negative errno on failure.</summary>
+			int Submit(unsigned waitFor) noexcept { return Enter(m_pending, waitFor); }
+			/// <summary>Waits for at least one completion of what was already submitted. Returns a negative errno on failure.</summary>
+			int Wait() noexcept { return Enter(0, 1); }
+			/// <summary>Takes back the reads prepared but not yet submitted, the kernel never sees them. Returns how many.</summary>
+			unsigned DiscardPending() noexcept
+			{
+				const unsigned discarded = m_pending;
+				std::atomic_ref<unsigned>(*m_sqTail).store(*m_sqTail - discarded, std::memory_order_release);
+				m_pending = 0;
+				return discarded;
+			}
+			/// <summary>Calls <c>complete(userData, result)</c> for every completion posted so far.</summary>
+			template<typename Complete>
+			void Reap(const Complete& complete)
+			{
+				unsigned head = *m_cqHead;
+				const unsigned tail = std::atomic_ref<unsigned>(*m_cqTail).load(std::memory_order_acquire);
+				for (; head != tail; head++)
+				{
+					const io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+					complete(cqe.user_data, cqe.res);
+				}
+				std::atomic_ref<unsigned>(*m_cqHead).store(head, std::memory_order_release);
+			}
+		private:
+			int Enter(unsigned toSubmit, unsigned waitFor) noexcept
+			{
+				for (;;)
+				{
+					const long submitted = ::syscall(__NR_io_uring_enter, m_fd, toSubmit, waitFor, waitFor > 0 ? IORING_ENTER_GETEVENTS : 0u, nullptr, 0);
+					if (submitted >= 0)
+					{
+						m_pending -= static_cast<unsigned>(submitted);
+						return 0;
+					}
+					if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+						return -errno;
+				}
+			}
+			bool Supports(unsigned opcode) const
+			{
+				constexpr unsigned ProbeOps = 64;
+				std::vector<std::uint8_t> storage(sizeof(io_uring_probe) + ProbeOps * sizeof(io_uring_probe_op), 0);
+				auto* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+				if (::syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, probe, ProbeOps) != 0)
+					return false;
+				return opcode <= probe->last_op && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) != 0;
+			}
+			bool Fail()
+			{
+				Destroy();
+				return false;
+			}
+
+			int m_fd = -1;
+			void* m_sqRing = nullptr;
+			void* m_cqRing = nullptr;
+			size_t m_sqRingSize = 0;
+			size_t m_cqRingSize = 0;
+			size_t m_sqesSize = 0;
+			io_uring_sqe* m_sqes = nullptr;
+			unsigned* m_sqTail = nullptr;
+			unsigned* m_sqArray = nullptr;
+			unsigned m_sqMask = 0;
+			unsigned* m_cqHead = nullptr;
+			unsigned* m_cqTail = nullptr;
+			unsigned m_cqMask = 0;
+			io_uring_cqe* m_cqes = nullptr;
+			unsigned m_entries = 0;
+			unsigned m_pending = 0;
+		};
+
+		/// <summary>Keeps the ring full until every request completed, short reads are resubmitted for their remainder. If the
+		///	ring stops accepting submissions, the reads already in the kernel are waited for, since they still write into the
+		///	caller's buffers, then the ring is torn down and the rest is read with pread.</summary>
+		bool ReadRing(std::span<const AsyncReadRequest> requests)
+		{
+			//progress of each request, bytes already read.
+			m_done.assign(requests.size(), 0);
+			size_t next = 0;
+			size_t inFlight = 0;
+			size_t completed = 0;
+			std::string failure;
+			auto Prepare = [&](size_t index)
+			{
+				const AsyncReadRequest& request = requests[index];
+				const size_t done = m_done[index];
+				std::uint8_t* destination = request.destination + done;
+				const unsigned size = static_cast<unsigned>(std::min<size_t>(request.size - done, 1u << 30));
+				m_ring.PrepareRead(m_fd, destination, size, request.offset + done, RegisteredIndex(destination, size), index);
+				inFlight++;
+			};
+			while (completed < requests.size())
+			{
+				while (failure.empty() && next < requests.size() && inFlight < m_ring.Entries())
+				{
+					if (requests[next].size == 0)
+					{
+						next++;
+						completed++;
+						continue;
+					}
+					Prepare(next++);
+				}
+				if (inFlight == 0)
+					break;
+				if (const int error = m_ring.Submit(1); error < 0)
+					return DrainRing(requests, inFlight, failure, error);
+				m_ring.Reap([&](std::uint64_t userData, int result)
+				{
+					inFlight--;
+					const size_t index = static_cast<size_t>(userData);
+					if (result <= 0)
+					{
+						if (failure.empty())
+							failure = "Failed reading " + std::to_string(requests[index].size) + " bytes at offset " + std::to_string(requests[index].offset)
+								+ (result < 0 ? ": " + std::string(std::strerror(-result)) : "") + ".";
+						completed++;
+						return;
+					}
+					m_done[index] += static_cast<size_t>(result);
+					if (m_done[index] < requests[index].size && failure.empty())
+						Prepare(index);
+					else
+						completed++;
+				});
+			}
+			return failure.empty() ? true : SetError(std::move(failure));
+		}
+		/// <summary>Recovers from a failed submission of <c>ReadRing</c>: reaps until none of the <c>inFlight</c> reads is
+		///	left in the kernel, switches to the pread backend and completes every request from the progress in <c>m_done</c>.</summary>
+		bool DrainRing(std::span<const AsyncReadRequest> requests, size_t inFlight, std::string failure, int submitError)
+		{
+			inFlight -= m_ring.DiscardPending();
+			while (inFlight > 0)
+			{
+				m_ring.Reap([&](std::uint64_t userData, int result)
+				{
+					inFlight--;
+					const size_t index = static_cast<size_t>(userData);
+					if (result > 0)
+						m_done[index] += static_cast<size_t>(result);
+					else if (failure.empty())
+						failure = "Failed reading " + std::to_string(requests[index].size) + " bytes at offset " + std::to_string(requests[index].offset)
+							+ (result < 0 ? ": " + std::string(std::strerror(-result)) : "") + ".";
+				});
+				if (inFlight == 0)
+					break;
+				if (const int error = m_ring.Wait(); error < 0)
+				{
+					//nothing left to wait with, closing the ring makes the kernel cancel what it still holds.
+					m_ring.Destroy();
+					m_backend = AsyncBackend::PRead;
+					return SetError("io_uring_enter failed: " + std::string(std::strerror(-submitError)) + ", waiting for the reads in flight failed: " + std::strerror(-error) + ".");
+				}
+			}
+			m_ring.Destroy();
+			m_registered.clear();
+			m_backend = AsyncBackend::PRead;
+			if (!failure.empty())
+				return SetError(std::move(failure));
+			for (size_t index = 0; index < requests.size(); index++)
+			{
+				const AsyncReadRequest& request = requests[index];
+				if (m_done[index] < request.size && !ReadAt(request.destination + m_done[index], request.size - m_done[index], request.offset + m_done[index]))
+					return false;
+			}
+			return true;
+		}
+		/// <summary>Index of the registered buffer wholly containing [destination, destination + size), or -1.</summary>
+		[[nodiscard]] int RegisteredIndex(const std::uint8_t* destination, size_t size) const noexcept
+		{
+			for (size_t i = 0; i < m_registered.size(); i++)
+			{
+				const auto& buffer = m_registered[i];
+				if (destination >= buffer.data() && destination + size <= buffer.data() + buffer.size())
+					return static_cast<int>(i);
+			}
+			return -1;
+		}
+
+		Ring m_ring;
+		std::vector<size_t> m_done;
+#endif
+		bool SetError(std::string message)
+		{
+			m_errorMessage = std::move(message);
+			return false;
+		}
+
+#ifdef _WIN32
+		HANDLE m_file = INVALID_HANDLE_VALUE;
+#else
+		int m_fd = -1;
+#endif
+		size_t m_size = 0;
+		AsyncBackend m_backend = AsyncBackend::PRead;
+		std::vector<std::span<std::uint8_t>> m_registered;
+		std::string m_errorMessage;
+	};
+}
@@ -0,0 +1,312 @@
+#pragma once
+#include "stdafx.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "AlignedBuffer.hpp"
+#include "Instrumentation.hpp"
+#ifdef IDX3_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef IDX3_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace Idx3Lib
+{
+	/// <summary>Container format of a file, detected from its leading magic bytes.</summary>
+	enum class Compression
+	{
+		None,
+		Gzip,
+		Zstd
+	};
+	inline const char* ToString(Compression compression) noexcept
+	{
+		switch (compression)
+		{
+		case Compression::Gzip: return "gzip";
+		case Compression::Zstd: return "zstd";
+		default: return "none";
+		}
+	}
+	/// <summary>True if this build can decompress <c>compression</c> (gzip needs zlib, zstd needs libzstd).</summary>
+	[[nodiscard]] constexpr bool IsSupported(Compression compression) noexcept
+	{
+		switch (compression)
+		{
+#ifdef IDX3_HAVE_ZLIB
+		case Compression::Gzip: return true;
+#endif
+#ifdef IDX3_HAVE_ZSTD
+		case Compression::Zstd: return true;
+#endif
+		case Compression::None: return true;
+		default: return false;
+		}
+	}
+	/// <summary>Detects the format from the first bytes of a file, anything unrecognised is treated as uncompressed.</summary>
+	[[nodiscard]] inline Compression DetectCompression(std::span<const std::uint8_t> magic) noexcept
+	{
+		if (magic.size() >= 2 && magic[0] == 0x1F && magic[1] == 0x8B)
+			return Compression::Gzip;
+		if (magic.size() >= 4 && magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD)
+			return Compression::Zstd;
+		return Compression::None;
+	}
+	[[nodiscard]] inline Compression DetectCompression(const std::string& path)
+	{
+		std::array<std::uint8_t, 4> magic{};
+		std::ifstream file(path, std::ios::binary);
+		file.read(reinterpret_cast<char*>(magic.data()), magic.size());
+		return DetectCompression(std::span<const std::uint8_t>(magic.data(), static_cast<size_t>(file.gcount())));
+	}
+
+	/// <summary>
+	/// Sequential reader that decompresses gzip or zstd files on the fly and passes other files through unchanged,
+	/// so callers read the logical contents without knowing how they are stored. Compressed input is pulled in
+	/// <c>ChunkSize</c> blocks and inflated directly into the caller's buffer, nothing is expanded to disk and only
+	/// one chunk of compressed data is held in memory. Concatenated gzip members and zstd frames are read as one stream.
+	/// Not copyable or movable, the decompressor state points back into the object.
+	/// </summary>
+	class CompressedFileReader
+	{
+	public:
+		using ByteType = std::uint8_t;
+		static constexpr size_t ChunkSize = size_t{ 1 } << 18;
+
+		CompressedFileReader() = default;
+		CompressedFileReader(const CompressedFileReader&) = delete;
+		CompressedFileReader& operator=(const CompressedFileReader&) = delete;
+		~CompressedFileReader() { Close(); }
+
+		/// <summary>Opens <c>path</c> and detects its format. Returns false if the file could not be opened or is compressed
+		///	with a format this build does not support, see <c>ErrorMessage()</c>.</summary>
+		bool Open(const std::string& path)
+		{
+			Close();
+			m_file.open(path, std::ios::in | std::ios::binary);
+			if (!m_file)
+				return SetError("File failed to open.");
+			m_input.Resize(ChunkSize);
+			if (!Refill())
+				return SetError("File is empty.");
+			m_format = DetectCompression(std::span<const ByteType>(m_input.data() + m_inputBegin, m_inputEnd - m_inputBegin));
+			if (!IsSupported(m_format))
+				return SetError(std::string(ToString(m_format)) + " compressed files are not supported by this build.");
+#ifdef IDX3_HAVE_ZLIB
+			if (m_format == Compression::Gzip)
+			{
+				m_zlib = {};
+				//16 + MAX_WBITS selects the gzip wrapper instead of raw zlib.
+				if (inflateInit2(&m_zlib, 16 + MAX_WBITS) != Z_OK)
+					return SetError("Failed to initialise zlib.");
+				m_zlibActive = true;
+			}
+#endif
+#ifdef IDX3_HAVE_ZSTD
+			if (m_format == Compression::Zstd)
+			{
+				m_zstd = ZSTD_createDStream();
+				if (m_zstd == nullptr || ZSTD_isError(ZSTD_initDStream(m_zstd)))
+					return SetError("Failed to initialise zstd.");
+			}
+#endif
+			m_errorMessage.clear();
+			return true;
+		}
+		void Close()
+		{
+#ifdef IDX3_HAVE_ZLIB
+			if (m_zlibActive)
+				inflateEnd(&m_zlib);
+			m_zlibActive = false;
+#endif
+#ifdef IDX3_HAVE_ZSTD
+			ZSTD_freeDStream(m_zstd);
+			m_zstd = nullptr;
+			m_frameRemaining = 0;
+#endif
+			m_file.close();
+			m_file.clear();
+			m_inputBegin = 0;
+			m_inputEnd = 0;
+			m_compressedRead = 0;
+			m_finished = false;
+			m_format = Compression::None;
+		}
+
+		[[nodiscard]] bool IsOpen() const noexcept { return m_file.is_open() && m_errorMessage.empty(); }
+		[[nodiscard]] Compression Format() const noexcept { return m_format; }
+		/// <summary>Bytes of the underlying file consumed so far.</summary>
+		[[nodiscard]] std::uint64_t CompressedBytesRead() const noexcept { return m_compressedRead; }
+		[[nodiscard]] std::string_view ErrorMessage() const noexcept { return m_errorMessage; }
+
+		/// <summary>Fills <c>out</c> with the next decompressed bytes. Returns the number of bytes produced, less than
+		///	<c>out.size()</c> only at the end of the data or on error (a truncated or corrupt stream sets <c>ErrorMessage()</c>).</summary>
+		size_t Read(std::span<ByteType> out)
+		{
+			if (!IsOpen() || out.empty())
+				return 0;
+			IDX3_PROFILE_SCOPE_ITEMS("decompress", out.size());
+			switch (m_format)
+			{
+#ifdef IDX3_HAVE_ZLIB
+			case Compression::Gzip: return ReadGzip(out);
+#endif
+#ifdef IDX3_HAVE_ZSTD
+			case Compression::Zstd: return ReadZstd(out);
+#endif
+			default: return ReadRaw(out);
+			}
+		}
+		/// <summary>Reads exactly <c>out.size()</c> bytes, returns false and sets <c>ErrorMessage()</c> if the data ends early.</summary>
+		bool ReadExact(std::span<ByteType> out)
+		{
+			const size_t count = Read(out);
+			if (count != out.size() && m_errorMessage.empty())
+				SetError("Unexpected end of data, expected " + std::to_string(out.size()) + " bytes, got " + std::to_string(count) + " bytes.");
+			return count == out.size();
+		}
+		/// <summary>Appends everything left in the stream to <c>out</c>. Returns false on a read error.</summary>
+		bool ReadToEnd(std::vector<ByteType>& out)
+		{
+			size_t count = 0;
+			do
+			{
+				const size_t offset = out.size();
+				out.resize(offset + ChunkSize);
+				count = Read(std::span<ByteType>(out.data() + offset, ChunkSize));
+				out.resize(offset + count);
+			} while (count == ChunkSize);
+			return m_errorMessage.empty();
+		}
+	private:
+		/// <summary>Pulls the next chunk of the file into the input buffer once the current one is used up,
+		///	returns false at the end of the file.</summary>
+		bool Refill()
+		{
+			if (m_inputBegin < m_inputEnd)
+				return true;
+			m_file.read(reinterpret_cast<char*>(m_input.data()), static_cast<std::streamsize>(m_input.size()));
+			m_inputBegin = 0;
+			m_inputEnd = static_cast<size_t>(m_file.gcount());
+			m_compressedRead += m_inputEnd;
+			return m_inputEnd != 0;
+		}
+
+		size_t ReadRaw(std::span<ByteType> out)
+		{
+			const size_t buffered = std::min(out.size(), m_inputEnd - m_inputBegin);
+			std::memcpy(out.data(), m_input.data() + m_inputBegin, buffered);
+			m_inputBegin += buffered;
+			size_t produced = buffered;
+			//large reads go straight from the file into the caller's buffer.
+			if (produced < out.size() && m_file)
+			{
+				m_file.read(reinterpret_cast<char*>(out.data() + produced), static_cast<std::streamsize>(out.size() - produced));
+				const auto count = static_cast<size_t>(m_file.gcount());
+				m_compressedRead += count;
+				produced += count;
+			}
+			return produced;
+		}
+
+#ifdef IDX3_HAVE_ZLIB
+		size_t ReadGzip(std::span<ByteType> out)
+		{
+			size_t produced = 0;
+			while (produced < out.size() && !m_finished)
+			{
+				//inflate is still called at the end of the file, it may hold output that needs no further input.
+				const bool haveInput = Refill();
+				m_zlib.next_in = m_input.data() + m_inputBegin;
+				m_zlib.avail_in = static_cast<uInt>(m_inputEnd - m_inputBegin);
+				m_zlib.next_out = out.data() + produced;
+				m_zlib.avail_out = static_cast<uInt>(std::min<size_t>(out.size() - produced, std::numeric_limits<uInt>::max()));
+				const uInt outBefore = m_zlib.avail_out;
+				const int result = inflate(&m_zlib, Z_NO_FLUSH);
+				produced += outBefore - m_zlib.avail_out;
+				m_inputBegin = m_inputEnd - m_zlib.avail_in;
+				if (result == Z_STREAM_END)
+				{
+					//another member may follow, anything else after the last member is ignored like gzip does.
+					if (Refill() && m_input[m_inputBegin] == 0x1F)
+						inflateReset(&m_zlib);
+					else
+						m_finished = true;
+				}
+				else if (result == Z_BUF_ERROR && !haveInput)
+				{
+					SetError("Truncated gzip stream.");
+					break;
+				}
+				else if (result != Z_OK && result != Z_BUF_ERROR)
+				{
+					SetError(std::string("Corrupt gzip stream: ") + (m_zlib.msg != nullptr ? m_zlib.msg : "inflate failed."));
+					break;
+				}
+			}
+			return produced;
+		}
+#endif
+
+#ifdef IDX3_HAVE_ZSTD
+		size_t ReadZstd(std::span<ByteType> out)
+		{
+			ZSTD_outBuffer output{ out.data(), out.size(), 0 };
+			while (output.pos < output.size)
+			{
+				//decompression continues at the end of the file until the decoder has flushed everything it holds.
+				const bool haveInput = Refill();
+				ZSTD_inBuffer input{ m_input.data(), m_inputEnd, m_inputBegin };
+				const size_t before = output.pos;
+				const size_t result = ZSTD_decompressStream(m_zstd, &output, &input);
+				m_inputBegin = input.pos;
+				if (ZSTD_isError(result))
+				{
+					SetError(std::string("Corrupt zstd stream: ") + ZSTD_getErrorName(result));
+					break;
+				}
+				m_frameRemaining = result;
+				if (!haveInput && output.pos == before)
+				{
+					//a frame still expecting input means the file was cut short.
+					if (m_frameRemaining != 0)
+						SetError("Truncated zstd stream.");
+					break;
+				}
+			}
+			return output.pos;
+		}
+#endif
+
+		bool SetError(std::string message)
+		{
+			m_errorMessage = std::move(message);
+			return false;
+		}
+
+		std::ifstream m_file;
+		AlignedBuffer<ByteType> m_input;
+		size_t m_inputBegin = 0;
+		size_t m_inputEnd = 0;
+		std::uint64_t m_compressedRead = 0;
+		bool m_finished = false;
+		Compression m_format = Compression::None;
+#ifdef IDX3_HAVE_ZLIB
+		z_stream m_zlib{};
+		bool m_zlibActive = false;
+#endif
+#ifdef IDX3_HAVE_ZSTD
+		ZSTD_DStream* m_zstd = nullptr;
+		size_t m_frameRemaining = 0;
+#endif
+		std::string m_errorMessage;
+	};
+}
@@ -0,0 +1,161 @@
+#pragma once
+#include "stdafx.h"
+#include <algorithm>
+#include <array>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "Idx3HeaderData.hpp"
+#include "Idx3BatchReader.hpp"
+#include "AsyncFileReader.hpp"
+#include "AlignedBuffer.hpp"
+#include "Instrumentation.hpp"
+
+namespace Idx3Lib
+{
+	/// <summary>
+	/// IDX3 reader over an <c>AsyncFileReader</c>, for datasets read from disk rather than mapped. Sequential batches
+	/// mirror <c>Idx3BatchReader</c>, <c>ReadImages</c> gathers any list of images (e.g. the next slice of a shuffled epoch)
+	/// with every image read in flight at once. Reads complete into one staging buffer registered with the kernel,
+	/// then land in the caller's batch, converted if it holds another element type.
+	/// </summary>
+	class Idx3AsyncReader
+	{
+	public:
+		using Bits8Type = Idx3HeaderData::Bits8Type;
+		/// <summary>Sequential batches are split into reads of this size so several of them are in flight.</summary>
+		static constexpr size_t SequentialReadSize = size_t{ 256 } << 10;
+
+		Idx3AsyncReader() = default;
+		explicit Idx3AsyncReader(const std::string& path, const AsyncReadOptions& options = {}) { Open(path, options); }
+
+		/// <summary>Opens <c>path</c>, decodes the header and checks the file holds every image it describes.
+		///	Returns false on failure, see <c>ErrorMessage()</c>.</summary>
+		bool Open(const std::string& path, const AsyncReadOptions& options = {})
+		{
+			m_position = 0;
+			m_header = {};
+			//a fresh file starts with nothing registered, so the staging buffer is registered again on first use.
+			m_staging = {};
+			if (!m_file.Open(path, options))
+				return SetError(std::string(m_file.ErrorMessage()));
+			std::array<Bits8Type, Idx3HeaderData::HeaderSize> headerBytes{};
+			if (m_file.Size() < headerBytes.size() || !m_file.ReadAt(headerBytes.data(), headerBytes.size(), 0))
+				return SetError("Failed to read header!");
+			Idx3HeaderData::FromBytes(headerBytes, m_header);
+			if (!m_header.IsValid())
+				return SetError("Header is not a valid IDX3 image header.");
+			if ((m_file.Size() - Idx3HeaderData::HeaderSize) / ImageSize() < m_header.num_images)
+				return SetError("Size mismatch, header describes " + std::to_string(m_header.num_images) + " images, file holds " + std::to_string((m_file.Size() - Idx3HeaderData::HeaderSize) / ImageSize()) + ".");
+			m_errorMessage.clear();
+			return true;
+		}
+		[[nodiscard]] bool IsOpen() const noexcept { return m_file.IsOpen() && m_errorMessage.empty(); }
+		[[nodiscard]] const Idx3HeaderData& Header() const noexcept { return m_header; }
+		[[nodiscard]] size_t ImageCount() const noexcept { return m_header.num_images; }
+		[[nodiscard]] size_t ImageSize() const noexcept { return m_header.ImageSize(); }
+		/// <summary>Index of the next image <c>ReadBatch</c> reads.</summary>
+		[[nodiscard]] size_t Position() const noexcept { return m_position; }
+		[[nodiscard]] size_t Remaining() const noexcept { return ImageCount() - m_position; }
+		[[nodiscard]] AsyncBackend Backend() const noexcept { return m_file.Backend(); }
+		[[nodiscard]] std::string_view ErrorMessage() const noexcept { return m_errorMessage; }
+
+		/// <summary>Moves the read position to image <c>index</c>, returns false if out of range.</summary>
+		bool Seek(size_t index)
+		{
+			if (!IsOpen() || index > ImageCount())
+				return false;
+			m_position = index;
+			return true;
+		}
+
+		/// <summary>Reads up to <c>batch.Capacity</c> images from the read position, as <c>Idx3BatchReader::ReadBatch</c>.
+		///	Returns the number of images read, zero at the end of the data or on error.</summary>
+		template<typename T>
+		size_t ReadBatch(Idx3Batch<T>& batch, const PixelScale scale = PixelScale::Normalized)
+		{
+			IDX3_PROFILE_SCOPE_ITEMS("read images", std::min(batch.Capacity, Remaining()));
+			if (batch.ImageSize != ImageSize())
+				batch.Reshape(batch.Capacity, ImageSize());
+			batch.Count = 0;
+			const size_t count = std::min(batch.Capacity, Remaining());
+			if (!IsOpen() || count == 0)
+				return 0;
+			const size_t byteCount = count * ImageSize();
+			Bits8Type* staging = Stage(byteCount);
+			m_requests.clear();
+			const size_t offset = Idx3HeaderData::HeaderSize + m_position * ImageSize();
+			for (size_t done = 0; done < byteCount; done += SequentialReadSize)
+				m_requests.push_back({ offset + done, std::min(SequentialReadSize, byteCount - done), staging + done });
+			if (!Complete(batch, count, scale))
+				return 0;
+			m_position += count;
+			return count;
+		}
+
+		/// <summary>Reads the images at <c>indices</c> into <c>batch</c> in that order, up to <c>batch.Capacity</c> of them.
+		///	The read position is left alone. Returns the number of images read, zero on error or an index out of range.</summary>
+		template<typename T>
+		size_t ReadImages(std::span<const size_t> indices, Idx3Batch<T>& batch, const PixelScale scale = PixelScale::Normalized)
+		{
+			IDX3_PROFILE_SCOPE_ITEMS("read images", std::min(batch.Capacity, indices.size()));
+			if (batch.ImageSize != ImageSize())
+				batch.Reshape(batch.Capacity, ImageSize());
+			batch.Count = 0;
+			const size_t count = std::min(batch.Capacity, indices.size());
+			if (!IsOpen() || count == 0)
+				return 0;
+			Bits8Type* staging = Stage(count * ImageSize());
+			m_requests.clear();
+			for (size_t i = 0; i < count; i++)
+			{
+				if (indices[i] >= ImageCount())
+				{
+					SetError("Image " + std::to_string(indices[i]) + " is out of range, the file holds " + std::to_string(ImageCount()) + ".");
+					return 0;
+				}
+				m_requests.push_back({ Idx3HeaderData::HeaderSize + indices[i] * ImageSize(), ImageSize(), staging + i * ImageSize() });
+			}
+			return Complete(batch, count, scale) ? count : 0;
+		}
+	private:
+		/// <summary>The staging buffer sized for <c>byteCount</c>, registered again whenever it has to grow.</summary>
+		Bits8Type* Stage(size_t byteCount)
+		{
+			if (byteCount > m_staging.capacity())
+			{
+				m_staging.Resize(byteCount);
+				const std::span<std::uint8_t> buffer(m_staging.data(), m_staging.capacity());
+				m_file.RegisterBuffers(std::span(&buffer, 1));
+			}
+			m_staging.Resize(byteCount);
+			return m_staging.data();
+		}
+		/// <summary>Issues the prepared requests and moves the staged pixels into the batch.</summary>
+		template<typename T>
+		bool Complete(Idx3Batch<T>& batch, size_t count, const PixelScale scale)
+		{
+			if (!m_file.Read(m_requests))
+				return SetError(std::string(m_file.ErrorMessage()));
+			const auto staged = m_staging.Span().first(count * ImageSize());
+			if constexpr (std::is_same_v<T, Bits8Type>)
+				std::ranges::copy(staged, batch.data.begin());
+			else
+				ConvertPixels<T>(staged, batch.data.Span(), scale);
+			batch.Count = count;
+			return true;
+		}
+		bool SetError(std::string message)
+		{
+			m_errorMessage = std::move(message);
+			return false;
+		}
+
+		AsyncFileReader m_file;
+		Idx3HeaderData m_header;
+		size_t m_position = 0;
+		AlignedBuffer<Bits8Type, 4096> m_staging;
+		std::vector<AsyncReadRequest> m_requests;
+		std::string m_errorMessage;
+	};
+}
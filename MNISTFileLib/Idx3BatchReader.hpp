@@ -0,0 +1,164 @@
+#pragma once
+#include "stdafx.h"
+#include <span>
+#include <string_view>
+#include "Idx3HeaderData.hpp"
+#include "AlignedBuffer.hpp"
+#include "Instrumentation.hpp"
+
+namespace Idx3Lib
+{
+	/// <summary>How pixels are converted when a batch element type is not the raw byte type.</summary>
+	enum class PixelScale
+	{
+		Raw,        // 0 to 255
+		Normalized  // 0.0 to 1.0
+	};
+
+	/// <summary>Converts a run of raw pixels to <c>T</c>, <c>dst</c> must be at least as large as <c>src</c>.</summary>
+	template<typename T> requires std::is_arithmetic_v<T>
+	void ConvertPixels(std::span<const Idx3HeaderData::Bits8Type> src, std::span<T> dst, const PixelScale scale = PixelScale::Normalized) noexcept
+	{
+		if constexpr (std::is_floating_point_v<T>)
+		{
+			const T factor = scale == PixelScale::Normalized ? static_cast<T>(1.0 / 255.0) : static_cast<T>(1);
+			for (size_t i = 0; i < src.size(); i++)
+				dst[i] = static_cast<T>(src[i]) * factor;
+		}
+		else
+		{
+			for (size_t i = 0; i < src.size(); i++)
+				dst[i] = static_cast<T>(src[i]);
+		}
+	}
+
+	/// <summary>
+	/// Caller owned, reusable <c>[Capacity x ImageSize]</c> block of images stored row-major in one
+	/// 64-byte aligned allocation. <c>Count</c> is the number of images filled by the last read.
+	/// </summary>
+	template<typename T = Idx3HeaderData::Bits8Type> requires std::is_arithmetic_v<T>
+	struct Idx3Batch
+	{
+		using ElementType = T;
+		AlignedBuffer<T> data;
+		size_t ImageSize = 0;
+		size_t Capacity = 0;
+		size_t Count = 0;
+		Idx3Batch() = default;
+		Idx3Batch(size_t capacity, size_t imageSize) { Reshape(capacity, imageSize); }
+		/// <summary>Resizes the batch, the allocation is only replaced if it needs to grow.</summary>
+		void Reshape(size_t capacity, size_t imageSize)
+		{
+			data.Resize(capacity * imageSize);
+			Capacity = capacity;
+			ImageSize = imageSize;
+			Count = 0;
+		}
+		[[nodiscard]] std::span<T> Image(size_t index) noexcept { return { data.data() + index * ImageSize, ImageSize }; }
+		[[nodiscard]] std::span<const T> Image(size_t index) const noexcept { return { data.data() + index * ImageSize, ImageSize }; }
+		/// <summary>The filled portion of the batch, <c>Count * ImageSize</c> elements.</summary>
+		[[nodiscard]] std::span<T> Filled() noexcept { return { data.data(), Count * ImageSize }; }
+		[[nodiscard]] std::span<const T> Filled() const noexcept { return { data.data(), Count * ImageSize }; }
+	};
+
+	/// <summary>
+	/// Sequential IDX3 reader that fills a whole batch with one bulk read instead of one read
+	/// and one allocation per image. Non-byte batches are converted through a reused staging buffer.
+	/// </summary>
+	class Idx3BatchReader
+	{
+	public:
+		using Bits8Type = Idx3HeaderData::Bits8Type;
+		Idx3BatchReader() = default;
+		explicit Idx3BatchReader(const std::string& path) { Open(path); }
+
+		/// <summary>Opens the file and reads the header, returns false on failure, see <c>ErrorMessage()</c>.</summary>
+		bool Open(const std::string& path)
+		{
+			m_position = 0;
+			m_file.close();
+			m_file.clear();
+			m_file.open(path, std::ios::in | std::ios::binary);
+			if (!m_file)
+				return SetError("File failed to open.");
+			m_file >> m_header;
+			if (!m_file)
+				return SetError("Failed to read header!");
+			if (!m_header.IsValid())
+				return SetError("Header is not a valid IDX3 image header.");
+			m_errorMessage.clear();
+			return true;
+		}
+		[[nodiscard]] bool IsOpen() const { return m_file.is_open() && m_errorMessage.empty(); }
+		[[nodiscard]] const Idx3HeaderData& Header() const noexcept { return m_header; }
+		[[nodiscard]] size_t ImageCount() const noexcept { return m_header.num_images; }
+		[[nodiscard]] size_t ImageSize() const noexcept { return m_header.ImageSize(); }
+		/// <summary>Index of the next image to be read.</summary>
+		[[nodiscard]] size_t Position() const noexcept { return m_position; }
+		[[nodiscard]] size_t Remaining() const noexcept { return ImageCount() - m_position; }
+		[[nodiscard]] std::string_view ErrorMessage() const noexcept { return m_errorMessage; }
+
+		/// <summary>Moves the read position to image <c>index</c>, returns false if out of range or the seek failed.</summary>
+		bool Seek(size_t index)
+		{
+			if (!IsOpen() || index > ImageCount())
+				return false;
+			m_file.clear();
+			m_file.seekg(static_cast<std::streamoff>(Idx3HeaderData::HeaderSize + index * ImageSize()));
+			if (!m_file)
+				return SetError("Failed to seek to image " + std::to_string(index) + ".");
+			m_position = index;
+			return true;
+		}
+
+		/// <summary>
+		/// Reads up to <c>batch.Capacity</c> images into <c>batch</c>, the batch is reshaped if its image size differs
+		/// from the file's. Returns the number of images read, zero at the end of the data or on error.
+		/// </summary>
+		template<typename T>
+		size_t ReadBatch(Idx3Batch<T>& batch, const PixelScale scale = PixelScale::Normalized)
+		{
+			IDX3_PROFILE_SCOPE_ITEMS("read images", std::min(batch.Capacity, Remaining()));
+			if (batch.ImageSize != ImageSize())
+				batch.Reshape(batch.Capacity, ImageSize());
+			batch.Count = 0;
+			const size_t count = std::min(batch.Capacity, Remaining());
+			if (!IsOpen() || count == 0)
+				return 0;
+			const size_t byteCount = count * ImageSize();
+			if constexpr (std::is_same_v<T, Bits8Type>)
+			{
+				if (!ReadBytes(batch.data.data(), byteCount))
+					return 0;
+			}
+			else
+			{
+				m_staging.Resize(byteCount);
+				if (!ReadBytes(m_staging.data(), byteCount))
+					return 0;
+				ConvertPixels<T>(m_staging.Span(), batch.data.Span(), scale);
+			}
+			m_position += count;
+			batch.Count = count;
+			return count;
+		}
+	private:
+		bool ReadBytes(Bits8Type* destination, size_t byteCount)
+		{
+			m_file.read(reinterpret_cast<char*>(destination), static_cast<std::streamsize>(byteCount));
+			if (static_cast<size_t>(m_file.gcount()) != byteCount)
+				return SetError("Failed during reading the images! Expected " + std::to_string(byteCount) + " bytes, got " + std::to_string(m_file.gcount()) + " bytes.");
+			return true;
+		}
+		bool SetError(std::string message)
+		{
+			m_errorMessage = std::move(message);
+			return false;
+		}
+		std::ifstream m_file;
+		Idx3HeaderData m_header;
+		size_t m_position = 0;
+		AlignedBuffer<Bits8Type> m_staging;
+		std::string m_errorMessage;
+	};
+}
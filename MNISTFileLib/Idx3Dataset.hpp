@@ -0,0 +1,121 @@
+#pragma once
+#include "stdafx.h"
+#include <algorithm>
+#include <array>
+#include <future>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "Idx3HeaderData.hpp"
+#include "AlignedBuffer.hpp"
+#include "AsyncFileReader.hpp"
+
+namespace Idx3Lib
+{
+	/// <summary>
+	/// An IDX3 file fully loaded into one contiguous, 64-byte aligned pixel block.
+	/// Loading splits the image range into shards that are read concurrently, each worker preads its whole shard
+	/// from the computable offset of its first image straight into the final buffer. Unlike
+	/// <c>Idx3MappedDataset</c> the pixels are owned, so later access never page faults on the file.
+	/// </summary>
+	class Idx3Dataset
+	{
+	public:
+		using Bits8Type = Idx3HeaderData::Bits8Type;
+		using ImageView = std::span<const Bits8Type>;
+
+		/// <summary>Loads every image of <c>path</c> using <c>shardCount</c> concurrent readers, zero picks the hardware thread count.
+		/// Returns false on failure, see <c>ErrorMessage()</c>. On failure the dataset is left empty.</summary>
+		bool LoadSharded(const std::string& path, size_t shardCount = 0)
+		{
+			Clear();
+			AsyncFileReader headerFile;
+			if (!headerFile.Open(path, { .Backend = AsyncBackend::PRead }))
+				return SetError(std::string(headerFile.ErrorMessage()));
+			std::array<Bits8Type, Idx3HeaderData::HeaderSize> headerBytes{};
+			if (headerFile.Size() < headerBytes.size() || !headerFile.ReadAt(headerBytes.data(), headerBytes.size(), 0))
+				return SetError("Failed to read header!");
+			Idx3HeaderData::FromBytes(headerBytes, m_header);
+			if (!m_header.IsValid())
+				return SetError("Header is not a valid IDX3 image header.");
+			const size_t imageSize = m_header.ImageSize();
+			const size_t imageCount = m_header.num_images;
+			//checked before allocating, so a corrupt header cannot ask for more memory than the file could fill.
+			if ((headerFile.Size() - Idx3HeaderData::HeaderSize) / imageSize < imageCount)
+			{
+				const size_t available = (headerFile.Size() - Idx3HeaderData::HeaderSize) / imageSize;
+				m_header = {};
+				return SetError("Size mismatch, header describes " + std::to_string(imageCount) + " images, file holds " + std::to_string(available) + ".");
+			}
+			headerFile.Close();
+			m_pixels.Resize(imageCount * imageSize);
+			if (shardCount == 0)
+				shardCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+			shardCount = std::clamp<size_t>(shardCount, 1, std::max<size_t>(1, imageCount));
+
+			//image i starts at HeaderSize + i * imageSize, so every shard can be read independently.
+			std::vector<std::future<std::string>> shards;
+			size_t first = 0;
+			for (size_t shard = 0; shard < shardCount; shard++)
+			{
+				const size_t count = imageCount / shardCount + (shard < imageCount % shardCount ? 1 : 0);
+				shards.emplace_back(std::async(std::launch::async, [this, &path, first, count, imageSize]()
+				{
+					return ReadShard(path, first, count, imageSize);
+				}));
+				first += count;
+			}
+			std::string errors;
+			for (auto& shard : shards)
+			{
+				const std::string result = shard.get();
+				if (!result.empty())
+					errors += (errors.empty() ? "" : " ") + result;
+			}
+			if (!errors.empty())
+			{
+				Clear();
+				return SetError(errors);
+			}
+			m_errorMessage.clear();
+			return true;
+		}
+		void Clear()
+		{
+			m_header = {};
+			m_pixels.Resize(0);
+		}
+
+		[[nodiscard]] const Idx3HeaderData& Header() const noexcept { return m_header; }
+		[[nodiscard]] size_t ImageCount() const noexcept { return m_pixels.empty() ? 0 : m_header.num_images; }
+		[[nodiscard]] size_t ImageSize() const noexcept { return m_header.ImageSize(); }
+		[[nodiscard]] std::string_view ErrorMessage() const noexcept { return m_errorMessage; }
+		/// <summary>Unchecked access to image <c>index</c>.</summary>
+		[[nodiscard]] ImageView operator[](size_t index) const noexcept { return { m_pixels.data() + index * ImageSize(), ImageSize() }; }
+		/// <summary>Every pixel of every image, row-major <c>[ImageCount x ImageSize]</c>.</summary>
+		[[nodiscard]] ImageView Pixels() const noexcept { return m_pixels.Span(); }
+	private:
+		/// <summary>Reads images [first, first+count) into their final place, returns an empty string on success or the failure reason.
+		///	Every shard opens its own descriptor, so no reader state is shared between threads.</summary>
+		std::string ReadShard(const std::string& path, size_t first, size_t count, size_t imageSize)
+		{
+			if (count == 0)
+				return {};
+			AsyncFileReader file;
+			if (!file.Open(path, { .Backend = AsyncBackend::PRead }))
+				return "Shard at image " + std::to_string(first) + ": " + std::string(file.ErrorMessage());
+			if (!file.ReadAt(m_pixels.data() + first * imageSize, count * imageSize, Idx3HeaderData::HeaderSize + first * imageSize))
+				return "Shard at image " + std::to_string(first) + ": " + std::string(file.ErrorMessage());
+			return {};
+		}
+		bool SetError(std::string message)
+		{
+			m_errorMessage = std::move(message);
+			return false;
+		}
+		Idx3HeaderData m_header;
+		AlignedBuffer<Bits8Type> m_pixels;
+		std::string m_errorMessage;
+	};
+}
@@ -2,7 +2,10 @@
 #include "stdafx.h"
 #include <syncstream>
 #include <array>
+#include <span>
+#include <cstring>
 #include "SwapEndian.hpp"
+#include "Instrumentation.hpp"
 
 namespace Idx3Lib
 {
@@ -32,6 +35,34 @@ namespace Idx3Lib
 		Bits32Type num_images = 0;
 		Bits32Type num_rows = 0;
 		Bits32Type num_columns = 0;
+		static constexpr Bits32Type MagicNumber = 2051;
+		static constexpr size_t HeaderSize = NUM_ELEMENTS * sizeof(Bits32Type);
+		/// <summary>Size in bytes of a single image, [Row Size] * [Col Size]</summary>
+		[[nodiscard]] size_t ImageSize() const noexcept { return static_cast<size_t>(num_rows) * num_columns; }
+		/// <summary>True if the magic number matches and the image dimensions are non-zero.</summary>
+		[[nodiscard]] bool IsValid() const noexcept { return magic == MagicNumber && ImageSize() != 0; }
+		/// <summary>
+		/// Decodes the header from the first <c>HeaderSize</c> bytes of an in-memory file image.
+		/// Returns false if the span is too short to hold a header.
+		/// </summary>
+		static bool FromBytes(std::span<const Bits8Type> bytes, Idx3HeaderData& obj)
+		{
+			IDX3_PROFILE_SCOPE("header parse");
+			if (bytes.size() < HeaderSize)
+				return false;
+			std::array<Bits32Type, NUM_ELEMENTS> buf{};
+			std::memcpy(buf.data(), bytes.data(), HeaderSize);
+			if constexpr (SwitchEndian)
+			{
+				for (auto& elem : buf)
+					elem = swap_endian(elem);
+			}
+			obj.magic = buf[0];
+			obj.num_images = buf[1];
+			obj.num_rows = buf[2];
+			obj.num_columns = buf[3];
+			return true;
+		}
 		/// <summary>
 		/// Reads header data into struct, precondition is that the file stream's read pointer is at the beginning of the file!
 		/// input operator
@@ -40,26 +40,13 @@ namespace Idx3Lib
 			return is;
 		}
 		/// <summary>
-		/// Copies internal buffer into output stream.
+		/// Copies internal buffer into output stream with a single write, pixels are single bytes so no endian conversion applies.
 		/// output operator
 		/// </summary>
 		friend std::ofstream& operator<<(std::ofstream& os, const Idx3ImageDataBuffer& obj)
 		{
 			if (os.is_open())
-			{
-				for (auto& elem : obj.buffer)
-				{
-					if constexpr (obj.SwitchEndian)
-					{
-						auto fixed = swap_endian(elem);
-						os.put(fixed);
-					}
-					else
-					{
-						os.put(elem);
-					}
-				}
-			}
+				os.write(reinterpret_cast<const char*>(obj.buffer.data()), static_cast<std::streamsize>(sizeof(Bits8Type) * obj.buffer.size()));
 			return os;
 		}
 	};
@@ -0,0 +1,93 @@
+#pragma once
+#include "stdafx.h"
+#include <span>
+#include <string_view>
+#include "Idx3HeaderData.hpp"
+#include "MappedFile.hpp"
+
+namespace Idx3Lib
+{
+	/// <summary>
+	/// Zero-copy view of an IDX3 file. The file is memory mapped once and the header is validated
+	/// up front, images are then handed out as spans pointing directly into the mapping.
+	/// The spans remain valid for as long as this object is alive and open.
+	/// </summary>
+	class Idx3MappedDataset
+	{
+	public:
+		using Bits8Type = Idx3HeaderData::Bits8Type;
+		using ImageView = std::span<const Bits8Type>;
+
+		Idx3MappedDataset() = default;
+		explicit Idx3MappedDataset(const std::string& path) { Open(path); }
+
+		/// <summary>Maps the file and validates the header against the file size.
+		/// Returns false on failure, see <c>ErrorMessage()</c> for the reason.</summary>
+		bool Open(const std::string& path)
+		{
+			m_header = {};
+			m_imageSize = 0;
+			if (!m_file.Open(path))
+				return SetError("File failed to open.");
+			if (!Idx3HeaderData::FromBytes(m_file.Bytes(), m_header))
+				return SetError("Failed to read header!");
+			if (!m_header.IsValid())
+				return SetError("Header is not a valid IDX3 image header.");
+			m_imageSize = m_header.ImageSize();
+			const size_t payloadSize = m_file.Size() - Idx3HeaderData::HeaderSize;
+			if (payloadSize / m_imageSize < m_header.num_images)
+				return SetError("Size mismatch, header reports " + std::to_string(m_header.num_images) + " images, file holds " + std::to_string(payloadSize / m_imageSize) + ".");
+			m_errorMessage.clear();
+			return true;
+		}
+		void Close()
+		{
+			m_file.Close();
+			m_header = {};
+			m_imageSize = 0;
+		}
+
+		[[nodiscard]] bool IsOpen() const noexcept { return m_file.IsOpen() && m_imageSize != 0; }
+		[[nodiscard]] const Idx3HeaderData& Header() const noexcept { return m_header; }
+		[[nodiscard]] size_t ImageCount() const noexcept { return m_header.num_images; }
+		[[nodiscard]] size_t ImageSize() const noexcept { return m_imageSize; }
+		[[nodiscard]] std::string_view ErrorMessage() const noexcept { return m_errorMessage; }
+
+		/// <summary>Unchecked random access to image <c>index</c>.</summary>
+		[[nodiscard]] ImageView operator[](size_t index) const noexcept
+		{
+			return m_file.Bytes().subspan(Idx3HeaderData::HeaderSize + index * m_imageSize, m_imageSize);
+		}
+		/// <summary>Bounds checked random access, returns an empty span if <c>index</c> is out of range.</summary>
+		[[nodiscard]] ImageView Image(size_t index) const noexcept
+		{
+			if (!IsOpen() || index >= ImageCount())
+				return {};
+			return (*this)[index];
+		}
+		/// <summary>Contiguous view of <c>count</c> images beginning at <c>first</c>, clamped to the image count.</summary>
+		[[nodiscard]] ImageView Images(size_t first, size_t count) const noexcept
+		{
+			if (!IsOpen() || first >= ImageCount())
+				return {};
+			count = std::min(count, ImageCount() - first);
+			return m_file.Bytes().subspan(Idx3HeaderData::HeaderSize + first * m_imageSize, count * m_imageSize);
+		}
+		/// <summary>Asks the OS to start paging in a range of images ahead of use.</summary>
+		void Prefetch(size_t first, size_t count) const
+		{
+			m_file.WillNeed(Idx3HeaderData::HeaderSize + first * m_imageSize, count * m_imageSize);
+		}
+	private:
+		bool SetError(std::string message)
+		{
+			m_errorMessage = std::move(message);
+			m_file.Close();
+			return false;
+		}
+		MappedFile m_file;
+		Idx3HeaderData m_header;
+		size_t m_imageSize = 0;
+		std::string m_errorMessage;
+	};
+}
@@ -0,0 +1,315 @@
+#pragma once
+#include "stdafx.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <span>
+#include <thread>
+#include <vector>
+#include <limits>
+#include "Idx3MappedDataset.hpp"
+#include "Idx3BatchReader.hpp"
+#include "Idx3StreamReader.hpp"
+#include "Idx3AsyncReader.hpp"
+#include "Instrumentation.hpp"
+
+namespace Idx3Lib
+{
+	/// <summary>Configuration for <c>Idx3PrefetchPipeline</c>.</summary>
+	struct PrefetchOptions
+	{
+		size_t BatchSize = 256;     // images per batch slot
+		size_t PrefetchDepth = 4;   // number of reusable batch slots in the ring
+		size_t WorkerCount = 1;     // reader threads decoding batches ahead of the consumer
+		PixelScale Scale = PixelScale::Normalized;
+	};
+
+	/// <summary>Queue occupancy counters, a mean occupancy near the prefetch depth means the consumer is the bottleneck
+	/// (compute bound), frequent stalls with an empty queue mean the readers are (I/O bound).</summary>
+	struct PrefetchStats
+	{
+		size_t PrefetchDepth = 0;
+		size_t BatchesConsumed = 0;
+		size_t ConsumerStalls = 0;      // times Next() found no decoded batch waiting
+		size_t OccupancySum = 0;        // ready batches observed at each Next(), summed
+		[[nodiscard]] double MeanOccupancy() const noexcept { return BatchesConsumed == 0 ? 0.0 : static_cast<double>(OccupancySum) / BatchesConsumed; }
+		friend std::ostream& operator<<(std::ostream& os, const PrefetchStats& obj)
+		{
+			os << "batches: " << obj.BatchesConsumed
+				<< " stalls: " << obj.ConsumerStalls
+				<< " mean occupancy: " << obj.MeanOccupancy() << "/" << obj.PrefetchDepth;
+			return os;
+		}
+	};
+
+	/// <summary>
+	/// Producer/consumer pipeline decoding batches of a mapped IDX3 dataset ahead of a single consumer.
+	/// Batches live in a fixed ring of reusable slots, each slot carries a sequence number that workers and the
+	/// consumer hand back and forth with atomics (no locks). A worker that gets <c>PrefetchDepth</c> batches ahead
+	/// blocks until the consumer releases a slot, which provides back-pressure.
+	/// Batches are delivered to the consumer in file order. The dataset must outlive the pipeline.
+	/// A pipeline can also be started on an <c>Idx3StreamReader</c>, a single worker then decompresses the stream
+	/// straight into the batch slots, keeping decompression off the consumer's thread. Started on an
+	/// <c>Idx3AsyncReader</c>, a single worker reads each batch from disk with all of its reads in flight at once.
+	/// An optional transform (e.g. augmentation) runs on each batch on the worker thread right after it is decoded.
+	/// </summary>
+	template<typename T = Idx3HeaderData::Bits8Type>
+	class Idx3PrefetchPipeline
+	{
+	public:
+		using BatchType = Idx3Batch<T>;
+		/// <summary>Called with each decoded batch and its index, on the worker threads concurrently.</summary>
+		using TransformType = std::function<void(BatchType& batch, size_t batchIndex)>;
+		Idx3PrefetchPipeline() = default;
+		Idx3PrefetchPipeline(const Idx3PrefetchPipeline&) = delete;
+		Idx3PrefetchPipeline& operator=(const Idx3PrefetchPipeline&) = delete;
+		~Idx3PrefetchPipeline() { Stop(); }
+
+		/// <summary>Starts the reader threads over images [first, first+count) of <c>dataset</c>, count is clamped to the
+		/// images available. Returns false if the dataset is not open or the options are unusable.</summary>
+		bool Start(const Idx3MappedDataset& dataset, const PrefetchOptions& options = {}, size_t first = 0, size_t count = std::numeric_limits<size_t>::max())
+		{
+			Stop();
+			if (!dataset.IsOpen() || first > dataset.ImageCount())
+				return false;
+			m_dataset = &dataset;
+			m_stream = nullptr;
+			m_async = nullptr;
+			m_order = {};
+			m_firstImage = first;
+			return Launch(options, std::min(count, dataset.ImageCount() - first), dataset.ImageSize(), options.WorkerCount);
+		}
+		/// <summary>Starts the reader threads over the images of <c>dataset</c> listed in <c>order</c>, e.g. a shuffled
+		///	permutation for one training epoch. <c>order</c> must stay alive and unchanged until the pipeline is stopped.</summary>
+		bool Start(const Idx3MappedDataset& dataset, const PrefetchOptions& options, std::span<const size_t> order)
+		{
+			Stop();
+			if (!dataset.IsOpen() || std::ranges::any_of(order, [&dataset](size_t index) { return index >= dataset.ImageCount(); }))
+				return false;
+			m_dataset = &dataset;
+			m_stream = nullptr;
+			m_async = nullptr;
+			m_order = order;
+			m_firstImage = 0;
+			return Launch(options, order.size(), dataset.ImageSize(), options.WorkerCount);
+		}
+		/// <summary>Starts one reader thread over the remaining images of <c>reader</c>, a stream is sequential so
+		///	<c>WorkerCount</c> is ignored. The reader must outlive the pipeline and not be used until it is stopped,
+		///	check its <c>ErrorMessage()</c> afterwards, batches after a read error are empty.</summary>
+		bool Start(Idx3StreamReader& reader, const PrefetchOptions& options = {})
+		{
+			Stop();
+			if (!reader.IsOpen())
+				return false;
+			m_dataset = nullptr;
+			m_stream = &reader;
+			m_async = nullptr;
+			m_order = {};
+			m_firstImage = reader.Position();
+			return Launch(options, reader.Remaining(), reader.ImageSize(), 1);
+		}
+		/// <summary>Starts one reader thread over the images of <c>reader</c> listed in <c>order</c>, or over its remaining
+		///	images in file order if <c>order</c> is empty. One thread keeps a whole batch of reads in flight, so
+		///	<c>WorkerCount</c> is ignored. The reader and <c>order</c> must outlive the pipeline and the reader must not be
+		///	used until it is stopped, check its <c>ErrorMessage()</c> afterwards, batches after a read error are empty.</summary>
+		bool Start(Idx3AsyncReader& reader, const PrefetchOptions& options, std::span<const size_t> order = {})
+		{
+			Stop();
+			if (!reader.IsOpen() || std::ranges::any_of(order, [&reader](size_t index) { return index >= reader.ImageCount(); }))
+				return false;
+			m_dataset = nullptr;
+			m_stream = nullptr;
+			m_async = &reader;
+			m_order = order;
+			m_firstImage = order.empty() ? reader.Position() : 0;
+			return Launch(options, order.empty() ? reader.Remaining() : order.size(), reader.ImageSize(), 1);
+		}
+
+		/// <summary>
+		/// Returns the next batch in file order, blocking until it has been decoded, or nullptr once every batch
+		/// has been consumed. The batch stays valid until the next call to Next() or Stop(), which hands its slot back to the readers.
+		/// </summary>
+		const BatchType* Next()
+		{
+			ReleaseHeldSlot();
+			if (m_nextConsume >= m_batchCount)
+				return nullptr;
+			Slot& slot = m_slots[m_nextConsume % m_slots.size()];
+			const size_t readyCount = m_ready.load(std::memory_order_relaxed);
+			m_stats.OccupancySum += readyCount;
+			if (readyCount == 0)
+				m_stats.ConsumerStalls++;
+			const size_t filledSequence = FilledSequence(m_nextConsume);
+			for (size_t s = slot.sequence.load(std::memory_order_acquire); s != filledSequence; s = slot.sequence.load(std::memory_order_acquire))
+				slot.sequence.wait(s, std::memory_order_acquire);
+			m_ready.fetch_sub(1, std::memory_order_relaxed);
+			m_stats.BatchesConsumed++;
+			m_holdingSlot = true;
+			return &slot.batch;
+		}
+
+		/// <summary>Stops and joins the reader threads, batches not yet consumed are discarded.</summary>
+		void Stop()
+		{
+			m_stopping.store(true, std::memory_order_relaxed);
+			for (auto& slot : m_slots)
+			{
+				slot.sequence.store(StoppedSequence, std::memory_order_release);
+				slot.sequence.notify_all();
+			}
+			for (auto& worker : m_workers)
+				worker.join();
+			m_workers.clear();
+			m_stopping.store(false, std::memory_order_relaxed);
+			m_holdingSlot = false;
+			m_batchCount = 0;
+			m_nextConsume = 0;
+		}
+
+		/// <summary>Installs <c>transform</c> for subsequent starts, an empty function removes it. Must not be called while running.</summary>
+		void SetTransform(TransformType transform) { m_transform = std::move(transform); }
+
+		[[nodiscard]] size_t BatchCount() const noexcept { return m_batchCount; }
+		[[nodiscard]] size_t ImageCount() const noexcept { return m_imageCount; }
+		/// <summary>Number of decoded batches currently waiting for the consumer.</summary>
+		[[nodiscard]] size_t Occupancy() const noexcept { return m_ready.load(std::memory_order_relaxed); }
+		[[nodiscard]] const PrefetchStats& Stats() const noexcept { return m_stats; }
+	private:
+		static constexpr size_t StoppedSequence = std::numeric_limits<size_t>::max();
+		struct Slot
+		{
+			BatchType batch;
+			// == FreeSequence(b): free for the worker producing batch b
+			// == FilledSequence(b): holds decoded batch b, waiting for the consumer
+			std::atomic<size_t> sequence{ 0 };
+		};
+		//free and filled stay distinct even with a single slot, where batch b+1 reuses the slot batch b is held in.
+		[[nodiscard]] static constexpr size_t FreeSequence(size_t batchIndex) noexcept { return 2 * batchIndex; }
+		[[nodiscard]] static constexpr size_t FilledSequence(size_t batchIndex) noexcept { return 2 * batchIndex + 1; }
+
+		bool Launch(const PrefetchOptions& options, size_t imageCount, size_t imageSize, size_t workerCount)
+		{
+			if (options.BatchSize == 0 || options.PrefetchDepth == 0 || workerCount == 0)
+				return false;
+			m_options = options;
+			m_imageCount = imageCount;
+			m_batchCount = (m_imageCount + options.BatchSize - 1) / options.BatchSize;
+			m_slots = std::vector<Slot>(options.PrefetchDepth);
+			for (size_t i = 0; i < m_slots.size(); i++)
+			{
+				m_slots[i].batch.Reshape(options.BatchSize, imageSize);
+				m_slots[i].sequence.store(FreeSequence(i), std::memory_order_relaxed);
+			}
+			m_nextProduce.store(0, std::memory_order_relaxed);
+			m_ready.store(0, std::memory_order_relaxed);
+			m_nextConsume = 0;
+			m_holdingSlot = false;
+			m_stats = { options.PrefetchDepth };
+			for (size_t i = 0; i < workerCount; i++)
+				m_workers.emplace_back([this]() { WorkerLoop(); });
+			return true;
+		}
+
+		void ReleaseHeldSlot()
+		{
+			if (!m_holdingSlot)
+				return;
+			Slot& slot = m_slots[m_nextConsume % m_slots.size()];
+			slot.sequence.store(FreeSequence(m_nextConsume + m_slots.size()), std::memory_order_release);
+			slot.sequence.notify_all();
+			m_nextConsume++;
+			m_holdingSlot = false;
+		}
+
+		void WorkerLoop()
+		{
+			while (!m_stopping.load(std::memory_order_relaxed))
+			{
+				const size_t batchIndex = m_nextProduce.fetch_add(1, std::memory_order_relaxed);
+				if (batchIndex >= m_batchCount)
+					return;
+				Slot& slot = m_slots[batchIndex % m_slots.size()];
+				//back-pressure, wait for the consumer to hand this slot back.
+				for (size_t s = slot.sequence.load(std::memory_order_acquire); s != FreeSequence(batchIndex); s = slot.sequence.load(std::memory_order_acquire))
+				{
+					if (s == StoppedSequence)
+						return;
+					slot.sequence.wait(s, std::memory_order_acquire);
+				}
+				Decode(batchIndex, slot.batch);
+				if (m_transform)
+				{
+					IDX3_PROFILE_SCOPE_ITEMS("transform batch", slot.batch.Count);
+					m_transform(slot.batch, batchIndex);
+				}
+				m_ready.fetch_add(1, std::memory_order_relaxed);
+				size_t expected = FreeSequence(batchIndex);
+				//a failed exchange means Stop() was called while decoding.
+				if (!slot.sequence.compare_exchange_strong(expected, FilledSequence(batchIndex), std::memory_order_release))
+					return;
+				slot.sequence.notify_all();
+			}
+		}
+
+		void Decode(size_t batchIndex, BatchType& batch) const
+		{
+			IDX3_PROFILE_SCOPE("decode batch");
+			//the only worker of a stream reads its batches in order.
+			if (m_stream != nullptr)
+			{
+				m_stream->ReadBatch(batch, m_options.Scale);
+				return;
+			}
+			const size_t first = m_firstImage + batchIndex * m_options.BatchSize;
+			const size_t count = std::min(m_options.BatchSize, m_firstImage + m_imageCount - first);
+			//likewise the only worker of an async reader.
+			if (m_async != nullptr)
+			{
+				if (m_order.empty())
+					m_async->ReadBatch(batch, m_options.Scale);
+				else
+					m_async->ReadImages(m_order.subspan(first, count), batch, m_options.Scale);
+				return;
+			}
+			if (!m_order.empty())
+			{
+				//gathered image by image from wherever the order points in the mapping.
+				for (size_t i = 0; i < count; i++)
+				{
+					const auto source = (*m_dataset)[m_order[first + i]];
+					if constexpr (std::is_same_v<T, Idx3HeaderData::Bits8Type>)
+						std::ranges::copy(source, batch.Image(i).begin());
+					else
+						ConvertPixels<T>(source, batch.Image(i), m_options.Scale);
+				}
+				batch.Count = count;
+				return;
+			}
+			const auto source = m_dataset->Images(first, count);
+			if constexpr (std::is_same_v<T, Idx3HeaderData::Bits8Type>)
+				std::ranges::copy(source, batch.data.begin());
+			else
+				ConvertPixels<T>(source, batch.data.Span(), m_options.Scale);
+			batch.Count = count;
+		}
+
+		const Idx3MappedDataset* m_dataset = nullptr;
+		Idx3StreamReader* m_stream = nullptr;
+		Idx3AsyncReader* m_async = nullptr;
+		std::span<const size_t> m_order;
+		TransformType m_transform;
+		PrefetchOptions m_options;
+		size_t m_firstImage = 0;
+		size_t m_imageCount = 0;
+		size_t m_batchCount = 0;
+		std::vector<Slot> m_slots;
+		std::vector<std::thread> m_workers;
+		std::atomic<size_t> m_nextProduce{ 0 };
+		std::atomic<size_t> m_ready{ 0 };
+		std::atomic<bool> m_stopping{ false };
+		//consumer side state, only touched by the thread calling Next()
+		size_t m_nextConsume = 0;
+		bool m_holdingSlot = false;
+		PrefetchStats m_stats;
+	};
+}
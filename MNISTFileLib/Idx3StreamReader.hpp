@@ -0,0 +1,107 @@
+#pragma once
+#include "stdafx.h"
+#include <algorithm>
+#include <span>
+#include <string_view>
+#include "Idx3HeaderData.hpp"
+#include "Idx3BatchReader.hpp"
+#include "CompressedFileReader.hpp"
+
+namespace Idx3Lib
+{
+	/// <summary>
+	/// Forward-only IDX3 reader over a <c>CompressedFileReader</c>, so <c>.idx3-ubyte.gz</c> (or zstd) sources and raw
+	/// files are read the same way. Batches are decompressed straight into the caller's <c>Idx3Batch</c>, the API
+	/// mirrors <c>Idx3BatchReader</c> without <c>Seek()</c>, a compressed stream cannot be entered at an offset.
+	/// </summary>
+	class Idx3StreamReader
+	{
+	public:
+		using Bits8Type = Idx3HeaderData::Bits8Type;
+		Idx3StreamReader() = default;
+		explicit Idx3StreamReader(const std::string& path) { Open(path); }
+
+		/// <summary>Opens <c>path</c> and decodes the header. Returns false on failure, see <c>ErrorMessage()</c>.</summary>
+		bool Open(const std::string& path)
+		{
+			m_position = 0;
+			m_header = {};
+			m_errorMessage.clear();
+			if (!m_source.Open(path))
+				return SetError(std::string(m_source.ErrorMessage()));
+			std::array<Bits8Type, Idx3HeaderData::HeaderSize> headerBytes{};
+			if (!m_source.ReadExact(headerBytes))
+				return SetError("Failed to read the header: " + std::string(m_source.ErrorMessage()));
+			Idx3HeaderData::FromBytes(headerBytes, m_header);
+			if (!m_header.IsValid())
+				return SetError("Not an IDX3 image file, magic: " + std::to_string(m_header.magic) + ".");
+			return true;
+		}
+		void Close()
+		{
+			m_source.Close();
+			m_header = {};
+			m_position = 0;
+		}
+
+		[[nodiscard]] bool IsOpen() const noexcept { return m_source.IsOpen() && m_errorMessage.empty(); }
+		[[nodiscard]] const Idx3HeaderData& Header() const noexcept { return m_header; }
+		[[nodiscard]] size_t ImageCount() const noexcept { return m_header.num_images; }
+		[[nodiscard]] size_t ImageSize() const noexcept { return m_header.ImageSize(); }
+		/// <summary>Index of the next image to be read.</summary>
+		[[nodiscard]] size_t Position() const noexcept { return m_position; }
+		[[nodiscard]] size_t Remaining() const noexcept { return ImageCount() - m_position; }
+		[[nodiscard]] Compression Format() const noexcept { return m_source.Format(); }
+		[[nodiscard]] const CompressedFileReader& Source() const noexcept { return m_source; }
+		[[nodiscard]] std::string_view ErrorMessage() const noexcept { return m_errorMessage; }
+
+		/// <summary>
+		/// Reads up to <c>batch.Capacity</c> images into <c>batch</c>, as <c>Idx3BatchReader::ReadBatch</c>. Returns the
+		/// number of images read, zero at the end of the data or on error (a truncated or corrupt stream).
+		/// </summary>
+		template<typename T>
+		size_t ReadBatch(Idx3Batch<T>& batch, const PixelScale scale = PixelScale::Normalized)
+		{
+			IDX3_PROFILE_SCOPE_ITEMS("read images", std::min(batch.Capacity, Remaining()));
+			if (batch.ImageSize != ImageSize())
+				batch.Reshape(batch.Capacity, ImageSize());
+			batch.Count = 0;
+			const size_t count = std::min(batch.Capacity, Remaining());
+			if (!IsOpen() || count == 0)
+				return 0;
+			const size_t byteCount = count * ImageSize();
+			if constexpr (std::is_same_v<T, Bits8Type>)
+			{
+				if (!ReadBytes(batch.data.Span().first(byteCount)))
+					return 0;
+			}
+			else
+			{
+				m_staging.Resize(byteCount);
+				if (!ReadBytes(m_staging.Span()))
+					return 0;
+				ConvertPixels<T>(m_staging.Span(), batch.data.Span(), scale);
+			}
+			m_position += count;
+			batch.Count = count;
+			return count;
+		}
+	private:
+		bool ReadBytes(std::span<Bits8Type> destination)
+		{
+			if (!m_source.ReadExact(destination))
+				return SetError("Failed during reading the images at image " + std::to_string(m_position) + ": " + std::string(m_source.ErrorMessage()));
+			return true;
+		}
+		bool SetError(std::string message)
+		{
+			m_errorMessage = std::move(message);
+			return false;
+		}
+		CompressedFileReader m_source;
+		Idx3HeaderData m_header;
+		size_t m_position = 0;
+		AlignedBuffer<Bits8Type> m_staging;
+		std::string m_errorMessage;
+	};
+}
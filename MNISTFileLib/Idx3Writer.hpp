@@ -0,0 +1,292 @@
+#pragma once
+#include "stdafx.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <string_view>
+#include "Idx3HeaderData.hpp"
+#include "Idx3BatchReader.hpp"
+#include "AlignedBuffer.hpp"
+#include "Instrumentation.hpp"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace Idx3Lib
+{
+	struct Idx3WriterOptions
+	{
+		size_t BufferSize = size_t{ 1 } << 20;  // bytes gathered before each write, rounded up to a multiple of BlockSize
+		bool DirectIO = false;                  // Linux only, bypass the page cache with O_DIRECT, ignored elsewhere
+	};
+
+	/// <summary>
+	/// Streams an IDX3 file out in large blocks. The header is written once up front with a zero image count,
+	/// images can then be appended incrementally, and <c>Close()</c> flushes the tail and patches <c>num_images</c>
+	/// in the header. Appends are gathered into one aligned buffer, data larger than the buffer is written
+	/// straight from the caller's memory together with the buffered bytes in a single gathered write.
+	/// </summary>
+	class Idx3Writer
+	{
+	public:
+		using Bits8Type = Idx3HeaderData::Bits8Type;
+		static constexpr size_t BlockSize = 4096; // O_DIRECT transfer alignment
+
+		Idx3Writer() = default;
+		Idx3Writer(const Idx3Writer&) = delete;
+		Idx3Writer& operator=(const Idx3Writer&) = delete;
+		~Idx3Writer() { Close(); }
+
+		/// <summary>Creates (truncates) <c>path</c> and writes the header for images of <c>rows x columns</c> pixels.
+		/// Returns false on failure or if a dimension does not fit the 32 bit header field, see <c>ErrorMessage()</c>.</summary>
+		bool Open(const std::string& path, size_t rows, size_t columns, const Idx3WriterOptions& options = {})
+		{
+			Close();
+			constexpr size_t MaxDimension = std::numeric_limits<Idx3HeaderData::Bits32Type>::max();
+			if (rows > MaxDimension || columns > MaxDimension)
+				return SetError("Image dimensions " + std::to_string(rows) + " x " + std::to_string(columns) + " do not fit in an IDX3 header.");
+			m_header = { Idx3HeaderData::MagicNumber, 0, static_cast<Idx3HeaderData::Bits32Type>(rows), static_cast<Idx3HeaderData::Bits32Type>(columns) };
+			if (m_header.ImageSize() == 0)
+				return SetError("Image dimensions must be non-zero.");
+			m_buffer.Resize(std::max(BlockSize, (options.BufferSize + BlockSize - 1) / BlockSize * BlockSize));
+			m_buffered = 0;
+			m_fileOffset = 0;
+#ifdef _WIN32
+			m_file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+			if (!m_file)
+				return SetError("File failed to open.");
+#else
+			int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+			if (options.DirectIO)
+				flags |= O_DIRECT;
+#endif
+			m_fd = ::open(path.c_str(), flags, 0644);
+#ifdef O_DIRECT
+			//not every file system supports O_DIRECT, fall back to buffered I/O.
+			if (m_fd < 0 && options.DirectIO)
+				m_fd = ::open(path.c_str(), flags & ~O_DIRECT, 0644);
+			m_direct = m_fd >= 0 && (::fcntl(m_fd, F_GETFL) & O_DIRECT) != 0;
+#endif
+			if (m_fd < 0)
+				return SetError("File failed to open.");
+#endif
+			m_errorMessage.clear();
+			const auto headerBytes = EncodeHeader();
+			return Append(std::span<const Bits8Type>(headerBytes), 0);
+		}
+
+		/// <summary>Appends whole images, <c>pixels</c> must hold a multiple of the image size.</summary>
+		bool AppendImages(std::span<const Bits8Type> pixels)
+		{
+			if (!IsOpen())
+				return false;
+			IDX3_PROFILE_SCOPE_ITEMS("write images", pixels.size() / m_header.ImageSize());
+			if (pixels.size() % m_header.ImageSize() != 0)
+				return SetError("Append size " + std::to_string(pixels.size()) + " is not a multiple of the image size " + std::to_string(m_header.ImageSize()) + ".");
+			return Append(pixels, pixels.size() / m_header.ImageSize());
+		}
+		/// <summary>Appends the filled part of a batch.</summary>
+		bool AppendImages(const Idx3Batch<Bits8Type>& batch) { return AppendImages(batch.Filled()); }
+
+		/// <summary>Flushes buffered data, writes the final image count into the header and closes the file.
+		/// Returns false if anything failed, calling it on a closed writer does nothing.</summary>
+		bool Close()
+		{
+			if (!IsOpen())
+				return m_errorMessage.empty();
+			bool ok = m_errorMessage.empty() && FlushTail();
+			if (ok)
+			{
+				const auto headerBytes = EncodeHeader();
+				ok = WriteAt(headerBytes.data(), headerBytes.size(), 0);
+			}
+#ifdef _WIN32
+			m_file.close();
+			ok = ok && !m_file.fail();
+#else
+			ok = ::close(m_fd) == 0 && ok;
+			m_fd = -1;
+			m_direct = false;
+#endif
+			if (!ok && m_errorMessage.empty())
+				SetError("Failed to finish writing the file.");
+			return ok;
+		}
+
+		[[nodiscard]] bool IsOpen() const
+		{
+#ifdef _WIN32
+			return m_file.is_open();
+#else
+			return m_fd >= 0;
+#endif
+		}
+		[[nodiscard]] size_t ImagesWritten() const noexcept { return m_header.num_images; }
+		[[nodiscard]] size_t ImageSize() const noexcept { return m_header.ImageSize(); }
+		/// <summary>True if the file is being written with O_DIRECT.</summary>
+		[[nodiscard]] bool IsDirect() const noexcept { return m_direct; }
+		[[nodiscard]] std::string_view ErrorMessage() const noexcept { return m_errorMessage; }
+	private:
+		[[nodiscard]] std::array<Bits8Type, Idx3HeaderData::HeaderSize> EncodeHeader() const
+		{
+			std::array<Idx3HeaderData::Bits32Type, Idx3HeaderData::NUM_ELEMENTS> fields{ m_header.magic, m_header.num_images, m_header.num_rows, m_header.num_columns };
+			if constexpr (Idx3HeaderData::SwitchEndian)
+			{
+				for (auto& elem : fields)
+					elem = swap_endian(elem);
+			}
+			std::array<Bits8Type, Idx3HeaderData::HeaderSize> bytes{};
+			std::memcpy(bytes.data(), fields.data(), bytes.size());
+			return bytes;
+		}
+
+		bool Append(std::span<const Bits8Type> data, size_t imageCount)
+		{
+			if (!m_errorMessage.empty())
+				return false;
+			if (imageCount > std::numeric_limits<Idx3HeaderData::Bits32Type>::max() - m_header.num_images)
+				return SetError("Appending " + std::to_string(imageCount) + " images to " + std::to_string(m_header.num_images) + " exceeds the IDX3 limit of "
+					+ std::to_string(std::numeric_limits<Idx3HeaderData::Bits32Type>::max()) + " images.");
+			//small appends are gathered into the buffer.
+			if (m_buffered + data.size() <= m_buffer.size())
+			{
+				std::memcpy(m_buffer.data() + m_buffered, data.data(), data.size());
+				m_buffered += data.size();
+				m_header.num_images += static_cast<Idx3HeaderData::Bits32Type>(imageCount);
+				return true;
+			}
+			if (m_direct)
+			{
+				//O_DIRECT needs aligned memory, so everything passes through the buffer in whole blocks.
+				while (!data.empty())
+				{
+					const size_t chunk = std::min(data.size(), m_buffer.size() - m_buffered);
+					std::memcpy(m_buffer.data() + m_buffered, data.data(), chunk);
+					m_buffered += chunk;
+					data = data.subspan(chunk);
+					if (m_buffered == m_buffer.size() && !FlushBuffer())
+						return false;
+				}
+			}
+			else if (!WriteGathered(data))
+			{
+				return false;
+			}
+			m_header.num_images += static_cast<Idx3HeaderData::Bits32Type>(imageCount);
+			return true;
+		}
+
+		/// <summary>Writes the buffered bytes followed by <c>data</c> in one call where the platform allows it.</summary>
+		bool WriteGathered(std::span<const Bits8Type> data)
+		{
+#ifdef _WIN32
+			if (!WriteAt(m_buffer.data(), m_buffered, m_fileOffset) || !WriteAt(data.data(), data.size(), m_fileOffset + m_buffered))
+				return false;
+#else
+			iovec parts[2]{ { m_buffer.data(), m_buffered }, { const_cast<Bits8Type*>(data.data()), data.size() } };
+			size_t remaining = m_buffered + data.size();
+			size_t offset = m_fileOffset;
+			iovec* part = parts;
+			int partCount = 2;
+			while (remaining > 0)
+			{
+				const ssize_t written = ::pwritev(m_fd, part, partCount, static_cast<off_t>(offset));
+				if (written <= 0)
+					return SetError("Failed writing " + std::to_string(remaining) + " bytes at offset " + std::to_string(offset) + ".");
+				remaining -= static_cast<size_t>(written);
+				offset += static_cast<size_t>(written);
+				//skip whatever was fully written and continue with a partially written part.
+				size_t consumed = static_cast<size_t>(written);
+				while (partCount > 0 && consumed >= part->iov_len)
+				{
+					consumed -= part->iov_len;
+					part++;
+					partCount--;
+				}
+				if (partCount > 0)
+				{
+					part->iov_base = static_cast<char*>(part->iov_base) + consumed;
+					part->iov_len -= consumed;
+				}
+			}
+#endif
+			m_fileOffset += m_buffered + data.size();
+			m_buffered = 0;
+			return true;
+		}
+
+		/// <summary>Writes the whole buffer, only called once it is full so O_DIRECT transfers stay block sized.</summary>
+		bool FlushBuffer()
+		{
+			if (!WriteAt(m_buffer.data(), m_buffered, m_fileOffset))
+				return false;
+			m_fileOffset += m_buffered;
+			m_buffered = 0;
+			return true;
+		}
+
+		/// <summary>Writes whatever is left in the buffer. With O_DIRECT the whole blocks go out first, then direct I/O is
+		/// switched off for the unaligned remainder.</summary>
+		bool FlushTail()
+		{
+#if !defined(_WIN32) && defined(O_DIRECT)
+			if (m_direct)
+			{
+				const size_t aligned = m_buffered / BlockSize * BlockSize;
+				if (aligned != 0 && !WriteAt(m_buffer.data(), aligned, m_fileOffset))
+					return false;
+				m_fileOffset += aligned;
+				std::memmove(m_buffer.data(), m_buffer.data() + aligned, m_buffered - aligned);
+				m_buffered -= aligned;
+				::fcntl(m_fd, F_SETFL, ::fcntl(m_fd, F_GETFL) & ~O_DIRECT);
+				m_direct = false;
+			}
+#endif
+			return FlushBuffer();
+		}
+
+		bool WriteAt(const Bits8Type* data, size_t size, size_t offset)
+		{
+#ifdef _WIN32
+			m_file.seekp(static_cast<std::streamoff>(offset));
+			m_file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+			if (!m_file)
+				return SetError("Failed writing " + std::to_string(size) + " bytes at offset " + std::to_string(offset) + ".");
+#else
+			while (size > 0)
+			{
+				const ssize_t written = ::pwrite(m_fd, data, size, static_cast<off_t>(offset));
+				if (written <= 0)
+					return SetError("Failed writing " + std::to_string(size) + " bytes at offset " + std::to_string(offset) + ".");
+				data += written;
+				size -= static_cast<size_t>(written);
+				offset += static_cast<size_t>(written);
+			}
+#endif
+			return true;
+		}
+
+		bool SetError(std::string message)
+		{
+			m_errorMessage = std::move(message);
+			return false;
+		}
+
+		Idx3HeaderData m_header;
+		AlignedBuffer<Bits8Type, BlockSize> m_buffer;
+		size_t m_buffered = 0;
+		size_t m_fileOffset = 0;
+		bool m_direct = false;
+#ifdef _WIN32
+		std::ofstream m_file;
+#else
+		int m_fd = -1;
+#endif
+		std::string m_errorMessage;
+	};
+}
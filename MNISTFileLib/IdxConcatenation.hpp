@@ -0,0 +1,375 @@
+#pragma once
+#include "stdafx.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <limits>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "IdxFile.hpp"
+#include "AlignedBuffer.hpp"
+#include "Instrumentation.hpp"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Idx3Lib
+{
+	namespace Detail
+	{
+		/// <summary>Runs <c>body(shard, task)</c> for every task in [0, taskCount) on up to <c>shardCount</c> threads, each
+		///	taking the next task as it finishes one, <c>shard</c> is the index of the running thread. Returns the error
+		///	messages of failed tasks joined by spaces.</summary>
+		template<typename Body>
+		std::string RunSharded(size_t taskCount, size_t shardCount, const Body& body)
+		{
+			if (shardCount == 0)
+				shardCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+			shardCount = std::clamp<size_t>(shardCount, 1, std::max<size_t>(1, taskCount));
+			std::atomic<size_t> next{ 0 };
+			auto Worker = [&](size_t shard)
+			{
+				std::string errors;
+				for (size_t task = next.fetch_add(1, std::memory_order_relaxed); task < taskCount; task = next.fetch_add(1, std::memory_order_relaxed))
+				{
+					std::string error = body(shard, task);
+					if (!error.empty())
+						errors += (errors.empty() ? "" : " ") + error;
+				}
+				return errors;
+			};
+			std::vector<std::future<std::string>> shards;
+			for (size_t shard = 1; shard < shardCount; shard++)
+				shards.emplace_back(std::async(std::launch::async, Worker, shard));
+			std::string errors = Worker(0);
+			for (auto& shard : shards)
+			{
+				const std::string result = shard.get();
+				if (!result.empty())
+					errors += (errors.empty() ? "" : " ") + result;
+			}
+			return errors;
+		}
+	}
+
+	/// <summary>
+	/// Random permutation of [0, count) built in parallel: every index is sent to one of <c>Buckets</c> random buckets,
+	/// the buckets are laid out one after another and each is shuffled on its own. Blocks and buckets are fixed, so the
+	/// result depends only on <c>seed</c>, not on the number of threads.
+	/// </summary>
+	class IdxPermutation
+	{
+	public:
+		static constexpr size_t Buckets = 64;
+
+		[[nodiscard]] static std::vector<size_t> Random(size_t count, std::uint64_t seed, size_t shardCount = 0)
+		{
+			IDX3_PROFILE_SCOPE_ITEMS("permute", count);
+			std::vector<size_t> permutation(count);
+			if (count < Buckets * Buckets)
+			{
+				std::iota(permutation.begin(), permutation.end(), size_t{ 0 });
+				std::mt19937_64 engine = Engine(seed, 0);
+				std::shuffle(permutation.begin(), permutation.end(), engine);
+				return permutation;
+			}
+			//pass one, pick a bucket for every index of a block and count them per (bucket, block).
+			std::vector<std::uint8_t> bucketOf(count);
+			std::vector<size_t> offsets(Buckets * Buckets, 0);
+			const auto BlockBegin = [count](size_t block) { return count * block / Buckets; };
+			Detail::RunSharded(Buckets, shardCount, [&](size_t, size_t block)
+			{
+				std::mt19937_64 engine = Engine(seed, block);
+				std::uniform_int_distribution<unsigned> pick(0, Buckets - 1);
+				for (size_t i = BlockBegin(block); i < BlockBegin(block + 1); i++)
+				{
+					bucketOf[i] = static_cast<std::uint8_t>(pick(engine));
+					offsets[bucketOf[i] * Buckets + block]++;
+				}
+				return std::string();
+			});
+			//bucket-major prefix sum, so each block scatters into its own disjoint range of every bucket.
+			std::vector<size_t> bucketBegin(Buckets + 1, 0);
+			size_t total = 0;
+			for (size_t bucket = 0; bucket < Buckets; bucket++)
+			{
+				bucketBegin[bucket] = total;
+				for (size_t block = 0; block < Buckets; block++)
+					total += std::exchange(offsets[bucket * Buckets + block], total);
+			}
+			bucketBegin[Buckets] = total;
+			//pass two, scatter.
+			Detail::RunSharded(Buckets, shardCount, [&](size_t, size_t block)
+			{
+				for (size_t i = BlockBegin(block); i < BlockBegin(block + 1); i++)
+					permutation[offsets[bucketOf[i] * Buckets + block]++] = i;
+				return std::string();
+			});
+			//pass three, shuffle every bucket.
+			Detail::RunSharded(Buckets, shardCount, [&](size_t, size_t bucket)
+			{
+				std::mt19937_64 engine = Engine(seed, Buckets + bucket);
+				std::shuffle(permutation.begin() + bucketBegin[bucket], permutation.begin() + bucketBegin[bucket + 1], engine);
+				return std::string();
+			});
+			return permutation;
+		}
+	private:
+		[[nodiscard]] static std::mt19937_64 Engine(std::uint64_t seed, size_t stream)
+		{
+			std::seed_seq sequence{ static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32), static_cast<std::uint32_t>(stream) };
+			return std::mt19937_64(sequence);
+		}
+	};
+
+	struct IdxWriteOptions
+	{
+		size_t BufferSize = size_t{ 8 } << 20;  // bytes gathered by a thread before each write
+		size_t ShardCount = 0;                  // threads gathering and writing, 0 for one per hardware thread
+	};
+
+	/// <summary>
+	/// The items of several IDX files of the same element type and item shape (e.g. shards of one image set) seen as
+	/// one sequence, from which any selection of items can be written to a new file. Sources are memory mapped, the
+	/// output is cut into blocks of consecutive output items that threads gather from the mappings into large buffers,
+	/// copying each run of items that are consecutive in a source at once, and write at their final offset.
+	/// </summary>
+	class IdxConcatenation
+	{
+	public:
+		/// <summary>Maps <c>path</c> and appends its items. Returns false if it cannot be opened or does not hold the same
+		///	element type and item shape as the files added before it, see <c>ErrorMessage()</c>.</summary>
+		bool Add(const std::string& path)
+		{
+			IdxMappedFile file;
+			if (!file.Open(path))
+				return SetError(path + ": " + std::string(file.ErrorMessage()));
+			if (!m_sources.empty())
+			{
+				const IdxHeader& first = m_sources.front().Header();
+				const IdxHeader& header = file.Header();
+				if (header.type != first.type || !std::equal(header.dimensions.begin() + 1, header.dimensions.end(), first.dimensions.begin() + 1, first.dimensions.end()))
+					return SetError(path + ": items of type 0x" + ToHex(header.type) + " and shape " + Shape(header) + " do not match type 0x" + ToHex(first.type) + " and shape " + Shape(first) + ".");
+			}
+			if (m_sourceBegin.empty())
+				m_sourceBegin.push_back(0);
+			m_sourceBegin.push_back(m_sourceBegin.back() + file.ItemCount());
+			m_sources.push_back(std::move(file));
+			m_paths.push_back(path);
+			m_errorMessage.clear();
+			return true;
+		}
+
+		[[nodiscard]] size_t SourceCount() const noexcept { return m_sources.size(); }
+		[[nodiscard]] const IdxMappedFile& Source(size_t index) const noexcept { return m_sources[index]; }
+		[[nodiscard]] size_t ItemCount() const noexcept { return m_sourceBegin.empty() ? 0 : m_sourceBegin.back(); }
+		[[nodiscard]] size_t ItemSize() const noexcept { return m_sources.empty() ? 0 : m_sources.front().Header().ItemSize(); }
+		/// <summary>Header of a file holding <c>itemCount</c> of these items.</summary>
+		[[nodiscard]] IdxHeader Header(size_t itemCount) const
+		{
+			IdxHeader header = m_sources.empty() ? IdxHeader{} : m_sources.front().Header();
+			if (!header.dimensions.empty())
+				header.dimensions[0] = static_cast<IdxHeader::Bits32Type>(itemCount);
+			return header;
+		}
+		[[nodiscard]] std::string_view ErrorMessage() const noexcept { return m_errorMessage; }
+		/// <summary>True if <c>path</c> names one of the sources, through a link or another spelling too. Writing it would
+		///	replace a file that is still being read.</summary>
+		[[nodiscard]] bool ReadsFrom(const std::string& path) const
+		{
+			return std::any_of(m_paths.begin(), m_paths.end(), [&path](const std::string& source)
+			{
+				std::error_code ignored;
+				return std::filesystem::equivalent(path, source, ignored);
+			});
+		}
+
+		/// <summary>Writes a new file at <c>path</c> holding the items at <c>items</c> (indices into the whole sequence), in
+		///	that order. The file is written as <c>path</c>.tmp and renamed over <c>path</c> once complete, so a failed write
+		///	leaves no partial file. Returns false on failure or if <c>path</c> is one of the sources, see <c>ErrorMessage()</c>.</summary>
+		bool Write(const std::string& path, std::span<const size_t> items, const IdxWriteOptions& options = {})
+		{
+			if (m_sources.empty())
+				return SetError("No input files.");
+			if (items.size() > std::numeric_limits<IdxHeader::Bits32Type>::max())
+				return SetError(std::to_string(items.size()) + " items do not fit in an IDX header.");
+			const auto outOfRange = std::find_if(items.begin(), items.end(), [this](size_t item) { return item >= ItemCount(); });
+			if (outOfRange != items.end())
+				return SetError("Item " + std::to_string(*outOfRange) + " is out of range, there are " + std::to_string(ItemCount()) + ".");
+			if (ReadsFrom(path))
+				return SetError(path + ": is one of the input files, the output must be a different file.");
+			const auto headerBytes = Header(items.size()).ToBytes();
+			const size_t itemSize = ItemSize();
+			const size_t dataSize = items.size() * itemSize;
+			const std::string temporaryPath = path + ".tmp";
+			OutputFile out;
+			const auto Fail = [&](std::string message)
+			{
+				out.Close();
+				std::error_code ignored;
+				std::filesystem::remove(temporaryPath, ignored);
+				return SetError(path + ": " + std::move(message));
+			};
+			if (!out.Open(temporaryPath, headerBytes.size() + dataSize))
+				return Fail("file failed to open.");
+			if (!out.WriteAt(headerBytes.data(), headerBytes.size(), 0))
+				return Fail("failed writing the header.");
+
+			const size_t itemsPerBlock = std::max<size_t>(1, options.BufferSize / std::max<size_t>(1, itemSize));
+			const size_t blockCount = (items.size() + itemsPerBlock - 1) / itemsPerBlock;
+			const size_t shardCount = options.ShardCount == 0 ? std::max<size_t>(1, std::thread::hardware_concurrency()) : options.ShardCount;
+			//one gather buffer per thread, reused for every block it writes.
+			std::vector<AlignedBuffer<std::uint8_t>> buffers(std::clamp<size_t>(shardCount, 1, std::max<size_t>(1, blockCount)));
+			const std::string errors = Detail::RunSharded(blockCount, shardCount, [&](size_t shard, size_t block)
+			{
+				AlignedBuffer<std::uint8_t>* const buffer = &buffers[shard];
+				const size_t first = block * itemsPerBlock;
+				const auto blockItems = items.subspan(first, std::min(itemsPerBlock, items.size() - first));
+				IDX3_PROFILE_SCOPE_ITEMS("gather items", blockItems.size());
+				buffer->Resize(blockItems.size() * itemSize);
+				Gather(blockItems, buffer->data());
+				if (!out.WriteAt(buffer->data(), buffer->size(), headerBytes.size() + first * itemSize))
+					return "Failed writing " + std::to_string(buffer->size()) + " bytes at item " + std::to_string(first) + ".";
+				return std::string();
+			});
+			if (!errors.empty())
+				return Fail(errors);
+			if (!out.Close())
+				return Fail("failed to finish writing the file.");
+			std::error_code renameError;
+			std::filesystem::rename(temporaryPath, path, renameError);
+			if (renameError)
+				return Fail("failed to replace it with " + temporaryPath + ": " + renameError.message() + ".");
+			m_errorMessage.clear();
+			return true;
+		}
+		/// <summary>Items [first, last) of part <c>part</c> when <c>itemCount</c> items are split into <c>parts</c> parts of
+		///	near equal size, the sizes differ by at most one.</summary>
+		[[nodiscard]] static std::pair<size_t, size_t> PartRange(size_t itemCount, size_t part, size_t parts) noexcept
+		{
+			return { itemCount * part / parts, itemCount * (part + 1) / parts };
+		}
+		/// <summary>Writes items [first, first + count) of the sequence, e.g. every source back to back for a merge.</summary>
+		bool WriteRange(const std::string& path, size_t first, size_t count, const IdxWriteOptions& options = {})
+		{
+			std::vector<size_t> items(count);
+			std::iota(items.begin(), items.end(), first);
+			return Write(path, items, options);
+		}
+	private:
+		/// <summary>Destination opened for positional writes from several threads, sized up front.</summary>
+		class OutputFile
+		{
+		public:
+			OutputFile() = default;
+			OutputFile(const OutputFile&) = delete;
+			OutputFile& operator=(const OutputFile&) = delete;
+			~OutputFile() { Close(); }
+
+			bool Open(const std::string& path, size_t size)
+			{
+#ifdef _WIN32
+				(void)size;
+				m_file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+				return m_file.is_open();
+#else
+				m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+				//reserving the whole file keeps writes of later blocks from extending it one at a time.
+				return m_fd >= 0 && ::ftruncate(m_fd, static_cast<off_t>(size)) == 0;
+#endif
+			}
+			bool WriteAt(const std::uint8_t* data, size_t size, size_t offset)
+			{
+#ifdef _WIN32
+				std::lock_guard lock(m_mutex);
+				m_file.seekp(static_cast<std::streamoff>(offset));
+				m_file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+				return static_cast<bool>(m_file);
+#else
+				while (size > 0)
+				{
+					const ssize_t written = ::pwrite(m_fd, data, size, static_cast<off_t>(offset));
+					if (written <= 0)
+						return false;
+					data += written;
+					size -= static_cast<size_t>(written);
+					offset += static_cast<size_t>(written);
+				}
+				return true;
+#endif
+			}
+			bool Close()
+			{
+#ifdef _WIN32
+				if (!m_file.is_open())
+					return true;
+				m_file.close();
+				return !m_file.fail();
+#else
+				if (m_fd < 0)
+					return true;
+				return ::close(std::exchange(m_fd, -1)) == 0;
+#endif
+			}
+		private:
+#ifdef _WIN32
+			std::ofstream m_file;
+			std::mutex m_mutex;
+#else
+			int m_fd = -1;
+#endif
+		};
+
+		/// <summary>Copies <c>items</c> into <c>out</c> back to back, one copy per run of items consecutive in one source.</summary>
+		void Gather(std::span<const size_t> items, std::uint8_t* out) const
+		{
+			const size_t itemSize = ItemSize();
+			size_t i = 0;
+			while (i < items.size())
+			{
+				const size_t source = static_cast<size_t>(std::upper_bound(m_sourceBegin.begin(), m_sourceBegin.end(), items[i]) - m_sourceBegin.begin()) - 1;
+				const size_t first = items[i] - m_sourceBegin[source];
+				const size_t available = m_sourceBegin[source + 1] - items[i];
+				size_t run = 1;
+				while (run < available && i + run < items.size() && items[i + run] == items[i] + run)
+					run++;
+				const auto bytes = m_sources[source].ItemBytes(first, run);
+				std::memcpy(out, bytes.data(), bytes.size());
+				out += run * itemSize;
+				i += run;
+			}
+		}
+
+		static std::string ToHex(IdxDataType type)
+		{
+			std::ostringstream os;
+			os << std::hex << static_cast<int>(type);
+			return os.str();
+		}
+		static std::string Shape(const IdxHeader& header)
+		{
+			std::string shape = "[";
+			for (size_t i = 1; i < header.dimensions.size(); i++)
+				shape += (i == 1 ? "" : " x ") + std::to_string(header.dimensions[i]);
+			return shape + "]";
+		}
+		bool SetError(std::string message)
+		{
+			m_errorMessage = std::move(message);
+			return false;
+		}
+
+		std::vector<IdxMappedFile> m_sources;
+		std::vector<std::string> m_paths;      // path each source was added with
+		std::vector<size_t> m_sourceBegin;     // index of each source's first item in the sequence, plus the total
+		std::string m_errorMessage;
+	};
+}
@@ -0,0 +1,219 @@
+#pragma once
+#include "stdafx.h"
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "SwapEndian.hpp"
+#include "MappedFile.hpp"
+#include "Instrumentation.hpp"
+
+namespace Idx3Lib
+{
+	//Source: http://yann.lecun.com/exdb/mnist/
+	/*
+	 * The magic number is four bytes, the first two are always 0.
+	 * The third byte codes the type of the data:
+		0x08: unsigned byte
+		0x09: signed byte
+		0x0B: short (2 bytes)
+		0x0C: int (4 bytes)
+		0x0D: float (4 bytes)
+		0x0E: double (8 bytes)
+	 * The fourth byte codes the number of dimensions of the vector/matrix: 1 for vectors, 2 for matrices....
+	 * The sizes in each dimension are 4-byte integers (MSB first, high endian, like in most non-Intel processors).
+	 * The data is stored like in a C array, i.e. the index in the last dimension changes the fastest.
+	 */
+	enum class IdxDataType : std::uint8_t
+	{
+		UnsignedByte = 0x08,
+		SignedByte = 0x09,
+		Short = 0x0B,
+		Int = 0x0C,
+		Float = 0x0D,
+		Double = 0x0E
+	};
+
+	/// <summary>Size in bytes of one element of <c>type</c>, zero for an unknown type code.</summary>
+	[[nodiscard]] constexpr size_t ElementSize(IdxDataType type) noexcept
+	{
+		switch (type)
+		{
+		case IdxDataType::UnsignedByte:
+		case IdxDataType::SignedByte: return 1;
+		case IdxDataType::Short: return 2;
+		case IdxDataType::Int:
+		case IdxDataType::Float: return 4;
+		case IdxDataType::Double: return 8;
+		default: return 0;
+		}
+	}
+
+	/// <summary>The IDX type code matching a C++ element type.</summary>
+	template<typename T> struct IdxTypeOf;
+	template<> struct IdxTypeOf<std::uint8_t> { static constexpr IdxDataType value = IdxDataType::UnsignedByte; };
+	template<> struct IdxTypeOf<std::int8_t> { static constexpr IdxDataType value = IdxDataType::SignedByte; };
+	template<> struct IdxTypeOf<std::int16_t> { static constexpr IdxDataType value = IdxDataType::Short; };
+	template<> struct IdxTypeOf<std::int32_t> { static constexpr IdxDataType value = IdxDataType::Int; };
+	template<> struct IdxTypeOf<float> { static constexpr IdxDataType value = IdxDataType::Float; };
+	template<> struct IdxTypeOf<double> { static constexpr IdxDataType value = IdxDataType::Double; };
+
+	/// <summary>Header of an IDX file of any rank and element type, e.g. IDX1 labels (rank 1) or IDX3 images (rank 3).</summary>
+	struct IdxHeader
+	{
+		using Bits32Type = std::uint32_t;
+		static constexpr bool SwitchEndian = (std::endian::native != std::endian::big);
+		IdxDataType type = IdxDataType::UnsignedByte;
+		std::vector<Bits32Type> dimensions;
+
+		[[nodiscard]] size_t Rank() const noexcept { return dimensions.size(); }
+		/// <summary>Magic number plus one 32 bit size per dimension.</summary>
+		[[nodiscard]] size_t HeaderSize() const noexcept { return sizeof(Bits32Type) * (1 + dimensions.size()); }
+		[[nodiscard]] size_t ElementSize() const noexcept { return Idx3Lib::ElementSize(type); }
+		/// <summary>Number of items along the first dimension, e.g. the number of images or labels.</summary>
+		[[nodiscard]] size_t ItemCount() const noexcept { return dimensions.empty() ? 0 : dimensions[0]; }
+		/// <summary>Elements per item, the product of every dimension after the first (1 for a rank 1 file).</summary>
+		[[nodiscard]] size_t ItemElementCount() const noexcept
+		{
+			size_t count = 1;
+			for (size_t i = 1; i < dimensions.size(); i++)
+				count *= dimensions[i];
+			return count;
+		}
+		[[nodiscard]] size_t ItemSize() const noexcept { return ItemElementCount() * ElementSize(); }
+		[[nodiscard]] size_t DataSize() const noexcept { return ItemCount() * ItemSize(); }
+		/// <summary>True if every size derived from the dimensions fits in <c>size_t</c>. Zero dimensions are skipped so a
+		/// file of zero items cannot hide an item size that would wrap.</summary>
+		[[nodiscard]] bool SizesFit() const noexcept
+		{
+			size_t size = ElementSize();
+			for (const auto dimension : dimensions)
+			{
+				if (dimension == 0)
+					continue;
+				if (size > std::numeric_limits<size_t>::max() / dimension)
+					return false;
+				size *= dimension;
+			}
+			return true;
+		}
+		/// <summary>The 32 bit magic number as stored in the file (before any byte swapping).</summary>
+		[[nodiscard]] Bits32Type Magic() const noexcept { return (static_cast<Bits32Type>(type) << 8) | static_cast<Bits32Type>(dimensions.size()); }
+
+		/// <summary>Decodes a header from the beginning of an in-memory file image. Returns false if the
+		/// leading bytes are not zero, the type code is unknown, the rank is zero, the span is too short or the
+		/// dimensions describe more data than <c>size_t</c> can hold.</summary>
+		static bool FromBytes(std::span<const std::uint8_t> bytes, IdxHeader& obj)
+		{
+			IDX3_PROFILE_SCOPE("header parse");
+			if (bytes.size() < sizeof(Bits32Type) || bytes[0] != 0 || bytes[1] != 0)
+				return false;
+			obj.type = static_cast<IdxDataType>(bytes[2]);
+			const size_t rank = bytes[3];
+			if (Idx3Lib::ElementSize(obj.type) == 0 || rank == 0 || bytes.size() < sizeof(Bits32Type) * (1 + rank))
+				return false;
+			obj.dimensions.resize(rank);
+			std::memcpy(obj.dimensions.data(), bytes.data() + sizeof(Bits32Type), rank * sizeof(Bits32Type));
+			if constexpr (SwitchEndian)
+			{
+				for (auto& elem : obj.dimensions)
+					elem = swap_endian(elem);
+			}
+			//a wrapped data size would pass the file size check in IdxMappedFile::Open and let reads run past the mapping.
+			return obj.SizesFit();
+		}
+		/// <summary>Encodes the header as it is stored at the beginning of a file, the inverse of <c>FromBytes</c>.</summary>
+		[[nodiscard]] std::vector<std::uint8_t> ToBytes() const
+		{
+			std::vector<Bits32Type> fields{ Magic() };
+			fields.insert(fields.end(), dimensions.begin(), dimensions.end());
+			if constexpr (SwitchEndian)
+			{
+				for (auto& elem : fields)
+					elem = swap_endian(elem);
+			}
+			std::vector<std::uint8_t> bytes(HeaderSize());
+			std::memcpy(bytes.data(), fields.data(), bytes.size());
+			return bytes;
+		}
+		friend std::ostream& operator<<(std::ostream& os, const IdxHeader& obj)
+		{
+			os << "type: 0x" << std::hex << static_cast<int>(obj.type) << std::dec << " dimensions:";
+			for (const auto elem : obj.dimensions)
+				os << " " << elem;
+			return os;
+		}
+	};
+
+	/// <summary>
+	/// Zero-copy, memory mapped view of an IDX file of any rank and element type.
+	/// Items are handed out as raw byte spans into the mapping, <c>Items()</c> returns typed spans for single byte data,
+	/// multi-byte data is big endian in the file and decoded with <c>CopyItems()</c>.
+	/// </summary>
+	class IdxMappedFile
+	{
+	public:
+		using ByteView = std::span<const std::uint8_t>;
+		IdxMappedFile() = default;
+		explicit IdxMappedFile(const std::string& path) { Open(path); }
+
+		/// <summary>Maps the file, decodes the header and checks the file holds all the data it describes.
+		/// Returns false on failure, see <c>ErrorMessage()</c>.</summary>
+		bool Open(const std::string& path)
+		{
+			m_header = {};
+			if (!m_file.Open(path))
+				return SetError("File failed to open.");
+			if (!IdxHeader::FromBytes(m_file.Bytes(), m_header))
+				return SetError("Failed to read header, not an IDX file.");
+			if (m_file.Size() - m_header.HeaderSize() < m_header.DataSize())
+				return SetError("Size mismatch, header describes " + std::to_string(m_header.DataSize()) + " bytes of data, file holds " + std::to_string(m_file.Size() - m_header.HeaderSize()) + ".");
+			m_errorMessage.clear();
+			return true;
+		}
+		[[nodiscard]] bool IsOpen() const noexcept { return m_file.IsOpen(); }
+		[[nodiscard]] const IdxHeader& Header() const noexcept { return m_header; }
+		[[nodiscard]] size_t ItemCount() const noexcept { return m_header.ItemCount(); }
+		[[nodiscard]] std::string_view ErrorMessage() const noexcept { return m_errorMessage; }
+		/// <summary>Raw bytes of <c>count</c> items beginning at <c>first</c>, unchecked.</summary>
+		[[nodiscard]] ByteView ItemBytes(size_t first, size_t count = 1) const noexcept
+		{
+			return m_file.Bytes().subspan(m_header.HeaderSize() + first * m_header.ItemSize(), count * m_header.ItemSize());
+		}
+		/// <summary>Every element of the file as a typed span, only for single byte element types where no decoding is needed.
+		/// Returns an empty span if <c>T</c> does not match the file's type.</summary>
+		template<typename T> requires (sizeof(T) == 1)
+		[[nodiscard]] std::span<const T> Items() const noexcept
+		{
+			if (!IsOpen() || IdxTypeOf<T>::value != m_header.type)
+				return {};
+			const auto bytes = ItemBytes(0, ItemCount());
+			return { reinterpret_cast<const T*>(bytes.data()), bytes.size() };
+		}
+		/// <summary>Decodes <c>count</c> items beginning at <c>first</c> into <c>out</c>, converting from the file's
+		/// big endian layout in the same pass as the copy (a plain copy for single byte types).
+		/// Returns false if <c>T</c> does not match the file's type or <c>out</c> is too small.</summary>
+		template<typename T>
+		bool CopyItems(size_t first, size_t count, std::span<T> out) const
+		{
+			if (!IsOpen() || IdxTypeOf<T>::value != m_header.type || first + count > ItemCount() || out.size() < count * m_header.ItemElementCount())
+				return false;
+			IDX3_PROFILE_SCOPE_ITEMS("decode items", count);
+			const auto bytes = ItemBytes(first, count);
+			Endian::FromBigEndian(bytes.data(), out.data(), bytes.size() / sizeof(T));
+			return true;
+		}
+	private:
+		bool SetError(std::string message)
+		{
+			m_errorMessage = std::move(message);
+			m_file.Close();
+			return false;
+		}
+		MappedFile m_file;
+		IdxHeader m_header;
+		std::string m_errorMessage;
+	};
+}
@@ -0,0 +1,476 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/// Scoped timing of the hot paths, compiled in only when <c>IDX3_PROFILING</c> is defined (the <c>IDX3_PROFILING</c> CMake option).
+/// Without it the <c>IDX3_PROFILE_*</c> macros expand to nothing. With it, each one costs a relaxed load until
+/// <c>Instrumentation::Enable</c> is called.
+///	  IDX3_PROFILE_SCOPE("name")                  times the rest of the enclosing scope
+///	  IDX3_PROFILE_SCOPE_ITEMS("name", count)     the same, also adding <c>count</c> items (images, bytes, rows) to the zone
+///	  IDX3_PROFILE_SCOPE_INDEXED("name ", index)  one zone per index, e.g. per layer, named "name 0", "name 1", ...
+#ifdef IDX3_PROFILING
+#define IDX3_PROFILE_JOIN2(a, b) a##b
+#define IDX3_PROFILE_JOIN(a, b) IDX3_PROFILE_JOIN2(a, b)
+#define IDX3_PROFILE_SCOPE_ITEMS(name, items) \
+	static const ::Idx3Lib::Instrumentation::Site IDX3_PROFILE_JOIN(idx3ProfileSite, __LINE__)(name); \
+	const ::Idx3Lib::Instrumentation::ScopedTimer IDX3_PROFILE_JOIN(idx3ProfileTimer, __LINE__)(IDX3_PROFILE_JOIN(idx3ProfileSite, __LINE__), (items))
+#define IDX3_PROFILE_SCOPE(name) IDX3_PROFILE_SCOPE_ITEMS(name, 0)
+#define IDX3_PROFILE_SCOPE_INDEXED(name, index) \
+	static const ::Idx3Lib::Instrumentation::SiteArray IDX3_PROFILE_JOIN(idx3ProfileSites, __LINE__)(name); \
+	const ::Idx3Lib::Instrumentation::ScopedTimer IDX3_PROFILE_JOIN(idx3ProfileTimer, __LINE__)(IDX3_PROFILE_JOIN(idx3ProfileSites, __LINE__)[(index)])
+#else
+#define IDX3_PROFILE_SCOPE_ITEMS(name, items) static_cast<void>(0)
+#define IDX3_PROFILE_SCOPE(name) static_cast<void>(0)
+#define IDX3_PROFILE_SCOPE_INDEXED(name, index) static_cast<void>(0)
+#endif
+
+/// <summary>
+/// Per-zone call counts, times and item counts, kept per thread and summed only when a report is written, so
+/// instrumented code never takes a lock or shares a cache line with another thread. Optionally records every
+/// zone entered as a Chrome trace event (load the JSON from <c>WriteChromeTrace</c> in chrome://tracing or Perfetto)
+/// and, on Linux, reads the CPU cycle and cache miss counters around each zone through <c>perf_event_open</c>.
+/// Times are inclusive, a zone's total contains the zones nested in it.
+/// </summary>
+namespace Idx3Lib::Instrumentation
+{
+#ifdef IDX3_PROFILING
+	constexpr bool CompiledIn = true;
+#else
+	constexpr bool CompiledIn = false;
+#endif
+	constexpr size_t MaxSites = 256;                     // the last one collects any zones past the limit
+	constexpr size_t TraceCapacity = size_t{ 1 } << 17;  // trace events kept per thread, later ones are counted as dropped
+
+	struct Options
+	{
+		bool Trace = false;             // record every zone for WriteChromeTrace
+		bool HardwareCounters = false;  // cycles and cache misses per zone, Linux only and subject to perf_event_paranoid
+	};
+
+	namespace Detail
+	{
+		using Clock = std::chrono::steady_clock;
+
+		/// <summary>Written only by the owning thread, read by reports, hence relaxed atomics rather than plain integers.</summary>
+		struct SiteStats
+		{
+			std::atomic<std::uint64_t> calls{ 0 };
+			std::atomic<std::uint64_t> nanoseconds{ 0 };
+			std::atomic<std::uint64_t> items{ 0 };
+			std::atomic<std::uint64_t> cycles{ 0 };
+			std::atomic<std::uint64_t> cacheMisses{ 0 };
+
+			static void Add(std::atomic<std::uint64_t>& counter, std::uint64_t value) noexcept
+			{
+				counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+			}
+		};
+		struct TraceEvent
+		{
+			std::uint32_t site;
+			std::uint64_t start;     // ns since Enable
+			std::uint64_t duration;  // ns
+		};
+		struct HardwareSample
+		{
+			std::uint64_t cycles = 0;
+			std::uint64_t cacheMisses = 0;
+		};
+
+		/// <summary>One thread's counters. Never freed, a thread that exits releases its slot to the next new thread,
+		///	so pipeline workers restarted every epoch keep adding to the same few slots.</summary>
+		struct ThreadData
+		{
+			ThreadData* next = nullptr;
+			std::uint32_t id = 0;
+			std::atomic<bool> inUse{ true };
+			std::array<SiteStats, MaxSites> stats;
+			std::unique_ptr<TraceEvent[]> events;
+			std::atomic<size_t> eventCount{ 0 };
+			std::atomic<std::uint64_t> droppedEvents{ 0 };
+			int perfLeader = -1;
+			int perfMember = -1;
+			bool perfOpened = false;
+
+			void OpenHardwareCounters() noexcept
+			{
+				perfOpened = true;
+#if defined(__linux__)
+				//a group of cycles and cache misses on the calling thread, user space only so a default perf_event_paranoid allows it.
+				perf_event_attr attr{};
+				attr.size = sizeof(attr);
+				attr.type = PERF_TYPE_HARDWARE;
+				attr.config = PERF_COUNT_HW_CPU_CYCLES;
+				attr.read_format = PERF_FORMAT_GROUP;
+				attr.exclude_kernel = 1;
+				attr.exclude_hv = 1;
+				perfLeader = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+				if (perfLeader < 0)
+					return;
+				attr.config = PERF_COUNT_HW_CACHE_MISSES;
+				perfMember = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, perfLeader, 0));
+				if (perfMember < 0)
+					CloseHardwareCounters();
+#endif
+			}
+			void CloseHardwareCounters() noexcept
+			{
+#if defined(__linux__)
+				if (perfMember >= 0)
+					close(perfMember);
+				if (perfLeader >= 0)
+					close(perfLeader);
+#endif
+				perfLeader = -1;
+				perfMember = -1;
+				perfOpened = false;
+			}
+			/// <summary>Current counter values, zero if the counters could not be opened.</summary>
+			HardwareSample ReadHardwareCounters() noexcept
+			{
+				if (!perfOpened)
+					OpenHardwareCounters();
+				HardwareSample sample;
+#if defined(__linux__)
+				struct { std::uint64_t count; std::uint64_t values[2]; } group{};
+				if (perfLeader >= 0 && read(perfLeader, &group, sizeof(group)) == static_cast<ssize_t>(sizeof(group)))
+				{
+					sample.cycles = group.values[0];
+					sample.cacheMisses = group.values[1];
+				}
+#endif
+				return sample;
+			}
+		};
+
+		struct State
+		{
+			std::atomic<bool> enabled{ false };
+			std::atomic<bool> trace{ false };
+			std::atomic<bool> hardwareCounters{ false };
+			Clock::time_point origin = Clock::now();   // trace timestamps are relative to the first Enable or last Reset
+			bool started = false;
+			std::array<std::atomic<const char*>, MaxSites> names{};
+			std::atomic<size_t> siteCount{ 0 };
+			std::atomic<ThreadData*> threads{ nullptr };
+			std::atomic<std::uint32_t> threadCount{ 0 };
+		};
+		inline State& GlobalState() noexcept
+		{
+			static State state;
+			return state;
+		}
+
+		inline std::uint32_t RegisterSite(const char* name) noexcept
+		{
+			State& state = GlobalState();
+			const size_t id = state.siteCount.fetch_add(1, std::memory_order_relaxed);
+			if (id >= MaxSites - 1)
+			{
+				state.names[MaxSites - 1].store("(other zones)", std::memory_order_release);
+				return static_cast<std::uint32_t>(MaxSites - 1);
+			}
+			state.names[id].store(name, std::memory_order_release);
+			return static_cast<std::uint32_t>(id);
+		}
+
+		/// <summary>Takes a slot released by an exited thread, or pushes a new one onto the lock-free list.</summary>
+		inline ThreadData* AcquireThreadData()
+		{
+			State& state = GlobalState();
+			for (ThreadData* data = state.threads.load(std::memory_order_acquire); data != nullptr; data = data->next)
+			{
+				bool released = false;
+				if (data->inUse.compare_exchange_strong(released, true, std::memory_order_acq_rel))
+					return data;
+			}
+			auto* data = new ThreadData;
+			data->id = state.threadCount.fetch_add(1, std::memory_order_relaxed) + 1;
+			data->next = state.threads.load(std::memory_order_relaxed);
+			while (!state.threads.compare_exchange_weak(data->next, data, std::memory_order_release, std::memory_order_relaxed)) { }
+			return data;
+		}
+		struct ThreadHandle
+		{
+			ThreadData* data = nullptr;
+			~ThreadHandle()
+			{
+				if (data == nullptr)
+					return;
+				//the counters measure this thread only, the next owner opens its own.
+				data->CloseHardwareCounters();
+				data->inUse.store(false, std::memory_order_release);
+			}
+		};
+		inline ThreadData& CurrentThread()
+		{
+			thread_local ThreadHandle handle;
+			if (handle.data == nullptr)
+				handle.data = AcquireThreadData();
+			return *handle.data;
+		}
+
+		template<typename Fn>
+		void ForEachThread(Fn&& fn)
+		{
+			for (ThreadData* data = GlobalState().threads.load(std::memory_order_acquire); data != nullptr; data = data->next)
+				fn(*data);
+		}
+
+		inline void WriteJsonString(std::ostream& os, const char* text)
+		{
+			os << '"';
+			for (; *text != '\0'; text++)
+			{
+				if (*text == '"' || *text == '\\')
+					os << '\\';
+				os << *text;
+			}
+			os << '"';
+		}
+	}
+
+	/// <summary>A named zone, one static instance per instrumented scope.</summary>
+	class Site
+	{
+	public:
+		explicit Site(const char* name) noexcept : m_id(Detail::RegisterSite(name)) { }
+		[[nodiscard]] std::uint32_t Id() const noexcept { return m_id; }
+	private:
+		std::uint32_t m_id;
+	};
+
+	/// <summary>Zones "prefix 0" to "prefix N-1" for per-index timing, indices past the last share the last zone.</summary>
+	class SiteArray
+	{
+	public:
+		static constexpr size_t Count = 16;
+		explicit SiteArray(const char* prefix)
+		{
+			for (size_t i = 0; i < Count; i++)
+				m_names[i] = prefix + std::to_string(i);
+			for (size_t i = 0; i < Count; i++)
+				m_sites.emplace_back(m_names[i].c_str());
+		}
+		[[nodiscard]] const Site& operator[](size_t index) const noexcept { return m_sites[std::min(index, Count - 1)]; }
+	private:
+		std::array<std::string, Count> m_names;
+		std::vector<Site> m_sites;
+	};
+
+	/// <summary>Starts recording, or resumes it after <c>Disable</c>. Options only change while recording is stopped.</summary>
+	inline void Enable(const Options& options = {})
+	{
+		Detail::State& state = Detail::GlobalState();
+		if (!state.started)
+			state.origin = Detail::Clock::now();
+		state.started = true;
+		state.trace.store(options.Trace, std::memory_order_relaxed);
+		state.hardwareCounters.store(options.HardwareCounters, std::memory_order_relaxed);
+		state.enabled.store(true, std::memory_order_release);
+	}
+	inline void Disable() noexcept { Detail::GlobalState().enabled.store(false, std::memory_order_release); }
+	[[nodiscard]] inline bool IsEnabled() noexcept { return Detail::GlobalState().enabled.load(std::memory_order_relaxed); }
+
+	/// <summary>Clears every counter and trace event and restarts the trace clock. Call only while no instrumented code runs.</summary>
+	inline void Reset()
+	{
+		Detail::GlobalState().origin = Detail::Clock::now();
+		Detail::ForEachThread([](Detail::ThreadData& data)
+		{
+			for (auto& stats : data.stats)
+			{
+				stats.calls.store(0, std::memory_order_relaxed);
+				stats.nanoseconds.store(0, std::memory_order_relaxed);
+				stats.items.store(0, std::memory_order_relaxed);
+				stats.cycles.store(0, std::memory_order_relaxed);
+				stats.cacheMisses.store(0, std::memory_order_relaxed);
+			}
+			data.eventCount.store(0, std::memory_order_relaxed);
+			data.droppedEvents.store(0, std::memory_order_relaxed);
+		});
+	}
+
+	/// <summary>Times its scope into a zone of the calling thread, does nothing if recording is off when it is created.</summary>
+	class ScopedTimer
+	{
+	public:
+		explicit ScopedTimer(const Site& site, std::uint64_t items = 0) noexcept
+		{
+			const Detail::State& state = Detail::GlobalState();
+			if (!state.enabled.load(std::memory_order_relaxed))
+				return;
+			m_thread = &Detail::CurrentThread();
+			m_site = site.Id();
+			m_items = items;
+			m_hardware = state.hardwareCounters.load(std::memory_order_relaxed);
+			if (m_hardware)
+				m_hardwareStart = m_thread->ReadHardwareCounters();
+			m_start = Detail::Clock::now();
+		}
+		ScopedTimer(const ScopedTimer&) = delete;
+		ScopedTimer& operator=(const ScopedTimer&) = delete;
+		~ScopedTimer()
+		{
+			if (m_thread == nullptr)
+				return;
+			const auto end = Detail::Clock::now();
+			const auto nanoseconds = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - m_start).count());
+			Detail::SiteStats& stats = m_thread->stats[m_site];
+			Detail::SiteStats::Add(stats.calls, 1);
+			Detail::SiteStats::Add(stats.nanoseconds, nanoseconds);
+			Detail::SiteStats::Add(stats.items, m_items);
+			if (m_hardware)
+			{
+				const Detail::HardwareSample sample = m_thread->ReadHardwareCounters();
+				Detail::SiteStats::Add(stats.cycles, sample.cycles - m_hardwareStart.cycles);
+				Detail::SiteStats::Add(stats.cacheMisses, sample.cacheMisses - m_hardwareStart.cacheMisses);
+			}
+			const Detail::State& state = Detail::GlobalState();
+			if (state.trace.load(std::memory_order_relaxed))
+				Record(state, nanoseconds);
+		}
+	private:
+		void Record(const Detail::State& state, std::uint64_t nanoseconds) noexcept
+		{
+			const size_t count = m_thread->eventCount.load(std::memory_order_relaxed);
+			if (count == TraceCapacity)
+			{
+				Detail::SiteStats::Add(m_thread->droppedEvents, 1);
+				return;
+			}
+			if (m_thread->events == nullptr)
+				m_thread->events.reset(new (std::nothrow) Detail::TraceEvent[TraceCapacity]);
+			if (m_thread->events == nullptr)
+				return;
+			const auto start = std::chrono::duration_cast<std::chrono::nanoseconds>(m_start - state.origin).count();
+			m_thread->events[count] = { m_site, static_cast<std::uint64_t>(std::max<std::int64_t>(start, 0)), nanoseconds };
+			//publishes the event to a report running on another thread.
+			m_thread->eventCount.store(count + 1, std::memory_order_release);
+		}
+
+		Detail::ThreadData* m_thread = nullptr;
+		std::uint32_t m_site = 0;
+		std::uint64_t m_items = 0;
+		bool m_hardware = false;
+		Detail::HardwareSample m_hardwareStart;
+		Detail::Clock::time_point m_start;
+	};
+
+	/// <summary>Totals of one zone over every thread.</summary>
+	struct ZoneSummary
+	{
+		std::string name;
+		std::uint64_t calls = 0;
+		std::uint64_t nanoseconds = 0;
+		std::uint64_t items = 0;
+		std::uint64_t cycles = 0;
+		std::uint64_t cacheMisses = 0;
+	};
+	/// <summary>Sums every thread's counters, zones registered more than once under one name (e.g. from each instantiation
+	///	of a template) are merged. Sorted by total time, longest first.</summary>
+	[[nodiscard]] inline std::vector<ZoneSummary> Summarize()
+	{
+		const Detail::State& state = Detail::GlobalState();
+		const size_t siteCount = std::min(state.siteCount.load(std::memory_order_relaxed), MaxSites);
+		std::map<std::string, ZoneSummary> zones;
+		for (size_t site = 0; site < siteCount; site++)
+		{
+			const char* name = state.names[site].load(std::memory_order_acquire);
+			if (name == nullptr)
+				continue;
+			ZoneSummary& zone = zones[name];
+			zone.name = name;
+			Detail::ForEachThread([&](const Detail::ThreadData& data)
+			{
+				const Detail::SiteStats& stats = data.stats[site];
+				zone.calls += stats.calls.load(std::memory_order_relaxed);
+				zone.nanoseconds += stats.nanoseconds.load(std::memory_order_relaxed);
+				zone.items += stats.items.load(std::memory_order_relaxed);
+				zone.cycles += stats.cycles.load(std::memory_order_relaxed);
+				zone.cacheMisses += stats.cacheMisses.load(std::memory_order_relaxed);
+			});
+		}
+		std::vector<ZoneSummary> summary;
+		for (auto& [name, zone] : zones)
+			if (zone.calls != 0)
+				summary.push_back(std::move(zone));
+		std::sort(summary.begin(), summary.end(), [](const ZoneSummary& a, const ZoneSummary& b) { return a.nanoseconds > b.nanoseconds; });
+		return summary;
+	}
+
+	/// <summary>Writes the per-zone table: calls, total and mean time, items per second and, when hardware counters were
+	///	read, cycles and cache misses per call.</summary>
+	inline void WriteSummary(std::ostream& os)
+	{
+		const auto summary = Summarize();
+		const bool hardware = std::any_of(summary.begin(), summary.end(), [](const ZoneSummary& zone) { return zone.cycles != 0; });
+		const auto flags = os.flags();
+		os << std::left << std::setw(28) << "Zone" << std::right << std::setw(10) << "Calls" << std::setw(12) << "Total ms"
+			<< std::setw(12) << "Mean us" << std::setw(14) << "Items/s";
+		if (hardware)
+			os << std::setw(14) << "Cycles/call" << std::setw(14) << "Misses/call";
+		os << '\n' << std::fixed;
+		for (const auto& zone : summary)
+		{
+			const double seconds = static_cast<double>(zone.nanoseconds) * 1e-9;
+			const auto calls = static_cast<double>(zone.calls);
+			os << std::left << std::setw(28) << zone.name << std::right << std::setw(10) << zone.calls
+				<< std::setw(12) << std::setprecision(2) << seconds * 1e3 << std::setw(12) << seconds * 1e6 / calls
+				<< std::setw(14) << std::setprecision(0) << (zone.items != 0 && seconds > 0.0 ? static_cast<double>(zone.items) / seconds : 0.0);
+			if (hardware)
+				os << std::setw(14) << static_cast<double>(zone.cycles) / calls << std::setw(14) << static_cast<double>(zone.cacheMisses) / calls;
+			os << '\n';
+		}
+		std::uint64_t dropped = 0;
+		Detail::ForEachThread([&dropped](const Detail::ThreadData& data) { dropped += data.droppedEvents.load(std::memory_order_relaxed); });
+		if (dropped != 0)
+			os << dropped << " trace events were dropped, at most " << TraceCapacity << " are kept per thread.\n";
+		os.flags(flags);
+	}
+
+	/// <summary>Writes the recorded zones in the Chrome trace event format, one row per thread. Returns false if the file
+	///	could not be written.</summary>
+	inline bool WriteChromeTrace(const std::string& path)
+	{
+		std::ofstream out(path);
+		if (!out)
+			return false;
+		const Detail::State& state = Detail::GlobalState();
+		out << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+		bool first = true;
+		const auto Separator = [&out, &first]() -> std::ostream& { out << (first ? "\n" : ",\n"); first = false; return out; };
+		Detail::ForEachThread([&](const Detail::ThreadData& data)
+		{
+			const size_t count = data.eventCount.load(std::memory_order_acquire);
+			if (count == 0)
+				return;
+			Separator() << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << data.id << ",\"args\":{\"name\":\"thread " << data.id << "\"}}";
+			for (size_t i = 0; i < count; i++)
+			{
+				const Detail::TraceEvent& event = data.events[i];
+				Separator() << "{\"name\":";
+				Detail::WriteJsonString(out, state.names[event.site].load(std::memory_order_acquire));
+				out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << data.id << ",\"ts\":" << static_cast<double>(event.start) * 1e-3
+					<< ",\"dur\":" << static_cast<double>(event.duration) * 1e-3 << '}';
+			}
+		});
+		out << "\n]}\n";
+		return static_cast<bool>(out);
+	}
+}
@@ -1,60 +1,182 @@
 #include "stdafx.h"
 #include <iostream>
 #include <fstream>
-#include <future>
+#include <charconv>
 #include <thread>
 
 #include "Idx3HeaderData.hpp"
-#include "Idx3ImageDataBuffer.hpp"
+#include "Idx3StreamReader.hpp"
+#include "Idx3PrefetchPipeline.hpp"
+#include "IdxFile.hpp"
+#include "IdxConcatenation.hpp"
+#include "Instrumentation.hpp"
 
-bool read_vector(const std::string &path)
+constexpr const char* Usage = R"(Usage: MNISTFileLib <command> [options] <input>...
+Commands:
+  info      check every input holds the data its header describes and print the header
+  merge     concatenate the inputs, in order, into --output
+  shuffle   concatenate the inputs and write them to --output in a random order
+  subset    write --count items from --first of the concatenation (shuffled first with --shuffle)
+  split     write the concatenation (shuffled first with --shuffle) as --parts files of near equal size,
+            named after --output with the part number before the extension, e.g. out-0.idx3-ubyte
+Options:
+  -o, --output <path>   output file, or base name for split
+  --seed <n>            seed of the random order, the same seed always gives the same order (default 0)
+  --shuffle             shuffle before subset or split
+  --first <n>           first item of a subset (default 0)
+  --count <n>           items in a subset (default all after --first)
+  --parts <n>           files a split writes
+  --threads <n>         threads gathering and writing (default one per hardware thread)
+  --profile             print per stage timings and save them as a Chrome trace, needs an IDX3_PROFILING build
+Files that belong together, such as images and their labels, are given as comma separated columns, e.g.
+  MNISTFileLib shuffle --seed 7 -o all-images.idx3-ubyte,all-labels.idx1-ubyte a-images.idx3-ubyte,a-labels.idx1-ubyte b-images.idx3-ubyte,b-labels.idx1-ubyte
+every column is reordered the same way, so labels stay with their images.
+Inputs are memory mapped, compressed files can only be inspected with info.)";
+
+struct ToolOptions
 {
-	std::osyncstream ss(std::cout);
-	auto HandleErrorCondition = [&ss](const std::string_view s)
+	std::string command;
+	std::vector<std::vector<std::string>> inputs;  // [input][column]
+	std::vector<std::string> outputs;              // one per column
+	std::uint64_t seed = 0;
+	bool shuffle = false;
+	size_t first = 0;
+	size_t count = std::numeric_limits<size_t>::max();
+	size_t parts = 0;
+	size_t threads = 0;
+	bool profile = false;
+};
+
+std::vector<std::string> SplitColumns(std::string_view list)
+{
+	std::vector<std::string> columns;
+	size_t begin = 0;
+	for (size_t comma = list.find(','); comma != std::string_view::npos; comma = list.find(',', begin))
 	{
-		ss << s << std::endl;
+		columns.emplace_back(list.substr(begin, comma - begin));
+		begin = comma + 1;
+	}
+	columns.emplace_back(list.substr(begin));
+	return columns;
+}
+
+bool ParseArguments(int argc, char* argv[], ToolOptions& options, std::string& error)
+{
+	if (argc < 2)
+	{
+		error = "No command given.";
 		return false;
-	};
-	std::ifstream currentFile(path, std::ios::in | std::ios::binary);
-	if (currentFile)
-	{
-		//read header
-		Idx3Lib::Idx3HeaderData myHeader;
-		currentFile >> myHeader;
-		ss << "Logged a header: " << myHeader << std::endl;
-		if (!currentFile)
+	}
+	options.command = argv[1];
+	for (int i = 2; i < argc; i++)
+	{
+		const std::string_view arg = argv[i];
+		auto Number = [&](auto& value)
+		{
+			if (i + 1 >= argc)
+			{
+				error = std::string(arg) + " needs a value.";
+				return false;
+			}
+			const std::string_view text = argv[++i];
+			const auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+			if (result.ec != std::errc() || result.ptr != text.data() + text.size())
+			{
+				error = std::string(arg) + " expects a number, got " + std::string(text) + ".";
+				return false;
+			}
+			return true;
+		};
+		if (arg == "-o" || arg == "--output")
 		{
-			return HandleErrorCondition("Failed to read header!");
+			if (i + 1 >= argc)
+			{
+				error = std::string(arg) + " needs a value.";
+				return false;
+			}
+			options.outputs = SplitColumns(argv[++i]);
 		}
-		ss << "Done getting input file header." << std::endl;
-		//compute image size from the header attributes [Row Size] and [Col Size]
-		const size_t image_size = static_cast<size_t>(myHeader.num_columns) * myHeader.num_rows;
-		const size_t NumImages = myHeader.num_images;
-		size_t imagesRead = 0;
-		ss << "Reading images..." << std::endl;
-		//for each image based on the [Num Images] position
-		std::shared_ptr<Idx3Lib::Idx3ImageDataBuffer> imagePointer;
-		for (size_t i = 0; i < NumImages; i++)
+		else if (arg == "--seed") { if (!Number(options.seed)) return false; }
+		else if (arg == "--first") { if (!Number(options.first)) return false; }
+		else if (arg == "--count") { if (!Number(options.count)) return false; }
+		else if (arg == "--parts") { if (!Number(options.parts)) return false; }
+		else if (arg == "--threads") { if (!Number(options.threads)) return false; }
+		else if (arg == "--shuffle")
+			options.shuffle = true;
+		else if (arg == "--profile")
+			options.profile = true;
+		else if (arg.starts_with("-"))
 		{
-			std::shared_ptr<Idx3Lib::Idx3ImageDataBuffer> currentImage = std::make_shared<Idx3Lib::Idx3ImageDataBuffer>(image_size);
-			currentFile >> *currentImage;
-			if (!currentFile && !currentFile.eof())
-				return HandleErrorCondition("Failed during reading the images!");
-			if (currentImage->ImageSize != currentImage->buffer.size())
-				return HandleErrorCondition("Size mismatch, expected" + std::to_string(currentImage->ImageSize) + " bytes, got " + std::to_string(currentImage->buffer.size()) + " bytes.");
-			imagesRead++;
-			imagePointer = currentImage;
+			error = "Unknown option " + std::string(arg) + ".";
+			return false;
 		}
-		ss << "Read " << imagesRead << " images." << std::endl;
+		else
+			options.inputs.push_back(SplitColumns(arg));
 	}
-	else
+	if (options.inputs.empty())
+	{
+		error = "No input files given.";
+		return false;
+	}
+	const size_t columns = options.inputs.front().size();
+	for (const auto& input : options.inputs)
+	{
+		if (input.size() != columns)
+		{
+			error = "Every input needs the same number of comma separated files, expected " + std::to_string(columns) + ".";
+			return false;
+		}
+	}
+	if (options.command != "info" && options.outputs.size() != columns)
+	{
+		error = options.outputs.empty() ? "No --output given." : "--output needs one file per input column, " + std::to_string(columns) + ".";
+		return false;
+	}
+	if (options.command == "split" && options.parts == 0)
+	{
+		error = "split needs --parts.";
+		return false;
+	}
+	return true;
+}
+
+/// <summary>Inserts "-<c>part</c>" before the extension of the file name, out.idx3-ubyte becomes out-3.idx3-ubyte.</summary>
+std::string PartPath(const std::string& path, size_t part)
+{
+	const size_t nameBegin = path.find_last_of("/\\") == std::string::npos ? 0 : path.find_last_of("/\\") + 1;
+	const size_t extension = std::min(path.find('.', nameBegin), path.size());
+	return path.substr(0, extension) + "-" + std::to_string(part) + path.substr(extension);
+}
+
+bool read_compressed_vector(const std::string &path)
+{
+	std::osyncstream ss(std::cout);
+	auto HandleErrorCondition = [&ss](const std::string_view s)
+	{
+		ss << s << std::endl;
+		return false;
+	};
+	Idx3Lib::Idx3StreamReader reader;
+	if (!reader.Open(path))
 	{
-		return HandleErrorCondition("File failed to open.");
+		return HandleErrorCondition(reader.ErrorMessage());
 	}
+	ss << "Logged a header: " << reader.Header() << std::endl;
+	ss << "Done getting input file header, decompressing " << Idx3Lib::ToString(reader.Format()) << " stream." << std::endl;
+	//a background thread inflates straight into the batch slots while this thread consumes them.
+	Idx3Lib::Idx3PrefetchPipeline<> pipeline;
+	pipeline.Start(reader, { .BatchSize = 1024, .PrefetchDepth = 4 });
+	size_t imagesRead = 0;
+	while (const auto batch = pipeline.Next())
+		imagesRead += batch->Count;
+	pipeline.Stop();
+	if (!reader.ErrorMessage().empty())
+		return HandleErrorCondition(reader.ErrorMessage());
+	ss << "Read " << imagesRead << " images, " << pipeline.Stats() << std::endl;
 	return true;
 }
 
-bool CopyDataFile(const std::string &path)
+bool read_vector(const std::string &path)
 {
 	std::osyncstream ss(std::cout);
 	auto HandleErrorCondition = [&ss](const std::string_view s)
@@ -62,74 +184,163 @@ bool CopyDataFile(const std::string &path)
 		ss << s << std::endl;
 		return false;
 	};
-	//open in and out files
-	std::ifstream currentFile(path, std::ios::in | std::ios::binary);
-	auto id = std::this_thread::get_id();
-	std::stringstream strs;
-	strs << id;
-	std::ofstream outFile(std::format("{0}.txt", strs.str()), std::ios::binary); //unique thread id filename
-	if (currentFile)
-	{
-		//read header
-		Idx3Lib::Idx3HeaderData myHeader;
-		currentFile >> myHeader;
-		if (!currentFile)
+	//compressed files cannot be mapped, they are streamed instead.
+	if (Idx3Lib::DetectCompression(path) != Idx3Lib::Compression::None)
+		return read_compressed_vector(path);
+	//map the file once, the header is validated against the file size up front.
+	Idx3Lib::IdxMappedFile file;
+	if (!file.Open(path))
+	{
+		return HandleErrorCondition(file.ErrorMessage());
+	}
+	ss << "Logged a header: " << file.Header() << std::endl;
+	ss << "Holds " << file.ItemCount() << " items of " << file.Header().ItemSize() << " bytes." << std::endl;
+	return true;
+}
+
+/// <summary>True after printing which output is also an input of any column, writing it would destroy an input.</summary>
+bool OutputIsInput(const std::vector<Idx3Lib::IdxConcatenation>& columns, const std::vector<std::string>& outputs)
+{
+	for (const auto& output : outputs)
+		for (const auto& column : columns)
+			if (column.ReadsFrom(output))
+			{
+				std::cout << output << " is one of the input files, the output must be a different file." << std::endl;
+				return true;
+			}
+	return false;
+}
+
+/// <summary>Writes the selected items of every column, returns false after printing the first failure.</summary>
+bool WriteColumns(std::vector<Idx3Lib::IdxConcatenation>& columns, const std::vector<std::string>& outputs, std::span<const size_t> items, const Idx3Lib::IdxWriteOptions& writeOptions)
+{
+	for (size_t c = 0; c < columns.size(); c++)
+	{
+		const auto startTime = std::chrono::steady_clock::now();
+		if (!columns[c].Write(outputs[c], items, writeOptions))
 		{
-			return HandleErrorCondition("Failed to read header!");
+			std::cout << columns[c].ErrorMessage() << std::endl;
+			return false;
 		}
-		else
-			ss << "Logged a header: " << myHeader << std::endl;
-		ss << "Done getting input file header." << std::endl;
-		ss << "Writing header to output." << std::endl;
-		outFile << myHeader;
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+		const double megabytes = static_cast<double>(items.size() * columns[c].ItemSize()) / (1024.0 * 1024.0);
+		std::cout << "Wrote " << items.size() << " items (" << std::fixed << std::setprecision(1) << megabytes << " MiB) to " << outputs[c]
+			<< " in " << elapsed.count() * 1e3 << "ms, " << megabytes / std::max(elapsed.count(), 1e-9) << " MiB/s." << std::defaultfloat << std::endl;
+	}
+	return true;
+}
 
-		//compute image size from the header attributes [Row Size] and [Col Size]
-		const size_t image_size = static_cast<size_t>(myHeader.num_columns) * myHeader.num_rows;
-		const size_t NumImages = myHeader.num_images;
-		size_t imagesRead = 0;
-		ss << "Copying images..." << std::endl;
-		//for each image based on the [Num Images] position
-		for (size_t i = 0; i < NumImages; i++)
+int RunTool(const ToolOptions& options)
+{
+	using namespace std;
+	if (options.command == "info")
+	{
+		bool ok = true;
+		for (const auto& input : options.inputs)
+			for (const auto& path : input)
+			{
+				cout << path << ":" << endl;
+				ok = read_vector(path) && ok;
+			}
+		return ok ? 0 : 1;
+	}
+	if (options.command != "merge" && options.command != "shuffle" && options.command != "subset" && options.command != "split")
+	{
+		cout << "Unknown command " << options.command << "." << endl << Usage << endl;
+		return 1;
+	}
+	//one concatenation per column, the files of an input must hold the same number of items.
+	vector<Idx3Lib::IdxConcatenation> columns(options.outputs.size());
+	for (const auto& input : options.inputs)
+	{
+		for (size_t c = 0; c < columns.size(); c++)
 		{
-			Idx3Lib::Idx3ImageDataBuffer currentImage(image_size);
-			currentFile >> currentImage;
-			if (!currentFile && !currentFile.eof())
-				return HandleErrorCondition("Failed during reading the images!");
-			if (currentImage.ImageSize != currentImage.buffer.size())
-				return HandleErrorCondition("Size mismatch, expected" + std::to_string(currentImage.ImageSize) + " bytes, got " + std::to_string(currentImage.buffer.size()) + " bytes.");
-			imagesRead++;
-			outFile << currentImage;
+			if (!columns[c].Add(input[c]))
+			{
+				cout << columns[c].ErrorMessage() << endl;
+				return 1;
+			}
+			if (columns[c].ItemCount() != columns[0].ItemCount())
+			{
+				cout << input[c] << " holds " << columns[c].Source(columns[c].SourceCount() - 1).ItemCount() << " items, "
+					<< input[0] << " holds " << columns[0].Source(columns[0].SourceCount() - 1).ItemCount() << "." << endl;
+				return 1;
+			}
 		}
-		ss << "Copied " << imagesRead << " images." << std::endl;
+	}
+	const size_t itemCount = columns[0].ItemCount();
+	cout << "Read " << options.inputs.size() << " inputs holding " << itemCount << " items." << endl;
+
+	vector<size_t> items;
+	if (options.command == "shuffle" || options.shuffle)
+	{
+		const auto startTime = chrono::steady_clock::now();
+		items = Idx3Lib::IdxPermutation::Random(itemCount, options.seed, options.threads);
+		cout << "Shuffled with seed " << options.seed << " in " << chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - startTime).count() << "ms." << endl;
 	}
 	else
 	{
-		return HandleErrorCondition("File failed to open.");
+		items.resize(itemCount);
+		iota(items.begin(), items.end(), size_t{ 0 });
 	}
-	return true;
+	const Idx3Lib::IdxWriteOptions writeOptions{ .ShardCount = options.threads };
+	if (options.command != "split" && OutputIsInput(columns, options.outputs))
+		return 1;
+	if (options.command == "subset")
+	{
+		if (options.first > itemCount)
+		{
+			cout << "--first " << options.first << " is past the last of " << itemCount << " items." << endl;
+			return 1;
+		}
+		const size_t count = min(options.count, itemCount - options.first);
+		return WriteColumns(columns, options.outputs, span<const size_t>(items).subspan(options.first, count), writeOptions) ? 0 : 1;
+	}
+	if (options.command == "split")
+	{
+		vector<vector<string>> partOutputs(options.parts);
+		for (size_t part = 0; part < options.parts; part++)
+		{
+			for (const auto& output : options.outputs)
+				partOutputs[part].push_back(PartPath(output, part));
+			if (OutputIsInput(columns, partOutputs[part]))
+				return 1;
+		}
+		for (size_t part = 0; part < options.parts; part++)
+		{
+			const vector<string>& outputs = partOutputs[part];
+			const auto [first, last] = Idx3Lib::IdxConcatenation::PartRange(itemCount, part, options.parts);
+			if (!WriteColumns(columns, outputs, span<const size_t>(items).subspan(first, last - first), writeOptions))
+				return 1;
+		}
+		return 0;
+	}
+	return WriteColumns(columns, options.outputs, items, writeOptions) ? 0 : 1;
 }
-int main()
+
+int main(int argc, char* argv[])
 {
 	using namespace std;
-	const std::string firstFileName = "t10k-images.idx3-ubyte";
-	const std::string secondFileName = "train-images.idx3-ubyte";
-	std::osyncstream ss(std::cout);
-	auto ReadFileLocal = [&ss](const std::string fileName)
+	ToolOptions options;
+	string error;
+	if (!ParseArguments(argc, argv, options, error))
 	{
-		ss << "Reading file: " << fileName << endl;
-		const bool result = read_vector(fileName);
-		ss << "Finished reading file: " << fileName << endl;
-		return result;
-	};
-	ss << "Beginning async file copies..." << endl;
-	future<bool> firstReturnVal = async(CopyDataFile, firstFileName);
-	future<bool> secondReturnVal = async(CopyDataFile, secondFileName);
-
-	firstReturnVal.wait();
-	if (firstReturnVal.valid())
-		ss << "First thread using file: " << firstFileName << " completed with result: " << firstReturnVal.get() << endl;
-	secondReturnVal.wait();
-	if (secondReturnVal.valid())
-		ss << "Second thread using file: " << secondFileName << " completed with result: " << secondReturnVal.get() << endl;
-	ss << "Ended file copies..." << endl;
-}
\ No newline at end of file
+		cout << error << endl << Usage << endl;
+		return 1;
+	}
+	//--profile records per stage timings and hardware counters, printed at exit and saved as a Chrome trace.
+	if (options.profile && !Idx3Lib::Instrumentation::CompiledIn)
+		cout << "--profile needs a build with IDX3_PROFILING defined, no timings will be recorded." << endl;
+	if (options.profile)
+		Idx3Lib::Instrumentation::Enable({ .Trace = true, .HardwareCounters = true });
+	const int result = RunTool(options);
+	if (options.profile && Idx3Lib::Instrumentation::CompiledIn)
+	{
+		Idx3Lib::Instrumentation::Disable();
+		Idx3Lib::Instrumentation::WriteSummary(cout);
+		constexpr const char* TracePath = "MNISTFileLib-trace.json";
+		if (Idx3Lib::Instrumentation::WriteChromeTrace(TracePath))
+			cout << "Trace written to " << TracePath << ", open it in chrome://tracing or ui.perfetto.dev." << endl;
+	}
+	return result;
+}
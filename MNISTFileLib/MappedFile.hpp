@@ -0,0 +1,137 @@
+#pragma once
+#include "stdafx.h"
+#include <span>
+#include <cstddef>
+#include <algorithm>
+#include <utility>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Idx3Lib
+{
+	/// <summary>
+	/// Read-only memory mapping of an entire file. Move-only, the mapping is released in the dtor.
+	/// Several MappedFile objects on the same path share one copy in the OS page cache.
+	/// </summary>
+	class MappedFile
+	{
+	public:
+		using ByteType = unsigned char;
+		MappedFile() = default;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+		MappedFile& operator=(MappedFile&& other) noexcept
+		{
+			if (this != &other)
+			{
+				Close();
+				m_data = std::exchange(other.m_data, nullptr);
+				m_size = std::exchange(other.m_size, 0);
+#ifdef _WIN32
+				m_fileHandle = std::exchange(other.m_fileHandle, INVALID_HANDLE_VALUE);
+				m_mappingHandle = std::exchange(other.m_mappingHandle, nullptr);
+#endif
+			}
+			return *this;
+		}
+		~MappedFile() { Close(); }
+
+		/// <summary>Maps the whole file at <c>path</c> read-only. Returns false if the file could not be opened or mapped,
+		/// an empty file is reported as a failure as there is nothing to map.</summary>
+		bool Open(const std::string& path)
+		{
+			Close();
+#ifdef _WIN32
+			m_fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (m_fileHandle == INVALID_HANDLE_VALUE)
+				return false;
+			LARGE_INTEGER fileSize{};
+			if (!GetFileSizeEx(m_fileHandle, &fileSize) || fileSize.QuadPart == 0)
+			{
+				Close();
+				return false;
+			}
+			m_mappingHandle = CreateFileMappingA(m_fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (m_mappingHandle == nullptr)
+			{
+				Close();
+				return false;
+			}
+			m_data = static_cast<const ByteType*>(MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0));
+			if (m_data == nullptr)
+			{
+				Close();
+				return false;
+			}
+			m_size = static_cast<size_t>(fileSize.QuadPart);
+#else
+			const int fd = ::open(path.c_str(), O_RDONLY);
+			if (fd < 0)
+				return false;
+			struct stat fileStat {};
+			if (::fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+			{
+				::close(fd);
+				return false;
+			}
+			void* mapped = ::mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_SHARED, fd, 0);
+			//the mapping holds its own reference to the file, the descriptor is no longer needed.
+			::close(fd);
+			if (mapped == MAP_FAILED)
+				return false;
+			m_data = static_cast<const ByteType*>(mapped);
+			m_size = static_cast<size_t>(fileStat.st_size);
+#endif
+			return true;
+		}
+		/// <summary>Hints to the OS that the range will be read soon, a no-op where unsupported.</summary>
+		void WillNeed(size_t offset, size_t length) const
+		{
+#ifndef _WIN32
+			if (m_data == nullptr || offset >= m_size)
+				return;
+			//madvise needs a page aligned start address.
+			const auto pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+			const size_t alignedOffset = offset - (offset % pageSize);
+			length = std::min(length + (offset - alignedOffset), m_size - alignedOffset);
+			::madvise(const_cast<ByteType*>(m_data) + alignedOffset, length, MADV_WILLNEED);
+#else
+			(void)offset;
+			(void)length;
+#endif
+		}
+		void Close()
+		{
+#ifdef _WIN32
+			if (m_data != nullptr)
+				UnmapViewOfFile(m_data);
+			if (m_mappingHandle != nullptr)
+				CloseHandle(m_mappingHandle);
+			if (m_fileHandle != INVALID_HANDLE_VALUE)
+				CloseHandle(m_fileHandle);
+			m_mappingHandle = nullptr;
+			m_fileHandle = INVALID_HANDLE_VALUE;
+#else
+			if (m_data != nullptr)
+				::munmap(const_cast<ByteType*>(m_data), m_size);
+#endif
+			m_data = nullptr;
+			m_size = 0;
+		}
+		[[nodiscard]] bool IsOpen() const noexcept { return m_data != nullptr; }
+		[[nodiscard]] size_t Size() const noexcept { return m_size; }
+		[[nodiscard]] std::span<const ByteType> Bytes() const noexcept { return { m_data, m_size }; }
+	private:
+		const ByteType* m_data = nullptr;
+		size_t m_size = 0;
+#ifdef _WIN32
+		HANDLE m_fileHandle = INVALID_HANDLE_VALUE;
+		HANDLE m_mappingHandle = nullptr;
+#endif
+	};
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "stdafx.h"
+#include <span>
+#include <string_view>
+#include "Idx3MappedDataset.hpp"
+#include "IdxFile.hpp"
+
+namespace Idx3Lib
+{
+	/// <summary>
+	/// An IDX3 image file paired with its IDX1 label file, both memory mapped. Opening validates that the labels are
+	/// a rank 1 unsigned byte vector with exactly one label per image. Images and labels are zero-copy views.
+	/// </summary>
+	class MnistDataset
+	{
+	public:
+		using Bits8Type = Idx3HeaderData::Bits8Type;
+		using LabelType = std::uint8_t;
+		MnistDataset() = default;
+		MnistDataset(const std::string& imagesPath, const std::string& labelsPath) { Open(imagesPath, labelsPath); }
+
+		/// <summary>Opens both files, returns false on failure, see <c>ErrorMessage()</c>.</summary>
+		bool Open(const std::string& imagesPath, const std::string& labelsPath)
+		{
+			m_labels = {};
+			if (!m_images.Open(imagesPath))
+				return SetError(imagesPath + ": " + std::string(m_images.ErrorMessage()));
+			if (!m_labelFile.Open(labelsPath))
+				return SetError(labelsPath + ": " + std::string(m_labelFile.ErrorMessage()));
+			const IdxHeader& labelHeader = m_labelFile.Header();
+			if (labelHeader.Rank() != 1 || labelHeader.type != IdxDataType::UnsignedByte)
+				return SetError(labelsPath + ": expected an IDX1 unsigned byte label file.");
+			if (labelHeader.ItemCount() != m_images.ImageCount())
+				return SetError("Image and label counts differ: " + std::to_string(m_images.ImageCount()) + " images, " + std::to_string(labelHeader.ItemCount()) + " labels.");
+			m_labels = m_labelFile.Items<LabelType>();
+			m_errorMessage.clear();
+			return true;
+		}
+		[[nodiscard]] bool IsOpen() const noexcept { return m_images.IsOpen() && m_labelFile.IsOpen() && m_errorMessage.empty(); }
+		[[nodiscard]] size_t Count() const noexcept { return m_labels.size(); }
+		[[nodiscard]] size_t ImageSize() const noexcept { return m_images.ImageSize(); }
+		[[nodiscard]] std::span<const Bits8Type> Image(size_t index) const noexcept { return m_images[index]; }
+		[[nodiscard]] LabelType Label(size_t index) const noexcept { return m_labels[index]; }
+		[[nodiscard]] std::span<const LabelType> Labels() const noexcept { return m_labels; }
+		[[nodiscard]] const Idx3MappedDataset& Images() const noexcept { return m_images; }
+		[[nodiscard]] std::string_view ErrorMessage() const noexcept { return m_errorMessage; }
+	private:
+		bool SetError(std::string message)
+		{
+			m_errorMessage = std::move(message);
+			m_images.Close();
+			m_labels = {};
+			return false;
+		}
+		Idx3MappedDataset m_images;
+		IdxMappedFile m_labelFile;
+		std::span<const LabelType> m_labels;
+		std::string m_errorMessage;
+	};
+}
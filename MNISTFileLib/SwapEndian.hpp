@@ -1,17 +1,224 @@
 #pragma once
+#include <bit>
 #include <climits>
-//Stackoverflow user Alexandre C.
-template <typename T>
-T swap_endian(T u)
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <type_traits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SWAPENDIAN_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+//MSVC emits any intrinsic without a per-function target, the caller is responsible for the CPUID check.
+#define SWAPENDIAN_TARGET_SSSE3
+#define SWAPENDIAN_TARGET_AVX2
+#else
+#define SWAPENDIAN_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define SWAPENDIAN_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+/// <summary>Reverses the byte order of one value of 1, 2, 4 or 8 bytes, floats included. Single bytes are returned as is,
+///	wider values compile to a single bswap/rev instruction and can be used in constant expressions.</summary>
+template <typename T> requires (std::is_trivially_copyable_v<T> && (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8))
+[[nodiscard]] constexpr T swap_endian(T u) noexcept
 {
 	static_assert (CHAR_BIT == 8, "CHAR_BIT != 8");
-	union
-	{
-		T u;
-		unsigned char u8[sizeof(T)];
-	} source, dest;
-	source.u = u;
-	for (size_t k = 0; k < sizeof(T); k++)
-		dest.u8[k] = source.u8[sizeof(T) - k - 1];
-	return dest.u;
-}
\ No newline at end of file
+	if constexpr (sizeof(T) == 1)
+		return u;
+	else
+	{
+		using Bits = std::conditional_t<sizeof(T) == 2, std::uint16_t, std::conditional_t<sizeof(T) == 4, std::uint32_t, std::uint64_t>>;
+		auto bits = std::bit_cast<Bits>(u);
+#if defined(__cpp_lib_byteswap)
+		bits = std::byteswap(bits);
+#elif defined(__GNUC__) || defined(__clang__)
+		if constexpr (sizeof(T) == 2)
+			bits = __builtin_bswap16(bits);
+		else if constexpr (sizeof(T) == 4)
+			bits = __builtin_bswap32(bits);
+		else
+			bits = __builtin_bswap64(bits);
+#else
+		Bits swapped = 0;
+		for (size_t k = 0; k < sizeof(T); k++, bits >>= 8)
+			swapped = static_cast<Bits>((swapped << 8) | (bits & 0xFF));
+		bits = swapped;
+#endif
+		return std::bit_cast<T>(bits);
+	}
+}
+
+/// <summary>Byte order conversion of whole arrays, e.g. the int16/int32/float/double payload of an IDX file. The widest
+///	byte shuffle the running CPU supports (AVX2, then SSSE3, then scalar bswap) is selected once at runtime via CPUID.</summary>
+namespace Endian
+{
+	enum class Kernel
+	{
+		Scalar,
+		SSSE3,
+		AVX2
+	};
+
+	[[nodiscard]] inline const char* ToString(Kernel kernel) noexcept
+	{
+		switch (kernel)
+		{
+		case Kernel::AVX2: return "AVX2";
+		case Kernel::SSSE3: return "SSSE3";
+		default: return "Scalar";
+		}
+	}
+
+	/// <summary>The widest byte shuffle usable on this CPU and OS, computed once.</summary>
+	[[nodiscard]] inline Kernel DetectKernel() noexcept
+	{
+		static const Kernel detected = []()
+		{
+#if defined(SWAPENDIAN_X86) && defined(_MSC_VER)
+			int info[4]{};
+			__cpuid(info, 0);
+			const int maxLeaf = info[0];
+			__cpuid(info, 1);
+			const bool hasSsse3 = (info[2] & (1 << 9)) != 0;
+			const bool hasOsxsave = (info[2] & (1 << 27)) != 0;
+			if (maxLeaf >= 7 && hasOsxsave && (_xgetbv(0) & 0x6) == 0x6)
+			{
+				__cpuidex(info, 7, 0);
+				if ((info[1] & (1 << 5)) != 0)
+					return Kernel::AVX2;
+			}
+			return hasSsse3 ? Kernel::SSSE3 : Kernel::Scalar;
+#elif defined(SWAPENDIAN_X86)
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2"))
+				return Kernel::AVX2;
+			return __builtin_cpu_supports("ssse3") ? Kernel::SSSE3 : Kernel::Scalar;
+#else
+			return Kernel::Scalar;
+#endif
+		}();
+		return detected;
+	}
+
+	namespace Detail
+	{
+		using SwapFn = void(*)(const std::uint8_t* source, std::uint8_t* destination, size_t count);
+
+		template<size_t Size>
+		using Bits = std::conditional_t<Size == 2, std::uint16_t, std::conditional_t<Size == 4, std::uint32_t, std::uint64_t>>;
+
+		template<size_t Size>
+		void SwapScalar(const std::uint8_t* source, std::uint8_t* destination, size_t count) noexcept
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				Bits<Size> value;
+				std::memcpy(&value, source + i * Size, Size);
+				value = swap_endian(value);
+				std::memcpy(destination + i * Size, &value, Size);
+			}
+		}
+
+#ifdef SWAPENDIAN_X86
+		/// <summary>pshufb control reversing each <c>Size</c> byte group of a 16 byte lane.</summary>
+		template<size_t Size>
+		constexpr std::uint8_t ShuffleByte(int index) noexcept { return static_cast<std::uint8_t>(index / Size * Size + (Size - 1 - index % Size)); }
+
+		template<size_t Size>
+		SWAPENDIAN_TARGET_SSSE3 void SwapSSSE3(const std::uint8_t* source, std::uint8_t* destination, size_t count) noexcept
+		{
+			const __m128i control = _mm_setr_epi8(
+				ShuffleByte<Size>(0), ShuffleByte<Size>(1), ShuffleByte<Size>(2), ShuffleByte<Size>(3), ShuffleByte<Size>(4), ShuffleByte<Size>(5), ShuffleByte<Size>(6), ShuffleByte<Size>(7),
+				ShuffleByte<Size>(8), ShuffleByte<Size>(9), ShuffleByte<Size>(10), ShuffleByte<Size>(11), ShuffleByte<Size>(12), ShuffleByte<Size>(13), ShuffleByte<Size>(14), ShuffleByte<Size>(15));
+			const size_t byteCount = count * Size;
+			size_t i = 0;
+			for (; i + 32 <= byteCount; i += 32)
+			{
+				const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+				const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i + 16));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), _mm_shuffle_epi8(a, control));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i + 16), _mm_shuffle_epi8(b, control));
+			}
+			for (; i + 16 <= byteCount; i += 16)
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i)), control));
+			SwapScalar<Size>(source + i, destination + i, (byteCount - i) / Size);
+		}
+
+		template<size_t Size>
+		SWAPENDIAN_TARGET_AVX2 void SwapAVX2(const std::uint8_t* source, std::uint8_t* destination, size_t count) noexcept
+		{
+			//vpshufb shuffles within each 128 bit lane, both lanes take the same control.
+			const __m256i control = _mm256_setr_epi8(
+				ShuffleByte<Size>(0), ShuffleByte<Size>(1), ShuffleByte<Size>(2), ShuffleByte<Size>(3), ShuffleByte<Size>(4), ShuffleByte<Size>(5), ShuffleByte<Size>(6), ShuffleByte<Size>(7),
+				ShuffleByte<Size>(8), ShuffleByte<Size>(9), ShuffleByte<Size>(10), ShuffleByte<Size>(11), ShuffleByte<Size>(12), ShuffleByte<Size>(13), ShuffleByte<Size>(14), ShuffleByte<Size>(15),
+				ShuffleByte<Size>(0), ShuffleByte<Size>(1), ShuffleByte<Size>(2), ShuffleByte<Size>(3), ShuffleByte<Size>(4), ShuffleByte<Size>(5), ShuffleByte<Size>(6), ShuffleByte<Size>(7),
+				ShuffleByte<Size>(8), ShuffleByte<Size>(9), ShuffleByte<Size>(10), ShuffleByte<Size>(11), ShuffleByte<Size>(12), ShuffleByte<Size>(13), ShuffleByte<Size>(14), ShuffleByte<Size>(15));
+			const size_t byteCount = count * Size;
+			size_t i = 0;
+			for (; i + 64 <= byteCount; i += 64)
+			{
+				const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i));
+				const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i + 32));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + i), _mm256_shuffle_epi8(a, control));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + i + 32), _mm256_shuffle_epi8(b, control));
+			}
+			for (; i + 32 <= byteCount; i += 32)
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + i), _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i)), control));
+			SwapScalar<Size>(source + i, destination + i, (byteCount - i) / Size);
+		}
+#endif
+
+		template<size_t Size>
+		[[nodiscard]] SwapFn GetSwap(Kernel kernel) noexcept
+		{
+#ifdef SWAPENDIAN_X86
+			if (kernel == Kernel::AVX2)
+				return &SwapAVX2<Size>;
+			if (kernel == Kernel::SSSE3)
+				return &SwapSSSE3<Size>;
+#endif
+			(void)kernel;
+			return &SwapScalar<Size>;
+		}
+	}
+
+	/// <summary>Copies <c>count</c> elements from <c>source</c>, which need not be aligned, to <c>destination</c> reversing
+	///	the byte order of each. <c>source</c> may equal <c>destination</c> but must not otherwise overlap it.</summary>
+	template<typename T> requires std::is_trivially_copyable_v<T>
+	void SwapCopy(const void* source, T* destination, size_t count, Kernel kernel = DetectKernel()) noexcept
+	{
+		if constexpr (sizeof(T) == 1)
+		{
+			if (count != 0 && source != destination)
+				std::memcpy(destination, source, count);
+		}
+		else
+		{
+			static_assert(sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8, "only 1, 2, 4 and 8 byte elements are supported");
+			Detail::GetSwap<sizeof(T)>(kernel)(static_cast<const std::uint8_t*>(source), reinterpret_cast<std::uint8_t*>(destination), count);
+		}
+	}
+	/// <summary>Reverses the byte order of every element of <c>values</c> in place.</summary>
+	template<typename T> requires std::is_trivially_copyable_v<T>
+	void SwapInPlace(std::span<T> values, Kernel kernel = DetectKernel()) noexcept
+	{
+		SwapCopy(values.data(), values.data(), values.size(), kernel);
+	}
+	/// <summary>Copies <c>count</c> big endian elements from <c>source</c> into native order, a plain copy for single byte
+	///	elements or on a big endian host.</summary>
+	template<typename T> requires std::is_trivially_copyable_v<T>
+	void FromBigEndian(const void* source, T* destination, size_t count) noexcept
+	{
+		if constexpr (sizeof(T) == 1 || std::endian::native == std::endian::big)
+		{
+			if (count != 0 && source != destination)
+				std::memcpy(destination, source, count * sizeof(T));
+		}
+		else
+			SwapCopy(source, destination, count);
+	}
+}
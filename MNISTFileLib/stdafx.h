@@ -6,7 +6,9 @@
 #define WIN32_LEAN_AND_MEAN
 #endif
 //Windows.h is included only to ensure compatibility with Windows.h macros and other goodies.
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 #include <iostream>
 #include <fstream>
 #include <random>
@@ -18,7 +20,9 @@
 #include <numeric>
 #include <typeinfo>
 #include <exception>
+#if __has_include(<format>)
 #include <format>
+#endif
 #include <iomanip>
 #include <utility>
 #include <unordered_map>
\ No newline at end of file
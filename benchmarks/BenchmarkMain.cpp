@@ -0,0 +1,57 @@
+#include "BenchmarkSupport.hpp"
+#include <cstring>
+#include <iostream>
+#include "../feedforwardnetmnist/DotKernels.hpp"
+
+#ifndef IDX3_BENCH_REVISION
+#define IDX3_BENCH_REVISION "unknown"
+#endif
+
+/// Benchmark driver. Besides the usual --benchmark_* flags it accepts:
+///	  --idx3_images=N  number of images in the synthetic IDX3 file (default 60000)
+///	  --idx3_rows=N, --idx3_columns=N  image dimensions (default 28 x 28)
+///	  --idx3_dir=PATH  where the synthetic files are written (default the system temp directory)
+/// Use --benchmark_out=results.json --benchmark_out_format=json to record results for comparison across versions.
+int main(int argc, char** argv)
+{
+	Bench::BenchmarkConfig& config = Bench::Config();
+	int remaining = 1;
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string_view arg(argv[i]);
+		const auto Value = [&arg](std::string_view name) -> const char*
+		{
+			return arg.starts_with(name) && arg.size() > name.size() && arg[name.size()] == '=' ? arg.data() + name.size() + 1 : nullptr;
+		};
+		if (const char* value = Value("--idx3_images"))
+			config.ImageCount = std::stoull(value);
+		else if (const char* value = Value("--idx3_rows"))
+			config.Rows = std::stoull(value);
+		else if (const char* value = Value("--idx3_columns"))
+			config.Columns = std::stoull(value);
+		else if (const char* value = Value("--idx3_dir"))
+			config.Directory = value;
+		else
+			argv[remaining++] = argv[i];
+	}
+	argc = remaining;
+	if (config.ImageCount == 0 || config.ImageSize() == 0)
+	{
+		std::cerr << "--idx3_images, --idx3_rows and --idx3_columns must be non-zero." << std::endl;
+		return 1;
+	}
+
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv))
+		return 1;
+	benchmark::AddCustomContext("revision", IDX3_BENCH_REVISION);
+	benchmark::AddCustomContext("instruction_set", DotKernels::ToString(DotKernels::DetectInstructionSet()));
+	benchmark::AddCustomContext("idx3_images", std::to_string(config.ImageCount));
+	benchmark::AddCustomContext("idx3_image_size", std::to_string(config.Rows) + "x" + std::to_string(config.Columns));
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	std::error_code ignored;
+	std::filesystem::remove(config.SyntheticPath(), ignored);
+	std::filesystem::remove(config.GzipPath(), ignored);
+	return 0;
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../MNISTFileLib/Idx3Writer.hpp"
+#include "../MNISTFileLib/CompressedFileReader.hpp"
+#include "../feedforwardnetmnist/BuildRandom.hpp"
+#include "../tests/AllocationHook.hpp"
+
+namespace Bench
+{
+	/// <summary>Settings shared by every benchmark, filled from the command line in <c>main</c>.</summary>
+	struct BenchmarkConfig
+	{
+		size_t ImageCount = 60'000;
+		size_t Rows = 28;
+		size_t Columns = 28;
+		std::filesystem::path Directory = std::filesystem::temp_directory_path();
+
+		[[nodiscard]] size_t ImageSize() const noexcept { return Rows * Columns; }
+		[[nodiscard]] std::filesystem::path SyntheticPath() const { return Directory / ("idx3bench-" + std::to_string(ImageCount) + ".idx3-ubyte"); }
+		[[nodiscard]] std::filesystem::path CopyPath() const { return Directory / "idx3bench-copy.idx3-ubyte"; }
+		[[nodiscard]] std::filesystem::path GzipPath() const { return Directory / ("idx3bench-" + std::to_string(ImageCount) + ".idx3-ubyte.gz"); }
+	};
+
+	inline BenchmarkConfig& Config()
+	{
+		static BenchmarkConfig config;
+		return config;
+	}
+
+	/// <summary>Path of the synthetic IDX3 file, written on first use with <c>Config().ImageCount</c> random images.
+	///	Returns an empty string if the file could not be written.</summary>
+	inline const std::string& SyntheticIdx3File()
+	{
+		static const std::string path = []() -> std::string
+		{
+			const BenchmarkConfig& config = Config();
+			constexpr size_t ImagesPerChunk = 1024;
+			Idx3Lib::Idx3Writer writer;
+			if (!writer.Open(config.SyntheticPath().string(), config.Rows, config.Columns))
+				return {};
+			for (size_t written = 0; written < config.ImageCount; written += ImagesPerChunk)
+			{
+				const size_t pixelCount = std::min(ImagesPerChunk, config.ImageCount - written) * config.ImageSize();
+				const auto pixels = BuildRandom::BuildRandomVector<Idx3Lib::Idx3Writer::Bits8Type>(pixelCount, pixelCount);
+				if (!writer.AppendImages(pixels))
+					return {};
+			}
+			return writer.Close() ? config.SyntheticPath().string() : std::string{};
+		}();
+		return path;
+	}
+
+#ifdef IDX3_HAVE_ZLIB
+	/// <summary>Path of a gzipped copy of <c>SyntheticIdx3File()</c>, written on first use at the default compression level.
+	///	Returns an empty string if the file could not be written.</summary>
+	inline const std::string& SyntheticGzipFile()
+	{
+		static const std::string path = []() -> std::string
+		{
+			const std::string& source = SyntheticIdx3File();
+			const std::string target = Config().GzipPath().string();
+			std::ifstream in(source, std::ios::binary);
+			gzFile out = gzopen(target.c_str(), "wb");
+			if (source.empty() || !in || out == nullptr)
+				return {};
+			std::vector<char> chunk(Idx3Lib::CompressedFileReader::ChunkSize);
+			bool ok = true;
+			while (ok && in.read(chunk.data(), static_cast<std::streamsize>(chunk.size())).gcount() > 0)
+				ok = gzwrite(out, chunk.data(), static_cast<unsigned>(in.gcount())) == static_cast<int>(in.gcount());
+			return gzclose(out) == Z_OK && ok ? target : std::string{};
+		}();
+		return path;
+	}
+#endif
+
+	/// <summary>
+	/// Collects per-operation latencies inside a benchmark loop and reports percentiles as user counters
+	/// (<c>p50_ns</c>, <c>p90_ns</c>, <c>p99_ns</c>, <c>max_ns</c>), which end up in the JSON output next to the throughput.
+	/// Once <c>MaxSamples</c> is reached the oldest samples are overwritten.
+	/// </summary>
+	class LatencyRecorder
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+		static constexpr size_t MaxSamples = size_t{ 1 } << 20;
+
+		/// <summary>Times one call of <c>op</c>, which performs <c>opsPerCall</c> operations.</summary>
+		template<typename Op>
+		void Measure(Op&& op, size_t opsPerCall = 1)
+		{
+			const auto startTime = Clock::now();
+			op();
+			const std::chrono::duration<double, std::nano> elapsed = Clock::now() - startTime;
+			const double sample = elapsed.count() / static_cast<double>(opsPerCall);
+			if (m_samples.size() < MaxSamples)
+				m_samples.push_back(sample);
+			else
+				m_samples[m_recorded % MaxSamples] = sample;
+			m_recorded++;
+		}
+
+		void Report(benchmark::State& state)
+		{
+			if (m_samples.empty())
+				return;
+			std::sort(m_samples.begin(), m_samples.end());
+			const auto Percentile = [this](double p) { return m_samples[static_cast<size_t>(p * static_cast<double>(m_samples.size() - 1))]; };
+			state.counters["p50_ns"] = Percentile(0.50);
+			state.counters["p90_ns"] = Percentile(0.90);
+			state.counters["p99_ns"] = Percentile(0.99);
+			state.counters["max_ns"] = m_samples.back();
+		}
+	private:
+		std::vector<double> m_samples;
+		size_t m_recorded = 0;
+	};
+
+	/// <summary>
+	/// Counts the heap allocations made by the operations it measures, on any thread, and reports them as <c>allocations</c>
+	/// per iteration. A loop that is meant to be allocation free (<c>expectNone</c>) fails the benchmark instead, so a
+	/// regression shows up as an error rather than a number nobody reads.
+	/// </summary>
+	class AllocationCounter
+	{
+	public:
+		template<typename Op>
+		void Measure(Op&& op)
+		{
+			m_allocations += Test::CountAllocations(std::forward<Op>(op));
+		}
+
+		void Report(benchmark::State& state, bool expectNone)
+		{
+			state.counters["allocations"] = benchmark::Counter(static_cast<double>(m_allocations), benchmark::Counter::kAvgIterations);
+			if (expectNone && m_allocations != 0)
+				state.SkipWithError(("steady state loop made " + std::to_string(m_allocations) + " heap allocations").c_str());
+		}
+	private:
+		size_t m_allocations = 0;
+	};
+
+	/// <summary>Sums the bytes so reads cannot be optimized away.</summary>
+	[[nodiscard]] inline unsigned Checksum(std::span<const unsigned char> bytes) noexcept
+	{
+		unsigned sum = 0;
+		for (const auto elem : bytes)
+			sum += elem;
+		return sum;
+	}
+}
@@ -0,0 +1,327 @@
+#include "BenchmarkSupport.hpp"
+#include <cstring>
+#include <random>
+#include "../MNISTFileLib/Idx3HeaderData.hpp"
+#include "../MNISTFileLib/Idx3MappedDataset.hpp"
+#include "../MNISTFileLib/Idx3Dataset.hpp"
+#include "../MNISTFileLib/Idx3BatchReader.hpp"
+#include "../MNISTFileLib/Idx3Writer.hpp"
+#include "../MNISTFileLib/Idx3StreamReader.hpp"
+#include "../MNISTFileLib/Idx3PrefetchPipeline.hpp"
+#include "../MNISTFileLib/Idx3AsyncReader.hpp"
+#include "../MNISTFileLib/SwapEndian.hpp"
+
+namespace
+{
+	using Bits8Type = Idx3Lib::Idx3HeaderData::Bits8Type;
+
+	/// <summary>Opens the synthetic file mapped, skipping the benchmark if it is unavailable.</summary>
+	bool OpenSynthetic(benchmark::State& state, Idx3Lib::Idx3MappedDataset& dataset)
+	{
+		const std::string& path = Bench::SyntheticIdx3File();
+		if (path.empty() || !dataset.Open(path))
+		{
+			state.SkipWithError("failed to create the synthetic IDX3 file");
+			return false;
+		}
+		return true;
+	}
+
+	/// <summary>Decoding the 16 byte big endian header from memory.</summary>
+	void BM_HeaderParse(benchmark::State& state)
+	{
+		Idx3Lib::Idx3MappedDataset dataset;
+		if (!OpenSynthetic(state, dataset))
+			return;
+		//the header is just ahead of the first image in the mapping.
+		const std::span<const Bits8Type> headerBytes(dataset[0].data() - Idx3Lib::Idx3HeaderData::HeaderSize, Idx3Lib::Idx3HeaderData::HeaderSize);
+		constexpr size_t ParsesPerSample = 256;
+		Bench::LatencyRecorder latency;
+		Idx3Lib::Idx3HeaderData header;
+		for (auto _ : state)
+		{
+			latency.Measure([&]()
+			{
+				for (size_t i = 0; i < ParsesPerSample; i++)
+				{
+					benchmark::DoNotOptimize(Idx3Lib::Idx3HeaderData::FromBytes(headerBytes, header));
+					benchmark::ClobberMemory();
+				}
+			}, ParsesPerSample);
+		}
+		state.SetItemsProcessed(state.iterations() * ParsesPerSample);
+		state.SetBytesProcessed(state.iterations() * ParsesPerSample * Idx3Lib::Idx3HeaderData::HeaderSize);
+		latency.Report(state);
+	}
+	BENCHMARK(BM_HeaderParse);
+
+	/// <summary>Mapping the file and validating its header against the file size.</summary>
+	void BM_OpenMapped(benchmark::State& state)
+	{
+		const std::string& path = Bench::SyntheticIdx3File();
+		Bench::LatencyRecorder latency;
+		Idx3Lib::Idx3MappedDataset dataset;
+		for (auto _ : state)
+		{
+			latency.Measure([&]() { benchmark::DoNotOptimize(dataset.Open(path)); });
+			dataset.Close();
+		}
+		state.SetItemsProcessed(state.iterations());
+		latency.Report(state);
+	}
+	BENCHMARK(BM_OpenMapped);
+
+	/// <summary>Loading the whole synthetic file into memory with <c>Idx3Dataset::LoadSharded</c>, the argument is the shard
+	///	count. Warm cache load time should fall with the shard count up to the number of cores.</summary>
+	void BM_LoadSharded(benchmark::State& state)
+	{
+		const std::string& path = Bench::SyntheticIdx3File();
+		Idx3Lib::Idx3Dataset dataset;
+		Bench::LatencyRecorder latency;
+		for (auto _ : state)
+		{
+			bool ok = true;
+			latency.Measure([&]() { ok = dataset.LoadSharded(path, static_cast<size_t>(state.range(0))); });
+			if (!ok)
+			{
+				state.SkipWithError(std::string(dataset.ErrorMessage()).c_str());
+				return;
+			}
+		}
+		state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(dataset.ImageCount()));
+		state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(dataset.Pixels().size()));
+		latency.Report(state);
+	}
+	BENCHMARK(BM_LoadSharded)->RangeMultiplier(2)->Range(1, 16)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+	/// <summary>Sequential pass over the mapped file, one batch of images per iteration, the argument is the batch size.</summary>
+	void BM_SequentialReadMapped(benchmark::State& state)
+	{
+		Idx3Lib::Idx3MappedDataset dataset;
+		if (!OpenSynthetic(state, dataset))
+			return;
+		const auto batchSize = std::min(static_cast<size_t>(state.range(0)), dataset.ImageCount());
+		Bench::LatencyRecorder latency;
+		size_t position = 0;
+		for (auto _ : state)
+		{
+			if (position + batchSize > dataset.ImageCount())
+				position = 0;
+			latency.Measure([&]() { benchmark::DoNotOptimize(Bench::Checksum(dataset.Images(position, batchSize))); });
+			position += batchSize;
+		}
+		state.SetItemsProcessed(state.iterations() * batchSize);
+		state.SetBytesProcessed(state.iterations() * batchSize * dataset.ImageSize());
+		latency.Report(state);
+	}
+	BENCHMARK(BM_SequentialReadMapped)->Arg(1)->Arg(64)->Arg(1024);
+
+	/// <summary>Sequential pass through <c>Idx3BatchReader</c>, one bulk read per batch, the argument is the batch size.</summary>
+	void BM_SequentialReadStream(benchmark::State& state)
+	{
+		Idx3Lib::Idx3BatchReader reader;
+		if (Bench::SyntheticIdx3File().empty() || !reader.Open(Bench::SyntheticIdx3File()))
+		{
+			state.SkipWithError("failed to open the synthetic IDX3 file");
+			return;
+		}
+		Idx3Lib::Idx3Batch<> batch(static_cast<size_t>(state.range(0)), reader.ImageSize());
+		Bench::LatencyRecorder latency;
+		size_t imagesRead = 0;
+		for (auto _ : state)
+		{
+			if (reader.Remaining() == 0)
+				reader.Seek(0);
+			latency.Measure([&]() { imagesRead += reader.ReadBatch(batch); }, 1);
+			benchmark::DoNotOptimize(batch.data.data());
+		}
+		state.SetItemsProcessed(static_cast<int64_t>(imagesRead));
+		state.SetBytesProcessed(static_cast<int64_t>(imagesRead * reader.ImageSize()));
+		latency.Report(state);
+	}
+	BENCHMARK(BM_SequentialReadStream)->Arg(1)->Arg(64)->Arg(1024);
+
+	/// <summary>Uniformly random single image reads from the mapped file.</summary>
+	void BM_RandomAccessRead(benchmark::State& state)
+	{
+		Idx3Lib::Idx3MappedDataset dataset;
+		if (!OpenSynthetic(state, dataset))
+			return;
+		std::mt19937 engine(42);
+		std::uniform_int_distribution<size_t> indexDist(0, dataset.ImageCount() - 1);
+		std::vector<size_t> indices(4096);
+		for (auto& elem : indices)
+			elem = indexDist(engine);
+		Bench::LatencyRecorder latency;
+		size_t next = 0;
+		for (auto _ : state)
+		{
+			const size_t index = indices[next++ % indices.size()];
+			latency.Measure([&]() { benchmark::DoNotOptimize(Bench::Checksum(dataset[index])); });
+		}
+		state.SetItemsProcessed(state.iterations());
+		state.SetBytesProcessed(state.iterations() * dataset.ImageSize());
+		latency.Report(state);
+	}
+	BENCHMARK(BM_RandomAccessRead);
+
+	/// <summary>Batches of 256 uniformly random images read from disk by <c>Idx3AsyncReader</c>, the argument selects the
+	///	backend, 0 pread, 1 io_uring. The file is usually in the page cache here, the gap widens on a cold cache.</summary>
+	void BM_RandomBatchAsync(benchmark::State& state)
+	{
+		const auto backend = state.range(0) == 1 ? Idx3Lib::AsyncBackend::IoUring : Idx3Lib::AsyncBackend::PRead;
+		Idx3Lib::Idx3AsyncReader reader;
+		if (Bench::SyntheticIdx3File().empty() || !reader.Open(Bench::SyntheticIdx3File(), { .Backend = backend }))
+		{
+			state.SkipWithError(backend == Idx3Lib::AsyncBackend::IoUring ? "io_uring unavailable" : "failed to open the synthetic IDX3 file");
+			return;
+		}
+		state.SetLabel(Idx3Lib::ToString(reader.Backend()));
+		constexpr size_t BatchSize = 256;
+		std::mt19937 engine(42);
+		std::uniform_int_distribution<size_t> indexDist(0, reader.ImageCount() - 1);
+		std::vector<size_t> indices(BatchSize * 64);
+		for (auto& elem : indices)
+			elem = indexDist(engine);
+		Idx3Lib::Idx3Batch<> batch(BatchSize, reader.ImageSize());
+		Bench::LatencyRecorder latency;
+		size_t next = 0;
+		size_t imagesRead = 0;
+		for (auto _ : state)
+		{
+			const auto slice = std::span<const size_t>(indices).subspan(next++ % 64 * BatchSize, BatchSize);
+			latency.Measure([&]() { imagesRead += reader.ReadImages(slice, batch); }, 1);
+			benchmark::DoNotOptimize(batch.data.data());
+		}
+		state.SetItemsProcessed(static_cast<int64_t>(imagesRead));
+		state.SetBytesProcessed(static_cast<int64_t>(imagesRead * reader.ImageSize()));
+		latency.Report(state);
+	}
+	BENCHMARK(BM_RandomBatchAsync)->Arg(0)->Arg(1);
+
+	/// <summary>Decoding a batch of raw pixels to normalized floats, the argument is the batch size.</summary>
+	void BM_DecodePixels(benchmark::State& state)
+	{
+		Idx3Lib::Idx3MappedDataset dataset;
+		if (!OpenSynthetic(state, dataset))
+			return;
+		const auto batchSize = std::min(static_cast<size_t>(state.range(0)), dataset.ImageCount());
+		const auto pixels = dataset.Images(0, batchSize);
+		Idx3Lib::AlignedBuffer<float> decoded(pixels.size());
+		Bench::LatencyRecorder latency;
+		for (auto _ : state)
+		{
+			latency.Measure([&]() { Idx3Lib::ConvertPixels(pixels, decoded.Span(), Idx3Lib::PixelScale::Normalized); });
+			benchmark::DoNotOptimize(decoded.data());
+		}
+		state.SetItemsProcessed(state.iterations() * batchSize);
+		state.SetBytesProcessed(state.iterations() * pixels.size());
+		latency.Report(state);
+	}
+	BENCHMARK(BM_DecodePixels)->Arg(1)->Arg(64)->Arg(1024);
+
+	/// <summary>Decoding 1 MiB of big endian floats, the payload of a 0x0D IDX file, the argument selects the byte swap
+	///	kernel (-1 is a plain copy for reference).</summary>
+	void BM_SwapEndian(benchmark::State& state)
+	{
+		const auto kernel = static_cast<Endian::Kernel>(state.range(0));
+		if (state.range(0) >= 0 && kernel > Endian::DetectKernel())
+		{
+			state.SkipWithError("instruction set not supported on this CPU");
+			return;
+		}
+		constexpr size_t Count = (size_t{ 1 } << 20) / sizeof(float);
+		std::vector<Bits8Type> bigEndian(Count * sizeof(float));
+		BuildRandom::Philox4x32(42).Fill(bigEndian);
+		Idx3Lib::AlignedBuffer<float> decoded(Count);
+		state.SetLabel(state.range(0) < 0 ? "memcpy" : Endian::ToString(kernel));
+		for (auto _ : state)
+		{
+			if (state.range(0) < 0)
+				std::memcpy(decoded.data(), bigEndian.data(), bigEndian.size());
+			else
+				Endian::SwapCopy(bigEndian.data(), decoded.data(), Count, kernel);
+			benchmark::DoNotOptimize(decoded.data());
+		}
+		state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(Count));
+		state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(bigEndian.size()));
+	}
+	BENCHMARK(BM_SwapEndian)->DenseRange(-1, static_cast<int>(Endian::Kernel::AVX2));
+
+	/// <summary>Copying the whole file through <c>Idx3BatchReader</c> and <c>Idx3Writer</c>, the argument is the batch size.</summary>
+	void BM_CopyToFile(benchmark::State& state)
+	{
+		const std::string& path = Bench::SyntheticIdx3File();
+		const std::string outPath = Bench::Config().CopyPath().string();
+		Idx3Lib::Idx3Batch<> batch;
+		Bench::LatencyRecorder latency;
+		size_t imagesCopied = 0;
+		for (auto _ : state)
+		{
+			bool ok = true;
+			latency.Measure([&]()
+			{
+				Idx3Lib::Idx3BatchReader reader;
+				Idx3Lib::Idx3Writer writer;
+				ok = reader.Open(path) && writer.Open(outPath, reader.Header().num_rows, reader.Header().num_columns);
+				batch.Reshape(static_cast<size_t>(state.range(0)), reader.ImageSize());
+				while (ok && reader.ReadBatch(batch) != 0)
+					ok = writer.AppendImages(batch);
+				ok = writer.Close() && ok;
+				imagesCopied += writer.ImagesWritten();
+			});
+			if (!ok)
+			{
+				state.SkipWithError("copy failed");
+				break;
+			}
+		}
+		std::filesystem::remove(outPath);
+		state.SetItemsProcessed(static_cast<int64_t>(imagesCopied));
+		state.SetBytesProcessed(static_cast<int64_t>(imagesCopied * Bench::Config().ImageSize()));
+		latency.Report(state);
+	}
+	BENCHMARK(BM_CopyToFile)->Arg(1024)->Unit(benchmark::kMillisecond);
+
+	/// <summary>A whole pass through <c>Idx3StreamReader</c> and the prefetch pipeline, decompression runs on the pipeline's
+	///	reader thread. The argument selects the source, 0 the raw file, 1 its gzipped copy. Bytes are uncompressed bytes.</summary>
+	void BM_StreamRead(benchmark::State& state)
+	{
+		std::string path = Bench::SyntheticIdx3File();
+#ifdef IDX3_HAVE_ZLIB
+		if (state.range(0) == 1)
+			path = Bench::SyntheticGzipFile();
+#else
+		if (state.range(0) == 1)
+			path.clear();
+#endif
+		if (path.empty())
+		{
+			state.SkipWithError("source file unavailable");
+			return;
+		}
+		state.SetLabel(state.range(0) == 1 ? "gzip" : "raw");
+		Bench::LatencyRecorder latency;
+		size_t imagesRead = 0;
+		std::uint64_t checksum = 0;
+		for (auto _ : state)
+		{
+			latency.Measure([&]()
+			{
+				Idx3Lib::Idx3StreamReader reader(path);
+				Idx3Lib::Idx3PrefetchPipeline<> pipeline;
+				pipeline.Start(reader, { .BatchSize = 1024, .PrefetchDepth = 4 });
+				while (const auto batch = pipeline.Next())
+				{
+					checksum += Bench::Checksum(batch->Filled());
+					imagesRead += batch->Count;
+				}
+			});
+		}
+		benchmark::DoNotOptimize(checksum);
+		state.SetItemsProcessed(static_cast<int64_t>(imagesRead));
+		state.SetBytesProcessed(static_cast<int64_t>(imagesRead * Bench::Config().ImageSize()));
+		latency.Report(state);
+	}
+	BENCHMARK(BM_StreamRead)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+}
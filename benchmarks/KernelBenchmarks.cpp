@@ -0,0 +1,356 @@
+#include "BenchmarkSupport.hpp"
+#include <atomic>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+#include "../feedforwardnetmnist/DotKernels.hpp"
+#include "../feedforwardnetmnist/Gemm.hpp"
+#include "../feedforwardnetmnist/Network.hpp"
+#include "../feedforwardnetmnist/Trainer.hpp"
+#include "../feedforwardnetmnist/ThreadPool.hpp"
+#include "../feedforwardnetmnist/QuantizedNetwork.hpp"
+#include "../feedforwardnetmnist/StaticNetwork.hpp"
+#include "../feedforwardnetmnist/ModelFile.hpp"
+#include "../feedforwardnetmnist/Augmentation.hpp"
+#include "../feedforwardnetmnist/InferenceServer.hpp"
+
+namespace
+{
+	constexpr size_t RowLength = 28 * 28;
+
+	std::vector<float> RandomFloats(size_t count, std::mt19937& engine)
+	{
+		std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+		std::vector<float> values(count);
+		for (auto& elem : values)
+			elem = dist(engine);
+		return values;
+	}
+
+	/// <summary>One image row of pixels against one row of weights, the argument selects the instruction set.</summary>
+	void BM_DotU8F32(benchmark::State& state)
+	{
+		const auto isa = static_cast<DotKernels::InstructionSet>(state.range(0));
+		if (isa > DotKernels::DetectInstructionSet())
+		{
+			state.SkipWithError("instruction set not supported on this CPU");
+			return;
+		}
+		std::mt19937 engine(42);
+		std::uniform_int_distribution<unsigned> pixelDist(0, 255);
+		std::vector<DotKernels::PixelType> pixels(RowLength);
+		for (auto& elem : pixels)
+			elem = static_cast<DotKernels::PixelType>(pixelDist(engine));
+		const auto weights = RandomFloats(RowLength, engine);
+		const auto kernel = DotKernels::GetDotU8F32(isa);
+		state.SetLabel(DotKernels::ToString(isa));
+		for (auto _ : state)
+			benchmark::DoNotOptimize(kernel(pixels.data(), weights.data(), RowLength));
+		state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(RowLength));
+	}
+	BENCHMARK(BM_DotU8F32)->DenseRange(static_cast<int>(DotKernels::InstructionSet::Scalar), static_cast<int>(DotKernels::InstructionSet::AVX2));
+
+	/// <summary>One image row of pixels against one row of int8 weights, the argument selects the kernel:
+	///	0-2 the instruction sets, 3 the VNNI kernel when the CPU has one.</summary>
+	void BM_DotU8S8(benchmark::State& state)
+	{
+		const bool vnni = state.range(0) == 3;
+		const auto isa = vnni ? DotKernels::InstructionSet::AVX2 : static_cast<DotKernels::InstructionSet>(state.range(0));
+		if (isa > DotKernels::DetectInstructionSet() || (vnni && DotKernels::DetectVnni() == DotKernels::VnniSupport::None))
+		{
+			state.SkipWithError("instruction set not supported on this CPU");
+			return;
+		}
+		std::mt19937 engine(42);
+		std::uniform_int_distribution<int> dist(-127, 255);
+		std::vector<DotKernels::PixelType> pixels(RowLength);
+		std::vector<DotKernels::QuantizedWeightType> weights(RowLength);
+		for (size_t i = 0; i < RowLength; i++)
+		{
+			pixels[i] = static_cast<DotKernels::PixelType>(std::abs(dist(engine)));
+			weights[i] = static_cast<DotKernels::QuantizedWeightType>(dist(engine) % 128);
+		}
+		const auto kernel = DotKernels::GetDotU8S8(isa, vnni ? DotKernels::DetectVnni() : DotKernels::VnniSupport::None);
+		state.SetLabel(vnni ? DotKernels::ToString(DotKernels::DetectVnni()) : DotKernels::ToString(isa));
+		for (auto _ : state)
+			benchmark::DoNotOptimize(kernel(pixels.data(), weights.data(), RowLength));
+		state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(RowLength));
+	}
+	BENCHMARK(BM_DotU8S8)->DenseRange(0, 3);
+
+	/// <summary>C[m x n] = A[m x k] * B[n x k]^T, arguments are m, n, k.</summary>
+	void BM_MatMulTransposedB(benchmark::State& state)
+	{
+		const auto m = static_cast<size_t>(state.range(0));
+		const auto n = static_cast<size_t>(state.range(1));
+		const auto k = static_cast<size_t>(state.range(2));
+		std::mt19937 engine(42);
+		const auto a = RandomFloats(m * k, engine);
+		const auto b = RandomFloats(n * k, engine);
+		std::vector<float> c(m * n);
+		Gemm::Workspace workspace;
+		for (auto _ : state)
+		{
+			Gemm::MatMulTransposedB(a.data(), k, b.data(), k, nullptr, c.data(), n, m, n, k, workspace);
+			benchmark::ClobberMemory();
+		}
+		state.counters["FLOPS"] = benchmark::Counter(2.0 * static_cast<double>(m * n * k), benchmark::Counter::kIsIterationInvariantRate);
+	}
+	BENCHMARK(BM_MatMulTransposedB)->Args({ 64, 128, 784 })->Args({ 256, 128, 784 })->Args({ 256, 10, 128 })->Args({ 512, 512, 512 });
+
+	/// <summary>Forward pass of a 784-128-10 network, the argument is the batch size (1 is single image inference).
+	///	Fails if a forward pass allocates once the network has reserved its buffers.</summary>
+	void BM_NetworkForward(benchmark::State& state)
+	{
+		const auto batchSize = static_cast<size_t>(state.range(0));
+		Network network;
+		network.AddLayer(DenseLayer(RowLength, 128, Activation::ReLU));
+		network.AddLayer(DenseLayer(128, 10, Activation::Softmax));
+		network.Reserve(batchSize);
+		std::mt19937 engine(42);
+		const auto input = RandomFloats(batchSize * RowLength, engine);
+		Bench::LatencyRecorder latency;
+		Bench::AllocationCounter allocations;
+		for (auto _ : state)
+			latency.Measure([&]() { allocations.Measure([&]() { benchmark::DoNotOptimize(network.Forward(input, batchSize).data()); }); });
+		state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(batchSize));
+		latency.Report(state);
+		allocations.Report(state, true);
+	}
+	BENCHMARK(BM_NetworkForward)->RangeMultiplier(4)->Range(1, 1024);
+
+	/// <summary>Single image forward pass of the same network with its shape fixed at compile time.</summary>
+	void BM_StaticForward(benchmark::State& state)
+	{
+		Network network;
+		network.AddLayer(DenseLayer(RowLength, 128, Activation::ReLU));
+		network.AddLayer(DenseLayer(128, 10, Activation::Softmax));
+		using MnistNetwork = StaticNetwork<StaticLayer<RowLength, 128, Activation::ReLU>, StaticLayer<128, 10, Activation::Softmax>>;
+		const auto staticNetwork = std::make_unique<MnistNetwork>();
+		if (!staticNetwork->Load(network))
+		{
+			state.SkipWithError("network shape does not match");
+			return;
+		}
+		std::mt19937 engine(42);
+		const auto input = RandomFloats(RowLength, engine);
+		const std::span<const float, RowLength> image(input.data(), RowLength);
+		Bench::LatencyRecorder latency;
+		for (auto _ : state)
+			latency.Measure([&]() { benchmark::DoNotOptimize(staticNetwork->Forward(image).data()); });
+		state.SetItemsProcessed(state.iterations());
+		latency.Report(state);
+	}
+	BENCHMARK(BM_StaticForward);
+
+	/// <summary>Int8 forward pass of the same network on raw pixels, the argument is the batch size.</summary>
+	void BM_QuantizedForward(benchmark::State& state)
+	{
+		const auto batchSize = static_cast<size_t>(state.range(0));
+		Network network;
+		network.AddLayer(DenseLayer(RowLength, 128, Activation::ReLU));
+		network.AddLayer(DenseLayer(128, 10, Activation::Softmax));
+		std::vector<DotKernels::PixelType> pixels(batchSize * RowLength);
+		BuildRandom::Philox4x32(42).Fill(pixels);
+		auto quantized = QuantizedNetwork::Calibrate(network, pixels, batchSize);
+		Bench::LatencyRecorder latency;
+		for (auto _ : state)
+			latency.Measure([&]() { benchmark::DoNotOptimize(quantized.Forward(pixels, batchSize).data()); });
+		state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(batchSize));
+		latency.Report(state);
+	}
+	BENCHMARK(BM_QuantizedForward)->RangeMultiplier(4)->Range(1, 1024);
+
+	/// <summary>Bulk uniform fill of a float array, the argument is the element count.</summary>
+	void BM_FillUniform(benchmark::State& state)
+	{
+		std::vector<float> values(static_cast<size_t>(state.range(0)));
+		BuildRandom::Philox4x32 engine;
+		for (auto _ : state)
+		{
+			engine.Fill(values, -1.0f, 1.0f);
+			benchmark::DoNotOptimize(values.data());
+		}
+		state.SetItemsProcessed(state.iterations() * state.range(0));
+	}
+	BENCHMARK(BM_FillUniform)->Arg(RowLength * 128);
+
+	/// <summary>Construction of a randomly initialized 784 x 128 layer.</summary>
+	void BM_DenseLayerInit(benchmark::State& state)
+	{
+		Bench::LatencyRecorder latency;
+		for (auto _ : state)
+			latency.Measure([&]() { benchmark::DoNotOptimize(DenseLayer(RowLength, 128, Activation::ReLU).m_weights.data()); });
+		state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(RowLength * 128));
+		latency.Report(state);
+	}
+	BENCHMARK(BM_DenseLayerInit);
+
+	/// <summary>Cold start of a mapped model file, the argument is the hidden layer width.</summary>
+	void BM_MappedModelOpen(benchmark::State& state)
+	{
+		const auto hidden = static_cast<size_t>(state.range(0));
+		Network network;
+		network.AddLayer(DenseLayer(RowLength, hidden, Activation::ReLU));
+		network.AddLayer(DenseLayer(hidden, 10, Activation::Softmax));
+		const std::string path = (Bench::Config().Directory / "idx3bench.model").string();
+		if (!ModelFile::Save(network, path))
+		{
+			state.SkipWithError("failed to save the model file");
+			return;
+		}
+		Bench::LatencyRecorder latency;
+		for (auto _ : state)
+		{
+			ModelFile::MappedModel model;
+			latency.Measure([&]() { benchmark::DoNotOptimize(model.Open(path)); });
+		}
+		std::filesystem::remove(path);
+		state.SetItemsProcessed(state.iterations());
+		latency.Report(state);
+	}
+	BENCHMARK(BM_MappedModelOpen)->Arg(128)->Arg(4096);
+
+	/// <summary>Bilinear resampling of one image at random source positions, the argument selects the instruction set
+	///	(SSE2 runs the scalar kernel).</summary>
+	void BM_Remap(benchmark::State& state)
+	{
+		const auto isa = static_cast<DotKernels::InstructionSet>(state.range(0));
+		if (isa > DotKernels::DetectInstructionSet())
+		{
+			state.SkipWithError("instruction set not supported on this CPU");
+			return;
+		}
+		std::mt19937 engine(42);
+		const auto source = RandomFloats(RowLength, engine);
+		std::vector<float> sourceX(RowLength), sourceY(RowLength), output(RowLength);
+		std::uniform_real_distribution<float> dist(-2.0f, 30.0f);
+		for (size_t i = 0; i < RowLength; i++)
+		{
+			sourceX[i] = dist(engine);
+			sourceY[i] = dist(engine);
+		}
+		const auto remap = Augmentation::GetRemap(isa);
+		state.SetLabel(DotKernels::ToString(isa));
+		for (auto _ : state)
+		{
+			remap(source.data(), 28, 28, sourceX.data(), sourceY.data(), output.data(), RowLength);
+			benchmark::DoNotOptimize(output.data());
+		}
+		state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(RowLength));
+	}
+	BENCHMARK(BM_Remap)->DenseRange(static_cast<int>(DotKernels::InstructionSet::Scalar), static_cast<int>(DotKernels::InstructionSet::AVX2));
+
+	/// <summary>One transform over a batch of 256 images, the argument selects it: 0 standardize, 1 random shift,
+	///	2 random rotation, 3 elastic distortion, 4 deskew.</summary>
+	void BM_AugmentBatch(benchmark::State& state)
+	{
+		constexpr size_t BatchSize = 256;
+		static const char* const Names[] = { "standardize", "shift", "rotation", "elastic", "deskew" };
+		const Augmentation::Transform transforms[] = { Augmentation::Standardize{}, Augmentation::RandomShift{}, Augmentation::RandomRotation{ 10.0f, 0.1f },
+			Augmentation::ElasticDistortion{}, Augmentation::Deskew{} };
+		const auto kind = static_cast<size_t>(state.range(0));
+		Augmentation::TransformChain chain(28, 28);
+		chain.Add(transforms[kind]);
+		std::mt19937 engine(42);
+		const auto pixels = RandomFloats(BatchSize * RowLength, engine);
+		Idx3Lib::Idx3Batch<float> batch(BatchSize, RowLength);
+		batch.Count = BatchSize;
+		Bench::LatencyRecorder latency;
+		std::uint64_t stream = 0;
+		state.SetLabel(Names[kind]);
+		for (auto _ : state)
+		{
+			//fresh pixels each pass so repeated transforms do not converge on a degenerate image.
+			std::copy(pixels.begin(), pixels.end(), batch.data.begin());
+			latency.Measure([&]() { chain.Apply(batch, stream++); }, BatchSize);
+			benchmark::DoNotOptimize(batch.data.data());
+		}
+		state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(BatchSize));
+		latency.Report(state);
+	}
+	BENCHMARK(BM_AugmentBatch)->DenseRange(0, 4);
+
+	/// <summary>One training step of a 784-128-10 network on a batch of 256, the argument is the thread count
+	///	(1 trains without a pool). Throughput should scale close to linearly while each thread gets 16 rows or more.
+	///	Fails if a step allocates once the trainer has reserved its buffers.</summary>
+	void BM_TrainBatch(benchmark::State& state)
+	{
+		constexpr size_t BatchSize = 256;
+		const auto threadCount = static_cast<size_t>(state.range(0));
+		ThreadPool pool(threadCount);
+		Network network;
+		network.AddLayer(DenseLayer(RowLength, 128, Activation::ReLU));
+		network.AddLayer(DenseLayer(128, 10, Activation::Softmax));
+		Trainer trainer(network, { .Type = OptimizerType::Adam, .LearningRate = 0.001f }, threadCount > 1 ? &pool : nullptr);
+		std::mt19937 engine(42);
+		const auto input = RandomFloats(BatchSize * RowLength, engine);
+		std::vector<Trainer::LabelType> labels(BatchSize);
+		for (size_t n = 0; n < BatchSize; n++)
+			labels[n] = static_cast<Trainer::LabelType>(n % 10);
+		trainer.Reserve(BatchSize);
+		//the optimizer sizes its moment estimates on the first step.
+		trainer.TrainBatch(input, labels, BatchSize);
+		Bench::AllocationCounter allocations;
+		for (auto _ : state)
+			allocations.Measure([&]() { benchmark::DoNotOptimize(trainer.TrainBatch(input, labels, BatchSize)); });
+		state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(BatchSize));
+		allocations.Report(state, true);
+	}
+	BENCHMARK(BM_TrainBatch)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+#ifndef _WIN32
+	/// <summary>Round trips to an in-process <c>InferenceServer</c> running the 784-128-10 network, the argument is the
+	///	number of clients sending concurrently. The measured client is one of them, <c>mean_batch</c> shows how far
+	///	the server coalesced their requests.</summary>
+	void BM_InferenceServer(benchmark::State& state)
+	{
+		const auto clientCount = static_cast<size_t>(state.range(0));
+		Network network;
+		network.AddLayer(DenseLayer(RowLength, 128, Activation::ReLU));
+		network.AddLayer(DenseLayer(128, 10, Activation::Softmax));
+		Idx3Lib::AlignedBuffer<float> decoded;
+		const auto evaluate = [&](std::span<const InferenceServer::PixelType> pixels, size_t batchSize)
+		{
+			decoded.Resize(pixels.size());
+			Idx3Lib::ConvertPixels<float>(pixels, decoded.Span());
+			return network.Forward(decoded.Span(), batchSize);
+		};
+		const std::string socketPath = (Bench::Config().Directory / "idx3bench.sock").string();
+		InferenceServer server;
+		if (!server.Start(socketPath, RowLength, 10, evaluate))
+		{
+			state.SkipWithError(std::string(server.ErrorMessage()).c_str());
+			return;
+		}
+		std::vector<InferenceServer::PixelType> image(RowLength);
+		BuildRandom::Philox4x32(42).Fill(image);
+		std::atomic<bool> stopping = false;
+		std::vector<std::thread> others;
+		for (size_t c = 1; c < clientCount; c++)
+			others.emplace_back([&]()
+			{
+				InferenceClient client;
+				if (client.Connect(socketPath, 10))
+					while (!stopping && client.Predict(image) >= 0) { }
+			});
+		InferenceClient client;
+		if (!client.Connect(socketPath, 10))
+			state.SkipWithError("failed to connect");
+		Bench::LatencyRecorder latency;
+		for (auto _ : state)
+			latency.Measure([&]() { benchmark::DoNotOptimize(client.Predict(image)); });
+		stopping = true;
+		server.Stop();
+		for (auto& other : others)
+			other.join();
+		const auto stats = server.Stats();
+		state.SetItemsProcessed(state.iterations());
+		state.counters["mean_batch"] = stats.MeanBatchSize();
+		state.counters["server_requests_per_s"] = stats.RequestsPerSecond();
+		latency.Report(state);
+	}
+	BENCHMARK(BM_InferenceServer)->RangeMultiplier(4)->Range(1, 64)->UseRealTime();
+#endif
+}
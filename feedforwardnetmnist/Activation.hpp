@@ -0,0 +1,80 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+/// <summary>Activation functions applied to a layer's <c>[rows x cols]</c> results in place, and their derivatives for back propagation.</summary>
+enum class Activation
+{
+	Identity,
+	Sigmoid,
+	ReLU,
+	Softmax // normalized across each row, only meaningful on the output layer
+};
+
+[[nodiscard]] inline const char* ToString(Activation activation) noexcept
+{
+	switch (activation)
+	{
+	case Activation::Sigmoid: return "Sigmoid";
+	case Activation::ReLU: return "ReLU";
+	case Activation::Softmax: return "Softmax";
+	default: return "Identity";
+	}
+}
+
+/// <summary>Applies <c>activation</c> to each of <c>rows</c> rows of <c>cols</c> values.</summary>
+inline void ApplyActivation(Activation activation, float* values, size_t rows, size_t cols) noexcept
+{
+	const size_t count = rows * cols;
+	switch (activation)
+	{
+	case Activation::Sigmoid:
+		for (size_t i = 0; i < count; i++)
+			values[i] = 1.0f / (1.0f + std::exp(-values[i]));
+		break;
+	case Activation::ReLU:
+		for (size_t i = 0; i < count; i++)
+			values[i] = std::max(values[i], 0.0f);
+		break;
+	case Activation::Softmax:
+		for (size_t r = 0; r < rows; r++)
+		{
+			float* row = values + r * cols;
+			//subtract the row max so exp() cannot overflow.
+			const float rowMax = *std::max_element(row, row + cols);
+			float sum = 0.0f;
+			for (size_t c = 0; c < cols; c++)
+			{
+				row[c] = std::exp(row[c] - rowMax);
+				sum += row[c];
+			}
+			const float inverse = 1.0f / sum;
+			for (size_t c = 0; c < cols; c++)
+				row[c] *= inverse;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/// <summary>Multiplies the gradient w.r.t. a layer's activated outputs by the activation's derivative, expressed in terms
+///	of the activated outputs, giving the gradient w.r.t. the pre-activation values. Softmax is left unchanged, its
+///	derivative is folded into the cross-entropy gradient of the output layer.</summary>
+inline void ApplyActivationDerivative(Activation activation, const float* activated, float* gradient, size_t count) noexcept
+{
+	switch (activation)
+	{
+	case Activation::Sigmoid:
+		for (size_t i = 0; i < count; i++)
+			gradient[i] *= activated[i] * (1.0f - activated[i]);
+		break;
+	case Activation::ReLU:
+		for (size_t i = 0; i < count; i++)
+			gradient[i] = activated[i] > 0.0f ? gradient[i] : 0.0f;
+		break;
+	default:
+		break;
+	}
+}
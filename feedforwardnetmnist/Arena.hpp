@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <span>
+#include <type_traits>
+#include "../MNISTFileLib/AlignedBuffer.hpp"
+
+/// <summary>
+/// Bump allocator over one preallocated block, for the intermediate buffers of a forward/backward pass.
+/// The owner works out the footprint of everything a step needs at its largest batch size with <c>Footprint</c>,
+/// reserves it once when the model is built, then hands out cache line aligned slices with <c>Allocate</c> and calls
+/// <c>Reset</c> before the next step. Resetting keeps the block, so a steady state loop does not touch the heap.
+/// </summary>
+class Arena
+{
+public:
+	static constexpr size_t Alignment = 64;
+
+	Arena() = default;
+	explicit Arena(size_t bytes) { Reserve(bytes); }
+
+	/// <summary>Bytes a slice of <c>count</c> <c>T</c> takes up, padded to the next cache line.</summary>
+	template<typename T>
+	[[nodiscard]] static constexpr size_t Footprint(size_t count) noexcept
+	{
+		return (count * sizeof(T) + Alignment - 1) / Alignment * Alignment;
+	}
+
+	/// <summary>Makes room for at least <c>bytes</c>. Growing replaces the block, which invalidates every slice handed out,
+	///	so it is only done between steps (at model build, or when a larger batch than planned for arrives).</summary>
+	///	<throws> std::bad_alloc on failure to allocate. </throws>
+	void Reserve(size_t bytes)
+	{
+		if (bytes > m_block.size())
+			m_block.Resize(bytes);
+		m_used = 0;
+	}
+	/// <summary>Releases every slice at once, the block is kept.</summary>
+	void Reset() noexcept { m_used = 0; }
+
+	/// <summary>Next <c>count</c> uninitialized elements, aligned to <c>Alignment</c>.</summary>
+	///	<throws> std::bad_alloc if the reserved block is exhausted, the owner's footprint is wrong. </throws>
+	template<typename T> requires std::is_trivially_copyable_v<T>
+	[[nodiscard]] std::span<T> Allocate(size_t count)
+	{
+		const size_t bytes = Footprint<T>(count);
+		if (bytes > m_block.size() - m_used)
+			throw std::bad_alloc();
+		T* slice = reinterpret_cast<T*>(m_block.data() + m_used);
+		m_used += bytes;
+		return { slice, count };
+	}
+
+	[[nodiscard]] size_t Capacity() const noexcept { return m_block.size(); }
+	[[nodiscard]] size_t Used() const noexcept { return m_used; }
+private:
+	Idx3Lib::AlignedBuffer<std::byte, Alignment> m_block;
+	size_t m_used = 0;
+};
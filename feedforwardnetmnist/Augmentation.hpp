@@ -0,0 +1,451 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <numbers>
+#include <random>
+#include <span>
+#include <variant>
+#include <vector>
+#include "../MNISTFileLib/AlignedBuffer.hpp"
+#include "../MNISTFileLib/Idx3BatchReader.hpp"
+#include "DotKernels.hpp"
+#include "RandomEngine.hpp"
+
+/// <summary>Online preprocessing and augmentation of decoded (float) image batches, applied in place.
+///	Every geometric transform is expressed as a per-pixel source coordinate and resolved by one bilinear resampling
+///	kernel, vectorized with AVX2 gathers and selected once at runtime like the dot product kernels. Pixels sampled from
+///	outside the image read as zero, the MNIST background. Scratch space is per thread and reused, so once warmed up the
+///	transforms perform no allocations and can run concurrently on the prefetch pipeline's reader threads.</summary>
+namespace Augmentation
+{
+	using RemapFn = void(*)(const float* src, size_t rows, size_t columns, const float* sourceX, const float* sourceY, float* dst, size_t count);
+	using ScaleShiftFn = void(*)(float* values, size_t count, float scale, float shift);
+	using AxpyFn = void(*)(float* out, const float* in, size_t count, float weight);
+
+	/// <summary>Portable resampling kernel: <c>dst[i]</c> is <c>src</c> bilinearly sampled at (<c>sourceX[i]</c>, <c>sourceY[i]</c>).</summary>
+	inline void RemapScalar(const float* src, size_t rows, size_t columns, const float* sourceX, const float* sourceY, float* dst, size_t count) noexcept
+	{
+		const auto width = static_cast<std::int64_t>(columns);
+		const auto height = static_cast<std::int64_t>(rows);
+		auto tap = [&](std::int64_t x, std::int64_t y) { return x >= 0 && x < width && y >= 0 && y < height ? src[y * width + x] : 0.0f; };
+		for (size_t i = 0; i < count; i++)
+		{
+			const float fx = std::floor(sourceX[i]);
+			const float fy = std::floor(sourceY[i]);
+			//far outside the image, also keeps the integer conversion in range.
+			if (!(fx > -2.0f && fx < static_cast<float>(columns) && fy > -2.0f && fy < static_cast<float>(rows)))
+			{
+				dst[i] = 0.0f;
+				continue;
+			}
+			const auto x0 = static_cast<std::int64_t>(fx);
+			const auto y0 = static_cast<std::int64_t>(fy);
+			const float wx = sourceX[i] - fx;
+			const float wy = sourceY[i] - fy;
+			const float top = tap(x0, y0) + wx * (tap(x0 + 1, y0) - tap(x0, y0));
+			const float bottom = tap(x0, y0 + 1) + wx * (tap(x0 + 1, y0 + 1) - tap(x0, y0 + 1));
+			dst[i] = top + wy * (bottom - top);
+		}
+	}
+	/// <summary><c>values[i] = values[i] * scale + shift</c>, written so the compiler can vectorize it.</summary>
+	inline void ScaleShiftScalar(float* values, size_t count, float scale, float shift) noexcept
+	{
+		for (size_t i = 0; i < count; i++)
+			values[i] = values[i] * scale + shift;
+	}
+	/// <summary><c>out[i] += weight * in[i]</c>, the inner step of the Gaussian blur.</summary>
+	inline void AxpyScalar(float* out, const float* in, size_t count, float weight) noexcept
+	{
+		for (size_t i = 0; i < count; i++)
+			out[i] += weight * in[i];
+	}
+
+#ifdef DOTKERNELS_X86
+	/// <summary>AVX2 resampling kernel, eight output pixels per step. Each of the four bilinear taps is a masked gather,
+	///	lanes whose tap lies outside the image are masked off and read as zero.</summary>
+	DOTKERNELS_TARGET_AVX2 inline void RemapAVX2(const float* src, size_t rows, size_t columns, const float* sourceX, const float* sourceY, float* dst, size_t count) noexcept
+	{
+		const __m256i width = _mm256_set1_epi32(static_cast<int>(columns));
+		const __m256i height = _mm256_set1_epi32(static_cast<int>(rows));
+		const __m256i minusOne = _mm256_set1_epi32(-1);
+		const __m256i one = _mm256_set1_epi32(1);
+		const __m256 lowLimit = _mm256_set1_ps(-2.0f);
+		const __m256 widthLimit = _mm256_set1_ps(static_cast<float>(columns));
+		const __m256 heightLimit = _mm256_set1_ps(static_cast<float>(rows));
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m256 sx = _mm256_loadu_ps(sourceX + i);
+			const __m256 sy = _mm256_loadu_ps(sourceY + i);
+			//clamp before converting so coordinates far outside cannot overflow, they are masked off either way.
+			const __m256 fx = _mm256_floor_ps(_mm256_min_ps(_mm256_max_ps(sx, lowLimit), widthLimit));
+			const __m256 fy = _mm256_floor_ps(_mm256_min_ps(_mm256_max_ps(sy, lowLimit), heightLimit));
+			const __m256 wx = _mm256_sub_ps(sx, fx);
+			const __m256 wy = _mm256_sub_ps(sy, fy);
+			const __m256i x0 = _mm256_cvtps_epi32(fx);
+			const __m256i y0 = _mm256_cvtps_epi32(fy);
+			const __m256i x1 = _mm256_add_epi32(x0, one);
+			const __m256i y1 = _mm256_add_epi32(y0, one);
+			const __m256i x0In = _mm256_and_si256(_mm256_cmpgt_epi32(x0, minusOne), _mm256_cmpgt_epi32(width, x0));
+			const __m256i x1In = _mm256_and_si256(_mm256_cmpgt_epi32(x1, minusOne), _mm256_cmpgt_epi32(width, x1));
+			const __m256i y0In = _mm256_and_si256(_mm256_cmpgt_epi32(y0, minusOne), _mm256_cmpgt_epi32(height, y0));
+			const __m256i y1In = _mm256_and_si256(_mm256_cmpgt_epi32(y1, minusOne), _mm256_cmpgt_epi32(height, y1));
+			const __m256i index00 = _mm256_add_epi32(_mm256_mullo_epi32(y0, width), x0);
+			const __m256i index10 = _mm256_add_epi32(index00, one);
+			const __m256i index01 = _mm256_add_epi32(index00, width);
+			const __m256i index11 = _mm256_add_epi32(index01, one);
+			const __m256 zero = _mm256_setzero_ps();
+			const __m256 v00 = _mm256_mask_i32gather_ps(zero, src, index00, _mm256_castsi256_ps(_mm256_and_si256(x0In, y0In)), 4);
+			const __m256 v10 = _mm256_mask_i32gather_ps(zero, src, index10, _mm256_castsi256_ps(_mm256_and_si256(x1In, y0In)), 4);
+			const __m256 v01 = _mm256_mask_i32gather_ps(zero, src, index01, _mm256_castsi256_ps(_mm256_and_si256(x0In, y1In)), 4);
+			const __m256 v11 = _mm256_mask_i32gather_ps(zero, src, index11, _mm256_castsi256_ps(_mm256_and_si256(x1In, y1In)), 4);
+			const __m256 top = _mm256_fmadd_ps(wx, _mm256_sub_ps(v10, v00), v00);
+			const __m256 bottom = _mm256_fmadd_ps(wx, _mm256_sub_ps(v11, v01), v01);
+			_mm256_storeu_ps(dst + i, _mm256_fmadd_ps(wy, _mm256_sub_ps(bottom, top), top));
+		}
+		RemapScalar(src, rows, columns, sourceX + i, sourceY + i, dst + i, count - i);
+	}
+	DOTKERNELS_TARGET_AVX2 inline void ScaleShiftAVX2(float* values, size_t count, float scale, float shift) noexcept
+	{
+		const __m256 s = _mm256_set1_ps(scale);
+		const __m256 t = _mm256_set1_ps(shift);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm256_storeu_ps(values + i, _mm256_fmadd_ps(_mm256_loadu_ps(values + i), s, t));
+		ScaleShiftScalar(values + i, count - i, scale, shift);
+	}
+	DOTKERNELS_TARGET_AVX2 inline void AxpyAVX2(float* out, const float* in, size_t count, float weight) noexcept
+	{
+		const __m256 w = _mm256_set1_ps(weight);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm256_storeu_ps(out + i, _mm256_fmadd_ps(w, _mm256_loadu_ps(in + i), _mm256_loadu_ps(out + i)));
+		AxpyScalar(out + i, in + i, count - i, weight);
+	}
+#endif
+
+	/// <summary>The resampling kernel for a specific instruction set. SSE2 has no gather, it uses the scalar kernel.</summary>
+	[[nodiscard]] inline RemapFn GetRemap(DotKernels::InstructionSet isa) noexcept
+	{
+#ifdef DOTKERNELS_X86
+		if (isa == DotKernels::InstructionSet::AVX2)
+			return &RemapAVX2;
+#endif
+		(void)isa;
+		return &RemapScalar;
+	}
+	[[nodiscard]] inline ScaleShiftFn GetScaleShift(DotKernels::InstructionSet isa) noexcept
+	{
+#ifdef DOTKERNELS_X86
+		if (isa == DotKernels::InstructionSet::AVX2)
+			return &ScaleShiftAVX2;
+#endif
+		(void)isa;
+		return &ScaleShiftScalar;
+	}
+	[[nodiscard]] inline AxpyFn GetAxpy(DotKernels::InstructionSet isa) noexcept
+	{
+#ifdef DOTKERNELS_X86
+		if (isa == DotKernels::InstructionSet::AVX2)
+			return &AxpyAVX2;
+#endif
+		(void)isa;
+		return &AxpyScalar;
+	}
+
+	/// <summary>Scratch buffers of the calling thread, grown on first use and reused afterwards.</summary>
+	struct Scratch
+	{
+		Idx3Lib::AlignedBuffer<float> source;
+		Idx3Lib::AlignedBuffer<float> sourceX;
+		Idx3Lib::AlignedBuffer<float> sourceY;
+		Idx3Lib::AlignedBuffer<float> fieldX;
+		Idx3Lib::AlignedBuffer<float> fieldY;
+		Idx3Lib::AlignedBuffer<float> blurred;
+		std::vector<float> kernel;
+
+		static Scratch& ForThread()
+		{
+			thread_local Scratch scratch;
+			return scratch;
+		}
+	};
+
+	/// <summary>One image of <c>Rows x Columns</c> pixels, row-major, transformed in place.</summary>
+	struct ImageView
+	{
+		float* Pixels;
+		size_t Rows;
+		size_t Columns;
+		[[nodiscard]] size_t Size() const noexcept { return Rows * Columns; }
+	};
+
+	/// <summary>Source coordinates of an affine map, <c>x' = XX*x + XY*y + X0</c>, <c>y' = YX*x + YY*y + Y0</c>, giving for every
+	///	output pixel (x, y) the input position it is sampled from.</summary>
+	struct AffineMap
+	{
+		float XX = 1.0f, XY = 0.0f, X0 = 0.0f;
+		float YX = 0.0f, YY = 1.0f, Y0 = 0.0f;
+
+		/// <summary>The map that samples around <c>(centerX, centerY)</c> of the input with <c>[XX XY; YX YY]</c> applied
+		///	around the image center of the output.</summary>
+		[[nodiscard]] static AffineMap AroundCenter(float xx, float xy, float yx, float yy, float centerX, float centerY, const ImageView& image) noexcept
+		{
+			const float cx = (static_cast<float>(image.Columns) - 1.0f) * 0.5f;
+			const float cy = (static_cast<float>(image.Rows) - 1.0f) * 0.5f;
+			return { xx, xy, centerX - xx * cx - xy * cy, yx, yy, centerY - yx * cx - yy * cy };
+		}
+	};
+
+	/// <summary>Resamples <c>image</c> in place through the source coordinates already in <c>scratch.sourceX/Y</c>.</summary>
+	inline void Resample(const ImageView& image, Scratch& scratch)
+	{
+		static const RemapFn remap = GetRemap(DotKernels::DetectInstructionSet());
+		scratch.source.Resize(image.Size());
+		std::memcpy(scratch.source.data(), image.Pixels, image.Size() * sizeof(float));
+		remap(scratch.source.data(), image.Rows, image.Columns, scratch.sourceX.data(), scratch.sourceY.data(), image.Pixels, image.Size());
+	}
+	/// <summary>Applies <c>map</c> to <c>image</c> in place.</summary>
+	inline void WarpAffine(const ImageView& image, const AffineMap& map, Scratch& scratch)
+	{
+		scratch.sourceX.Resize(image.Size());
+		scratch.sourceY.Resize(image.Size());
+		for (size_t y = 0; y < image.Rows; y++)
+		{
+			float* sx = scratch.sourceX.data() + y * image.Columns;
+			float* sy = scratch.sourceY.data() + y * image.Columns;
+			const float rowX = map.XY * static_cast<float>(y) + map.X0;
+			const float rowY = map.YY * static_cast<float>(y) + map.Y0;
+			for (size_t x = 0; x < image.Columns; x++)
+			{
+				sx[x] = map.XX * static_cast<float>(x) + rowX;
+				sy[x] = map.YX * static_cast<float>(x) + rowY;
+			}
+		}
+		Resample(image, scratch);
+	}
+
+	/// <summary>Mean/standard deviation standardization, <c>(x - Mean) / StdDev</c>. Apply it after the geometric transforms,
+	///	they assume a zero background.</summary>
+	struct Standardize
+	{
+		float Mean = 0.1307f;       // MNIST training set, normalized pixels
+		float StdDev = 0.3081f;
+	};
+
+	/// <summary>Random whole-pixel translation by up to <c>MaxShift</c> pixels in each direction, zero filled, equivalent to
+	///	padding by <c>MaxShift</c> and taking a random crop of the original size.</summary>
+	struct RandomShift
+	{
+		int MaxShift = 2;
+	};
+
+	/// <summary>Random rotation by up to <c>MaxDegrees</c> either way and scaling by up to <c>MaxScale</c> (0.1 = +/-10%)
+	///	about the image center.</summary>
+	struct RandomRotation
+	{
+		float MaxDegrees = 10.0f;
+		float MaxScale = 0.0f;
+	};
+
+	/// <summary>Elastic distortion (Simard, Steinkraus and Platt, 2003): a uniform random displacement field smoothed with
+	///	a Gaussian of <c>Sigma</c> pixels and scaled by <c>Alpha</c>.</summary>
+	struct ElasticDistortion
+	{
+		float Alpha = 34.0f;
+		float Sigma = 4.0f;
+	};
+
+	/// <summary>Removes slant by shearing each image so its principal axis is vertical and centering its center of mass,
+	///	computed from the image moments. Deterministic, so it belongs at both training and test time.</summary>
+	struct Deskew
+	{
+	};
+
+	using Transform = std::variant<Standardize, RandomShift, RandomRotation, ElasticDistortion, Deskew>;
+
+	inline void Apply(const Standardize& transform, std::span<float> pixels)
+	{
+		static const ScaleShiftFn scaleShift = GetScaleShift(DotKernels::DetectInstructionSet());
+		const float scale = 1.0f / transform.StdDev;
+		scaleShift(pixels.data(), pixels.size(), scale, -transform.Mean * scale);
+	}
+
+	inline void Apply(const RandomShift& transform, const ImageView& image, BuildRandom::Philox4x32& engine, Scratch& scratch)
+	{
+		std::uniform_int_distribution<int> shift(-transform.MaxShift, transform.MaxShift);
+		const int dx = shift(engine);
+		const int dy = shift(engine);
+		if (dx == 0 && dy == 0)
+			return;
+		scratch.source.Resize(image.Size());
+		std::memcpy(scratch.source.data(), image.Pixels, image.Size() * sizeof(float));
+		std::fill(image.Pixels, image.Pixels + image.Size(), 0.0f);
+		const auto rows = static_cast<int>(image.Rows);
+		const auto columns = static_cast<int>(image.Columns);
+		const int width = columns - std::abs(dx);
+		if (width <= 0)
+			return;
+		for (int y = std::max(0, dy); y < std::min(rows, rows + dy); y++)
+			std::memcpy(image.Pixels + static_cast<size_t>(y) * image.Columns + std::max(0, dx),
+				scratch.source.data() + static_cast<size_t>(y - dy) * image.Columns + std::max(0, -dx), static_cast<size_t>(width) * sizeof(float));
+	}
+
+	inline void Apply(const RandomRotation& transform, const ImageView& image, BuildRandom::Philox4x32& engine, Scratch& scratch)
+	{
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		const float angle = unit(engine) * transform.MaxDegrees * std::numbers::pi_v<float> / 180.0f;
+		const float scale = 1.0f + unit(engine) * transform.MaxScale;
+		//sampling uses the inverse map: rotate back by the angle and shrink by the scale.
+		const float c = std::cos(angle) / scale;
+		const float s = std::sin(angle) / scale;
+		const float cx = (static_cast<float>(image.Columns) - 1.0f) * 0.5f;
+		const float cy = (static_cast<float>(image.Rows) - 1.0f) * 0.5f;
+		WarpAffine(image, AffineMap::AroundCenter(c, s, -s, c, cx, cy, image), scratch);
+	}
+
+	/// <summary>In place separable Gaussian blur of a <c>rows x columns</c> field, zero outside the field.</summary>
+	inline void GaussianBlur(float* field, size_t rows, size_t columns, float sigma, Scratch& scratch)
+	{
+		const auto radius = static_cast<std::ptrdiff_t>(std::ceil(3.0f * sigma));
+		scratch.kernel.resize(static_cast<size_t>(2 * radius + 1));
+		float sum = 0.0f;
+		for (std::ptrdiff_t k = -radius; k <= radius; k++)
+		{
+			scratch.kernel[static_cast<size_t>(k + radius)] = std::exp(-0.5f * static_cast<float>(k * k) / (sigma * sigma));
+			sum += scratch.kernel[static_cast<size_t>(k + radius)];
+		}
+		for (auto& weight : scratch.kernel)
+			weight /= sum;
+		scratch.blurred.Resize(rows * columns);
+		const auto width = static_cast<std::ptrdiff_t>(columns);
+		const auto height = static_cast<std::ptrdiff_t>(rows);
+		//horizontal pass into the blur buffer, vertical pass back into the field. Both loop over the taps outermost so
+		//each step is a multiply-add along contiguous memory, a whole block of rows at once in the vertical pass.
+		static const AxpyFn axpy = GetAxpy(DotKernels::DetectInstructionSet());
+		std::fill(scratch.blurred.begin(), scratch.blurred.end(), 0.0f);
+		for (std::ptrdiff_t k = -radius; k <= radius; k++)
+		{
+			const float weight = scratch.kernel[static_cast<size_t>(k + radius)];
+			const std::ptrdiff_t first = std::max<std::ptrdiff_t>(0, -k);
+			const std::ptrdiff_t last = std::min(width, width - k);
+			if (first >= last)
+				continue;
+			for (std::ptrdiff_t y = 0; y < height; y++)
+				axpy(scratch.blurred.data() + y * width + first, field + y * width + first + k, static_cast<size_t>(last - first), weight);
+		}
+		std::fill(field, field + rows * columns, 0.0f);
+		for (std::ptrdiff_t k = -radius; k <= radius; k++)
+		{
+			const std::ptrdiff_t first = std::max<std::ptrdiff_t>(0, -k);
+			const std::ptrdiff_t last = std::min(height, height - k);
+			if (first < last)
+				axpy(field + first * width, scratch.blurred.data() + (first + k) * width, static_cast<size_t>((last - first) * width), scratch.kernel[static_cast<size_t>(k + radius)]);
+		}
+	}
+
+	inline void Apply(const ElasticDistortion& transform, const ImageView& image, BuildRandom::Philox4x32& engine, Scratch& scratch)
+	{
+		scratch.fieldX.Resize(image.Size());
+		scratch.fieldY.Resize(image.Size());
+		engine.Fill(scratch.fieldX.Span(), -1.0f, 1.0f);
+		engine.Fill(scratch.fieldY.Span(), -1.0f, 1.0f);
+		GaussianBlur(scratch.fieldX.data(), image.Rows, image.Columns, transform.Sigma, scratch);
+		GaussianBlur(scratch.fieldY.data(), image.Rows, image.Columns, transform.Sigma, scratch);
+		scratch.sourceX.Resize(image.Size());
+		scratch.sourceY.Resize(image.Size());
+		for (size_t y = 0; y < image.Rows; y++)
+			for (size_t x = 0; x < image.Columns; x++)
+			{
+				const size_t i = y * image.Columns + x;
+				scratch.sourceX[i] = static_cast<float>(x) + transform.Alpha * scratch.fieldX[i];
+				scratch.sourceY[i] = static_cast<float>(y) + transform.Alpha * scratch.fieldY[i];
+			}
+		Resample(image, scratch);
+	}
+
+	inline void Apply(const Deskew&, const ImageView& image, Scratch& scratch)
+	{
+		double total = 0.0, sumX = 0.0, sumY = 0.0;
+		for (size_t y = 0; y < image.Rows; y++)
+			for (size_t x = 0; x < image.Columns; x++)
+			{
+				const double v = image.Pixels[y * image.Columns + x];
+				total += v;
+				sumX += v * static_cast<double>(x);
+				sumY += v * static_cast<double>(y);
+			}
+		if (total <= 0.0)
+			return;
+		const double meanX = sumX / total;
+		const double meanY = sumY / total;
+		double varianceY = 0.0, covariance = 0.0;
+		for (size_t y = 0; y < image.Rows; y++)
+			for (size_t x = 0; x < image.Columns; x++)
+			{
+				const double v = image.Pixels[y * image.Columns + x];
+				const double dy = static_cast<double>(y) - meanY;
+				varianceY += v * dy * dy;
+				covariance += v * dy * (static_cast<double>(x) - meanX);
+			}
+		if (varianceY <= 0.0)
+			return;
+		//a stroke leaning right has x growing as y falls, shearing by the regression slope straightens it.
+		const auto skew = static_cast<float>(covariance / varianceY);
+		WarpAffine(image, AffineMap::AroundCenter(1.0f, skew, 0.0f, 1.0f, static_cast<float>(meanX), static_cast<float>(meanY), image), scratch);
+	}
+
+	/// <summary>
+	/// An ordered list of transforms applied to whole batches in place. Random transforms draw from a Philox stream chosen
+	/// by the caller (e.g. epoch and batch index), so the result does not depend on which thread applies it or in what
+	/// order. <c>Apply</c> is const and thread safe, which lets a chain be installed as a prefetch pipeline transform.
+	/// </summary>
+	class TransformChain
+	{
+	public:
+		TransformChain(size_t rows, size_t columns, std::uint64_t seed = BuildRandom::GlobalSeed()) : m_rows(rows), m_columns(columns), m_seed(seed) { }
+
+		TransformChain& Add(Transform transform)
+		{
+			m_transforms.push_back(transform);
+			return *this;
+		}
+		[[nodiscard]] bool empty() const noexcept { return m_transforms.empty(); }
+		[[nodiscard]] size_t size() const noexcept { return m_transforms.size(); }
+
+		/// <summary>Transforms the filled images of <c>batch</c>, whose image size must be <c>rows x columns</c>.</summary>
+		void Apply(Idx3Lib::Idx3Batch<float>& batch, std::uint64_t stream) const
+		{
+			if (batch.ImageSize != m_rows * m_columns)
+				return;
+			Scratch& scratch = Scratch::ForThread();
+			BuildRandom::Philox4x32 engine(m_seed, stream);
+			for (const auto& transform : m_transforms)
+			{
+				if (const auto* standardize = std::get_if<Standardize>(&transform))
+				{
+					Augmentation::Apply(*standardize, batch.Filled());
+					continue;
+				}
+				for (size_t n = 0; n < batch.Count; n++)
+				{
+					const ImageView image{ batch.Image(n).data(), m_rows, m_columns };
+					std::visit([&](const auto& t) { ApplyToImage(t, image, engine, scratch); }, transform);
+				}
+			}
+		}
+	private:
+		static void ApplyToImage(const Standardize&, const ImageView&, BuildRandom::Philox4x32&, Scratch&) { }
+		static void ApplyToImage(const Deskew& t, const ImageView& image, BuildRandom::Philox4x32&, Scratch& scratch) { Augmentation::Apply(t, image, scratch); }
+		template<typename T>
+		static void ApplyToImage(const T& t, const ImageView& image, BuildRandom::Philox4x32& engine, Scratch& scratch) { Augmentation::Apply(t, image, engine, scratch); }
+
+		size_t m_rows;
+		size_t m_columns;
+		std::uint64_t m_seed;
+		std::vector<Transform> m_transforms;
+	};
+}
@@ -7,6 +7,7 @@
 #include <numeric>
 #include <ranges>
 #include <concepts>
+#include "RandomEngine.hpp"
 
 namespace BuildRandom
 {
@@ -27,9 +28,9 @@ namespace BuildRandom
 	constexpr static void DoGenerate(std::ranges::range auto& containerType, const CountType maxLength, const CountType minLength)
 	{
 		std::uniform_int_distribution<X> distElementPossibility(std::numeric_limits<X>::min(), std::numeric_limits<X>::max());
-		const std::uniform_int_distribution distLengthPossibility(minLength, maxLength);
-		std::random_device rd;
-		std::mt19937 randomElementGenerator(rd()); // seed mersenne engine
+		std::uniform_int_distribution distLengthPossibility(minLength, maxLength);
+		//the calling thread's counter based engine, seeded from GlobalSeed() so results repeat run to run.
+		Philox4x32& randomElementGenerator = ThreadEngine();
 		//the distribution uses the generator engine to get the value
 		const auto tLength = static_cast<std::size_t>(distLengthPossibility(randomElementGenerator));
 		containerType.resize(tLength); // <-- can fail to allocate the memory.
@@ -131,7 +132,7 @@ namespace BuildRandom
 		for (CountType i = 0; i < numberOfStrings; i++)
 		{
 			const auto tempString = BuildRandom::BuildRandomVector<WCharType>(maxLength, minLength);
-			ret.emplace_back(WStringType(tempString));
+			ret.emplace_back(WStringType(tempString.begin(), tempString.end()));
 		}
 		return ret;
 	}
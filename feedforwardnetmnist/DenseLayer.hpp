@@ -0,0 +1,95 @@
+#pragma once
+#include "stdafx.h"
+#include <span>
+#include <cmath>
+#include <limits>
+#include "../MNISTFileLib/AlignedBuffer.hpp"
+#include "RandomEngine.hpp"
+#include "DotKernels.hpp"
+#include "Activation.hpp"
+
+/// <summary>Non-owning view of a dense layer's parameters, e.g. of a <c>DenseLayer</c> or of a memory mapped model file.</summary>
+struct DenseLayerView
+{
+	size_t m_inputs = 0;
+	size_t m_outputs = 0;
+	Activation m_activation = Activation::Identity;
+	std::span<const float> m_weights;   // [outputs x inputs]
+	std::span<const float> m_bias;      // [outputs]
+
+	[[nodiscard]] size_t InputCount() const noexcept { return m_inputs; }
+	[[nodiscard]] size_t OutputCount() const noexcept { return m_outputs; }
+};
+
+/// <summary>A fully connected layer, weights are stored as one contiguous row-major <c>[outputs x inputs]</c> array
+///	so row <c>o</c> holds the weights of every incoming connection to output node <c>o</c>, followed by a bias per output.
+///	The whole layer is evaluated for one input vector in a single pass over the weight array.</summary>
+struct DenseLayer
+{
+	using WeightType = float;
+	using BiasType = float;
+	using ActivationResultType = float;
+
+	size_t m_inputs = 0;
+	size_t m_outputs = 0;
+	Activation m_activation = Activation::Identity;
+	Idx3Lib::AlignedBuffer<WeightType> m_weights;
+	Idx3Lib::AlignedBuffer<BiasType> m_bias;
+
+	DenseLayer() = default;
+	/// <summary>Ctor, random weights are assigned uniformly in [-limit, limit] scaled to the layer's fan in/out
+	///	(He initialization for ReLU, Xavier otherwise) so activations neither vanish nor explode. Biases start at zero.</summary>
+	DenseLayer(size_t inputs, size_t outputs, Activation activation = Activation::Identity)
+		: m_inputs(inputs), m_outputs(outputs), m_activation(activation), m_weights(inputs * outputs), m_bias(outputs)
+	{
+		const double limit = activation == Activation::ReLU
+			? std::sqrt(6.0 / static_cast<double>(std::max<size_t>(1, inputs)))
+			: std::sqrt(6.0 / static_cast<double>(std::max<size_t>(1, inputs + outputs)));
+		FillRandom(m_weights.Span(), limit);
+		std::fill(m_bias.begin(), m_bias.end(), 0.0f);
+	}
+	DenseLayer(DenseLayer&&) noexcept = default;
+	DenseLayer& operator=(DenseLayer&&) noexcept = default;
+
+	[[nodiscard]] size_t InputCount() const noexcept { return m_inputs; }
+	[[nodiscard]] size_t OutputCount() const noexcept { return m_outputs; }
+	/// <summary>The incoming connection weights of output node <c>output</c>.</summary>
+	[[nodiscard]] std::span<WeightType> Row(size_t output) noexcept { return { m_weights.data() + output * m_inputs, m_inputs }; }
+	[[nodiscard]] std::span<const WeightType> Row(size_t output) const noexcept { return { m_weights.data() + output * m_inputs, m_inputs }; }
+	[[nodiscard]] WeightType& Weight(size_t output, size_t input) noexcept { return m_weights[output * m_inputs + input]; }
+	[[nodiscard]] DenseLayerView View() const noexcept { return { m_inputs, m_outputs, m_activation, m_weights.Span(), m_bias.Span() }; }
+
+	/// <summary>Computes every output node's activation for one input vector, <c>input</c> must hold <c>InputCount()</c>
+	///	values and <c>output</c> <c>OutputCount()</c>. The input may be raw pixels or the previous layer's results,
+	///	both are dispatched to the SIMD dot product kernels. The layer's activation function is applied to the results.</summary>
+	template<typename T> requires std::is_arithmetic_v<T>
+	void Forward(std::span<const T> input, std::span<ActivationResultType> output) const noexcept
+	{
+		for (size_t o = 0; o < m_outputs; o++)
+		{
+			if constexpr (std::is_same_v<T, DotKernels::PixelType>)
+				output[o] = DotKernels::DotU8F32(input.first(m_inputs), Row(o)) + m_bias[o];
+			else if constexpr (std::is_same_v<T, float>)
+				output[o] = DotKernels::DotF32F32(input.first(m_inputs), Row(o)) + m_bias[o];
+			else
+				output[o] = ScalarDot(input, Row(o)) + m_bias[o];
+		}
+		ApplyActivation(m_activation, output.data(), 1, m_outputs);
+	}
+private:
+	template<typename T>
+	static ActivationResultType ScalarDot(std::span<const T> input, std::span<const WeightType> row) noexcept
+	{
+		ActivationResultType runningSum = 0;
+		for (size_t i = 0; i < row.size(); i++)
+		{
+			runningSum += static_cast<ActivationResultType>(input[i]) * row[i];
+		}
+		return runningSum;
+	}
+	static void FillRandom(std::span<WeightType> values, double limit)
+	{
+		//generated in bulk straight into the weight array by the thread's engine.
+		BuildRandom::ThreadEngine().Fill(values, static_cast<WeightType>(-limit), static_cast<WeightType>(limit));
+	}
+};
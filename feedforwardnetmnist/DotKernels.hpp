@@ -0,0 +1,446 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DOTKERNELS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+//MSVC emits any intrinsic without a per-function target, the caller is responsible for the CPUID check.
+#define DOTKERNELS_TARGET_AVX2
+#else
+#define DOTKERNELS_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+//VNNI intrinsics need GCC 11, Clang 12 or MSVC.
+#if defined(_MSC_VER) || (defined(__clang__) && __clang_major__ >= 12) || (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 11)
+#define DOTKERNELS_VNNI 1
+#ifdef _MSC_VER
+#define DOTKERNELS_TARGET_AVXVNNI
+#define DOTKERNELS_TARGET_AVX512VNNI
+#else
+#define DOTKERNELS_TARGET_AVXVNNI __attribute__((target("avx2,avxvnni")))
+#define DOTKERNELS_TARGET_AVX512VNNI __attribute__((target("avx2,avx512f,avx512vl,avx512vnni")))
+#endif
+#endif
+#endif
+
+/// <summary>Dot product kernels used by the layer forward passes. The widest instruction set supported by the running CPU
+///	(AVX2+FMA, then SSE2, then portable scalar) is selected once at runtime via CPUID, so a single binary runs everywhere.</summary>
+namespace DotKernels
+{
+	using PixelType = std::uint8_t;
+	using WeightType = float;
+	using DotU8F32Fn = float(*)(const PixelType* pixels, const WeightType* weights, size_t count);
+	using DotF32F32Fn = float(*)(const float* values, const WeightType* weights, size_t count);
+	using QuantizedWeightType = std::int8_t;
+	using DotU8S8Fn = std::int32_t(*)(const PixelType* values, const QuantizedWeightType* weights, size_t count);
+
+	enum class InstructionSet
+	{
+		Scalar,
+		SSE2,
+		AVX2
+	};
+
+	[[nodiscard]] inline const char* ToString(InstructionSet isa) noexcept
+	{
+		switch (isa)
+		{
+		case InstructionSet::AVX2: return "AVX2+FMA";
+		case InstructionSet::SSE2: return "SSE2";
+		default: return "Scalar";
+		}
+	}
+
+	/// <summary>The widest instruction set usable on this CPU and OS, computed once.</summary>
+	[[nodiscard]] inline InstructionSet DetectInstructionSet() noexcept
+	{
+		static const InstructionSet detected = []()
+		{
+#if defined(DOTKERNELS_X86) && defined(_MSC_VER)
+			int info[4]{};
+			__cpuid(info, 0);
+			const int maxLeaf = info[0];
+			__cpuid(info, 1);
+			const bool hasFma = (info[2] & (1 << 12)) != 0;
+			const bool hasOsxsave = (info[2] & (1 << 27)) != 0;
+			const bool hasSse2 = (info[3] & (1 << 26)) != 0;
+			bool hasAvx2 = false;
+			if (maxLeaf >= 7 && hasOsxsave)
+			{
+				//the OS must save the YMM registers on context switch, XCR0 bits 1 and 2.
+				const bool osSavesYmm = (_xgetbv(0) & 0x6) == 0x6;
+				__cpuidex(info, 7, 0);
+				hasAvx2 = osSavesYmm && (info[1] & (1 << 5)) != 0;
+			}
+			if (hasAvx2 && hasFma)
+				return InstructionSet::AVX2;
+			return hasSse2 ? InstructionSet::SSE2 : InstructionSet::Scalar;
+#elif defined(DOTKERNELS_X86)
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+				return InstructionSet::AVX2;
+			return __builtin_cpu_supports("sse2") ? InstructionSet::SSE2 : InstructionSet::Scalar;
+#else
+			return InstructionSet::Scalar;
+#endif
+		}();
+		return detected;
+	}
+
+	/// <summary>Which VNNI dot product instructions (u8 x s8 summed in groups of four straight into int32) the CPU and OS support.
+	///	Only the int8 kernels use them, everything else keys off <c>InstructionSet</c>.</summary>
+	enum class VnniSupport
+	{
+		None,
+		AVX512,     // AVX512-VNNI with AVX512VL, used at 256 bit width
+		AVX         // AVX-VNNI, the VEX encoded form
+	};
+
+	[[nodiscard]] inline const char* ToString(VnniSupport vnni) noexcept
+	{
+		switch (vnni)
+		{
+		case VnniSupport::AVX: return "AVX-VNNI";
+		case VnniSupport::AVX512: return "AVX512-VNNI";
+		default: return "None";
+		}
+	}
+
+	/// <summary>VNNI support of this CPU and OS, computed once. Requires AVX2 as the kernels use it for the tail.</summary>
+	[[nodiscard]] inline VnniSupport DetectVnni() noexcept
+	{
+		static const VnniSupport detected = []()
+		{
+			if (DetectInstructionSet() != InstructionSet::AVX2)
+				return VnniSupport::None;
+#if defined(DOTKERNELS_VNNI) && defined(_MSC_VER)
+			int info[4]{};
+			__cpuidex(info, 7, 1);
+			if ((info[0] & (1 << 4)) != 0)
+				return VnniSupport::AVX;
+			__cpuidex(info, 7, 0);
+			const bool hasAvx512Vnni = (info[2] & (1 << 11)) != 0 && (info[1] & (1 << 31)) != 0 && (info[1] & (1 << 16)) != 0;
+			//the OS must also save the opmask and ZMM registers, XCR0 bits 5 to 7.
+			if (hasAvx512Vnni && (_xgetbv(0) & 0xE6) == 0xE6)
+				return VnniSupport::AVX512;
+			return VnniSupport::None;
+#elif defined(DOTKERNELS_VNNI)
+			if (__builtin_cpu_supports("avxvnni"))
+				return VnniSupport::AVX;
+			if (__builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512vl"))
+				return VnniSupport::AVX512;
+			return VnniSupport::None;
+#else
+			return VnniSupport::None;
+#endif
+		}();
+		return detected;
+	}
+
+	/// <summary>Sets flush-to-zero and denormals-are-zero for the calling thread. Gradients decay into the denormal range late in
+	///	training and every operation touching them would otherwise take a slow microcode path.</summary>
+	inline void FlushDenormalsToZero() noexcept
+	{
+#ifdef DOTKERNELS_X86
+		constexpr unsigned int FlushToZero = 0x8000;
+		constexpr unsigned int DenormalsAreZero = 0x0040;
+		const unsigned int csr = _mm_getcsr();
+		if ((csr & (FlushToZero | DenormalsAreZero)) != (FlushToZero | DenormalsAreZero))
+			_mm_setcsr(csr | FlushToZero | DenormalsAreZero);
+#endif
+	}
+
+	/// <summary>Portable reference kernel, one pixel at a time.</summary>
+	inline float DotU8F32Scalar(const PixelType* pixels, const WeightType* weights, size_t count) noexcept
+	{
+		float runningSum = 0.0f;
+		for (size_t i = 0; i < count; i++)
+			runningSum += static_cast<float>(pixels[i]) * weights[i];
+		return runningSum;
+	}
+	inline float DotF32F32Scalar(const float* values, const WeightType* weights, size_t count) noexcept
+	{
+		float runningSum = 0.0f;
+		for (size_t i = 0; i < count; i++)
+			runningSum += values[i] * weights[i];
+		return runningSum;
+	}
+	/// <summary>Portable reference int8 kernel, exact int32 accumulation of u8 x s8 products.</summary>
+	inline std::int32_t DotU8S8Scalar(const PixelType* values, const QuantizedWeightType* weights, size_t count) noexcept
+	{
+		std::int32_t runningSum = 0;
+		for (size_t i = 0; i < count; i++)
+			runningSum += static_cast<std::int32_t>(values[i]) * weights[i];
+		return runningSum;
+	}
+
+#ifdef DOTKERNELS_X86
+	inline float HorizontalSum(__m128 v) noexcept
+	{
+		__m128 shuffled = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+		__m128 sums = _mm_add_ps(v, shuffled);
+		shuffled = _mm_movehl_ps(shuffled, sums);
+		sums = _mm_add_ss(sums, shuffled);
+		return _mm_cvtss_f32(sums);
+	}
+
+	/// <summary>SSE2 kernel, 16 pixels per iteration widened u8 -> u16 -> u32 -> float by unpacking with zero.</summary>
+	inline float DotU8F32SSE2(const PixelType* pixels, const WeightType* weights, size_t count) noexcept
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		__m128 acc2 = _mm_setzero_ps();
+		__m128 acc3 = _mm_setzero_ps();
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i));
+			const __m128i lo16 = _mm_unpacklo_epi8(bytes, zero);
+			const __m128i hi16 = _mm_unpackhi_epi8(bytes, zero);
+			const __m128 p0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo16, zero));
+			const __m128 p1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo16, zero));
+			const __m128 p2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi16, zero));
+			const __m128 p3 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi16, zero));
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(p0, _mm_loadu_ps(weights + i)));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(p1, _mm_loadu_ps(weights + i + 4)));
+			acc2 = _mm_add_ps(acc2, _mm_mul_ps(p2, _mm_loadu_ps(weights + i + 8)));
+			acc3 = _mm_add_ps(acc3, _mm_mul_ps(p3, _mm_loadu_ps(weights + i + 12)));
+		}
+		float runningSum = HorizontalSum(_mm_add_ps(_mm_add_ps(acc0, acc1), _mm_add_ps(acc2, acc3)));
+		return runningSum + DotU8F32Scalar(pixels + i, weights + i, count - i);
+	}
+	inline float DotF32F32SSE2(const float* values, const WeightType* weights, size_t count) noexcept
+	{
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(values + i), _mm_loadu_ps(weights + i)));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(values + i + 4), _mm_loadu_ps(weights + i + 4)));
+		}
+		return HorizontalSum(_mm_add_ps(acc0, acc1)) + DotF32F32Scalar(values + i, weights + i, count - i);
+	}
+
+	/// <summary>AVX2 kernel, 32 pixels per iteration widened u8 -> u32 -> float in groups of 8 and FMA'd into four accumulators.</summary>
+	DOTKERNELS_TARGET_AVX2 inline float DotU8F32AVX2(const PixelType* pixels, const WeightType* weights, size_t count) noexcept
+	{
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		__m256 acc2 = _mm256_setzero_ps();
+		__m256 acc3 = _mm256_setzero_ps();
+		size_t i = 0;
+		for (; i + 32 <= count; i += 32)
+		{
+			const __m128i bytesLo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i));
+			const __m128i bytesHi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i + 16));
+			const __m256 p0 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytesLo));
+			const __m256 p1 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(bytesLo, 8)));
+			const __m256 p2 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytesHi));
+			const __m256 p3 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(bytesHi, 8)));
+			acc0 = _mm256_fmadd_ps(p0, _mm256_loadu_ps(weights + i), acc0);
+			acc1 = _mm256_fmadd_ps(p1, _mm256_loadu_ps(weights + i + 8), acc1);
+			acc2 = _mm256_fmadd_ps(p2, _mm256_loadu_ps(weights + i + 16), acc2);
+			acc3 = _mm256_fmadd_ps(p3, _mm256_loadu_ps(weights + i + 24), acc3);
+		}
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m256 p = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pixels + i))));
+			acc0 = _mm256_fmadd_ps(p, _mm256_loadu_ps(weights + i), acc0);
+		}
+		const __m256 sum256 = _mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3));
+		const float runningSum = HorizontalSum(_mm_add_ps(_mm256_castps256_ps128(sum256), _mm256_extractf128_ps(sum256, 1)));
+		return runningSum + DotU8F32Scalar(pixels + i, weights + i, count - i);
+	}
+	DOTKERNELS_TARGET_AVX2 inline float DotF32F32AVX2(const float* values, const WeightType* weights, size_t count) noexcept
+	{
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(values + i), _mm256_loadu_ps(weights + i), acc0);
+			acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(values + i + 8), _mm256_loadu_ps(weights + i + 8), acc1);
+		}
+		const __m256 sum256 = _mm256_add_ps(acc0, acc1);
+		const float runningSum = HorizontalSum(_mm_add_ps(_mm256_castps256_ps128(sum256), _mm256_extractf128_ps(sum256, 1)));
+		return runningSum + DotF32F32Scalar(values + i, weights + i, count - i);
+	}
+
+	inline std::int32_t HorizontalSum(__m128i v) noexcept
+	{
+		v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+		v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtsi128_si32(v);
+	}
+
+	/*
+	 * The int8 kernels avoid pmaddubsw: u8 x s8 pairs can reach 2 * 255 * 127, which saturates its 16 bit sums.
+	 * Instead both operands are widened to 16 bits and multiplied with pmaddwd, which sums pairs into 32 bits exactly,
+	 * or, where available, VNNI's vpdpbusd does the widening, multiply and accumulate of four pairs in one instruction.
+	 */
+	/// <summary>SSE2 int8 kernel, 16 values per iteration, u8 zero extended and s8 sign extended to 16 bits.</summary>
+	inline std::int32_t DotU8S8SSE2(const PixelType* values, const QuantizedWeightType* weights, size_t count) noexcept
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128i acc0 = _mm_setzero_si128();
+		__m128i acc1 = _mm_setzero_si128();
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+			const __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(weights + i));
+			//sign extension without SSE4.1, duplicate each byte into both halves of a 16 bit lane and shift arithmetically.
+			const __m128i wLo = _mm_srai_epi16(_mm_unpacklo_epi8(w, w), 8);
+			const __m128i wHi = _mm_srai_epi16(_mm_unpackhi_epi8(w, w), 8);
+			acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi8(bytes, zero), wLo));
+			acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi8(bytes, zero), wHi));
+		}
+		return HorizontalSum(_mm_add_epi32(acc0, acc1)) + DotU8S8Scalar(values + i, weights + i, count - i);
+	}
+
+	/// <summary>AVX2 int8 kernel, 32 values per iteration widened to 16 bits and multiplied with pmaddwd.</summary>
+	DOTKERNELS_TARGET_AVX2 inline std::int32_t DotU8S8AVX2(const PixelType* values, const QuantizedWeightType* weights, size_t count) noexcept
+	{
+		__m256i acc0 = _mm256_setzero_si256();
+		__m256i acc1 = _mm256_setzero_si256();
+		size_t i = 0;
+		for (; i + 32 <= count; i += 32)
+		{
+			const __m256i v0 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i)));
+			const __m256i v1 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i + 16)));
+			const __m256i w0 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(weights + i)));
+			const __m256i w1 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(weights + i + 16)));
+			acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(v0, w0));
+			acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(v1, w1));
+		}
+		if (i + 16 <= count)
+		{
+			const __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i)));
+			const __m256i w = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(weights + i)));
+			acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(v, w));
+			i += 16;
+		}
+		const __m256i sum256 = _mm256_add_epi32(acc0, acc1);
+		const std::int32_t runningSum = HorizontalSum(_mm_add_epi32(_mm256_castsi256_si128(sum256), _mm256_extracti128_si256(sum256, 1)));
+		return runningSum + DotU8S8Scalar(values + i, weights + i, count - i);
+	}
+
+#ifdef DOTKERNELS_VNNI
+	/// <summary>AVX-VNNI int8 kernel, 64 values per iteration with vpdpbusd accumulating straight into int32.</summary>
+	DOTKERNELS_TARGET_AVXVNNI inline std::int32_t DotU8S8AVXVNNI(const PixelType* values, const QuantizedWeightType* weights, size_t count) noexcept
+	{
+		__m256i acc0 = _mm256_setzero_si256();
+		__m256i acc1 = _mm256_setzero_si256();
+		size_t i = 0;
+		for (; i + 64 <= count; i += 64)
+		{
+			acc0 = _mm256_dpbusd_avx_epi32(acc0, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i)));
+			acc1 = _mm256_dpbusd_avx_epi32(acc1, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i + 32)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i + 32)));
+		}
+		for (; i + 32 <= count; i += 32)
+			acc0 = _mm256_dpbusd_avx_epi32(acc0, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i)));
+		const __m256i sum256 = _mm256_add_epi32(acc0, acc1);
+		__m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum256), _mm256_extracti128_si256(sum256, 1));
+		if (i + 16 <= count)
+		{
+			sum128 = _mm_dpbusd_avx_epi32(sum128, _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(weights + i)));
+			i += 16;
+		}
+		const std::int32_t runningSum = HorizontalSum(sum128);
+		return runningSum + DotU8S8Scalar(values + i, weights + i, count - i);
+	}
+	/// <summary>AVX512-VNNI int8 kernel, the same loop as the AVX-VNNI one using the EVEX encoded 256 bit vpdpbusd.</summary>
+	DOTKERNELS_TARGET_AVX512VNNI inline std::int32_t DotU8S8AVX512VNNI(const PixelType* values, const QuantizedWeightType* weights, size_t count) noexcept
+	{
+		__m256i acc0 = _mm256_setzero_si256();
+		__m256i acc1 = _mm256_setzero_si256();
+		size_t i = 0;
+		for (; i + 64 <= count; i += 64)
+		{
+			acc0 = _mm256_dpbusd_epi32(acc0, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i)));
+			acc1 = _mm256_dpbusd_epi32(acc1, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i + 32)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i + 32)));
+		}
+		for (; i + 32 <= count; i += 32)
+			acc0 = _mm256_dpbusd_epi32(acc0, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i)));
+		const __m256i sum256 = _mm256_add_epi32(acc0, acc1);
+		__m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum256), _mm256_extracti128_si256(sum256, 1));
+		if (i + 16 <= count)
+		{
+			sum128 = _mm_dpbusd_epi32(sum128, _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(weights + i)));
+			i += 16;
+		}
+		const std::int32_t runningSum = HorizontalSum(sum128);
+		return runningSum + DotU8S8Scalar(values + i, weights + i, count - i);
+	}
+#endif
+#endif
+
+	/// <summary>The u8 x f32 kernel for a specific instruction set, falls back to scalar if it was not compiled in.</summary>
+	[[nodiscard]] inline DotU8F32Fn GetDotU8F32(InstructionSet isa) noexcept
+	{
+#ifdef DOTKERNELS_X86
+		if (isa == InstructionSet::AVX2)
+			return &DotU8F32AVX2;
+		if (isa == InstructionSet::SSE2)
+			return &DotU8F32SSE2;
+#endif
+		(void)isa;
+		return &DotU8F32Scalar;
+	}
+	[[nodiscard]] inline DotF32F32Fn GetDotF32F32(InstructionSet isa) noexcept
+	{
+#ifdef DOTKERNELS_X86
+		if (isa == InstructionSet::AVX2)
+			return &DotF32F32AVX2;
+		if (isa == InstructionSet::SSE2)
+			return &DotF32F32SSE2;
+#endif
+		(void)isa;
+		return &DotF32F32Scalar;
+	}
+
+	/// <summary>The u8 x s8 kernel for a specific instruction set, VNNI takes precedence when given. Falls back to scalar if
+	///	the kernel was not compiled in.</summary>
+	[[nodiscard]] inline DotU8S8Fn GetDotU8S8(InstructionSet isa, VnniSupport vnni = VnniSupport::None) noexcept
+	{
+#ifdef DOTKERNELS_X86
+#ifdef DOTKERNELS_VNNI
+		if (vnni == VnniSupport::AVX)
+			return &DotU8S8AVXVNNI;
+		if (vnni == VnniSupport::AVX512)
+			return &DotU8S8AVX512VNNI;
+#endif
+		if (isa == InstructionSet::AVX2)
+			return &DotU8S8AVX2;
+		if (isa == InstructionSet::SSE2)
+			return &DotU8S8SSE2;
+#endif
+		(void)isa;
+		(void)vnni;
+		return &DotU8S8Scalar;
+	}
+
+	/// <summary>Dot product of a row of raw pixels with a row of weights, using the best kernel for this CPU.</summary>
+	[[nodiscard]] inline float DotU8F32(std::span<const PixelType> pixels, std::span<const WeightType> weights) noexcept
+	{
+		static const DotU8F32Fn kernel = GetDotU8F32(DetectInstructionSet());
+		return kernel(pixels.data(), weights.data(), pixels.size());
+	}
+	/// <summary>Dot product of a row of float activations with a row of weights, using the best kernel for this CPU.</summary>
+	[[nodiscard]] inline float DotF32F32(std::span<const float> values, std::span<const WeightType> weights) noexcept
+	{
+		static const DotF32F32Fn kernel = GetDotF32F32(DetectInstructionSet());
+		return kernel(values.data(), weights.data(), values.size());
+	}
+	/// <summary>Exact int32 dot product of a row of u8 values with a row of int8 weights, using the best kernel for this CPU.</summary>
+	[[nodiscard]] inline std::int32_t DotU8S8(std::span<const PixelType> values, std::span<const QuantizedWeightType> weights) noexcept
+	{
+		static const DotU8S8Fn kernel = GetDotU8S8(DetectInstructionSet(), DetectVnni());
+		return kernel(values.data(), weights.data(), values.size());
+	}
+}
@@ -0,0 +1,231 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include "../MNISTFileLib/AlignedBuffer.hpp"
+#include "DotKernels.hpp"
+#include "ThreadPool.hpp"
+
+/// <summary>Blocked single precision matrix multiply used by the batched forward pass.
+///	Computes <c>C[M x N] = A[M x K] * B[N x K]^T + bias[N]</c>, which is a whole batch of input rows times a
+///	row-major <c>[outputs x inputs]</c> weight matrix. <c>B</c> is packed once per call into <c>NR</c> wide, <c>KC</c> deep
+///	panels that stay in L1/L2 while every row block of <c>A</c> is streamed past them, so each weight is read from
+///	memory once per batch instead of once per image. The register blocked micro-kernel computes an
+///	<c>MR x NR</c> tile of <c>C</c> per call.</summary>
+namespace Gemm
+{
+	constexpr size_t MR = 4;    // rows of A per micro-kernel tile
+	constexpr size_t NR = 16;   // columns of C (outputs) per micro-kernel tile, two AVX registers
+	constexpr size_t KC = 256;  // depth of a packed panel, MR*KC of A plus KC*NR of B fit in L1
+	constexpr size_t MC = 64;   // rows of A per L2 block
+
+	/// <summary>Scratch space reused across calls, so the steady state performs no allocations.</summary>
+	struct Workspace
+	{
+		Idx3Lib::AlignedBuffer<float> packedB;
+		std::vector<Workspace> chunks;      // one per chunk of a parallel multiply
+	};
+
+	/// <summary>Sizes <c>workspace</c> for products with up to <c>n</c> rows of <c>B</c>, split up to <c>chunkCount</c> ways,
+	///	so even the first call of that size does not allocate.</summary>
+	inline void Reserve(Workspace& workspace, size_t n, size_t chunkCount = 1)
+	{
+		const size_t panelCount = (n + NR - 1) / NR;
+		workspace.packedB.Resize(std::max(workspace.packedB.capacity(), panelCount * NR * KC));
+		if (chunkCount > 1)
+		{
+			if (workspace.chunks.size() < chunkCount)
+				workspace.chunks.resize(chunkCount);
+			for (auto& chunk : workspace.chunks)
+				Reserve(chunk, n);
+		}
+	}
+
+	using MicroKernelFn = void(*)(const float* a, size_t lda, const float* packedPanel, size_t kc, float* c, size_t ldc);
+
+	/// <summary>Portable micro-kernel: c[MR x NR] += a[MR x kc] * panel[kc x NR], written so the compiler can vectorize the NR loop.</summary>
+	inline void MicroKernelScalar(const float* a, size_t lda, const float* packedPanel, size_t kc, float* c, size_t ldc) noexcept
+	{
+		float acc[MR][NR]{};
+		for (size_t k = 0; k < kc; k++)
+		{
+			const float* b = packedPanel + k * NR;
+			for (size_t r = 0; r < MR; r++)
+			{
+				const float av = a[r * lda + k];
+				for (size_t j = 0; j < NR; j++)
+					acc[r][j] += av * b[j];
+			}
+		}
+		for (size_t r = 0; r < MR; r++)
+			for (size_t j = 0; j < NR; j++)
+				c[r * ldc + j] += acc[r][j];
+	}
+
+#ifdef DOTKERNELS_X86
+	/// <summary>AVX2 micro-kernel, the 4x16 tile of C lives in eight YMM accumulators for the whole panel depth.</summary>
+	DOTKERNELS_TARGET_AVX2 inline void MicroKernelAVX2(const float* a, size_t lda, const float* packedPanel, size_t kc, float* c, size_t ldc) noexcept
+	{
+		__m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+		__m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+		__m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+		__m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+		const float* a0 = a;
+		const float* a1 = a + lda;
+		const float* a2 = a + 2 * lda;
+		const float* a3 = a + 3 * lda;
+		for (size_t k = 0; k < kc; k++)
+		{
+			const __m256 b0 = _mm256_load_ps(packedPanel + k * NR);
+			const __m256 b1 = _mm256_load_ps(packedPanel + k * NR + 8);
+			__m256 av = _mm256_broadcast_ss(a0 + k);
+			c00 = _mm256_fmadd_ps(av, b0, c00);
+			c01 = _mm256_fmadd_ps(av, b1, c01);
+			av = _mm256_broadcast_ss(a1 + k);
+			c10 = _mm256_fmadd_ps(av, b0, c10);
+			c11 = _mm256_fmadd_ps(av, b1, c11);
+			av = _mm256_broadcast_ss(a2 + k);
+			c20 = _mm256_fmadd_ps(av, b0, c20);
+			c21 = _mm256_fmadd_ps(av, b1, c21);
+			av = _mm256_broadcast_ss(a3 + k);
+			c30 = _mm256_fmadd_ps(av, b0, c30);
+			c31 = _mm256_fmadd_ps(av, b1, c31);
+		}
+		//a lambda would not inherit the AVX2 target attribute, so the tile is added back row by row.
+		_mm256_storeu_ps(c, _mm256_add_ps(_mm256_loadu_ps(c), c00));
+		_mm256_storeu_ps(c + 8, _mm256_add_ps(_mm256_loadu_ps(c + 8), c01));
+		c += ldc;
+		_mm256_storeu_ps(c, _mm256_add_ps(_mm256_loadu_ps(c), c10));
+		_mm256_storeu_ps(c + 8, _mm256_add_ps(_mm256_loadu_ps(c + 8), c11));
+		c += ldc;
+		_mm256_storeu_ps(c, _mm256_add_ps(_mm256_loadu_ps(c), c20));
+		_mm256_storeu_ps(c + 8, _mm256_add_ps(_mm256_loadu_ps(c + 8), c21));
+		c += ldc;
+		_mm256_storeu_ps(c, _mm256_add_ps(_mm256_loadu_ps(c), c30));
+		_mm256_storeu_ps(c + 8, _mm256_add_ps(_mm256_loadu_ps(c + 8), c31));
+	}
+#endif
+
+	[[nodiscard]] inline MicroKernelFn SelectMicroKernel() noexcept
+	{
+#ifdef DOTKERNELS_X86
+		if (DotKernels::DetectInstructionSet() == DotKernels::InstructionSet::AVX2)
+			return &MicroKernelAVX2;
+#endif
+		return &MicroKernelScalar;
+	}
+
+	/// <summary>Packs rows [n0, n0+NR) x depth [k0, k0+kc) of B into a k-major panel, zero filling past the last row.</summary>
+	inline void PackPanel(const float* b, size_t ldb, size_t n0, size_t n, size_t k0, size_t kc, float* panel) noexcept
+	{
+		const size_t rows = std::min(NR, n - n0);
+		for (size_t k = 0; k < kc; k++)
+		{
+			float* dst = panel + k * NR;
+			for (size_t j = 0; j < rows; j++)
+				dst[j] = b[(n0 + j) * ldb + k0 + k];
+			for (size_t j = rows; j < NR; j++)
+				dst[j] = 0.0f;
+		}
+	}
+
+	/// <summary>
+	/// <c>C[M x N] = A[M x K] * B[N x K]^T + bias[N]</c>, all row-major with leading dimensions <c>lda</c>, <c>ldb</c> and <c>ldc</c>.
+	/// <c>bias</c> may be null. Rows and columns that do not fill a whole tile go through a small edge buffer.
+	/// </summary>
+	inline void MatMulTransposedB(const float* a, size_t lda, const float* b, size_t ldb, const float* bias, float* c, size_t ldc,
+		size_t m, size_t n, size_t k, Workspace& workspace)
+	{
+		static const MicroKernelFn microKernel = SelectMicroKernel();
+		const size_t panelCount = (n + NR - 1) / NR;
+		workspace.packedB.Resize(panelCount * NR * KC);
+		//initialize C with the bias, the k blocks below accumulate on top of it.
+		for (size_t i = 0; i < m; i++)
+		{
+			float* row = c + i * ldc;
+			if (bias != nullptr)
+				std::memcpy(row, bias, n * sizeof(float));
+			else
+				std::fill_n(row, n, 0.0f);
+		}
+		alignas(64) float edgeTile[MR * NR];
+		alignas(64) float edgeA[MR * KC];
+		for (size_t k0 = 0; k0 < k; k0 += KC)
+		{
+			const size_t kc = std::min(KC, k - k0);
+			for (size_t p = 0; p < panelCount; p++)
+				PackPanel(b, ldb, p * NR, n, k0, kc, workspace.packedB.data() + p * NR * KC);
+			for (size_t m0 = 0; m0 < m; m0 += MC)
+			{
+				const size_t mc = std::min(MC, m - m0);
+				for (size_t p = 0; p < panelCount; p++)
+				{
+					const float* panel = workspace.packedB.data() + p * NR * KC;
+					const size_t n0 = p * NR;
+					const size_t cols = std::min(NR, n - n0);
+					for (size_t i = 0; i < mc; i += MR)
+					{
+						const size_t rows = std::min(MR, mc - i);
+						const float* aTile = a + (m0 + i) * lda + k0;
+						float* cTile = c + (m0 + i) * ldc + n0;
+						if (rows == MR && cols == NR)
+						{
+							microKernel(aTile, lda, panel, kc, cTile, ldc);
+							continue;
+						}
+						//partial tile, the kernel writes into a zeroed edge tile and the valid part is added back.
+						//missing rows of A are zero padded, a partial set of columns is already zero padded in the panel.
+						const float* aSource = aTile;
+						size_t aStride = lda;
+						if (rows != MR)
+						{
+							std::fill_n(edgeA, MR * KC, 0.0f);
+							for (size_t r = 0; r < rows; r++)
+								std::memcpy(edgeA + r * KC, aTile + r * lda, kc * sizeof(float));
+							aSource = edgeA;
+							aStride = KC;
+						}
+						std::fill_n(edgeTile, MR * NR, 0.0f);
+						microKernel(aSource, aStride, panel, kc, edgeTile, NR);
+						for (size_t r = 0; r < rows; r++)
+							for (size_t j = 0; j < cols; j++)
+								cTile[r * ldc + j] += edgeTile[r * NR + j];
+					}
+				}
+			}
+		}
+	}
+
+	/// <summary>
+	/// <c>MatMulTransposedB</c> split across <c>pool</c>. Tall products (a large batch) are split into blocks of rows of
+	/// <c>A</c> and <c>C</c>, wide ones (e.g. weight gradients) into blocks of rows of <c>B</c>, which are columns of <c>C</c>.
+	/// Each chunk packs its own slice of <c>B</c> into its own workspace, so chunks share nothing but read-only inputs.
+	/// Falls back to the single threaded multiply when the product is too small to split.
+	/// </summary>
+	inline void MatMulTransposedB(const float* a, size_t lda, const float* b, size_t ldb, const float* bias, float* c, size_t ldc,
+		size_t m, size_t n, size_t k, Workspace& workspace, ThreadPool& pool)
+	{
+		const bool splitRows = m >= n;
+		//a chunk should be at least one full L2 block of rows, or two tiles of columns.
+		const size_t unit = splitRows ? MC : 2 * NR;
+		const size_t chunkCount = std::min(pool.ThreadCount(), (splitRows ? m : n) / unit);
+		if (chunkCount <= 1)
+		{
+			MatMulTransposedB(a, lda, b, ldb, bias, c, ldc, m, n, k, workspace);
+			return;
+		}
+		if (workspace.chunks.size() < chunkCount)
+			workspace.chunks.resize(chunkCount);
+		const size_t blocks = ((splitRows ? m : n) + unit - 1) / unit;
+		pool.ParallelFor(blocks, chunkCount, [&](size_t chunk, size_t first, size_t last)
+		{
+			const size_t begin = first * unit;
+			const size_t end = std::min(last * unit, splitRows ? m : n);
+			if (splitRows)
+				MatMulTransposedB(a + begin * lda, lda, b, ldb, bias, c + begin * ldc, ldc, end - begin, n, k, workspace.chunks[chunk]);
+			else
+				MatMulTransposedB(a, lda, b + begin * ldb, ldb, bias == nullptr ? nullptr : bias + begin, c + begin, ldc, m, end - begin, k, workspace.chunks[chunk]);
+		});
+	}
+}
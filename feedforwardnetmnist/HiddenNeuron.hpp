@@ -32,8 +32,7 @@ struct HiddenNeuron
 	/// <summary>Default ctor, a random bias value is assigned.</summary>
 	HiddenNeuron(NodeIdType id) : m_nodeId(id)
 	{
-		const auto w = BuildRandom::BuildRandomVector<RandomType>(1, 1);
-		m_bias = w[0] % 100 / 100.0;
+		m_bias = BuildRandom::ThreadEngine()() % 100 / 100.0;
 	}
 
 	/// <summary>Ctor for assigning a bias explicitly</summary>
@@ -48,8 +47,7 @@ struct HiddenNeuron
 			if (!m_weightMap[elem.m_nodeId])
 			{
 				//Randomly generate a weight.
-				const auto w = BuildRandom::BuildRandomVector<RandomType>(1, 1);
-				m_weightMap[elem.m_nodeId] = w[0] % 100 / 100.0;
+				m_weightMap[elem.m_nodeId] = BuildRandom::ThreadEngine()() % 100 / 100.0;
 			}
 		}
 		// might want a big number lib for this with many input nodes, boost has one that seemed good
@@ -0,0 +1,486 @@
+#pragma once
+#include "stdafx.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "../MNISTFileLib/AlignedBuffer.hpp"
+#include "../MNISTFileLib/Instrumentation.hpp"
+#ifndef _WIN32
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+/// <summary>Configuration for <c>InferenceServer</c>.</summary>
+struct InferenceServerOptions
+{
+	size_t MaxBatchSize = 64;                           // requests evaluated together at most
+	std::chrono::microseconds MaxDelay{ 100 };          // longest a request waits for others to share its batch
+	size_t QueueCapacity = 1024;                        // requests waiting at most, readers stop reading while it is full
+};
+
+/// <summary>Latency and throughput since the server started. Latency runs from the moment a request's last byte was
+///	read to the moment its response was handed to the socket.</summary>
+struct InferenceStats
+{
+	size_t Requests = 0;
+	size_t Batches = 0;
+	double Seconds = 0.0;
+	double P50Microseconds = 0.0;
+	double P99Microseconds = 0.0;
+	double MaxMicroseconds = 0.0;
+	[[nodiscard]] double MeanBatchSize() const noexcept { return Batches == 0 ? 0.0 : static_cast<double>(Requests) / Batches; }
+	[[nodiscard]] double RequestsPerSecond() const noexcept { return Seconds <= 0.0 ? 0.0 : Requests / Seconds; }
+	friend std::ostream& operator<<(std::ostream& os, const InferenceStats& obj)
+	{
+		const auto flags = os.flags();
+		os << "requests: " << obj.Requests << " batches: " << obj.Batches << std::fixed << std::setprecision(1)
+			<< " mean batch: " << obj.MeanBatchSize() << " p50: " << obj.P50Microseconds << "us p99: " << obj.P99Microseconds
+			<< "us max: " << obj.MaxMicroseconds << "us throughput: " << obj.RequestsPerSecond() << " requests/s";
+		os.flags(flags);
+		return os;
+	}
+};
+
+#ifndef _WIN32
+/// <summary>
+/// Serves a model over a Unix domain stream socket. A request is one image of <c>InputSize</c> raw u8 pixels, its response
+/// is the predicted class as a native <c>std::int32_t</c> followed by the <c>OutputCount</c> float scores, in the
+/// order the requests were sent on that connection, so a client may pipeline several requests.
+/// Each connection has a reader thread that queues complete images, a single inference thread takes what is queued as
+/// one micro-batch once <c>MaxBatchSize</c> requests wait, every connected client has a request in or the oldest has
+/// waited <c>MaxDelay</c>, runs the batched forward pass and writes the responses. A lone client is served at once,
+/// under heavy load batches fill up and the forward pass is amortized over many images. Responses are written without
+/// blocking, a client that stops reading until its socket buffer is full is disconnected rather than stalling the rest.
+/// </summary>
+class InferenceServer
+{
+public:
+	using PixelType = std::uint8_t;
+	using LabelType = std::int32_t;
+	/// <summary>Evaluates <c>batchSize</c> images of raw pixels, returns <c>[batchSize x OutputCount]</c> scores that
+	///	stay valid until the next call. Only ever called from the inference thread.</summary>
+	using EvaluateFn = std::function<std::span<const float>(std::span<const PixelType> pixels, size_t batchSize)>;
+
+	InferenceServer() = default;
+	InferenceServer(const InferenceServer&) = delete;
+	InferenceServer& operator=(const InferenceServer&) = delete;
+	~InferenceServer() { Stop(); }
+
+	/// <summary>Binds <c>socketPath</c>, replacing a stale socket file, and starts serving. Returns false on failure,
+	///	see <c>ErrorMessage()</c>.</summary>
+	bool Start(const std::string& socketPath, size_t inputSize, size_t outputCount, EvaluateFn evaluate, const InferenceServerOptions& options = {})
+	{
+		Stop();
+		if (inputSize == 0 || outputCount == 0 || options.MaxBatchSize == 0 || options.QueueCapacity < options.MaxBatchSize)
+			return SetError("Invalid server options.");
+		sockaddr_un address{};
+		if (socketPath.size() >= sizeof(address.sun_path))
+			return SetError("Socket path is too long.");
+		address.sun_family = AF_UNIX;
+		std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+		m_listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (m_listenFd < 0)
+			return SetError("Failed to create the socket: " + std::string(std::strerror(errno)) + ".");
+		::unlink(socketPath.c_str());
+		if (::bind(m_listenFd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(m_listenFd, SOMAXCONN) != 0)
+		{
+			const std::string error = std::strerror(errno);
+			::close(std::exchange(m_listenFd, -1));
+			return SetError("Failed to listen on " + socketPath + ": " + error + ".");
+		}
+		m_socketPath = socketPath;
+		m_inputSize = inputSize;
+		m_outputCount = outputCount;
+		m_evaluate = std::move(evaluate);
+		m_options = options;
+		m_queuePixels.Resize(options.QueueCapacity * inputSize);
+		m_queue.assign(options.QueueCapacity, {});
+		m_queueHead = 0;
+		m_queueCount = 0;
+		m_liveConnections = 0;
+		m_pendingConnections = 0;
+		m_batchPixels.Resize(options.MaxBatchSize * inputSize);
+		m_batch.assign(options.MaxBatchSize, {});
+		m_responses.Resize(options.MaxBatchSize * ResponseSize());
+		m_latencies.assign(LatencySamples, 0.0f);
+		m_requests = 0;
+		m_batches = 0;
+		m_startTime = Clock::now();
+		m_stopping = false;
+		m_errorMessage.clear();
+		m_inferenceThread = std::thread([this]() { InferenceLoop(); });
+		m_acceptThread = std::thread([this]() { AcceptLoop(); });
+		return true;
+	}
+
+	/// <summary>Stops accepting, disconnects every client, joins the threads and removes the socket file.
+	///	Requests still queued are dropped.</summary>
+	void Stop()
+	{
+		if (m_listenFd < 0)
+			return;
+		{
+			std::lock_guard lock(m_queueMutex);
+			m_stopping = true;
+		}
+		m_queued.notify_all();
+		m_space.notify_all();
+		//shutting the listening socket down wakes the blocked accept.
+		::shutdown(m_listenFd, SHUT_RDWR);
+		m_acceptThread.join();
+		::close(std::exchange(m_listenFd, -1));
+		{
+			std::lock_guard lock(m_connectionsMutex);
+			for (const auto& connection : m_connections)
+				::shutdown(connection->fd, SHUT_RDWR);
+		}
+		for (const auto& connection : m_connections)
+			connection->reader.join();
+		m_inferenceThread.join();
+		for (size_t i = 0; i < m_queue.size(); i++)
+			m_queue[i].connection.reset();
+		for (auto& request : m_batch)
+			request.connection.reset();
+		m_connections.clear();
+		::unlink(m_socketPath.c_str());
+	}
+
+	[[nodiscard]] bool IsRunning() const noexcept { return m_listenFd >= 0; }
+	/// <summary>Bytes of one response, the label and the scores.</summary>
+	[[nodiscard]] size_t ResponseSize() const noexcept { return sizeof(LabelType) + m_outputCount * sizeof(float); }
+	[[nodiscard]] std::string_view ErrorMessage() const noexcept { return m_errorMessage; }
+
+	/// <summary>Counters since <c>Start</c>, percentiles over the most recent <c>LatencySamples</c> requests.</summary>
+	[[nodiscard]] InferenceStats Stats() const
+	{
+		InferenceStats stats;
+		std::vector<float> samples;
+		{
+			std::lock_guard lock(m_statsMutex);
+			stats.Requests = m_requests;
+			stats.Batches = m_batches;
+			samples.assign(m_latencies.begin(), m_latencies.begin() + std::min(m_requests, m_latencies.size()));
+		}
+		stats.Seconds = std::chrono::duration<double>(Clock::now() - m_startTime).count();
+		if (samples.empty())
+			return stats;
+		const auto Percentile = [&samples](double p)
+		{
+			const auto nth = samples.begin() + static_cast<std::ptrdiff_t>(p * static_cast<double>(samples.size() - 1));
+			std::nth_element(samples.begin(), nth, samples.end());
+			return static_cast<double>(*nth);
+		};
+		stats.P50Microseconds = Percentile(0.50);
+		stats.P99Microseconds = Percentile(0.99);
+		stats.MaxMicroseconds = *std::max_element(samples.begin(), samples.end());
+		return stats;
+	}
+	/// <summary>Writes all of <c>data</c> to a stream socket, false if the peer went away. With <c>MSG_DONTWAIT</c> in
+	///	<c>flags</c> it is also false, possibly after a partial write, once the socket buffer is full.</summary>
+	static bool SendAll(int fd, const PixelType* data, size_t size, int flags = 0)
+	{
+		while (size > 0)
+		{
+			const ssize_t sent = ::send(fd, data, size, flags | MSG_NOSIGNAL);
+			if (sent < 0 && errno == EINTR)
+				continue;
+			if (sent <= 0)
+				return false;
+			data += sent;
+			size -= static_cast<size_t>(sent);
+		}
+		return true;
+	}
+private:
+	using Clock = std::chrono::steady_clock;
+	static constexpr size_t LatencySamples = size_t{ 1 } << 16;
+
+	struct Connection
+	{
+		int fd = -1;
+		std::thread reader;
+		std::atomic<bool> finished = false;
+		size_t pending = 0;                             // requests queued or being evaluated, guarded by m_queueMutex
+		~Connection()
+		{
+			if (fd >= 0)
+				::close(fd);
+		}
+	};
+	struct Request
+	{
+		std::shared_ptr<Connection> connection;
+		Clock::time_point arrival;
+	};
+
+	void AcceptLoop()
+	{
+		for (;;)
+		{
+			const int fd = ::accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+			if (fd < 0)
+			{
+				if (errno == EINTR || errno == ECONNABORTED)
+					continue;
+				return;
+			}
+			auto connection = std::make_shared<Connection>();
+			connection->fd = fd;
+			std::lock_guard lock(m_connectionsMutex);
+			if (m_stopping)
+				return;
+			//reap the readers of clients that disconnected.
+			std::erase_if(m_connections, [](const std::shared_ptr<Connection>& c)
+			{
+				if (!c->finished)
+					return false;
+				c->reader.join();
+				return true;
+			});
+			{
+				std::lock_guard queueLock(m_queueMutex);
+				m_liveConnections++;
+			}
+			connection->reader = std::thread([this, connection]()
+			{
+				ReadLoop(connection);
+				{
+					std::lock_guard queueLock(m_queueMutex);
+					m_liveConnections--;
+				}
+				m_queued.notify_one();
+				connection->finished = true;
+			});
+			m_connections.push_back(std::move(connection));
+		}
+	}
+
+	/// <summary>Reads whole images off one connection and queues them, blocking while the queue is full.</summary>
+	void ReadLoop(const std::shared_ptr<Connection>& connection)
+	{
+		Idx3Lib::AlignedBuffer<PixelType> buffer(m_options.MaxBatchSize * m_inputSize);
+		size_t filled = 0;
+		for (;;)
+		{
+			const ssize_t received = ::recv(connection->fd, buffer.data() + filled, buffer.size() - filled, 0);
+			if (received < 0 && errno == EINTR)
+				continue;
+			if (received <= 0)
+				return;
+			filled += static_cast<size_t>(received);
+			const size_t images = filled / m_inputSize;
+			if (images == 0)
+				continue;
+			const auto arrival = Clock::now();
+			{
+				std::unique_lock lock(m_queueMutex);
+				for (size_t i = 0; i < images; i++)
+				{
+					m_space.wait(lock, [this]() { return m_stopping || m_queueCount < m_queue.size(); });
+					if (m_stopping)
+						return;
+					const size_t slot = (m_queueHead + m_queueCount++) % m_queue.size();
+					std::memcpy(m_queuePixels.data() + slot * m_inputSize, buffer.data() + i * m_inputSize, m_inputSize);
+					m_queue[slot] = { connection, arrival };
+					if (connection->pending++ == 0)
+						m_pendingConnections++;
+					//the inference thread only needs waking for the first request and when the batch cannot grow any more.
+					if (m_queueCount == 1 || m_queueCount == m_options.MaxBatchSize || m_pendingConnections >= m_liveConnections)
+						m_queued.notify_one();
+				}
+			}
+			filled -= images * m_inputSize;
+			std::memmove(buffer.data(), buffer.data() + images * m_inputSize, filled);
+		}
+	}
+
+	void InferenceLoop()
+	{
+		for (;;)
+		{
+			size_t batchSize = 0;
+			{
+				std::unique_lock lock(m_queueMutex);
+				m_queued.wait(lock, [this]() { return m_stopping || m_queueCount != 0; });
+				if (m_stopping)
+					return;
+				//waiting is pointless once every client has a request in, clients wait for their responses before sending more.
+				const auto deadline = m_queue[m_queueHead].arrival + m_options.MaxDelay;
+				m_queued.wait_until(lock, deadline, [this]()
+				{
+					return m_stopping || m_queueCount >= m_options.MaxBatchSize || m_pendingConnections >= m_liveConnections;
+				});
+				if (m_stopping)
+					return;
+				batchSize = std::min(m_queueCount, m_options.MaxBatchSize);
+				for (size_t i = 0; i < batchSize; i++)
+				{
+					const size_t slot = (m_queueHead + i) % m_queue.size();
+					std::memcpy(m_batchPixels.data() + i * m_inputSize, m_queuePixels.data() + slot * m_inputSize, m_inputSize);
+					m_batch[i] = std::move(m_queue[slot]);
+				}
+				m_queueHead = (m_queueHead + batchSize) % m_queue.size();
+				m_queueCount -= batchSize;
+			}
+			m_space.notify_all();
+			Serve(batchSize);
+		}
+	}
+
+	/// <summary>Evaluates the taken batch and writes each connection's responses with one send per run of consecutive requests.</summary>
+	void Serve(size_t batchSize)
+	{
+		IDX3_PROFILE_SCOPE_ITEMS("serve batch", batchSize);
+		const auto scores = m_evaluate(m_batchPixels.Span().first(batchSize * m_inputSize), batchSize);
+		const size_t responseSize = ResponseSize();
+		for (size_t i = 0; i < batchSize; i++)
+		{
+			const auto row = scores.subspan(i * m_outputCount, m_outputCount);
+			const auto label = static_cast<LabelType>(std::max_element(row.begin(), row.end()) - row.begin());
+			PixelType* response = m_responses.data() + i * responseSize;
+			std::memcpy(response, &label, sizeof(label));
+			std::memcpy(response + sizeof(label), row.data(), row.size_bytes());
+		}
+		for (size_t first = 0; first < batchSize;)
+		{
+			size_t last = first + 1;
+			while (last < batchSize && m_batch[last].connection == m_batch[first].connection)
+				last++;
+			//a client that went away is not an error, its responses are dropped. One that does not read its responses is cut
+			//off, a response may be half written by then. Shutting the socket down also ends its reader.
+			const int fd = m_batch[first].connection->fd;
+			if (!SendAll(fd, m_responses.data() + first * responseSize, (last - first) * responseSize, MSG_DONTWAIT))
+				::shutdown(fd, SHUT_RDWR);
+			first = last;
+		}
+		const auto done = Clock::now();
+		{
+			std::lock_guard lock(m_statsMutex);
+			for (size_t i = 0; i < batchSize; i++)
+				m_latencies[m_requests++ % m_latencies.size()] = std::chrono::duration<float, std::micro>(done - m_batch[i].arrival).count();
+			m_batches++;
+		}
+		std::lock_guard lock(m_queueMutex);
+		for (size_t i = 0; i < batchSize; i++)
+		{
+			if (--m_batch[i].connection->pending == 0)
+				m_pendingConnections--;
+			m_batch[i].connection.reset();
+		}
+	}
+
+	bool SetError(std::string message)
+	{
+		m_errorMessage = std::move(message);
+		return false;
+	}
+
+	int m_listenFd = -1;
+	std::string m_socketPath;
+	size_t m_inputSize = 0;
+	size_t m_outputCount = 0;
+	EvaluateFn m_evaluate;
+	InferenceServerOptions m_options;
+	std::thread m_acceptThread;
+	std::thread m_inferenceThread;
+	std::mutex m_connectionsMutex;
+	std::vector<std::shared_ptr<Connection>> m_connections;
+	//ring of queued requests, guarded by m_queueMutex
+	std::mutex m_queueMutex;
+	std::condition_variable m_queued;
+	std::condition_variable m_space;
+	Idx3Lib::AlignedBuffer<PixelType> m_queuePixels;
+	std::vector<Request> m_queue;
+	size_t m_queueHead = 0;
+	size_t m_queueCount = 0;
+	size_t m_liveConnections = 0;
+	size_t m_pendingConnections = 0;                    // connections with at least one request queued or being evaluated
+	std::atomic<bool> m_stopping = false;               // written under m_queueMutex so the waits see it, read by the accept thread too
+	//inference thread state
+	Idx3Lib::AlignedBuffer<PixelType> m_batchPixels;
+	std::vector<Request> m_batch;
+	Idx3Lib::AlignedBuffer<PixelType> m_responses;
+	mutable std::mutex m_statsMutex;
+	std::vector<float> m_latencies;
+	size_t m_requests = 0;
+	size_t m_batches = 0;
+	Clock::time_point m_startTime;
+	std::string m_errorMessage;
+};
+
+/// <summary>Blocking client of <c>InferenceServer</c>, one request at a time or several pipelined with <c>Send</c>/<c>Receive</c>.</summary>
+class InferenceClient
+{
+public:
+	InferenceClient() = default;
+	InferenceClient(const InferenceClient&) = delete;
+	InferenceClient& operator=(const InferenceClient&) = delete;
+	~InferenceClient() { Close(); }
+
+	bool Connect(const std::string& socketPath, size_t outputCount)
+	{
+		Close();
+		sockaddr_un address{};
+		if (socketPath.size() >= sizeof(address.sun_path))
+			return false;
+		address.sun_family = AF_UNIX;
+		std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+		m_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (m_fd < 0 || ::connect(m_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+		{
+			Close();
+			return false;
+		}
+		m_response.resize(sizeof(InferenceServer::LabelType) + outputCount * sizeof(float));
+		return true;
+	}
+	void Close()
+	{
+		if (m_fd >= 0)
+			::close(std::exchange(m_fd, -1));
+	}
+	[[nodiscard]] bool IsConnected() const noexcept { return m_fd >= 0; }
+
+	/// <summary>Sends one or more images back to back without waiting for their responses.</summary>
+	bool Send(std::span<const InferenceServer::PixelType> pixels) { return m_fd >= 0 && InferenceServer::SendAll(m_fd, pixels.data(), pixels.size()); }
+	/// <summary>Waits for the next response, returns the predicted class or -1 if the connection failed. <c>scores</c>
+	///	receives the output scores if it is not empty.</summary>
+	InferenceServer::LabelType Receive(std::span<float> scores = {})
+	{
+		size_t received = 0;
+		while (received < m_response.size())
+		{
+			const ssize_t count = ::recv(m_fd, m_response.data() + received, m_response.size() - received, 0);
+			if (count < 0 && errno == EINTR)
+				continue;
+			if (count <= 0)
+				return -1;
+			received += static_cast<size_t>(count);
+		}
+		InferenceServer::LabelType label = 0;
+		std::memcpy(&label, m_response.data(), sizeof(label));
+		if (!scores.empty())
+			std::memcpy(scores.data(), m_response.data() + sizeof(label), std::min(scores.size_bytes(), m_response.size() - sizeof(label)));
+		return label;
+	}
+	/// <summary>One round trip.</summary>
+	InferenceServer::LabelType Predict(std::span<const InferenceServer::PixelType> image, std::span<float> scores = {})
+	{
+		return Send(image) ? Receive(scores) : -1;
+	}
+private:
+	int m_fd = -1;
+	std::vector<std::uint8_t> m_response;
+};
+#endif
@@ -20,8 +20,7 @@ struct InputNode
 	InputNode(const NodeIdType nodeId, const PixelType pixData) : m_nodeId(nodeId), m_bwPixel(pixData)
 	{
 		//randomly generate a weight
-		const auto w = BuildRandom::BuildRandomVector<RandomType>(1, 1);
-		m_weight = w[0] % 100 / 100.0;
+		m_weight = BuildRandom::ThreadEngine()() % 100 / 100.0;
 	}
 	/// <summary>ctor to assign a specific weight</summary>
 	InputNode(const NodeIdType nodeId, const PixelType pixData, const WeightType weight) : m_nodeId(nodeId), m_bwPixel(pixData), m_weight(weight)	{ }
@@ -0,0 +1,238 @@
+#pragma once
+#include "stdafx.h"
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "../MNISTFileLib/AlignedBuffer.hpp"
+#include "../MNISTFileLib/MappedFile.hpp"
+#include "../MNISTFileLib/SwapEndian.hpp"
+#include "Network.hpp"
+
+/// <summary>
+/// Binary model file for a <c>Network</c> of dense layers, laid out so it can be memory mapped and evaluated in place.
+/// </summary>
+namespace ModelFile
+{
+	/*
+	 * Header and layer table fields are big endian like the IDX formats, blobs are little endian floats.
+	 * [offset]    [type]          [value]          [description]
+		0000     32 bit integer  0x46464E4D       magic number ("FFNM")
+		0004     32 bit integer  1                format version
+		0008     32 bit integer  ??               number of layers
+		0012     32 bit integer  64               blob alignment in bytes
+		then per layer, 32 bytes:
+		0000     32 bit integer  ??               number of inputs
+		0004     32 bit integer  ??               number of outputs
+		0008     32 bit integer  ??               activation (Identity 0, Sigmoid 1, ReLU 2, Softmax 3)
+		0012     32 bit integer  0                reserved
+		0016     64 bit integer  ??               file offset of the [outputs x inputs] weights
+		0024     64 bit integer  ??               file offset of the [outputs] biases
+		Every blob starts at a multiple of the blob alignment, padding bytes are zero.
+	 */
+	using Bits32Type = std::uint32_t;
+	using Bits64Type = std::uint64_t;
+	static constexpr Bits32Type MagicNumber = 0x46464E4D;
+	static constexpr Bits32Type Version = 1;
+	static constexpr Bits32Type BlobAlignment = 64;
+	static constexpr size_t HeaderSize = 4 * sizeof(Bits32Type);
+	static constexpr size_t LayerEntrySize = 4 * sizeof(Bits32Type) + 2 * sizeof(Bits64Type);
+	static constexpr bool SwitchEndian = (std::endian::native != std::endian::big);
+	//blobs can be used in place only when the host is little endian.
+	static constexpr bool BlobsNative = (std::endian::native == std::endian::little);
+
+	template<typename T>
+	void AppendBigEndian(std::vector<unsigned char>& bytes, T value)
+	{
+		if constexpr (SwitchEndian)
+			value = swap_endian(value);
+		const size_t offset = bytes.size();
+		bytes.resize(offset + sizeof(T));
+		std::memcpy(bytes.data() + offset, &value, sizeof(T));
+	}
+	template<typename T>
+	[[nodiscard]] T ReadBigEndian(const unsigned char* bytes) noexcept
+	{
+		T value;
+		std::memcpy(&value, bytes, sizeof(T));
+		if constexpr (SwitchEndian)
+			value = swap_endian(value);
+		return value;
+	}
+	[[nodiscard]] constexpr size_t AlignUp(size_t offset) noexcept { return (offset + BlobAlignment - 1) / BlobAlignment * BlobAlignment; }
+
+	/// <summary>Writes every layer of <c>network</c> to <c>path</c>. Returns false if the file could not be written.</summary>
+	inline bool Save(const Network& network, const std::string& path)
+	{
+		std::vector<unsigned char> header;
+		AppendBigEndian<Bits32Type>(header, MagicNumber);
+		AppendBigEndian<Bits32Type>(header, Version);
+		AppendBigEndian<Bits32Type>(header, static_cast<Bits32Type>(network.LayerCount()));
+		AppendBigEndian<Bits32Type>(header, BlobAlignment);
+		size_t offset = AlignUp(HeaderSize + network.LayerCount() * LayerEntrySize);
+		std::vector<std::pair<size_t, std::span<const float>>> blobs;
+		for (size_t l = 0; l < network.LayerCount(); l++)
+		{
+			const DenseLayerView layer = network.Layer(l).View();
+			AppendBigEndian<Bits32Type>(header, static_cast<Bits32Type>(layer.InputCount()));
+			AppendBigEndian<Bits32Type>(header, static_cast<Bits32Type>(layer.OutputCount()));
+			AppendBigEndian<Bits32Type>(header, static_cast<Bits32Type>(layer.m_activation));
+			AppendBigEndian<Bits32Type>(header, 0);
+			for (const auto blob : { layer.m_weights, layer.m_bias })
+			{
+				AppendBigEndian<Bits64Type>(header, offset);
+				blobs.emplace_back(offset, blob);
+				offset = AlignUp(offset + blob.size_bytes());
+			}
+		}
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+		file.write(reinterpret_cast<const char*>(header.data()), static_cast<std::streamsize>(header.size()));
+		size_t written = header.size();
+		const std::array<char, BlobAlignment> padding{};
+		std::vector<float> swapped;
+		for (const auto& [blobOffset, blob] : blobs)
+		{
+			file.write(padding.data(), static_cast<std::streamsize>(blobOffset - written));
+			std::span<const float> data = blob;
+			if constexpr (!BlobsNative)
+			{
+				swapped.resize(blob.size());
+				Endian::SwapCopy(blob.data(), swapped.data(), blob.size());
+				data = swapped;
+			}
+			file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size_bytes()));
+			written = blobOffset + blob.size_bytes();
+		}
+		file.write(padding.data(), static_cast<std::streamsize>(AlignUp(written) - written));
+		return static_cast<bool>(file.flush());
+	}
+
+	/// <summary>
+	/// A model file mapped read-only and evaluated in place. Opening reads only the header and layer table, the weights are
+	/// paged in by the OS as the first forward pass touches them, so startup time does not grow with the model.
+	/// On a big endian host the blobs are copied and byte swapped instead.
+	/// </summary>
+	class MappedModel
+	{
+	public:
+		MappedModel() = default;
+		explicit MappedModel(const std::string& path) { Open(path); }
+
+		/// <summary>Maps the file and validates the header, layer table and blob bounds. Returns false on failure,
+		///	see <c>ErrorMessage()</c>.</summary>
+		bool Open(const std::string& path)
+		{
+			Close();
+			if (!m_file.Open(path))
+				return SetError("File failed to open.");
+			const auto bytes = m_file.Bytes();
+			if (bytes.size() < HeaderSize || ReadBigEndian<Bits32Type>(bytes.data()) != MagicNumber)
+				return SetError("Not a model file.");
+			if (const auto version = ReadBigEndian<Bits32Type>(bytes.data() + 4); version != Version)
+				return SetError("Unsupported model file version " + std::to_string(version) + ".");
+			const auto layerCount = ReadBigEndian<Bits32Type>(bytes.data() + 8);
+			if (ReadBigEndian<Bits32Type>(bytes.data() + 12) % alignof(float) != 0 || bytes.size() < HeaderSize + layerCount * LayerEntrySize)
+				return SetError("Corrupt model header.");
+			for (size_t l = 0; l < layerCount; l++)
+			{
+				const unsigned char* entry = bytes.data() + HeaderSize + l * LayerEntrySize;
+				DenseLayerView layer;
+				layer.m_inputs = ReadBigEndian<Bits32Type>(entry);
+				layer.m_outputs = ReadBigEndian<Bits32Type>(entry + 4);
+				const auto activation = ReadBigEndian<Bits32Type>(entry + 8);
+				if (activation > static_cast<Bits32Type>(Activation::Softmax))
+					return SetError("Layer " + std::to_string(l) + " has an unknown activation.");
+				layer.m_activation = static_cast<Activation>(activation);
+				if (!m_layers.empty() && m_layers.back().OutputCount() != layer.InputCount())
+					return SetError("Layer " + std::to_string(l) + " input count does not match the previous layer.");
+				if (!Blob(ReadBigEndian<Bits64Type>(entry + 16), layer.m_inputs * layer.m_outputs, layer.m_weights)
+					|| !Blob(ReadBigEndian<Bits64Type>(entry + 24), layer.m_outputs, layer.m_bias))
+					return SetError("Layer " + std::to_string(l) + " data lies outside the file.");
+				m_layers.push_back(layer);
+			}
+			m_outputs.resize(m_layers.size());
+			m_errorMessage.clear();
+			return true;
+		}
+		void Close()
+		{
+			m_layers.clear();
+			m_outputs.clear();
+			m_swapped.clear();
+			m_file.Close();
+		}
+
+		[[nodiscard]] bool IsOpen() const noexcept { return m_file.IsOpen(); }
+		[[nodiscard]] size_t LayerCount() const noexcept { return m_layers.size(); }
+		[[nodiscard]] const DenseLayerView& Layer(size_t index) const noexcept { return m_layers[index]; }
+		[[nodiscard]] size_t InputCount() const noexcept { return m_layers.empty() ? 0 : m_layers.front().InputCount(); }
+		[[nodiscard]] size_t OutputCount() const noexcept { return m_layers.empty() ? 0 : m_layers.back().OutputCount(); }
+		[[nodiscard]] std::string_view ErrorMessage() const noexcept { return m_errorMessage; }
+
+		/// <summary>Evaluates <c>batchSize</c> input rows, as <c>Network::Forward</c>. The returned span stays valid until the next call.</summary>
+		std::span<const float> Forward(std::span<const float> input, size_t batchSize)
+		{
+			if (m_layers.empty())
+				return {};
+			const float* layerInput = input.data();
+			for (size_t l = 0; l < m_layers.size(); l++)
+			{
+				m_outputs[l].Resize(batchSize * m_layers[l].OutputCount());
+				ForwardLayer(m_layers[l], layerInput, batchSize, m_outputs[l].data(), m_workspace);
+				layerInput = m_outputs[l].data();
+			}
+			return { m_outputs.back().data(), batchSize * OutputCount() };
+		}
+
+		/// <summary>Copies the model into an owning <c>Network</c>, e.g. to continue training it.</summary>
+		[[nodiscard]] Network ToNetwork() const
+		{
+			Network network;
+			for (const auto& view : m_layers)
+			{
+				DenseLayer layer(view.InputCount(), view.OutputCount(), view.m_activation);
+				std::copy(view.m_weights.begin(), view.m_weights.end(), layer.m_weights.begin());
+				std::copy(view.m_bias.begin(), view.m_bias.end(), layer.m_bias.begin());
+				network.AddLayer(std::move(layer));
+			}
+			return network;
+		}
+	private:
+		bool Blob(Bits64Type offset, size_t count, std::span<const float>& out)
+		{
+			const auto bytes = m_file.Bytes();
+			if (offset % alignof(float) != 0 || offset > bytes.size() || (bytes.size() - offset) / sizeof(float) < count)
+				return false;
+			const float* data = reinterpret_cast<const float*>(bytes.data() + offset);
+			if constexpr (BlobsNative)
+			{
+				out = { data, count };
+			}
+			else
+			{
+				auto& copy = m_swapped.emplace_back(count);
+				Endian::SwapCopy(data, copy.data(), count);
+				out = copy.Span();
+			}
+			return true;
+		}
+		bool SetError(std::string message)
+		{
+			m_errorMessage = std::move(message);
+			Close();
+			return false;
+		}
+
+		Idx3Lib::MappedFile m_file;
+		std::vector<DenseLayerView> m_layers;
+		std::vector<Idx3Lib::AlignedBuffer<float>> m_outputs;
+		std::vector<Idx3Lib::AlignedBuffer<float>> m_swapped;
+		Gemm::Workspace m_workspace;
+		std::string m_errorMessage;
+	};
+}
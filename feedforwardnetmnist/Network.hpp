@@ -0,0 +1,119 @@
+#pragma once
+#include "stdafx.h"
+#include <span>
+#include <vector>
+#include "../MNISTFileLib/Idx3BatchReader.hpp"
+#include "../MNISTFileLib/Instrumentation.hpp"
+#include "Arena.hpp"
+#include "DenseLayer.hpp"
+#include "Gemm.hpp"
+#include "ThreadPool.hpp"
+
+/// <summary>Batched forward pass of one layer, <c>output[N x outputs] = activation(input[N x inputs] * weights^T + bias)</c>.
+///	The multiply is split across <c>pool</c> when one is given.</summary>
+inline void ForwardLayer(const DenseLayerView& layer, const float* input, size_t batchSize, float* output, Gemm::Workspace& workspace, ThreadPool* pool = nullptr)
+{
+	if (pool != nullptr)
+		Gemm::MatMulTransposedB(input, layer.InputCount(), layer.m_weights.data(), layer.InputCount(), layer.m_bias.data(),
+			output, layer.OutputCount(), batchSize, layer.OutputCount(), layer.InputCount(), workspace, *pool);
+	else
+		Gemm::MatMulTransposedB(input, layer.InputCount(), layer.m_weights.data(), layer.InputCount(), layer.m_bias.data(),
+			output, layer.OutputCount(), batchSize, layer.OutputCount(), layer.InputCount(), workspace);
+	ApplyActivation(layer.m_activation, output, batchSize, layer.OutputCount());
+}
+
+/// <summary>A feed forward network of <c>DenseLayer</c>s evaluated a whole batch at a time.
+///	Each layer is one blocked matrix multiply of the <c>[N x inputs]</c> batch with the layer's weights, so the weights
+///	are streamed through the cache once per batch rather than once per image. Per layer results are slices of one
+///	arena sized for the largest batch by <c>Reserve</c>, a steady state loop over batches up to that size does not allocate.</summary>
+class Network
+{
+public:
+	using ActivationResultType = DenseLayer::ActivationResultType;
+
+	Network() = default;
+	/// <summary>Builds randomly initialized layers without activation functions, <c>layerSizes</c> holds the input count followed
+	///	by each layer's output count, e.g. { 784, 10, 1 } is a 784 input network with a hidden layer of 10 and an output layer of 1.</summary>
+	explicit Network(std::initializer_list<size_t> layerSizes)
+	{
+		const std::vector<size_t> sizes(layerSizes);
+		for (size_t i = 1; i < sizes.size(); i++)
+			AddLayer(DenseLayer(sizes[i - 1], sizes[i]));
+	}
+	/// <summary>Appends a layer, its input count must match the previous layer's output count.</summary>
+	void AddLayer(DenseLayer layer)
+	{
+		m_layers.emplace_back(std::move(layer));
+		m_outputs.emplace_back();
+		m_maxBatchSize = 0;
+	}
+	/// <summary>Preallocates every layer's results and the multiply's scratch space for batches of up to <c>maxBatchSize</c> rows,
+	///	call once the layers and thread pool are set. A larger batch reserves again on its first <c>Forward</c>.</summary>
+	void Reserve(size_t maxBatchSize)
+	{
+		size_t bytes = 0;
+		size_t widest = 0;
+		for (const auto& layer : m_layers)
+		{
+			bytes += Arena::Footprint<ActivationResultType>(maxBatchSize * layer.OutputCount());
+			widest = std::max(widest, layer.OutputCount());
+		}
+		m_arena.Reserve(bytes);
+		Gemm::Reserve(m_workspace, widest, m_pool == nullptr ? 1 : m_pool->ThreadCount());
+		m_maxBatchSize = maxBatchSize;
+	}
+	[[nodiscard]] size_t MaxBatchSize() const noexcept { return m_maxBatchSize; }
+
+	/// <summary>Splits each layer's matrix multiply across <c>pool</c>, null runs single threaded. The pool must outlive its use.</summary>
+	void SetThreadPool(ThreadPool* pool) noexcept
+	{
+		m_pool = pool;
+		m_maxBatchSize = 0;
+	}
+	[[nodiscard]] ThreadPool* GetThreadPool() const noexcept { return m_pool; }
+
+	[[nodiscard]] size_t LayerCount() const noexcept { return m_layers.size(); }
+	[[nodiscard]] DenseLayer& Layer(size_t index) noexcept { return m_layers[index]; }
+	[[nodiscard]] const DenseLayer& Layer(size_t index) const noexcept { return m_layers[index]; }
+	[[nodiscard]] size_t InputCount() const noexcept { return m_layers.empty() ? 0 : m_layers.front().InputCount(); }
+	[[nodiscard]] size_t OutputCount() const noexcept { return m_layers.empty() ? 0 : m_layers.back().OutputCount(); }
+	/// <summary>Activated results of layer <c>index</c> from the last Forward call, row-major <c>[N x outputs]</c>.</summary>
+	[[nodiscard]] std::span<const ActivationResultType> LayerOutput(size_t index) const noexcept
+	{
+		return { m_outputs[index].data(), m_batchSize * m_layers[index].OutputCount() };
+	}
+
+	/// <summary>Evaluates <c>batchSize</c> input rows of <c>InputCount()</c> values each, returns the final layer's
+	///	<c>[batchSize x OutputCount()]</c> results. The returned span stays valid until the next call.</summary>
+	std::span<const ActivationResultType> Forward(std::span<const float> input, size_t batchSize)
+	{
+		if (batchSize > m_maxBatchSize)
+			Reserve(batchSize);
+		m_arena.Reset();
+		m_batchSize = batchSize;
+		const float* layerInput = input.data();
+		for (size_t i = 0; i < m_layers.size(); i++)
+		{
+			const DenseLayer& layer = m_layers[i];
+			auto& output = m_outputs[i];
+			output = m_arena.Allocate<ActivationResultType>(batchSize * layer.OutputCount());
+			IDX3_PROFILE_SCOPE_INDEXED("forward layer ", i);
+			ForwardLayer(layer.View(), layerInput, batchSize, output.data(), m_workspace, m_pool);
+			layerInput = output.data();
+		}
+		return m_layers.empty() ? std::span<const ActivationResultType>{} : LayerOutput(m_layers.size() - 1);
+	}
+	/// <summary>Evaluates the filled part of a decoded batch.</summary>
+	std::span<const ActivationResultType> Forward(const Idx3Lib::Idx3Batch<float>& batch)
+	{
+		return Forward(batch.Filled(), batch.Count);
+	}
+private:
+	std::vector<DenseLayer> m_layers;
+	std::vector<std::span<ActivationResultType>> m_outputs;
+	Arena m_arena;
+	Gemm::Workspace m_workspace;
+	ThreadPool* m_pool = nullptr;
+	size_t m_batchSize = 0;
+	size_t m_maxBatchSize = 0;
+};
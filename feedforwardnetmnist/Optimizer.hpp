@@ -0,0 +1,98 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <span>
+#include "../MNISTFileLib/AlignedBuffer.hpp"
+
+enum class OptimizerType
+{
+	SGD,
+	Momentum,
+	Adam
+};
+
+struct OptimizerOptions
+{
+	OptimizerType Type = OptimizerType::Adam;
+	float LearningRate = 0.001f;
+	float Momentum = 0.9f;      // Momentum only
+	float Beta1 = 0.9f;         // Adam only
+	float Beta2 = 0.999f;       // Adam only
+	float Epsilon = 1e-8f;      // Adam only
+};
+
+/// <summary>Per parameter array optimizer state (velocity, or Adam's first and second moments), zeroed on first use.</summary>
+struct OptimizerState
+{
+	Idx3Lib::AlignedBuffer<float> first;
+	Idx3Lib::AlignedBuffer<float> second;
+};
+
+/// <summary>Applies one gradient step to parameter arrays. Call <c>BeginStep()</c> once per mini-batch, then
+///	<c>Update()</c> for every parameter array with its gradient and its own state.</summary>
+class Optimizer
+{
+public:
+	explicit Optimizer(const OptimizerOptions& options = {}) : m_options(options) { }
+	[[nodiscard]] const OptimizerOptions& Options() const noexcept { return m_options; }
+	void BeginStep() noexcept
+	{
+		m_step++;
+		if (m_options.Type == OptimizerType::Adam)
+		{
+			m_beta1Correction = 1.0f / (1.0f - std::pow(m_options.Beta1, static_cast<float>(m_step)));
+			m_beta2Correction = 1.0f / (1.0f - std::pow(m_options.Beta2, static_cast<float>(m_step)));
+		}
+	}
+	void Update(std::span<float> parameters, std::span<const float> gradients, OptimizerState& state) const
+	{
+		const float learningRate = m_options.LearningRate;
+		switch (m_options.Type)
+		{
+		case OptimizerType::SGD:
+			for (size_t i = 0; i < parameters.size(); i++)
+				parameters[i] -= learningRate * gradients[i];
+			break;
+		case OptimizerType::Momentum:
+		{
+			EnsureState(state.first, parameters.size());
+			float* velocity = state.first.data();
+			for (size_t i = 0; i < parameters.size(); i++)
+			{
+				velocity[i] = m_options.Momentum * velocity[i] - learningRate * gradients[i];
+				parameters[i] += velocity[i];
+			}
+			break;
+		}
+		case OptimizerType::Adam:
+		{
+			EnsureState(state.first, parameters.size());
+			EnsureState(state.second, parameters.size());
+			float* m = state.first.data();
+			float* v = state.second.data();
+			const float beta1 = m_options.Beta1;
+			const float beta2 = m_options.Beta2;
+			for (size_t i = 0; i < parameters.size(); i++)
+			{
+				m[i] = beta1 * m[i] + (1.0f - beta1) * gradients[i];
+				v[i] = beta2 * v[i] + (1.0f - beta2) * gradients[i] * gradients[i];
+				parameters[i] -= learningRate * (m[i] * m_beta1Correction) / (std::sqrt(v[i] * m_beta2Correction) + m_options.Epsilon);
+			}
+			break;
+		}
+		}
+	}
+private:
+	static void EnsureState(Idx3Lib::AlignedBuffer<float>& buffer, size_t count)
+	{
+		if (buffer.size() != count)
+		{
+			buffer.Resize(count);
+			std::fill(buffer.begin(), buffer.end(), 0.0f);
+		}
+	}
+	OptimizerOptions m_options;
+	size_t m_step = 0;
+	float m_beta1Correction = 1.0f;
+	float m_beta2Correction = 1.0f;
+};
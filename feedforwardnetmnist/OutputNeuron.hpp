@@ -34,8 +34,7 @@ struct OutputNeuron
 			if (!m_weightMap[elem.m_nodeId])
 			{
 				//Randomly generate a weight.
-				const auto w = BuildRandom::BuildRandomVector<RandomType>(1, 1);
-				m_weightMap[elem.m_nodeId] = w[0] % 100 / 100.0;
+				m_weightMap[elem.m_nodeId] = BuildRandom::ThreadEngine()() % 100 / 100.0;
 			}
 		}
 		// might want a big number lib for this with many input nodes, boost has one that seemed good
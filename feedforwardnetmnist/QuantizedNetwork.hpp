@@ -0,0 +1,181 @@
+#pragma once
+#include "stdafx.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "../MNISTFileLib/AlignedBuffer.hpp"
+#include "../MNISTFileLib/Idx3BatchReader.hpp"
+#include "DotKernels.hpp"
+#include "Network.hpp"
+
+/// <summary>Affine mapping between real values and unsigned 8 bit codes, <c>real = Scale * (code - ZeroPoint)</c>.</summary>
+struct QuantizationParams
+{
+	float Scale = 1.0f;
+	std::int32_t ZeroPoint = 0;
+
+	/// <summary>Parameters covering [min, max], widened to include zero so zero is represented exactly.</summary>
+	[[nodiscard]] static QuantizationParams FromRange(float min, float max) noexcept
+	{
+		min = std::min(min, 0.0f);
+		max = std::max(max, 0.0f);
+		if (max - min <= 0.0f)
+			return {};
+		const float scale = (max - min) / 255.0f;
+		return { scale, std::clamp(static_cast<std::int32_t>(std::lround(-min / scale)), 0, 255) };
+	}
+	[[nodiscard]] std::uint8_t Quantize(float value) const noexcept
+	{
+		return static_cast<std::uint8_t>(std::clamp(static_cast<std::int32_t>(std::lrint(value / Scale)) + ZeroPoint, 0, 255));
+	}
+	[[nodiscard]] float Dequantize(std::uint8_t code) const noexcept { return Scale * static_cast<float>(static_cast<std::int32_t>(code) - ZeroPoint); }
+};
+
+/// <summary>An int8 copy of a <c>DenseLayer</c> for inference. Weights are quantized symmetrically with one scale for the
+///	whole layer (zero point 0, codes in [-127, 127]), inputs are u8 codes with the layer's input <c>QuantizationParams</c>.
+///	Each output is an exact int32 dot product rescaled to float, the input zero point is folded in with precomputed row sums:
+///	<c>y = weightScale * inputScale * (sum(q_w * q_x) - inputZeroPoint * sum(q_w)) + bias</c>.</summary>
+struct QuantizedLayer
+{
+	using WeightType = DotKernels::QuantizedWeightType;
+	using InputType = DotKernels::PixelType;
+
+	size_t m_inputs = 0;
+	size_t m_outputs = 0;
+	Activation m_activation = Activation::Identity;
+	float m_weightScale = 1.0f;
+	QuantizationParams m_input;
+	Idx3Lib::AlignedBuffer<WeightType> m_weights;      // [outputs x inputs]
+	Idx3Lib::AlignedBuffer<std::int32_t> m_rowSums;    // [outputs]
+	Idx3Lib::AlignedBuffer<float> m_bias;              // [outputs]
+
+	QuantizedLayer() = default;
+	QuantizedLayer(const DenseLayer& layer, QuantizationParams input)
+		: m_inputs(layer.InputCount()), m_outputs(layer.OutputCount()), m_activation(layer.m_activation), m_input(input),
+		m_weights(layer.m_weights.size()), m_rowSums(layer.OutputCount()), m_bias(layer.OutputCount())
+	{
+		float maxMagnitude = 0.0f;
+		for (const auto elem : layer.m_weights)
+			maxMagnitude = std::max(maxMagnitude, std::abs(elem));
+		m_weightScale = maxMagnitude > 0.0f ? maxMagnitude / 127.0f : 1.0f;
+		for (size_t o = 0; o < m_outputs; o++)
+		{
+			std::int32_t rowSum = 0;
+			for (size_t i = 0; i < m_inputs; i++)
+			{
+				const auto q = static_cast<WeightType>(std::clamp(std::lround(layer.m_weights[o * m_inputs + i] / m_weightScale), -127L, 127L));
+				m_weights[o * m_inputs + i] = q;
+				rowSum += q;
+			}
+			m_rowSums[o] = rowSum;
+			m_bias[o] = layer.m_bias[o];
+		}
+	}
+	QuantizedLayer(QuantizedLayer&&) noexcept = default;
+	QuantizedLayer& operator=(QuantizedLayer&&) noexcept = default;
+
+	[[nodiscard]] size_t InputCount() const noexcept { return m_inputs; }
+	[[nodiscard]] size_t OutputCount() const noexcept { return m_outputs; }
+	[[nodiscard]] std::span<const WeightType> Row(size_t output) const noexcept { return { m_weights.data() + output * m_inputs, m_inputs }; }
+	/// <summary>Bytes held by the weights, row sums and biases.</summary>
+	[[nodiscard]] size_t ModelSize() const noexcept { return m_weights.size() * sizeof(WeightType) + m_outputs * (sizeof(std::int32_t) + sizeof(float)); }
+
+	/// <summary>Evaluates <c>batchSize</c> rows of <c>InputCount()</c> u8 codes into <c>[batchSize x OutputCount()]</c> activated floats.</summary>
+	void Forward(const InputType* input, size_t batchSize, float* output) const noexcept
+	{
+		const float outputScale = m_weightScale * m_input.Scale;
+		for (size_t n = 0; n < batchSize; n++)
+		{
+			const std::span<const InputType> row(input + n * m_inputs, m_inputs);
+			float* out = output + n * m_outputs;
+			for (size_t o = 0; o < m_outputs; o++)
+			{
+				const std::int32_t acc = DotKernels::DotU8S8(row, Row(o)) - m_input.ZeroPoint * m_rowSums[o];
+				out[o] = outputScale * static_cast<float>(acc) + m_bias[o];
+			}
+		}
+		ApplyActivation(m_activation, output, batchSize, m_outputs);
+	}
+};
+
+/// <summary>
+/// Int8 inference copy of a trained <c>Network</c> that consumes raw IDX3 pixels directly, without decoding them to float.
+/// Built by <c>Calibrate()</c>: the float network is run over sample images to find the range of each hidden layer's
+/// activations, which become the u8 quantization parameters of the next layer's input. Weights take a quarter of the
+/// float model's memory. Results are float, the last layer's activation is applied as in the float network.
+/// </summary>
+class QuantizedNetwork
+{
+public:
+	using PixelType = DotKernels::PixelType;
+
+	QuantizedNetwork() = default;
+
+	/// <summary>Quantizes <c>network</c>, calibrating with <c>count</c> images of raw pixels. <c>scale</c> is how the network
+	///	was trained to see pixels, the default matches <c>PixelScale::Normalized</c> decoding.</summary>
+	static QuantizedNetwork Calibrate(Network& network, std::span<const PixelType> pixels, size_t count, Idx3Lib::PixelScale scale = Idx3Lib::PixelScale::Normalized)
+	{
+		QuantizedNetwork quantized;
+		if (network.LayerCount() == 0 || count == 0)
+			return quantized;
+		Idx3Lib::AlignedBuffer<float> decoded(count * network.InputCount());
+		Idx3Lib::ConvertPixels(pixels.first(decoded.size()), decoded.Span(), scale);
+		network.Forward(decoded.Span(), count);
+		//raw pixels are already u8 codes, normalized ones map back with a scale of 1/255.
+		QuantizationParams input{ scale == Idx3Lib::PixelScale::Normalized ? 1.0f / 255.0f : 1.0f, 0 };
+		for (size_t l = 0; l < network.LayerCount(); l++)
+		{
+			quantized.m_layers.emplace_back(network.Layer(l), input);
+			const auto activations = network.LayerOutput(l);
+			const auto [minIt, maxIt] = std::minmax_element(activations.begin(), activations.end());
+			input = QuantizationParams::FromRange(*minIt, *maxIt);
+		}
+		quantized.m_outputs.resize(quantized.m_layers.size());
+		quantized.m_codes.resize(quantized.m_layers.size());
+		return quantized;
+	}
+
+	[[nodiscard]] size_t LayerCount() const noexcept { return m_layers.size(); }
+	[[nodiscard]] const QuantizedLayer& Layer(size_t index) const noexcept { return m_layers[index]; }
+	[[nodiscard]] size_t InputCount() const noexcept { return m_layers.empty() ? 0 : m_layers.front().InputCount(); }
+	[[nodiscard]] size_t OutputCount() const noexcept { return m_layers.empty() ? 0 : m_layers.back().OutputCount(); }
+	[[nodiscard]] size_t ModelSize() const noexcept
+	{
+		size_t bytes = 0;
+		for (const auto& layer : m_layers)
+			bytes += layer.ModelSize();
+		return bytes;
+	}
+
+	/// <summary>Evaluates <c>batchSize</c> images of raw pixels, returns the final layer's <c>[batchSize x OutputCount()]</c>
+	///	results. Hidden activations are requantized to u8 between layers. The returned span stays valid until the next call.</summary>
+	std::span<const float> Forward(std::span<const PixelType> pixels, size_t batchSize)
+	{
+		if (m_layers.empty())
+			return {};
+		const PixelType* layerInput = pixels.data();
+		for (size_t l = 0; l < m_layers.size(); l++)
+		{
+			const QuantizedLayer& layer = m_layers[l];
+			auto& output = m_outputs[l];
+			output.Resize(batchSize * layer.OutputCount());
+			layer.Forward(layerInput, batchSize, output.data());
+			if (l + 1 < m_layers.size())
+			{
+				const QuantizationParams& next = m_layers[l + 1].m_input;
+				auto& codes = m_codes[l];
+				codes.Resize(output.size());
+				for (size_t i = 0; i < output.size(); i++)
+					codes[i] = next.Quantize(output[i]);
+				layerInput = codes.data();
+			}
+		}
+		return { m_outputs.back().data(), batchSize * OutputCount() };
+	}
+private:
+	std::vector<QuantizedLayer> m_layers;
+	std::vector<Idx3Lib::AlignedBuffer<float>> m_outputs;
+	std::vector<Idx3Lib::AlignedBuffer<PixelType>> m_codes;
+};
@@ -0,0 +1,171 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <span>
+
+namespace BuildRandom
+{
+	/// <summary>
+	/// Philox4x32-10 counter based generator (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3").
+	/// Every block of four 32 bit outputs is a pure function of (seed, stream, block index), so any position of any
+	/// stream can be reached in O(1) with <c>Seek()</c>. Work split across threads by position produces exactly the
+	/// same values as a single threaded pass, and distinct streams of one seed are independent.
+	/// Meets the UniformRandomBitGenerator requirements, so it plugs into the standard distributions.
+	/// </summary>
+	class Philox4x32
+	{
+	public:
+		using result_type = std::uint32_t;
+		using BlockType = std::array<result_type, 4>;
+		static constexpr std::uint64_t DefaultSeed = 0x853C49E6748FEA9BULL;
+
+		explicit Philox4x32(std::uint64_t seed = DefaultSeed, std::uint64_t stream = 0) noexcept : m_seed(seed), m_stream(stream) { }
+
+		static constexpr result_type min() noexcept { return 0; }
+		static constexpr result_type max() noexcept { return std::numeric_limits<result_type>::max(); }
+
+		result_type operator()() noexcept
+		{
+			if (m_lane == m_block.size())
+			{
+				m_block = Generate(m_seed, m_stream, m_blockIndex++);
+				m_lane = 0;
+			}
+			return m_block[m_lane++];
+		}
+
+		/// <summary>Moves to output number <c>position</c> of the stream.</summary>
+		void Seek(std::uint64_t position) noexcept
+		{
+			m_blockIndex = position / 4;
+			m_lane = static_cast<size_t>(position % 4);
+			if (m_lane != 0)
+				m_block = Generate(m_seed, m_stream, m_blockIndex++);
+			else
+				m_lane = m_block.size();
+		}
+		void Reseed(std::uint64_t seed, std::uint64_t stream = 0) noexcept
+		{
+			m_seed = seed;
+			m_stream = stream;
+			Seek(0);
+		}
+		/// <summary>Number of outputs consumed so far.</summary>
+		[[nodiscard]] std::uint64_t Position() const noexcept { return m_blockIndex * 4 - (m_block.size() - m_lane); }
+		[[nodiscard]] std::uint64_t Seed() const noexcept { return m_seed; }
+		[[nodiscard]] std::uint64_t Stream() const noexcept { return m_stream; }
+
+		/// <summary>Fills <c>values</c> uniformly in [low, high) with 24 bits of randomness per value, consuming one output each.</summary>
+		void Fill(std::span<float> values, float low, float high) noexcept
+		{
+			const float scale = (high - low) * (1.0f / 16777216.0f);
+			FillWith(values, [low, scale](result_type r) { return low + static_cast<float>(r >> 8) * scale; });
+		}
+		/// <summary>Fills <c>bytes</c> with uniform bytes, consuming one output per four bytes.
+		///	Bytes are taken least significant first so the result does not depend on the platform's byte order.</summary>
+		void Fill(std::span<std::uint8_t> bytes) noexcept
+		{
+			size_t i = 0;
+			for (; i + 4 <= bytes.size(); i += 4)
+			{
+				const result_type r = (*this)();
+				bytes[i] = static_cast<std::uint8_t>(r);
+				bytes[i + 1] = static_cast<std::uint8_t>(r >> 8);
+				bytes[i + 2] = static_cast<std::uint8_t>(r >> 16);
+				bytes[i + 3] = static_cast<std::uint8_t>(r >> 24);
+			}
+			if (i < bytes.size())
+			{
+				result_type r = (*this)();
+				for (; i < bytes.size(); i++, r >>= 8)
+					bytes[i] = static_cast<std::uint8_t>(r);
+			}
+		}
+
+		/// <summary>The four outputs of block <c>blockIndex</c> of <c>stream</c>, ten Philox rounds over the
+		///	counter (block index, stream) keyed by the seed.</summary>
+		[[nodiscard]] static constexpr BlockType Generate(std::uint64_t seed, std::uint64_t stream, std::uint64_t blockIndex) noexcept
+		{
+			constexpr std::uint64_t M0 = 0xD2511F53;
+			constexpr std::uint64_t M1 = 0xCD9E8D57;
+			constexpr result_type W0 = 0x9E3779B9;
+			constexpr result_type W1 = 0xBB67AE85;
+			BlockType c{ static_cast<result_type>(blockIndex), static_cast<result_type>(blockIndex >> 32), static_cast<result_type>(stream), static_cast<result_type>(stream >> 32) };
+			result_type k0 = static_cast<result_type>(seed);
+			result_type k1 = static_cast<result_type>(seed >> 32);
+			for (int round = 0; round < 10; round++)
+			{
+				const std::uint64_t p0 = M0 * c[0];
+				const std::uint64_t p1 = M1 * c[2];
+				c = { static_cast<result_type>(p1 >> 32) ^ c[1] ^ k0, static_cast<result_type>(p1),
+					static_cast<result_type>(p0 >> 32) ^ c[3] ^ k1, static_cast<result_type>(p0) };
+				k0 += W0;
+				k1 += W1;
+			}
+			return c;
+		}
+	private:
+		template<typename T, typename Convert>
+		void FillWith(std::span<T> values, Convert convert) noexcept
+		{
+			size_t i = 0;
+			//drain the current block, then generate whole blocks straight into the output.
+			for (; i < values.size() && m_lane != m_block.size(); i++)
+				values[i] = convert(m_block[m_lane++]);
+			for (; i + 4 <= values.size(); i += 4)
+			{
+				const BlockType block = Generate(m_seed, m_stream, m_blockIndex++);
+				for (size_t lane = 0; lane < 4; lane++)
+					values[i + lane] = convert(block[lane]);
+			}
+			for (; i < values.size(); i++)
+				values[i] = convert((*this)());
+		}
+
+		std::uint64_t m_seed;
+		std::uint64_t m_stream;
+		std::uint64_t m_blockIndex = 0;
+		BlockType m_block{};
+		size_t m_lane = 4;
+	};
+
+	namespace Detail
+	{
+		inline std::atomic<std::uint64_t>& GlobalSeedStorage() noexcept
+		{
+			static std::atomic<std::uint64_t> seed{ Philox4x32::DefaultSeed };
+			return seed;
+		}
+		inline std::atomic<std::uint64_t>& NextThreadStream() noexcept
+		{
+			static std::atomic<std::uint64_t> stream{ 0 };
+			return stream;
+		}
+	}
+
+	/// <summary>Seed used by <c>ThreadEngine()</c>, a fixed default unless changed so runs repeat exactly.</summary>
+	[[nodiscard]] inline std::uint64_t GlobalSeed() noexcept { return Detail::GlobalSeedStorage().load(std::memory_order_relaxed); }
+
+	/// <summary>The calling thread's generator, seeded with <c>GlobalSeed()</c>. The first thread to use it gets stream 0, the
+	///	next stream 1 and so on. Threads started in a nondeterministic order should call <c>SeedThread()</c> with a fixed
+	///	stream (e.g. their worker index) for reproducible results.</summary>
+	[[nodiscard]] inline Philox4x32& ThreadEngine()
+	{
+		thread_local Philox4x32 engine(GlobalSeed(), Detail::NextThreadStream().fetch_add(1, std::memory_order_relaxed));
+		return engine;
+	}
+	/// <summary>Restarts the calling thread's generator at the beginning of <c>stream</c> of the global seed.</summary>
+	inline void SeedThread(std::uint64_t stream)
+	{
+		ThreadEngine().Reseed(GlobalSeed(), stream);
+	}
+	/// <summary>Changes the global seed. The calling thread's generator restarts on its stream with the new seed immediately,
+	///	other threads pick it up when they first use <c>ThreadEngine()</c> or call <c>SeedThread()</c>.</summary>
+	inline void SetGlobalSeed(std::uint64_t seed)
+	{
+		Detail::GlobalSeedStorage().store(seed, std::memory_order_relaxed);
+		SeedThread(ThreadEngine().Stream());
+	}
+}
@@ -0,0 +1,201 @@
+#pragma once
+#include "stdafx.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <span>
+#include <tuple>
+#include <utility>
+#include "DotKernels.hpp"
+#include "Activation.hpp"
+#include "DenseLayer.hpp"
+#include "Network.hpp"
+
+/// <summary>Single image kernels of <c>StaticNetwork</c>, every loop bound is a template argument so the compiler
+///	unrolls the register loops completely and keeps the accumulators in registers.</summary>
+namespace StaticKernels
+{
+	constexpr size_t Lanes = 8;         // floats per AVX register
+	constexpr size_t BlockWidth = 64;   // outputs per pass over the input, eight accumulator registers
+
+	template<size_t Inputs, size_t Width>
+	using MatVecBlockFn = void(*)(const float* input, const float* panel, const float* bias, float* output);
+
+	/// <summary>Portable kernel: output[Width] = bias + input[Inputs] * panel[Inputs x Width], the panel input-major.</summary>
+	template<size_t Inputs, size_t Width>
+	inline void MatVecBlockScalar(const float* input, const float* panel, const float* bias, float* output) noexcept
+	{
+		std::array<float, Width> acc;
+		for (size_t j = 0; j < Width; j++)
+			acc[j] = bias[j];
+		for (size_t i = 0; i < Inputs; i++)
+		{
+			const float x = input[i];
+			const float* w = panel + i * Width;
+			for (size_t j = 0; j < Width; j++)
+				acc[j] += x * w[j];
+		}
+		for (size_t j = 0; j < Width; j++)
+			output[j] = acc[j];
+	}
+
+#ifdef DOTKERNELS_X86
+	/// <summary>AVX2 kernel, each input is broadcast once and multiplied into all <c>Width / 8</c> accumulators,
+	///	so the panel is streamed front to back exactly once.</summary>
+	template<size_t Inputs, size_t Width>
+	DOTKERNELS_TARGET_AVX2 inline void MatVecBlockAVX2(const float* input, const float* panel, const float* bias, float* output) noexcept
+	{
+		constexpr size_t Registers = Width / Lanes;
+		__m256 acc[Registers];
+		for (size_t r = 0; r < Registers; r++)
+			acc[r] = _mm256_load_ps(bias + r * Lanes);
+		for (size_t i = 0; i < Inputs; i++)
+		{
+			const __m256 x = _mm256_broadcast_ss(input + i);
+			const float* w = panel + i * Width;
+			for (size_t r = 0; r < Registers; r++)
+				acc[r] = _mm256_fmadd_ps(x, _mm256_load_ps(w + r * Lanes), acc[r]);
+		}
+		for (size_t r = 0; r < Registers; r++)
+			_mm256_store_ps(output + r * Lanes, acc[r]);
+	}
+#endif
+
+	template<size_t Inputs, size_t Width>
+	[[nodiscard]] inline MatVecBlockFn<Inputs, Width> GetMatVecBlock(DotKernels::InstructionSet isa) noexcept
+	{
+#ifdef DOTKERNELS_X86
+		if (isa >= DotKernels::InstructionSet::AVX2)
+			return &MatVecBlockAVX2<Inputs, Width>;
+#endif
+		(void)isa;
+		return &MatVecBlockScalar<Inputs, Width>;
+	}
+}
+
+/// <summary>
+/// A dense layer whose shape and activation are template arguments. Weights live in an aligned <c>std::array</c>
+/// packed for the single image kernel: outputs are padded to whole registers and split into blocks of
+/// <c>StaticKernels::BlockWidth</c>, each block stored input-major so one pass over it yields that block's outputs.
+/// </summary>
+template<size_t Inputs, size_t Outputs, Activation ActivationFunction = Activation::Identity>
+struct StaticLayer
+{
+	static_assert(Inputs > 0 && Outputs > 0, "A layer needs inputs and outputs.");
+	static constexpr size_t InputCount = Inputs;
+	static constexpr size_t OutputCount = Outputs;
+	static constexpr Activation LayerActivation = ActivationFunction;
+	static constexpr size_t PaddedOutputs = (Outputs + StaticKernels::Lanes - 1) / StaticKernels::Lanes * StaticKernels::Lanes;
+	static constexpr size_t FullBlocks = PaddedOutputs / StaticKernels::BlockWidth;
+	static constexpr size_t TailWidth = PaddedOutputs % StaticKernels::BlockWidth;
+
+	alignas(64) std::array<float, Inputs * PaddedOutputs> m_packed{};
+	alignas(64) std::array<float, PaddedOutputs> m_bias{};
+	alignas(64) std::array<float, PaddedOutputs> m_output{};
+
+	/// <summary>Packs <c>layer</c>'s row-major weights. Returns false if its shape or activation differ from this layer's.</summary>
+	bool Load(const DenseLayerView& layer) noexcept
+	{
+		if (layer.InputCount() != Inputs || layer.OutputCount() != Outputs || layer.m_activation != ActivationFunction)
+			return false;
+		for (size_t o = 0; o < Outputs; o++)
+		{
+			const size_t block = o / StaticKernels::BlockWidth;
+			const size_t width = block < FullBlocks ? StaticKernels::BlockWidth : TailWidth;
+			float* panel = m_packed.data() + block * StaticKernels::BlockWidth * Inputs;
+			for (size_t i = 0; i < Inputs; i++)
+				panel[i * width + o % StaticKernels::BlockWidth] = layer.m_weights[o * Inputs + i];
+			m_bias[o] = layer.m_bias[o];
+		}
+		return true;
+	}
+
+	/// <summary>Evaluates the layer for one input vector into <c>m_output</c>, padding outputs are left at zero.</summary>
+	const float* Forward(const float* input) noexcept
+	{
+		static const auto fullBlock = StaticKernels::GetMatVecBlock<Inputs, StaticKernels::BlockWidth>(DotKernels::DetectInstructionSet());
+		for (size_t block = 0; block < FullBlocks; block++)
+		{
+			const size_t offset = block * StaticKernels::BlockWidth;
+			fullBlock(input, m_packed.data() + offset * Inputs, m_bias.data() + offset, m_output.data() + offset);
+		}
+		if constexpr (TailWidth != 0)
+		{
+			static const auto tailBlock = StaticKernels::GetMatVecBlock<Inputs, TailWidth>(DotKernels::DetectInstructionSet());
+			constexpr size_t offset = FullBlocks * StaticKernels::BlockWidth;
+			tailBlock(input, m_packed.data() + offset * Inputs, m_bias.data() + offset, m_output.data() + offset);
+		}
+		ApplyActivation(ActivationFunction, m_output.data(), 1, Outputs);
+		return m_output.data();
+	}
+};
+
+/// <summary>
+/// Feed forward network with its topology fixed at compile time, e.g.
+/// <c>StaticNetwork&lt;StaticLayer&lt;784, 128, Activation::ReLU&gt;, StaticLayer&lt;128, 10, Activation::Softmax&gt;&gt;</c>.
+/// Meant for serving a trained model one image at a time, where the runtime shaped <c>Network</c>'s blocked GEMM
+/// spends most of its time packing weights for a single row. Weights are copied from a trained <c>Network</c>
+/// (or any set of layer views, such as a mapped model file) with <c>Load</c>. The object holds every weight
+/// inline, so it is normally heap allocated with <c>std::make_unique</c>.
+/// </summary>
+template<typename... Layers>
+class StaticNetwork
+{
+	static_assert(sizeof...(Layers) > 0, "A network needs at least one layer.");
+	using LayerTuple = std::tuple<Layers...>;
+	template<size_t Index>
+	using LayerAt = std::tuple_element_t<Index, LayerTuple>;
+
+	template<size_t... Index>
+	static constexpr bool ShapesChain(std::index_sequence<Index...>) noexcept
+	{
+		return ((LayerAt<Index>::OutputCount == LayerAt<Index + 1>::InputCount) && ...);
+	}
+	static_assert(ShapesChain(std::make_index_sequence<sizeof...(Layers) - 1>{}), "Each layer's inputs must match the previous layer's outputs.");
+public:
+	static constexpr size_t LayerCount = sizeof...(Layers);
+	static constexpr size_t InputCount = LayerAt<0>::InputCount;
+	static constexpr size_t OutputCount = LayerAt<LayerCount - 1>::OutputCount;
+
+	/// <summary>Copies the parameters of <c>layers</c>, one view per layer. Returns false if the layer count, a layer's shape
+	///	or its activation does not match this network, layers before the mismatch have been copied by then.</summary>
+	bool Load(std::span<const DenseLayerView> layers) noexcept
+	{
+		if (layers.size() != LayerCount)
+			return false;
+		return [&]<size_t... Index>(std::index_sequence<Index...>)
+		{
+			return (std::get<Index>(m_layers).Load(layers[Index]) && ...);
+		}(std::make_index_sequence<LayerCount>{});
+	}
+	/// <summary>Copies a trained runtime shaped network, see <c>Load(std::span)</c>.</summary>
+	bool Load(const Network& network)
+	{
+		std::array<DenseLayerView, LayerCount> views;
+		if (network.LayerCount() != LayerCount)
+			return false;
+		for (size_t l = 0; l < LayerCount; l++)
+			views[l] = network.Layer(l).View();
+		return Load(views);
+	}
+
+	/// <summary>Evaluates one input vector. The returned span stays valid until the next call.</summary>
+	std::span<const float, OutputCount> Forward(std::span<const float, InputCount> input) noexcept
+	{
+		const float* output = [&]<size_t... Index>(std::index_sequence<Index...>)
+		{
+			const float* layerInput = input.data();
+			((layerInput = std::get<Index>(m_layers).Forward(layerInput)), ...);
+			return layerInput;
+		}(std::make_index_sequence<LayerCount>{});
+		return std::span<const float, OutputCount>(output, OutputCount);
+	}
+	/// <summary>Index of the highest scoring output for one input vector.</summary>
+	size_t Predict(std::span<const float, InputCount> input) noexcept
+	{
+		const auto output = Forward(input);
+		return static_cast<size_t>(std::max_element(output.begin(), output.end()) - output.begin());
+	}
+private:
+	LayerTuple m_layers;
+};
@@ -0,0 +1,203 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/// <summary>
+/// Work-stealing pool for data-parallel loops. <c>ParallelFor</c> splits a range into chunks that are dealt round-robin
+/// onto per-worker deques, each worker pops from the back of its own deque and steals from the front of the others once it
+/// runs dry, and the calling thread steals alongside them until every chunk is done. Chunks are a fixed partition of the
+/// range, so work that keeps per-chunk results and combines them in chunk order is deterministic whichever thread ran
+/// each chunk. A <c>ParallelFor</c> issued from inside a chunk runs inline on the calling worker.
+/// </summary>
+class ThreadPool
+{
+public:
+	/// <summary>Starts <c>threadCount - 1</c> workers, the thread calling <c>ParallelFor</c> is the last one.
+	///	Zero selects one thread per hardware thread.</summary>
+	explicit ThreadPool(size_t threadCount = 0)
+	{
+		if (threadCount == 0)
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+		m_queues = std::vector<Queue>(threadCount - 1);
+		for (size_t i = 0; i + 1 < threadCount; i++)
+			m_workers.emplace_back([this, i]() { WorkerLoop(i); });
+	}
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	~ThreadPool()
+	{
+		m_stopping.store(true, std::memory_order_relaxed);
+		m_queued.fetch_add(1, std::memory_order_release);
+		m_queued.notify_all();
+		for (auto& worker : m_workers)
+			worker.join();
+	}
+
+	/// <summary>Threads taking part in a <c>ParallelFor</c>, the workers plus the caller.</summary>
+	[[nodiscard]] size_t ThreadCount() const noexcept { return m_workers.size() + 1; }
+
+	/// <summary>
+	/// Calls <c>body(chunk, begin, end)</c> for <c>chunkCount</c> contiguous chunks covering [0, count) and returns once
+	/// all of them have finished. The first exception thrown by a chunk is rethrown here after the others complete.
+	/// </summary>
+	template<typename Body>
+	void ParallelFor(size_t count, size_t chunkCount, const Body& body)
+	{
+		chunkCount = std::clamp<size_t>(chunkCount, 1, std::max<size_t>(count, 1));
+		if (chunkCount == 1 || m_queues.empty() || t_current == this)
+		{
+			for (size_t chunk = 0; chunk < chunkCount; chunk++)
+				body(chunk, count * chunk / chunkCount, count * (chunk + 1) / chunkCount);
+			return;
+		}
+		Job job;
+		job.body = &body;
+		job.invoke = [](const void* fn, size_t chunk, size_t begin, size_t end) { (*static_cast<const Body*>(fn))(chunk, begin, end); };
+		job.remaining.store(chunkCount, std::memory_order_relaxed);
+		for (size_t chunk = 0; chunk < chunkCount; chunk++)
+		{
+			Queue& queue = m_queues[chunk % m_queues.size()];
+			std::lock_guard lock(queue.mutex);
+			queue.tasks.push_back({ &job, chunk, count * chunk / chunkCount, count * (chunk + 1) / chunkCount });
+		}
+		m_queued.fetch_add(chunkCount, std::memory_order_release);
+		m_queued.notify_all();
+		//help until nothing is left to steal, then wait for the chunks still running on workers.
+		Task task;
+		while (job.remaining.load(std::memory_order_acquire) != 0 && Steal(0, task))
+			Run(task);
+		for (;;)
+		{
+			const auto completions = m_completions.load(std::memory_order_acquire);
+			if (job.remaining.load(std::memory_order_acquire) == 0)
+				break;
+			m_completions.wait(completions, std::memory_order_acquire);
+		}
+		if (job.error)
+			std::rethrow_exception(job.error);
+	}
+	/// <summary><c>ParallelFor</c> with one chunk per thread.</summary>
+	template<typename Body>
+	void ParallelFor(size_t count, const Body& body)
+	{
+		ParallelFor(count, ThreadCount(), body);
+	}
+private:
+	struct Job
+	{
+		const void* body = nullptr;
+		void (*invoke)(const void* body, size_t chunk, size_t begin, size_t end) = nullptr;
+		std::atomic<size_t> remaining{ 0 };
+		std::atomic<bool> failed{ false };
+		std::exception_ptr error;
+	};
+	struct Task
+	{
+		Job* job = nullptr;
+		size_t chunk = 0;
+		size_t begin = 0;
+		size_t end = 0;
+	};
+	/// <summary>Double ended ring of tasks, only grows, so a steady state of equally sized loops does not allocate.</summary>
+	class TaskRing
+	{
+	public:
+		[[nodiscard]] bool empty() const noexcept { return m_count == 0; }
+		void push_back(const Task& task)
+		{
+			if (m_count == m_tasks.size())
+			{
+				std::vector<Task> grown(std::max<size_t>(8, m_tasks.size() * 2));
+				for (size_t i = 0; i < m_count; i++)
+					grown[i] = m_tasks[(m_first + i) % m_tasks.size()];
+				m_tasks = std::move(grown);
+				m_first = 0;
+			}
+			m_tasks[(m_first + m_count++) % m_tasks.size()] = task;
+		}
+		Task pop_back() noexcept { return m_tasks[(m_first + --m_count) % m_tasks.size()]; }
+		Task pop_front() noexcept
+		{
+			const Task task = m_tasks[m_first];
+			m_first = (m_first + 1) % m_tasks.size();
+			m_count--;
+			return task;
+		}
+	private:
+		std::vector<Task> m_tasks;
+		size_t m_first = 0;
+		size_t m_count = 0;
+	};
+	struct Queue
+	{
+		std::mutex mutex;
+		TaskRing tasks;
+	};
+
+	/// <summary>Takes a task, from the back of queue <c>own</c> first, then from the front of the others.</summary>
+	bool Steal(size_t own, Task& task)
+	{
+		for (size_t i = 0; i < m_queues.size(); i++)
+		{
+			Queue& queue = m_queues[(own + i) % m_queues.size()];
+			std::lock_guard lock(queue.mutex);
+			if (queue.tasks.empty())
+				continue;
+			task = i == 0 ? queue.tasks.pop_back() : queue.tasks.pop_front();
+			m_queued.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+		return false;
+	}
+
+	void Run(const Task& task)
+	{
+		Job& job = *task.job;
+		ThreadPool* const previous = std::exchange(t_current, this);
+		try
+		{
+			job.invoke(job.body, task.chunk, task.begin, task.end);
+		}
+		catch (...)
+		{
+			if (!job.failed.exchange(true, std::memory_order_relaxed))
+				job.error = std::current_exception();
+		}
+		t_current = previous;
+		//the job lives on the caller's stack and may be gone as soon as remaining reaches zero, so the wake up goes
+		//through a counter owned by the pool.
+		if (job.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			m_completions.fetch_add(1, std::memory_order_release);
+			m_completions.notify_all();
+		}
+	}
+
+	void WorkerLoop(size_t index)
+	{
+		Task task;
+		while (!m_stopping.load(std::memory_order_relaxed))
+		{
+			if (Steal(index, task))
+			{
+				Run(task);
+				continue;
+			}
+			m_queued.wait(0, std::memory_order_acquire);
+		}
+	}
+
+	inline static thread_local ThreadPool* t_current = nullptr;
+	std::vector<Queue> m_queues;
+	std::vector<std::thread> m_workers;
+	std::atomic<size_t> m_queued{ 0 };
+	std::atomic<size_t> m_completions{ 0 };
+	std::atomic<bool> m_stopping{ false };
+};
@@ -0,0 +1,306 @@
+#pragma once
+#include "stdafx.h"
+#include <span>
+#include <vector>
+#include "../MNISTFileLib/AlignedBuffer.hpp"
+#include "Network.hpp"
+#include "Optimizer.hpp"
+#include "Gemm.hpp"
+#include "ThreadPool.hpp"
+#include "Arena.hpp"
+#include "../MNISTFileLib/Instrumentation.hpp"
+
+/// <summary>Mini-batch training of a <c>Network</c> by back propagation.
+///	The loss is cross-entropy against one-hot labels: categorical with a Softmax output layer, binary per output with a
+///	Sigmoid output layer. For either, the gradient w.r.t. the output layer's pre-activation values is simply
+///	<c>(prediction - target) / N</c>. Other output activations are trained on squared error.
+///	Every gradient product is a blocked matrix multiply. Activations, deltas and gradients are slices of arenas that
+///	<c>Reserve</c> sizes for the largest batch up front, each step resets them rather than allocating.
+///	The batch is split into row chunks that run forward and backward, in parallel given a <c>ThreadPool</c>, each into
+///	gradient buffers of its own, which are summed in chunk order before the single optimizer step. The split depends on
+///	the batch size alone, so a step gives bit-identical weights whatever the number of threads.</summary>
+class Trainer
+{
+public:
+	using LabelType = unsigned char;
+	static constexpr size_t MinRowsPerChunk = 16;   // smaller slices of a batch are not worth a thread
+	static constexpr size_t MaxChunks = 16;         // threads beyond this many share the chunks' matrix multiplies
+
+	Trainer(Network& network, const OptimizerOptions& options = {}, ThreadPool* pool = nullptr)
+		: m_network(network), m_optimizer(options), m_pool(pool), m_layers(network.LayerCount()), m_weightsTransposed(network.LayerCount()) { }
+
+	/// <summary>Splits subsequent batches across <c>pool</c>, null trains single threaded. The pool must outlive its use.</summary>
+	void SetThreadPool(ThreadPool* pool) noexcept
+	{
+		m_pool = pool;
+		m_maxBatchSize = 0;
+	}
+
+	/// <summary>Preallocates everything a step needs for batches of up to <c>maxBatchSize</c> rows, the network's own forward
+	///	buffers included, so training allocates nothing once it starts. A larger batch reserves again on its first step.</summary>
+	void Reserve(size_t maxBatchSize)
+	{
+		const size_t layerCount = m_network.LayerCount();
+		//the largest slice of any batch up to the maximum, fewer chunks of a smaller batch can each be longer.
+		size_t rows = 0;
+		for (size_t batchSize = 1; batchSize <= maxBatchSize; batchSize++)
+			rows = std::max(rows, (batchSize + ChunkCount(batchSize) - 1) / ChunkCount(batchSize));
+		size_t bytes = 0;
+		size_t widestInputs = 0;
+		size_t widestOutputs = 0;
+		for (size_t l = 0; l < layerCount; l++)
+		{
+			const DenseLayer& layer = m_network.Layer(l);
+			bytes += 2 * Arena::Footprint<float>(rows * layer.OutputCount());  // activations and deltas
+			bytes += Arena::Footprint<float>(layer.OutputCount() * layer.InputCount()) + Arena::Footprint<float>(layer.OutputCount());
+			widestInputs = std::max(widestInputs, layer.InputCount());
+			widestOutputs = std::max(widestOutputs, layer.OutputCount());
+			m_weightsTransposed[l].Resize(l == 0 ? 0 : layer.InputCount() * layer.OutputCount());
+		}
+		bytes += Arena::Footprint<float>(rows * widestOutputs) + Arena::Footprint<float>(rows * widestInputs);
+		const size_t chunkCount = ChunkCount(maxBatchSize);
+		if (m_replicas.size() < chunkCount)
+			m_replicas.resize(chunkCount);
+		for (auto& replica : m_replicas)
+		{
+			replica.arena.Reserve(bytes);
+			replica.activations.resize(layerCount);
+			replica.deltas.resize(layerCount);
+			replica.weightGradients.resize(layerCount);
+			replica.biasGradients.resize(layerCount);
+			Gemm::Reserve(replica.workspace, std::max(widestInputs, widestOutputs), m_pool == nullptr ? 1 : m_pool->ThreadCount());
+		}
+		m_network.Reserve(maxBatchSize);
+		m_maxBatchSize = maxBatchSize;
+	}
+
+	/// <summary>Runs one forward/backward pass over <c>batchSize</c> rows of <c>input</c> and applies an optimizer step.
+	///	<c>labels</c> holds the expected class of each row. Returns the mean loss of the batch before the update.</summary>
+	float TrainBatch(std::span<const float> input, std::span<const LabelType> labels, size_t batchSize)
+	{
+		IDX3_PROFILE_SCOPE_ITEMS("train batch", batchSize);
+		DotKernels::FlushDenormalsToZero();
+		if (batchSize > m_maxBatchSize)
+			Reserve(batchSize);
+		const size_t layerCount = m_network.LayerCount();
+		const size_t chunkCount = ChunkCount(batchSize);
+		//the backward pass propagates through the weights transposed, shared read-only by every chunk.
+		for (size_t l = 1; l < layerCount; l++)
+			Transpose(m_network.Layer(l).m_weights.data(), m_network.Layer(l).OutputCount(), m_network.Layer(l).InputCount(), m_weightsTransposed[l].Span());
+		auto body = [&](size_t chunk, size_t begin, size_t end)
+		{
+			DotKernels::FlushDenormalsToZero();
+			Backpropagate(m_replicas[chunk], input, labels, begin, end - begin, batchSize);
+		};
+		if (m_pool == nullptr)
+		{
+			for (size_t chunk = 0; chunk < chunkCount; chunk++)
+				body(chunk, batchSize * chunk / chunkCount, batchSize * (chunk + 1) / chunkCount);
+		}
+		else
+			m_pool->ParallelFor(batchSize, chunkCount, body);
+
+		//sum the chunk gradients into the first chunk's, always in chunk order so the result does not depend on scheduling.
+		IDX3_PROFILE_SCOPE("gradient reduce + update");
+		Replica& total = m_replicas[0];
+		double loss = total.loss;
+		for (size_t c = 1; c < chunkCount; c++)
+			loss += m_replicas[c].loss;
+		for (size_t l = 0; l < layerCount && chunkCount > 1; l++)
+		{
+			for (auto gradients : { &Replica::weightGradients, &Replica::biasGradients })
+			{
+				float* sum = (total.*gradients)[l].data();
+				auto reduce = [&](size_t, size_t begin, size_t end)
+				{
+					for (size_t c = 1; c < chunkCount; c++)
+					{
+						const float* part = (m_replicas[c].*gradients)[l].data();
+						for (size_t i = begin; i < end; i++)
+							sum[i] += part[i];
+					}
+				};
+				if (m_pool == nullptr)
+					reduce(0, 0, (total.*gradients)[l].size());
+				else
+					m_pool->ParallelFor((total.*gradients)[l].size(), reduce);
+			}
+		}
+		m_optimizer.BeginStep();
+		for (size_t l = 0; l < layerCount; l++)
+		{
+			DenseLayer& layer = m_network.Layer(l);
+			m_optimizer.Update(layer.m_weights.Span(), total.weightGradients[l], m_layers[l].weightState);
+			m_optimizer.Update(layer.m_bias.Span(), total.biasGradients[l], m_layers[l].biasState);
+		}
+		return static_cast<float>(loss * (1.0f / static_cast<float>(batchSize)));
+	}
+
+	/// <summary>Number of rows whose highest scoring output matches the label.</summary>
+	size_t CountCorrect(std::span<const float> input, std::span<const LabelType> labels, size_t batchSize)
+	{
+		const auto prediction = m_network.Forward(input, batchSize);
+		const size_t classes = m_network.OutputCount();
+		size_t correct = 0;
+		for (size_t n = 0; n < batchSize; n++)
+		{
+			const float* row = prediction.data() + n * classes;
+			const size_t predicted = static_cast<size_t>(std::max_element(row, row + classes) - row);
+			if (predicted == labels[n])
+				correct++;
+		}
+		return correct;
+	}
+
+	[[nodiscard]] const Optimizer& GetOptimizer() const noexcept { return m_optimizer; }
+private:
+	struct LayerState
+	{
+		OptimizerState weightState;
+		OptimizerState biasState;
+	};
+	/// <summary>Buffers of one chunk of rows, per layer where indexed, all sliced from the replica's arena each step.</summary>
+	struct Replica
+	{
+		Arena arena;
+		std::vector<std::span<float>> activations;       // [rows x outputs]
+		std::vector<std::span<float>> deltas;            // [rows x outputs] gradient w.r.t. pre-activation values
+		std::vector<std::span<float>> weightGradients;   // [outputs x inputs]
+		std::vector<std::span<float>> biasGradients;     // [outputs]
+		std::span<float> deltaTransposed;                // [outputs x rows] of the widest layer
+		std::span<float> inputTransposed;                // [inputs x rows] of the widest layer
+		Gemm::Workspace workspace;
+		double loss = 0.0;  // summed over the chunk's rows
+	};
+
+	/// <summary>Number of chunks a batch is split into, at least <c>MinRowsPerChunk</c> rows each. Independent of the pool so
+	///	that the order gradients are summed in is too.</summary>
+	[[nodiscard]] static size_t ChunkCount(size_t batchSize) noexcept
+	{
+		return std::clamp<size_t>(batchSize / MinRowsPerChunk, 1, MaxChunks);
+	}
+
+	/// <summary>Forward and backward pass of rows [first, first+rows) of a batch of <c>batchSize</c> into <c>replica</c>.</summary>
+	void Backpropagate(Replica& replica, std::span<const float> input, std::span<const LabelType> labels, size_t first, size_t rows, size_t batchSize)
+	{
+		const size_t layerCount = m_network.LayerCount();
+		Arena& arena = replica.arena;
+		arena.Reset();
+		size_t widestInputs = 0;
+		size_t widestOutputs = 0;
+		for (size_t l = 0; l < layerCount; l++)
+		{
+			const DenseLayer& layer = m_network.Layer(l);
+			replica.activations[l] = arena.Allocate<float>(rows * layer.OutputCount());
+			replica.deltas[l] = arena.Allocate<float>(rows * layer.OutputCount());
+			replica.weightGradients[l] = arena.Allocate<float>(layer.OutputCount() * layer.InputCount());
+			replica.biasGradients[l] = arena.Allocate<float>(layer.OutputCount());
+			widestInputs = std::max(widestInputs, layer.InputCount());
+			widestOutputs = std::max(widestOutputs, layer.OutputCount());
+		}
+		replica.deltaTransposed = arena.Allocate<float>(rows * widestOutputs);
+		replica.inputTransposed = arena.Allocate<float>(rows * widestInputs);
+
+		const float* chunkInput = input.data() + first * m_network.InputCount();
+		const float* layerInput = chunkInput;
+		for (size_t l = 0; l < layerCount; l++)
+		{
+			const DenseLayer& layer = m_network.Layer(l);
+			IDX3_PROFILE_SCOPE_INDEXED("train forward layer ", l);
+			ForwardLayer(layer.View(), layerInput, rows, replica.activations[l].data(), replica.workspace, m_pool);
+			layerInput = replica.activations[l].data();
+		}
+		const size_t lastLayer = layerCount - 1;
+		replica.loss = OutputGradient(replica.activations[lastLayer], labels.subspan(first, rows), rows, batchSize, replica.deltas[lastLayer]);
+		for (size_t l = lastLayer + 1; l-- > 0;)
+		{
+			const DenseLayer& layer = m_network.Layer(l);
+			const size_t inputs = layer.InputCount();
+			const size_t outputs = layer.OutputCount();
+			const float* delta = replica.deltas[l].data();
+			layerInput = l == 0 ? chunkInput : replica.activations[l - 1].data();
+			IDX3_PROFILE_SCOPE_INDEXED("train backward layer ", l);
+
+			//dW[outputs x inputs] = delta^T[outputs x N] * X[N x inputs], with both operands transposed so the product is A * B^T.
+			Transpose(delta, rows, outputs, replica.deltaTransposed);
+			Transpose(layerInput, rows, inputs, replica.inputTransposed);
+			MatMul(replica.deltaTransposed.data(), rows, replica.inputTransposed.data(), rows, replica.weightGradients[l].data(), inputs, outputs, inputs, rows, replica.workspace);
+			const std::span<float> biasGradient = replica.biasGradients[l];
+			for (size_t o = 0; o < outputs; o++)
+			{
+				const float* deltaColumn = replica.deltaTransposed.data() + o * rows;
+				float sum = 0.0f;
+				for (size_t n = 0; n < rows; n++)
+					sum += deltaColumn[n];
+				biasGradient[o] = sum;
+			}
+
+			//propagate to the previous layer, weights are only updated once every chunk is done, dX[N x inputs] = delta[N x outputs] * W[outputs x inputs].
+			if (l > 0)
+			{
+				const std::span<float> previousDelta = replica.deltas[l - 1];
+				MatMul(delta, outputs, m_weightsTransposed[l].data(), outputs, previousDelta.data(), inputs, rows, inputs, outputs, replica.workspace);
+				ApplyActivationDerivative(m_network.Layer(l - 1).m_activation, layerInput, previousDelta.data(), rows * inputs);
+			}
+		}
+	}
+	/// <summary>Bias free <c>Gemm::MatMulTransposedB</c>, split across the pool when there is one.</summary>
+	void MatMul(const float* a, size_t lda, const float* b, size_t ldb, float* c, size_t ldc, size_t m, size_t n, size_t k, Gemm::Workspace& workspace)
+	{
+		if (m_pool != nullptr)
+			Gemm::MatMulTransposedB(a, lda, b, ldb, nullptr, c, ldc, m, n, k, workspace, *m_pool);
+		else
+			Gemm::MatMulTransposedB(a, lda, b, ldb, nullptr, c, ldc, m, n, k, workspace);
+	}
+
+	/// <summary>Writes the output layer's delta for <c>rows</c> rows of a batch of <c>batchSize</c> and returns their summed loss.</summary>
+	double OutputGradient(std::span<const float> prediction, std::span<const LabelType> labels, size_t rows, size_t batchSize, std::span<float> delta) const
+	{
+		const Activation outputActivation = m_network.Layer(m_network.LayerCount() - 1).m_activation;
+		const size_t classes = m_network.OutputCount();
+		const float inverseBatch = 1.0f / static_cast<float>(batchSize);
+		constexpr float MinProbability = 1e-7f;
+		double loss = 0.0;
+		for (size_t n = 0; n < rows; n++)
+		{
+			const float* p = prediction.data() + n * classes;
+			float* d = delta.data() + n * classes;
+			for (size_t c = 0; c < classes; c++)
+			{
+				const float target = c == labels[n] ? 1.0f : 0.0f;
+				d[c] = (p[c] - target) * inverseBatch;
+				if (outputActivation == Activation::Softmax)
+				{
+					if (target != 0.0f)
+						loss -= std::log(std::max(p[c], MinProbability));
+				}
+				else if (outputActivation == Activation::Sigmoid)
+					loss -= std::log(std::max(target != 0.0f ? p[c] : 1.0f - p[c], MinProbability));
+				else
+					loss += 0.5 * (p[c] - target) * (p[c] - target);
+			}
+		}
+		if (outputActivation != Activation::Softmax && outputActivation != Activation::Sigmoid)
+			ApplyActivationDerivative(outputActivation, prediction.data(), delta.data(), rows * classes);
+		return loss;
+	}
+
+	/// <summary>dst[cols x rows] = src[rows x cols]^T</summary>
+	static void Transpose(const float* src, size_t rows, size_t cols, std::span<float> dst)
+	{
+		constexpr size_t Block = 32;
+		for (size_t r0 = 0; r0 < rows; r0 += Block)
+			for (size_t c0 = 0; c0 < cols; c0 += Block)
+				for (size_t r = r0; r < std::min(rows, r0 + Block); r++)
+					for (size_t c = c0; c < std::min(cols, c0 + Block); c++)
+						dst[c * rows + r] = src[r * cols + c];
+	}
+
+	Network& m_network;
+	Optimizer m_optimizer;
+	ThreadPool* m_pool;
+	size_t m_maxBatchSize = 0;
+	std::vector<LayerState> m_layers;
+	std::vector<Idx3Lib::AlignedBuffer<float>> m_weightsTransposed;    // per layer [inputs x outputs], unused for the first
+	std::vector<Replica> m_replicas;
+};
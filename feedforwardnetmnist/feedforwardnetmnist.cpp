@@ -1,55 +1,397 @@
 #include "stdafx.h"
-#include "InputNode.hpp"
-#include "HiddenNeuron.hpp"
-#include "OutputNeuron.hpp"
+#include "DenseLayer.hpp"
+#include "Network.hpp"
+#include "Trainer.hpp"
+#include "ThreadPool.hpp"
+#include "QuantizedNetwork.hpp"
+#include "StaticNetwork.hpp"
+#include "ModelFile.hpp"
+#include "Augmentation.hpp"
+#include "InferenceServer.hpp"
+#include "DotKernels.hpp"
 #include "../MNISTFileLib/Idx3HeaderData.hpp"
 #include "../MNISTFileLib/Idx3ImageDataBuffer.hpp"
+#include "../MNISTFileLib/Idx3PrefetchPipeline.hpp"
+#include "../MNISTFileLib/Idx3StreamReader.hpp"
+#include "../MNISTFileLib/Idx3AsyncReader.hpp"
+#include "../MNISTFileLib/IdxFile.hpp"
+#include "../MNISTFileLib/Instrumentation.hpp"
+#include "../MNISTFileLib/MnistDataset.hpp"
 #include "BuildRandom.hpp"
+#include <charconv>
+#ifndef _WIN32
+#include <signal.h>
+#endif
 
-int main()
+/// <summary>Micro-benchmark of the u8 x f32 dot product kernels against the scalar path, over image sized rows.</summary>
+void RunKernelBenchmark()
 {
 	using namespace std;
 	using RandomType = unsigned int;
-	constexpr size_t NumberOfHiddenNeurons = 10;
-	//read image data
-	ifstream inFile("train-images.idx3-ubyte", std::ios::binary);
-	Idx3Lib::Idx3HeaderData header;
-	inFile >> header;
-	Idx3Lib::Idx3ImageDataBuffer imageData(header.num_columns * header.num_rows);
-	inFile >> imageData;
-	//build ffn layers with pixel data (which happens to be black and white bytes)
-	vector<InputNode> inputLayer;
-	vector<HiddenNeuron> hiddenLayer;
-	const auto randomVector = BuildRandom::BuildRandomVector<RandomType>(imageData.ImageSize, imageData.ImageSize);
-	const auto randomNeuronVector = BuildRandom::BuildRandomVector<RandomType>(NumberOfHiddenNeurons, NumberOfHiddenNeurons);
-	for (size_t i = 0; i < imageData.ImageSize; i++)
-	{
-		InputNode n(imageData.buffer[i], i);
-		//cout << "Weight:" << n.m_weight << " ";
-		inputLayer.emplace_back(n);
-	}
-	for (size_t i = 0; i < NumberOfHiddenNeurons; i++)
-	{
-		HiddenNeuron n(i, randomNeuronVector[i] % 100 / 100.0);
-		//cout << "Bias:" << n.m_bias << " ";
-		hiddenLayer.emplace_back(n);
-	}
-	//Apply activation function on the neurons
-	cout << "Hidden layer neuron function results:" << endl;
-	for (auto& elem : hiddenLayer)
-	{
-		cout << "Activation result: " << elem.ActivationFunction(inputLayer) << endl;
-	}
-	//Apply function on output neuron.
-	const double TValue = 13'500.0;
-	cout << "Now for a (single neuron) output layer, some threshhold value has been arbitrarily chosen:" << TValue << endl;
-	OutputNeuron on(0, TValue);
-	const bool result = on.ActivationFunction(hiddenLayer);
-	if (result)
-		cout << "The output neuron reports true." << endl;
-	else
-		cout << "The output neuron reports false." << endl;
+	constexpr size_t RowLength = 28 * 28;
+	constexpr size_t Iterations = 200'000;
+	const auto randomPixels = BuildRandom::BuildRandomVector<RandomType>(RowLength, RowLength);
+	const auto randomWeights = BuildRandom::BuildRandomVector<RandomType>(RowLength, RowLength);
+	vector<DotKernels::PixelType> pixels(RowLength);
+	vector<DotKernels::WeightType> weights(RowLength);
+	for (size_t i = 0; i < RowLength; i++)
+	{
+		pixels[i] = static_cast<DotKernels::PixelType>(randomPixels[i]);
+		weights[i] = randomWeights[i] % 100 / 100.0f;
+	}
+	const float reference = DotKernels::DotU8F32Scalar(pixels.data(), weights.data(), RowLength);
+	cout << "Detected instruction set: " << DotKernels::ToString(DotKernels::DetectInstructionSet()) << endl;
+	for (const auto isa : { DotKernels::InstructionSet::Scalar, DotKernels::InstructionSet::SSE2, DotKernels::InstructionSet::AVX2 })
+	{
+		if (isa > DotKernels::DetectInstructionSet())
+			break;
+		const auto kernel = DotKernels::GetDotU8F32(isa);
+		volatile float sink = 0.0f;
+		const auto startTime = chrono::steady_clock::now();
+		for (size_t i = 0; i < Iterations; i++)
+			sink = sink + kernel(pixels.data(), weights.data(), RowLength);
+		const chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - startTime;
+		const double nsPerRow = elapsed.count() / Iterations;
+		cout << DotKernels::ToString(isa) << ": " << nsPerRow << " ns/row, "
+			<< RowLength / nsPerRow << " pixels/ns, relative error "
+			<< abs(kernel(pixels.data(), weights.data(), RowLength) - reference) / reference << endl;
+	}
+}
+
+/// <summary>Scores <c>trainer</c>'s network on a gzipped (or zstd) test set, the images are decompressed on a
+///	background thread straight into the batches, the small label file is inflated into memory.</summary>
+bool ScoreCompressedTestSet(Trainer& trainer, const std::string& imagesPath, const std::string& labelsPath)
+{
+	using namespace std;
+	Idx3Lib::CompressedFileReader labelFile;
+	vector<Trainer::LabelType> labelBytes;
+	Idx3Lib::IdxHeader labelHeader;
+	if (!labelFile.Open(labelsPath) || !labelFile.ReadToEnd(labelBytes) || !Idx3Lib::IdxHeader::FromBytes(labelBytes, labelHeader)
+		|| labelHeader.Rank() != 1 || labelHeader.type != Idx3Lib::IdxDataType::UnsignedByte || labelBytes.size() < labelHeader.HeaderSize() + labelHeader.DataSize())
+	{
+		cout << labelsPath << ": expected an IDX1 unsigned byte label file. " << labelFile.ErrorMessage() << endl;
+		return false;
+	}
+	const span<const Trainer::LabelType> labels(labelBytes.data() + labelHeader.HeaderSize(), labelHeader.ItemCount());
+	Idx3Lib::Idx3StreamReader reader;
+	if (!reader.Open(imagesPath) || reader.ImageCount() != labels.size())
+	{
+		cout << imagesPath << ": " << (reader.IsOpen() ? "image and label counts differ." : reader.ErrorMessage()) << endl;
+		return false;
+	}
+	Idx3Lib::Idx3PrefetchPipeline<float> pipeline;
+	pipeline.Start(reader, { .BatchSize = 1000, .PrefetchDepth = 4 });
+	size_t correct = 0;
+	size_t evaluated = 0;
+	while (const auto testBatch = pipeline.Next())
+	{
+		correct += trainer.CountCorrect(testBatch->Filled(), labels.subspan(evaluated, testBatch->Count), testBatch->Count);
+		evaluated += testBatch->Count;
+	}
+	pipeline.Stop();
+	if (!reader.ErrorMessage().empty())
+	{
+		cout << imagesPath << ": " << reader.ErrorMessage() << endl;
+		return false;
+	}
+	if (evaluated == 0)
+	{
+		cout << imagesPath << " holds no images, there is nothing to score." << endl;
+		return false;
+	}
+	cout << "Test accuracy: " << 100.0 * correct / evaluated << "% of " << evaluated << " images (" << Idx3Lib::ToString(reader.Format()) << ")." << endl;
+	return true;
+}
 
+/// <summary>Serves a saved model over a Unix domain socket until SIGINT or SIGTERM, printing latency and throughput
+///	every few seconds. Options: <c>--model path --socket path --int8 --max-batch N --max-delay-us N</c>.</summary>
+int RunInferenceServer(int argc, char* argv[])
+{
+	using namespace std;
+#ifdef _WIN32
+	(void)argc;
+	(void)argv;
+	cout << "--serve needs Unix domain sockets and is not available on Windows." << endl;
+	return 1;
+#else
+	const auto Option = [argc, argv](string_view name, const char* fallback)
+	{
+		for (int i = 1; i + 1 < argc; i++)
+			if (name == argv[i])
+				return string(argv[i + 1]);
+		return string(fallback);
+	};
+	const bool int8 = any_of(argv + 1, argv + argc, [](const char* arg) { return string_view(arg) == "--int8"; });
+	const string modelPath = Option("--model", "mnist-ffn.model");
+	const string socketPath = Option("--socket", "/tmp/feedforwardnetmnist.sock");
+	//a malformed or out of range value is a usage error, not an exception or a size wrapped around from a negative.
+	const auto Number = [&Option](string_view name, const char* fallback, size_t low, size_t high, size_t& value)
+	{
+		const string text = Option(name, fallback);
+		const auto result = from_chars(text.data(), text.data() + text.size(), value);
+		if (result.ec == errc() && result.ptr == text.data() + text.size() && value >= low && value <= high)
+			return true;
+		cout << name << " expects a number from " << low << " to " << high << ", got " << text << "." << endl
+			<< "Usage: feedforwardnetmnist --serve [--model path] [--socket path] [--int8] [--max-batch N] [--max-delay-us N]" << endl;
+		return false;
+	};
+	constexpr size_t MaxBatchLimit = 4096;
+	constexpr size_t MaxDelayLimit = 1000000;
+	size_t maxBatch = 0;
+	size_t maxDelay = 0;
+	if (!Number("--max-batch", "64", 1, MaxBatchLimit, maxBatch) || !Number("--max-delay-us", "100", 0, MaxDelayLimit, maxDelay))
+		return 1;
+	InferenceServerOptions options;
+	options.MaxBatchSize = maxBatch;
+	options.MaxDelay = chrono::microseconds(maxDelay);
+	options.QueueCapacity = max(options.QueueCapacity, options.MaxBatchSize);
+	ModelFile::MappedModel model;
+	if (!model.Open(modelPath))
+	{
+		cout << modelPath << ": " << model.ErrorMessage() << endl;
+		return 1;
+	}
+	//the float model decodes the raw pixels first, the int8 model runs on them directly.
+	Idx3Lib::AlignedBuffer<float> decoded;
+	QuantizedNetwork quantized;
+	InferenceServer::EvaluateFn evaluate = [&model, &decoded](span<const InferenceServer::PixelType> pixels, size_t batchSize)
+	{
+		decoded.Resize(pixels.size());
+		Idx3Lib::ConvertPixels<float>(pixels, decoded.Span());
+		return model.Forward(decoded.Span(), batchSize);
+	};
+	if (int8)
+	{
+		//calibrated on training images, as after training.
+		constexpr size_t CalibrationImages = 1000;
+		Idx3Lib::MnistDataset trainSet;
+		if (!trainSet.Open("train-images.idx3-ubyte", "train-labels.idx1-ubyte") || trainSet.ImageSize() != model.InputCount())
+		{
+			cout << "--int8 calibrates on train-images.idx3-ubyte. " << trainSet.ErrorMessage() << endl;
+			return 1;
+		}
+		Network network = model.ToNetwork();
+		const size_t calibrationCount = min(CalibrationImages, trainSet.Count());
+		quantized = QuantizedNetwork::Calibrate(network, trainSet.Images().Images(0, calibrationCount), calibrationCount);
+		evaluate = [&quantized](span<const InferenceServer::PixelType> pixels, size_t batchSize) { return quantized.Forward(pixels, batchSize); };
+	}
+	//the signals are taken synchronously by this thread, every server thread inherits the blocked mask.
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+	InferenceServer server;
+	if (!server.Start(socketPath, model.InputCount(), model.OutputCount(), evaluate, options))
+	{
+		cout << server.ErrorMessage() << endl;
+		return 1;
+	}
+	cout << "Serving " << modelPath << (int8 ? " (int8)" : "") << " on " << socketPath << ": " << model.InputCount() << " u8 pixels in, i32 label and "
+		<< model.OutputCount() << " float scores out, batches of up to " << options.MaxBatchSize << " within " << options.MaxDelay.count() << "us." << endl;
+	constexpr timespec ReportInterval{ 5, 0 };
+	size_t reported = 0;
+	while (sigtimedwait(&signals, nullptr, &ReportInterval) < 0)
+	{
+		const auto stats = server.Stats();
+		if (stats.Requests != reported)
+			cout << stats << endl;
+		reported = stats.Requests;
+	}
+	server.Stop();
+	cout << server.Stats() << endl;
+	return 0;
+#endif
+}
+
+int main(int argc, char* argv[])
+{
+	using namespace std;
+	if (argc > 1 && string_view(argv[1]) == "--bench-kernels")
+	{
+		RunKernelBenchmark();
+		return 0;
+	}
+	if (argc > 1 && string_view(argv[1]) == "--serve")
+		return RunInferenceServer(argc, argv);
+	//--augment distorts the training images online, a fresh random distortion of every image each epoch.
+	const bool augment = any_of(argv + 1, argv + argc, [](const char* arg) { return string_view(arg) == "--augment"; });
+	//--async-io reads the training images from disk with io_uring (pread where unavailable) instead of mapping them,
+	//for image sets larger than memory.
+	const bool asyncIo = any_of(argv + 1, argv + argc, [](const char* arg) { return string_view(arg) == "--async-io"; });
+	//--profile records per stage timings and hardware counters, printed at exit and saved as a Chrome trace.
+	const bool profile = any_of(argv + 1, argv + argc, [](const char* arg) { return string_view(arg) == "--profile"; });
+	if (profile && !Idx3Lib::Instrumentation::CompiledIn)
+		cout << "--profile needs a build with IDX3_PROFILING defined, no timings will be recorded." << endl;
+	if (profile)
+		Idx3Lib::Instrumentation::Enable({ .Trace = true, .HardwareCounters = true });
+	constexpr size_t NumberOfHiddenNeurons = 128;
+	constexpr size_t NumberOfClasses = 10;
+	constexpr size_t MnistImageSize = 28 * 28;
+	constexpr size_t NumberOfEpochs = 5;
+	constexpr size_t BatchSize = 64;
+	//map the training images and labels, counts are validated against each other.
+	Idx3Lib::MnistDataset trainSet;
+	if (!trainSet.Open("train-images.idx3-ubyte", "train-labels.idx1-ubyte"))
+	{
+		cout << trainSet.ErrorMessage() << endl;
+		return 1;
+	}
+	//build ffn layers, the input layer is the normalized pixel data itself.
+	Network network;
+	network.AddLayer(DenseLayer(trainSet.ImageSize(), NumberOfHiddenNeurons, Activation::ReLU));
+	network.AddLayer(DenseLayer(NumberOfHiddenNeurons, NumberOfClasses, Activation::Softmax));
+	//training splits every batch across the cores, inference splits the matrix products.
+	ThreadPool pool;
+	network.SetThreadPool(&pool);
+	Trainer trainer(network, { .Type = OptimizerType::Adam, .LearningRate = 0.001f }, &pool);
+	//every activation and gradient buffer is allocated here, the training loop itself does not touch the heap.
+	trainer.Reserve(BatchSize);
+	cout << "Training " << trainSet.ImageSize() << "-" << NumberOfHiddenNeurons << "-" << NumberOfClasses << " network on "
+		<< trainSet.Count() << " images, mini-batch size " << BatchSize << ", " << pool.ThreadCount() << " threads." << endl;
+
+	//images are visited in a new random order each epoch, gathered, decoded and augmented ahead of training on reader threads.
+	vector<size_t> order(trainSet.Count());
+	iota(order.begin(), order.end(), size_t{ 0 });
+	//a stream of its own so the order does not depend on how many weights were initialized.
+	BuildRandom::Philox4x32 shuffleEngine(BuildRandom::GlobalSeed(), 1);
+	Augmentation::TransformChain augmentation(trainSet.Images().Header().num_rows, trainSet.Images().Header().num_columns);
+	augmentation.Add(Augmentation::RandomRotation{ .MaxDegrees = 10.0f, .MaxScale = 0.1f })
+		.Add(Augmentation::ElasticDistortion{ .Alpha = 8.0f, .Sigma = 3.0f })
+		.Add(Augmentation::RandomShift{ .MaxShift = 2 });
+	const size_t batchesPerEpoch = (trainSet.Count() + BatchSize - 1) / BatchSize;
+	size_t epochStream = 0;
+	Idx3Lib::Idx3PrefetchPipeline<float> trainPipeline;
+	Idx3Lib::Idx3AsyncReader trainReader;
+	if (asyncIo)
+	{
+		if (!trainReader.Open("train-images.idx3-ubyte"))
+		{
+			cout << trainReader.ErrorMessage() << endl;
+			return 1;
+		}
+		cout << "Reading training images from disk with " << Idx3Lib::ToString(trainReader.Backend()) << "." << endl;
+	}
+	if (augment)
+	{
+		cout << "Augmenting training images with " << augmentation.size() << " transforms." << endl;
+		//each batch of each epoch draws from its own stream, whichever worker decodes it.
+		trainPipeline.SetTransform([&augmentation, &epochStream](Idx3Lib::Idx3Batch<float>& batch, size_t batchIndex) { augmentation.Apply(batch, epochStream + batchIndex); });
+	}
+	vector<Trainer::LabelType> batchLabels(BatchSize);
+	for (size_t epoch = 1; epoch <= NumberOfEpochs; epoch++)
+	{
+		const auto startTime = chrono::steady_clock::now();
+		shuffle(order.begin(), order.end(), shuffleEngine);
+		epochStream = epoch * batchesPerEpoch;
+		if (asyncIo)
+			trainPipeline.Start(trainReader, { .BatchSize = BatchSize, .PrefetchDepth = 8 }, order);
+		else
+			trainPipeline.Start(trainSet.Images(), { .BatchSize = BatchSize, .PrefetchDepth = 8, .WorkerCount = 2 }, order);
+		double lossSum = 0.0;
+		size_t batchCount = 0;
+		for (size_t first = 0; const auto batch = trainPipeline.Next(); first += BatchSize)
+		{
+			for (size_t i = 0; i < batch->Count; i++)
+				batchLabels[i] = trainSet.Label(order[first + i]);
+			lossSum += trainer.TrainBatch(batch->Filled(), batchLabels, batch->Count);
+			batchCount++;
+		}
+		const auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - startTime);
+		cout << "Epoch " << epoch << ": mean loss " << lossSum / batchCount << ", " << elapsed.count() << "ms" << endl;
+	}
+
+	//persist the trained model, mapping it back reads only the header and layer table.
+	constexpr auto ModelFileName = "mnist-ffn.model";
+	if (ModelFile::Save(network, ModelFileName))
+	{
+		const auto startTime = chrono::steady_clock::now();
+		const ModelFile::MappedModel model(ModelFileName);
+		const chrono::duration<double, micro> elapsed = chrono::steady_clock::now() - startTime;
+		if (model.IsOpen())
+			cout << "Saved model to " << ModelFileName << ", mapped back in " << elapsed.count() << "us." << endl;
+		else
+			cout << ModelFileName << ": " << model.ErrorMessage() << endl;
+	}
+
+	//score the test set if it is present, batches are decoded ahead of the network on reader threads.
+	//a gzipped test set as distributed is streamed instead, it cannot be mapped.
+	Idx3Lib::MnistDataset testSet;
+	if (!std::ifstream("t10k-images.idx3-ubyte").good() && std::ifstream("t10k-images.idx3-ubyte.gz").good())
+		ScoreCompressedTestSet(trainer, "t10k-images.idx3-ubyte.gz", "t10k-labels.idx1-ubyte.gz");
+	else if (testSet.Open("t10k-images.idx3-ubyte", "t10k-labels.idx1-ubyte") && testSet.Count() == 0)
+		cout << "t10k-images.idx3-ubyte holds no images, there is nothing to score." << endl;
+	else if (testSet.IsOpen())
+	{
+		Idx3Lib::Idx3PrefetchPipeline<float> pipeline;
+		pipeline.Start(testSet.Images(), { .BatchSize = 1000, .PrefetchDepth = 4, .WorkerCount = 2 });
+		size_t correct = 0;
+		size_t evaluated = 0;
+		while (const auto testBatch = pipeline.Next())
+		{
+			correct += trainer.CountCorrect(testBatch->Filled(), testSet.Labels().subspan(evaluated, testBatch->Count), testBatch->Count);
+			evaluated += testBatch->Count;
+		}
+		cout << "Test accuracy: " << 100.0 * correct / evaluated << "% of " << evaluated << " images." << endl;
+
+		//int8 copy of the trained network, calibrated on training images and run on the raw test pixels without decoding.
+		constexpr size_t CalibrationImages = 1000;
+		constexpr size_t InferenceBatchSize = 1000;
+		const size_t calibrationCount = std::min(CalibrationImages, trainSet.Count());
+		auto quantized = QuantizedNetwork::Calibrate(network, trainSet.Images().Images(0, calibrationCount), calibrationCount);
+		size_t floatModelSize = 0;
+		for (size_t l = 0; l < network.LayerCount(); l++)
+			floatModelSize += (network.Layer(l).m_weights.size() + network.Layer(l).m_bias.size()) * sizeof(float);
+		const auto startTime = chrono::steady_clock::now();
+		size_t quantizedCorrect = 0;
+		for (size_t first = 0; first < testSet.Count(); first += InferenceBatchSize)
+		{
+			const size_t count = std::min(InferenceBatchSize, testSet.Count() - first);
+			const auto prediction = quantized.Forward(testSet.Images().Images(first, count), count);
+			for (size_t n = 0; n < count; n++)
+			{
+				const float* row = prediction.data() + n * NumberOfClasses;
+				if (static_cast<size_t>(max_element(row, row + NumberOfClasses) - row) == testSet.Label(first + n))
+					quantizedCorrect++;
+			}
+		}
+		const chrono::duration<double> elapsed = chrono::steady_clock::now() - startTime;
+		cout << "Int8 test accuracy: " << 100.0 * quantizedCorrect / testSet.Count() << "%, " << testSet.Count() / elapsed.count() << " images/s, model "
+			<< quantized.ModelSize() << " bytes (float " << floatModelSize << " bytes)." << endl;
+
+		//the production topology compiled in, served one image at a time as a request would be.
+		using MnistNetwork = StaticNetwork<StaticLayer<MnistImageSize, NumberOfHiddenNeurons, Activation::ReLU>, StaticLayer<NumberOfHiddenNeurons, NumberOfClasses, Activation::Softmax>>;
+		const auto staticNetwork = make_unique<MnistNetwork>();
+		if (testSet.ImageSize() == MnistImageSize && staticNetwork->Load(network))
+		{
+			array<float, MnistImageSize> image;
+			size_t staticCorrect = 0;
+			chrono::duration<double, micro> staticTime{};
+			chrono::duration<double, micro> dynamicTime{};
+			for (size_t n = 0; n < testSet.Count(); n++)
+			{
+				Idx3Lib::ConvertPixels<float>(testSet.Images().Images(n, 1), image);
+				const auto staticStart = chrono::steady_clock::now();
+				if (staticNetwork->Predict(image) == testSet.Label(n))
+					staticCorrect++;
+				const auto dynamicStart = chrono::steady_clock::now();
+				network.Forward(image, 1);
+				dynamicTime += chrono::steady_clock::now() - dynamicStart;
+				staticTime += dynamicStart - staticStart;
+			}
+			cout << "Static network test accuracy: " << 100.0 * staticCorrect / testSet.Count() << "%, " << staticTime.count() / testSet.Count()
+				<< "us per image (runtime shaped network " << dynamicTime.count() / testSet.Count() << "us)." << endl;
+		}
+	}
+
+	if (profile && Idx3Lib::Instrumentation::CompiledIn)
+	{
+		Idx3Lib::Instrumentation::Disable();
+		Idx3Lib::Instrumentation::WriteSummary(cout);
+		constexpr const char* TracePath = "feedforwardnetmnist-trace.json";
+		if (Idx3Lib::Instrumentation::WriteChromeTrace(TracePath))
+			cout << "Trace written to " << TracePath << ", open it in chrome://tracing or ui.perfetto.dev." << endl;
+	}
 	cout << "[Enter] to exit..." << endl;
 	cin.get();
-}
\ No newline at end of file
+}
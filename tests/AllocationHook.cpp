@@ -0,0 +1,41 @@
+#include "AllocationHook.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+//every allocation in the process goes through these, so tests and benchmarks can assert their loops do not allocate.
+//the array and nothrow forms of the standard library forward to them.
+void* operator new(std::size_t size)
+{
+	Test::g_allocationCount.fetch_add(1, std::memory_order_relaxed);
+	if (void* memory = std::malloc(size == 0 ? 1 : size))
+		return memory;
+	throw std::bad_alloc();
+}
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+	Test::g_allocationCount.fetch_add(1, std::memory_order_relaxed);
+	const auto align = static_cast<std::size_t>(alignment);
+#ifdef _WIN32
+	if (void* memory = _aligned_malloc(size == 0 ? 1 : size, align))
+		return memory;
+#else
+	if (void* memory = std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) / align * align))
+		return memory;
+#endif
+	throw std::bad_alloc();
+}
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept
+{
+#ifdef _WIN32
+	_aligned_free(memory);
+#else
+	std::free(memory);
+#endif
+}
+void operator delete(void* memory, std::size_t, std::align_val_t alignment) noexcept { operator delete(memory, alignment); }
@@ -0,0 +1,21 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+/// <summary>
+/// Heap allocations made so far on any thread, counted by the global <c>operator new</c> replaced in AllocationHook.cpp.
+/// Only executables that compile AllocationHook.cpp count, elsewhere the value stays 0.
+/// </summary>
+namespace Test
+{
+	inline std::atomic<size_t> g_allocationCount{ 0 };
+
+	/// <summary>Number of heap allocations <c>op</c> made.</summary>
+	template<typename Op>
+	size_t CountAllocations(Op&& op)
+	{
+		const size_t before = g_allocationCount.load(std::memory_order_relaxed);
+		op();
+		return g_allocationCount.load(std::memory_order_relaxed) - before;
+	}
+}
@@ -0,0 +1,90 @@
+#include "TestSupport.hpp"
+#include "AllocationHook.hpp"
+#include <random>
+#include <vector>
+#include "../feedforwardnetmnist/Network.hpp"
+#include "../feedforwardnetmnist/Trainer.hpp"
+#include "../feedforwardnetmnist/ThreadPool.hpp"
+
+namespace
+{
+	constexpr size_t RowLength = 28 * 28;
+	constexpr size_t BatchSize = 64;
+	constexpr size_t Steps = 5;
+
+	std::vector<float> RandomFloats(size_t count)
+	{
+		std::mt19937 engine(42);
+		std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+		std::vector<float> values(count);
+		for (auto& elem : values)
+			elem = dist(engine);
+		return values;
+	}
+
+	Network MnistNetwork()
+	{
+		Network network;
+		network.AddLayer(DenseLayer(RowLength, 128, Activation::ReLU));
+		network.AddLayer(DenseLayer(128, 10, Activation::Softmax));
+		return network;
+	}
+
+	/// <summary>Reserves for <c>BatchSize</c>, runs one forward pass to warm up, then counts the allocations of passes at
+	///	every batch size up to the reserved one.</summary>
+	size_t ForwardAllocations(ThreadPool* pool)
+	{
+		auto network = MnistNetwork();
+		network.SetThreadPool(pool);
+		network.Reserve(BatchSize);
+		const auto input = RandomFloats(BatchSize * RowLength);
+		network.Forward(input, BatchSize);
+		return Test::CountAllocations([&]()
+		{
+			for (const size_t batchSize : { BatchSize, size_t{ 1 }, size_t{ 17 }, BatchSize })
+				network.Forward(std::span(input).first(batchSize * RowLength), batchSize);
+		});
+	}
+
+	/// <summary>Reserves for <c>BatchSize</c>, takes one step so the optimizer sizes its moment estimates, then counts the
+	///	allocations of the following steps.</summary>
+	size_t TrainAllocations(OptimizerType type, ThreadPool* pool)
+	{
+		auto network = MnistNetwork();
+		Trainer trainer(network, { .Type = type, .LearningRate = 0.001f }, pool);
+		trainer.Reserve(BatchSize);
+		const auto input = RandomFloats(BatchSize * RowLength);
+		std::vector<Trainer::LabelType> labels(BatchSize);
+		for (size_t n = 0; n < BatchSize; n++)
+			labels[n] = static_cast<Trainer::LabelType>(n % 10);
+		trainer.TrainBatch(input, labels, BatchSize);
+		return Test::CountAllocations([&]()
+		{
+			for (size_t step = 0; step < Steps; step++)
+				trainer.TrainBatch(input, labels, BatchSize);
+		});
+	}
+}
+
+IDX3_TEST(ForwardDoesNotAllocateAfterWarmUp)
+{
+	IDX3_CHECK(ForwardAllocations(nullptr) == 0);
+	ThreadPool pool(3);
+	IDX3_CHECK(ForwardAllocations(&pool) == 0);
+}
+
+IDX3_TEST(TrainBatchDoesNotAllocateAfterWarmUp)
+{
+	IDX3_CHECK(TrainAllocations(OptimizerType::Adam, nullptr) == 0);
+	IDX3_CHECK(TrainAllocations(OptimizerType::SGD, nullptr) == 0);
+	ThreadPool pool(3);
+	IDX3_CHECK(TrainAllocations(OptimizerType::Adam, &pool) == 0);
+}
+
+IDX3_TEST(AllocationHookCountsHeapAllocations)
+{
+	//guards the tests above against passing only because the replaced operator new was not linked in.
+	void* volatile memory = nullptr;
+	IDX3_CHECK(Test::CountAllocations([&]() { memory = ::operator new(16); }) == 1);
+	::operator delete(memory);
+}
@@ -0,0 +1,497 @@
+#include "TestSupport.hpp"
+#include <algorithm>
+#include <numeric>
+#include "../MNISTFileLib/stdafx.h"
+#include "../MNISTFileLib/Idx3HeaderData.hpp"
+#include "../MNISTFileLib/IdxFile.hpp"
+#include "../MNISTFileLib/Idx3BatchReader.hpp"
+#include "../MNISTFileLib/Idx3MappedDataset.hpp"
+#include "../MNISTFileLib/Idx3Dataset.hpp"
+#include "../MNISTFileLib/Idx3Writer.hpp"
+#include "../MNISTFileLib/Idx3PrefetchPipeline.hpp"
+#include "../MNISTFileLib/IdxConcatenation.hpp"
+#include "../MNISTFileLib/SwapEndian.hpp"
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+	using Bits8Type = Idx3Lib::Idx3HeaderData::Bits8Type;
+
+	/// <summary>Writes an IDX3 file of <c>count</c> images to a scratch path and returns the path.</summary>
+	std::string WriteIdx3(std::string_view name, std::uint32_t count, std::uint32_t rows, std::uint32_t columns)
+	{
+		const auto path = Test::TempPath(name).string();
+		Test::WriteFile(path, Test::Idx3FileBytes(count, rows, columns));
+		return path;
+	}
+	/// <summary>Runs <c>SwapCopy&lt;T&gt;</c> with every kernel the host supports, out of place from an unaligned source and
+	///	in place, and compares each element with <c>swap_endian</c>.</summary>
+	template<typename T>
+	void CheckSwapKernels()
+	{
+		for (const auto kernel : { Endian::Kernel::Scalar, Endian::Kernel::SSSE3, Endian::Kernel::AVX2 })
+		{
+			if (static_cast<int>(kernel) > static_cast<int>(Endian::DetectKernel()))
+				continue;
+			//counts that end in a partial vector, a lone element and nothing at all.
+			for (const size_t count : { 0, 1, 7, 33, 1000 })
+			{
+				std::vector<std::uint8_t> source(count * sizeof(T) + 1);
+				for (size_t i = 0; i < source.size(); i++)
+					source[i] = static_cast<std::uint8_t>(i * 37 + 11);
+				std::vector<T> expected(count);
+				for (size_t i = 0; i < count; i++)
+				{
+					T value;
+					std::memcpy(&value, source.data() + 1 + i * sizeof(T), sizeof(T));
+					expected[i] = swap_endian(value);
+				}
+				const auto SameBytes = [&expected](const std::vector<T>& values) { return std::memcmp(values.data(), expected.data(), expected.size() * sizeof(T)) == 0; };
+				std::vector<T> swapped(count);
+				Endian::SwapCopy(source.data() + 1, swapped.data(), count, kernel);
+				IDX3_CHECK(SameBytes(swapped));
+				std::vector<T> inPlace(count);
+				if (count != 0)
+					std::memcpy(inPlace.data(), source.data() + 1, count * sizeof(T));
+				Endian::SwapInPlace(std::span(inPlace), kernel);
+				IDX3_CHECK(SameBytes(inPlace));
+			}
+		}
+	}
+
+	/// <summary>Writes an IDX1 label file whose label n is <c>n % 256</c> to a scratch path and returns the path.</summary>
+	std::string WriteIdx1(std::string_view name, std::uint32_t count)
+	{
+		std::vector<std::uint8_t> bytes;
+		for (const auto field : { std::uint32_t{ 2049 }, count })
+			Test::AppendBigEndian32(bytes, field);
+		for (size_t n = 0; n < count; n++)
+			bytes.push_back(static_cast<std::uint8_t>(n));
+		const auto path = Test::TempPath(name).string();
+		Test::WriteFile(path, bytes);
+		return path;
+	}
+}
+
+IDX3_TEST(Idx3HeaderParsesBigEndianFields)
+{
+	const auto bytes = Test::Idx3FileBytes(3, 2, 5);
+	Idx3Lib::Idx3HeaderData header;
+	IDX3_REQUIRE(Idx3Lib::Idx3HeaderData::FromBytes(bytes, header));
+	IDX3_CHECK(header.magic == Idx3Lib::Idx3HeaderData::MagicNumber);
+	IDX3_CHECK(header.num_images == 3);
+	IDX3_CHECK(header.num_rows == 2);
+	IDX3_CHECK(header.num_columns == 5);
+	IDX3_CHECK(header.ImageSize() == 10);
+	IDX3_CHECK(header.IsValid());
+	IDX3_CHECK(!Idx3Lib::Idx3HeaderData::FromBytes(std::span(bytes).first(Idx3Lib::Idx3HeaderData::HeaderSize - 1), header));
+}
+
+IDX3_TEST(Idx3HeaderRejectsWrongMagic)
+{
+	auto bytes = Test::Idx3FileBytes(1, 2, 2);
+	bytes[3] = 0x01;
+	Idx3Lib::Idx3HeaderData header;
+	IDX3_REQUIRE(Idx3Lib::Idx3HeaderData::FromBytes(bytes, header));
+	IDX3_CHECK(!header.IsValid());
+}
+
+IDX3_TEST(IdxHeaderParsesAnyRankAndType)
+{
+	std::vector<std::uint8_t> bytes{ 0, 0, static_cast<std::uint8_t>(Idx3Lib::IdxDataType::Float), 2 };
+	Test::AppendBigEndian32(bytes, 7);
+	Test::AppendBigEndian32(bytes, 3);
+	Idx3Lib::IdxHeader header;
+	IDX3_REQUIRE(Idx3Lib::IdxHeader::FromBytes(bytes, header));
+	IDX3_CHECK(header.type == Idx3Lib::IdxDataType::Float);
+	IDX3_CHECK(header.Rank() == 2);
+	IDX3_CHECK(header.HeaderSize() == 12);
+	IDX3_CHECK(header.ItemCount() == 7);
+	IDX3_CHECK(header.ItemSize() == 3 * sizeof(float));
+	IDX3_CHECK(header.DataSize() == 7 * 3 * sizeof(float));
+	IDX3_CHECK(header.ToBytes() == bytes);
+}
+
+IDX3_TEST(IdxHeaderRejectsMalformedHeaders)
+{
+	Idx3Lib::IdxHeader header;
+	const std::vector<std::uint8_t> leadingByte{ 1, 0, 0x08, 1, 0, 0, 0, 1 };
+	const std::vector<std::uint8_t> unknownType{ 0, 0, 0x0A, 1, 0, 0, 0, 1 };
+	const std::vector<std::uint8_t> zeroRank{ 0, 0, 0x08, 0 };
+	const std::vector<std::uint8_t> truncated{ 0, 0, 0x08, 3, 0, 0, 0, 1 };
+	IDX3_CHECK(!Idx3Lib::IdxHeader::FromBytes(leadingByte, header));
+	IDX3_CHECK(!Idx3Lib::IdxHeader::FromBytes(unknownType, header));
+	IDX3_CHECK(!Idx3Lib::IdxHeader::FromBytes(zeroRank, header));
+	IDX3_CHECK(!Idx3Lib::IdxHeader::FromBytes(truncated, header));
+}
+
+IDX3_TEST(IdxHeaderRejectsDimensionsThatOverflow)
+{
+	//0xFFFFFFFF^3 * 8 wraps a 64 bit size, the wrapped data size would be small enough to pass a file size check.
+	std::vector<std::uint8_t> bytes{ 0, 0, static_cast<std::uint8_t>(Idx3Lib::IdxDataType::Double), 3 };
+	for (int i = 0; i < 3; i++)
+		Test::AppendBigEndian32(bytes, 0xFFFFFFFF);
+	Idx3Lib::IdxHeader header;
+	IDX3_CHECK(!Idx3Lib::IdxHeader::FromBytes(bytes, header));
+	//zero items do not excuse an item size that wraps.
+	bytes[7] = 0;
+	bytes[6] = 0;
+	bytes[5] = 0;
+	bytes[4] = 0;
+	IDX3_CHECK(!Idx3Lib::IdxHeader::FromBytes(bytes, header));
+
+	bytes.resize(bytes.size() + 16);
+	const auto path = Test::TempPath("overflow.idx").string();
+	Test::WriteFile(path, bytes);
+	Idx3Lib::IdxMappedFile file;
+	IDX3_CHECK(!file.Open(path));
+	std::filesystem::remove(path);
+}
+
+IDX3_TEST(BatchReaderReadsEveryImageInOrder)
+{
+	const auto bytes = Test::Idx3FileBytes(5, 3, 4);
+	const auto path = WriteIdx3("batch.idx3", 5, 3, 4);
+	Idx3Lib::Idx3BatchReader reader;
+	IDX3_REQUIRE(reader.Open(path));
+	IDX3_CHECK(reader.ImageCount() == 5);
+	IDX3_CHECK(reader.ImageSize() == 12);
+	Idx3Lib::Idx3Batch<> batch(2, reader.ImageSize());
+	std::vector<Bits8Type> read;
+	std::vector<size_t> counts;
+	while (const size_t count = reader.ReadBatch(batch))
+	{
+		counts.push_back(count);
+		read.insert(read.end(), batch.Filled().begin(), batch.Filled().end());
+	}
+	IDX3_CHECK((counts == std::vector<size_t>{ 2, 2, 1 }));
+	IDX3_CHECK(std::equal(read.begin(), read.end(), bytes.begin() + Idx3Lib::Idx3HeaderData::HeaderSize, bytes.end()));
+
+	//decoding to floats after a seek.
+	IDX3_REQUIRE(reader.Seek(4));
+	Idx3Lib::Idx3Batch<float> floats(4, reader.ImageSize());
+	IDX3_REQUIRE(reader.ReadBatch(floats) == 1);
+	for (size_t i = 0; i < floats.ImageSize; i++)
+		IDX3_CHECK(floats.data[i] == static_cast<float>(bytes[Idx3Lib::Idx3HeaderData::HeaderSize + 4 * 12 + i]) * (1.0f / 255.0f));
+	IDX3_CHECK(!reader.Seek(6));
+	std::filesystem::remove(path);
+}
+
+IDX3_TEST(BatchReaderRejectsTruncatedFile)
+{
+	auto bytes = Test::Idx3FileBytes(4, 2, 2);
+	bytes.resize(bytes.size() - 1);
+	const auto path = Test::TempPath("truncated.idx3").string();
+	Test::WriteFile(path, bytes);
+	Idx3Lib::Idx3BatchReader reader;
+	Idx3Lib::Idx3Batch<> batch(4, 4);
+	IDX3_CHECK(!reader.Open(path) || reader.ReadBatch(batch) < 4);
+	std::filesystem::remove(path);
+}
+
+IDX3_TEST(MappedDatasetChecksBounds)
+{
+	const auto bytes = Test::Idx3FileBytes(3, 2, 2);
+	const auto path = WriteIdx3("mapped.idx3", 3, 2, 2);
+	{
+		Idx3Lib::Idx3MappedDataset dataset;
+		IDX3_REQUIRE(dataset.Open(path));
+		IDX3_CHECK(dataset.ImageCount() == 3);
+		IDX3_CHECK(dataset.Image(2).size() == 4);
+		IDX3_CHECK(dataset.Image(2)[0] == bytes[Idx3Lib::Idx3HeaderData::HeaderSize + 8]);
+		IDX3_CHECK(dataset.Image(3).empty());
+		IDX3_CHECK(dataset.Images(1, 10).size() == 2 * 4);
+		IDX3_CHECK(dataset.Images(3, 1).empty());
+	}
+	//a header claiming more images than the file holds is refused.
+	auto truncated = bytes;
+	truncated.resize(truncated.size() - 1);
+	Test::WriteFile(path, truncated);
+	Idx3Lib::Idx3MappedDataset dataset;
+	IDX3_CHECK(!dataset.Open(path));
+	IDX3_CHECK(!dataset.IsOpen());
+	IDX3_CHECK(dataset.Image(0).empty());
+	std::filesystem::remove(path);
+}
+
+IDX3_TEST(ShardedLoadMatchesFileAtAnyShardCount)
+{
+	const auto bytes = Test::Idx3FileBytes(23, 3, 3);
+	const auto path = WriteIdx3("sharded.idx3", 23, 3, 3);
+	const auto expected = std::span(bytes).subspan(Idx3Lib::Idx3HeaderData::HeaderSize);
+	//more shards than images is clamped to one image per shard.
+	for (const size_t shards : { 0, 1, 3, 8, 64 })
+	{
+		Idx3Lib::Idx3Dataset dataset;
+		IDX3_REQUIRE(dataset.LoadSharded(path, shards));
+		IDX3_CHECK(dataset.ImageCount() == 23);
+		IDX3_CHECK(dataset.ImageSize() == 9);
+		IDX3_CHECK(std::equal(dataset.Pixels().begin(), dataset.Pixels().end(), expected.begin(), expected.end()));
+	}
+	auto truncated = bytes;
+	truncated.resize(truncated.size() - 1);
+	Test::WriteFile(path, truncated);
+	Idx3Lib::Idx3Dataset dataset;
+	IDX3_CHECK(!dataset.LoadSharded(path, 4));
+	IDX3_CHECK(dataset.ImageCount() == 0);
+	IDX3_CHECK(!dataset.LoadSharded(Test::TempPath("missing.idx3").string()));
+	std::filesystem::remove(path);
+}
+
+IDX3_TEST(WriterRoundTripsThroughReaders)
+{
+	const auto source = Test::Idx3FileBytes(9, 4, 3);
+	const std::span<const Bits8Type> pixels = std::span(source).subspan(Idx3Lib::Idx3HeaderData::HeaderSize);
+	const auto path = Test::TempPath("written.idx3").string();
+	{
+		Idx3Lib::Idx3Writer writer;
+		//a small buffer so appends both gather and write through.
+		IDX3_REQUIRE(writer.Open(path, 4, 3, { .BufferSize = 16 }));
+		IDX3_CHECK(writer.AppendImages(pixels.first(12)));
+		IDX3_CHECK(writer.AppendImages(pixels.subspan(12, 5 * 12)));
+		IDX3_CHECK(writer.AppendImages(pixels.subspan(6 * 12)));
+		IDX3_CHECK(writer.ImagesWritten() == 9);
+		IDX3_REQUIRE(writer.Close());
+	}
+	Idx3Lib::Idx3MappedDataset dataset;
+	IDX3_REQUIRE(dataset.Open(path));
+	IDX3_CHECK(dataset.Header().num_images == 9);
+	IDX3_CHECK(dataset.Header().num_rows == 4);
+	IDX3_CHECK(dataset.Header().num_columns == 3);
+	const auto images = dataset.Images(0, 9);
+	IDX3_CHECK(std::equal(images.begin(), images.end(), pixels.begin(), pixels.end()));
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	IDX3_CHECK(static_cast<size_t>(file.tellg()) == source.size());
+	std::filesystem::remove(path);
+}
+
+IDX3_TEST(WriterRejectsPartialImages)
+{
+	const auto path = Test::TempPath("partial.idx3").string();
+	Idx3Lib::Idx3Writer writer;
+	IDX3_REQUIRE(writer.Open(path, 2, 2));
+	const std::vector<Bits8Type> pixels(6);
+	IDX3_CHECK(!writer.AppendImages(pixels));
+	writer.Close();
+	std::filesystem::remove(path);
+}
+
+IDX3_TEST(WriterRejectsSizesBeyondTheHeaderFields)
+{
+	const auto path = Test::TempPath("oversized.idx3").string();
+	constexpr size_t Limit = std::numeric_limits<Idx3Lib::Idx3HeaderData::Bits32Type>::max();
+	{
+		Idx3Lib::Idx3Writer writer;
+		//sizes that would otherwise wrap to valid small dimensions.
+		IDX3_CHECK(!writer.Open(path, Limit + 2, 1));
+		IDX3_CHECK(!writer.Open(path, 2, Limit + 3));
+		IDX3_CHECK(!writer.ErrorMessage().empty());
+		IDX3_CHECK(!writer.IsOpen());
+	}
+#ifndef _WIN32
+	//more one pixel images than the header can count. The pixels are reserved but inaccessible, so the append has to
+	//be refused before any of them is read.
+	const size_t size = Limit + 1;
+	void* const pixels = ::mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	IDX3_REQUIRE(pixels != MAP_FAILED);
+	{
+		Idx3Lib::Idx3Writer writer;
+		IDX3_REQUIRE(writer.Open(path, 1, 1));
+		const std::vector<Bits8Type> one(1);
+		IDX3_CHECK(writer.AppendImages(one));
+		IDX3_CHECK(!writer.AppendImages(std::span(static_cast<const Bits8Type*>(pixels), size - 1)));
+		IDX3_CHECK(writer.ErrorMessage().find("exceeds") != std::string_view::npos);
+		IDX3_CHECK(writer.ImagesWritten() == 1);
+		IDX3_CHECK(!writer.Close());
+	}
+	::munmap(pixels, size);
+#endif
+	std::filesystem::remove(path);
+}
+
+IDX3_TEST(PrefetchPipelineDeliversBatchesInOrderAtAnyDepth)
+{
+	const auto bytes = Test::Idx3FileBytes(37, 2, 3);
+	const auto path = WriteIdx3("pipeline.idx3", 37, 2, 3);
+	Idx3Lib::Idx3MappedDataset dataset;
+	IDX3_REQUIRE(dataset.Open(path));
+	const auto expected = std::span(bytes).subspan(Idx3Lib::Idx3HeaderData::HeaderSize);
+	//a single slot is reused for the very next batch while the consumer still holds the previous one.
+	for (const size_t depth : { 1, 2, 4 })
+	{
+		for (const size_t workers : { 1, 3 })
+		{
+			Idx3Lib::Idx3PrefetchPipeline<> pipeline;
+			IDX3_REQUIRE(pipeline.Start(dataset, { .BatchSize = 4, .PrefetchDepth = depth, .WorkerCount = workers }));
+			std::vector<Bits8Type> read;
+			while (const auto batch = pipeline.Next())
+				read.insert(read.end(), batch->Filled().begin(), batch->Filled().end());
+			IDX3_CHECK(std::equal(read.begin(), read.end(), expected.begin(), expected.end()));
+			IDX3_CHECK(pipeline.Stats().BatchesConsumed == 10);
+		}
+	}
+	dataset.Close();
+	std::filesystem::remove(path);
+}
+
+IDX3_TEST(ConcatenationMergesInputsByteForByte)
+{
+	const auto first = Test::Idx3FileBytes(5, 3, 4);
+	auto second = Test::Idx3FileBytes(7, 3, 4);
+	std::transform(second.begin() + Idx3Lib::Idx3HeaderData::HeaderSize, second.end(), second.begin() + Idx3Lib::Idx3HeaderData::HeaderSize, [](std::uint8_t pixel) { return static_cast<std::uint8_t>(~pixel); });
+	const auto firstPath = WriteIdx3("merge-a.idx3", 5, 3, 4);
+	const auto secondPath = Test::TempPath("merge-b.idx3").string();
+	Test::WriteFile(secondPath, second);
+	const auto outputPath = Test::TempPath("merged.idx3").string();
+	{
+		Idx3Lib::IdxConcatenation concatenation;
+		IDX3_REQUIRE(concatenation.Add(firstPath));
+		IDX3_REQUIRE(concatenation.Add(secondPath));
+		IDX3_CHECK(concatenation.ItemCount() == 12);
+		//blocks of a few items, so runs cross both block and source boundaries.
+		IDX3_REQUIRE(concatenation.WriteRange(outputPath, 0, 12, { .BufferSize = 5 * 12, .ShardCount = 3 }));
+	}
+	auto expected = Test::Idx3FileBytes(12, 3, 4);
+	std::copy(second.begin() + Idx3Lib::Idx3HeaderData::HeaderSize, second.end(), expected.begin() + Idx3Lib::Idx3HeaderData::HeaderSize + 5 * 12);
+	IDX3_CHECK(Test::ReadFile(outputPath) == expected);
+	IDX3_CHECK(!std::filesystem::exists(outputPath + ".tmp"));
+	for (const auto& path : { firstPath, secondPath, outputPath })
+		std::filesystem::remove(path);
+}
+
+IDX3_TEST(PermutationIsABijectionIndependentOfThreads)
+{
+	//below and above the size at which the permutation is built from buckets.
+	for (const size_t count : { size_t{ 0 }, size_t{ 10 }, Idx3Lib::IdxPermutation::Buckets * Idx3Lib::IdxPermutation::Buckets + 123 })
+	{
+		const auto permutation = Idx3Lib::IdxPermutation::Random(count, 7, 1);
+		IDX3_CHECK(permutation.size() == count);
+		for (const size_t threads : { 2, 5 })
+			IDX3_CHECK(Idx3Lib::IdxPermutation::Random(count, 7, threads) == permutation);
+		auto sorted = permutation;
+		std::sort(sorted.begin(), sorted.end());
+		std::vector<size_t> identity(count);
+		std::iota(identity.begin(), identity.end(), size_t{ 0 });
+		IDX3_CHECK(sorted == identity);
+		if (count > 1)
+		{
+			IDX3_CHECK(permutation != identity);
+			IDX3_CHECK(Idx3Lib::IdxPermutation::Random(count, 8, 1) != permutation);
+		}
+	}
+}
+
+IDX3_TEST(ConcatenationReordersImagesAndLabelsAlike)
+{
+	constexpr std::uint32_t Count = 300;
+	const auto images = Test::Idx3FileBytes(Count, 2, 3);
+	const auto imagePath = WriteIdx3("column-images.idx3", Count, 2, 3);
+	const auto labelPath = WriteIdx1("column-labels.idx1", Count);
+	const auto imageOutput = Test::TempPath("column-images-out.idx3").string();
+	const auto labelOutput = Test::TempPath("column-labels-out.idx1").string();
+	const auto permutation = Idx3Lib::IdxPermutation::Random(Count, 3);
+	{
+		Idx3Lib::IdxConcatenation imageColumn;
+		Idx3Lib::IdxConcatenation labelColumn;
+		IDX3_REQUIRE(imageColumn.Add(imagePath));
+		IDX3_REQUIRE(labelColumn.Add(labelPath));
+		IDX3_REQUIRE(imageColumn.Write(imageOutput, permutation, { .BufferSize = 64, .ShardCount = 4 }));
+		IDX3_REQUIRE(labelColumn.Write(labelOutput, permutation, { .BufferSize = 7, .ShardCount = 2 }));
+	}
+	{
+		Idx3Lib::IdxMappedFile shuffledImages;
+		Idx3Lib::IdxMappedFile shuffledLabels;
+		IDX3_REQUIRE(shuffledImages.Open(imageOutput));
+		IDX3_REQUIRE(shuffledLabels.Open(labelOutput));
+		IDX3_REQUIRE(shuffledImages.ItemCount() == Count);
+		IDX3_REQUIRE(shuffledLabels.ItemCount() == Count);
+		for (size_t i = 0; i < Count; i++)
+		{
+			const auto image = shuffledImages.ItemBytes(i, 1);
+			const auto expected = std::span(images).subspan(Idx3Lib::Idx3HeaderData::HeaderSize + permutation[i] * 6, 6);
+			IDX3_CHECK(std::equal(image.begin(), image.end(), expected.begin(), expected.end()));
+			IDX3_CHECK(shuffledLabels.ItemBytes(i, 1)[0] == static_cast<std::uint8_t>(permutation[i]));
+		}
+	}
+	for (const auto& path : { imagePath, labelPath, imageOutput, labelOutput })
+		std::filesystem::remove(path);
+}
+
+IDX3_TEST(SplitPartsCoverItemsInNearEqualSizes)
+{
+	for (const auto& [count, parts] : { std::pair<size_t, size_t>{ 10, 3 }, { 12, 4 }, { 7, 7 }, { 3, 5 }, { 0, 2 }, { 60000, 7 } })
+	{
+		size_t next = 0;
+		for (size_t part = 0; part < parts; part++)
+		{
+			const auto [first, last] = Idx3Lib::IdxConcatenation::PartRange(count, part, parts);
+			IDX3_CHECK(first == next);
+			IDX3_CHECK(last - first == count / parts || last - first == count / parts + 1);
+			next = last;
+		}
+		IDX3_CHECK(next == count);
+	}
+	//the parts written hold exactly their share of the items.
+	const auto path = WriteIdx3("split.idx3", 10, 2, 2);
+	Idx3Lib::IdxConcatenation concatenation;
+	IDX3_REQUIRE(concatenation.Add(path));
+	for (size_t part = 0; part < 3; part++)
+	{
+		const auto [first, last] = Idx3Lib::IdxConcatenation::PartRange(10, part, 3);
+		const auto partPath = Test::TempPath("split-part.idx3").string();
+		IDX3_REQUIRE(concatenation.WriteRange(partPath, first, last - first));
+		{
+			Idx3Lib::IdxMappedFile written;
+			IDX3_REQUIRE(written.Open(partPath));
+			IDX3_CHECK(written.ItemCount() == (part == 2 ? 4u : 3u));
+			const auto bytes = written.ItemBytes(0, written.ItemCount());
+			const auto expected = Test::Idx3FileBytes(10, 2, 2);
+			IDX3_CHECK(std::equal(bytes.begin(), bytes.end(), expected.begin() + Idx3Lib::Idx3HeaderData::HeaderSize + first * 4));
+		}
+		std::filesystem::remove(partPath);
+	}
+	std::filesystem::remove(path);
+}
+
+IDX3_TEST(ConcatenationRefusesOutputThatIsAnInput)
+{
+	const auto bytes = Test::Idx3FileBytes(6, 2, 2);
+	const auto path = WriteIdx3("aliased.idx3", 6, 2, 2);
+	const auto otherPath = WriteIdx3("aliased-other.idx3", 6, 2, 2);
+	Idx3Lib::IdxConcatenation concatenation;
+	IDX3_REQUIRE(concatenation.Add(otherPath));
+	IDX3_REQUIRE(concatenation.Add(path));
+	IDX3_CHECK(concatenation.ReadsFrom(path));
+	IDX3_CHECK(!concatenation.ReadsFrom(Test::TempPath("aliased-new.idx3").string()));
+	IDX3_CHECK(!concatenation.WriteRange(path, 0, 12));
+	IDX3_CHECK(!concatenation.ErrorMessage().empty());
+	//another spelling of the same file is caught as well.
+	const auto respelled = (std::filesystem::path(path).parent_path() / "." / std::filesystem::path(path).filename()).string();
+	IDX3_CHECK(!concatenation.WriteRange(respelled, 0, 12));
+#ifndef _WIN32
+	const auto linkPath = Test::TempPath("aliased-link.idx3");
+	std::filesystem::remove(linkPath);
+	std::filesystem::create_symlink(path, linkPath);
+	IDX3_CHECK(concatenation.ReadsFrom(linkPath.string()));
+	IDX3_CHECK(!concatenation.WriteRange(linkPath.string(), 0, 12));
+	std::filesystem::remove(linkPath);
+#endif
+	IDX3_CHECK(Test::ReadFile(path) == bytes);
+	IDX3_CHECK(!std::filesystem::exists(path + ".tmp"));
+	for (const auto& file : { path, otherPath })
+		std::filesystem::remove(file);
+}
+
+IDX3_TEST(SwapKernelsMatchScalarSwap)
+{
+	static_assert(std::bit_cast<std::uint32_t>(swap_endian(1.0f)) == 0x0000803Fu);
+	static_assert(swap_endian(swap_endian(-2.5f)) == -2.5f);
+	static_assert(swap_endian(std::uint16_t{ 0x1234 }) == 0x3412);
+	CheckSwapKernels<std::uint16_t>();
+	CheckSwapKernels<std::int32_t>();
+	CheckSwapKernels<float>();
+	CheckSwapKernels<double>();
+	CheckSwapKernels<std::uint64_t>();
+}
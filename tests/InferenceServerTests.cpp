@@ -0,0 +1,55 @@
+#include "TestSupport.hpp"
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+#include "../feedforwardnetmnist/InferenceServer.hpp"
+
+#ifndef _WIN32
+IDX3_TEST(InferenceServerDisconnectsClientThatStopsReading)
+{
+	constexpr size_t InputSize = 1;
+	constexpr size_t OutputCount = 10;
+	//far more responses than a socket buffer holds.
+	constexpr size_t Flood = 20000;
+	const auto socketPath = Test::TempPath("server.sock").string();
+	const InferenceServerOptions options;
+	std::vector<float> scores(options.MaxBatchSize * OutputCount, 0.0f);
+	InferenceServer server;
+	IDX3_REQUIRE(server.Start(socketPath, InputSize, OutputCount,
+		[&scores](std::span<const InferenceServer::PixelType>, size_t batchSize) { return std::span<const float>(scores).first(batchSize * OutputCount); }, options));
+
+	InferenceClient flooder;
+	IDX3_REQUIRE(flooder.Connect(socketPath, OutputCount));
+	const std::vector<InferenceServer::PixelType> images(Flood * InputSize);
+	IDX3_REQUIRE(flooder.Send(images));
+	//lets the server get as far as it can with the flood, until its socket buffer is full.
+	for (size_t served = 0, idle = 0; idle < 4;)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		const size_t requests = server.Stats().Requests;
+		idle = requests == served ? idle + 1 : 0;
+		served = requests;
+	}
+
+	//another client is still served while the flooder does not read.
+	auto predicted = std::async(std::launch::async, [&]()
+	{
+		InferenceClient client;
+		const std::vector<InferenceServer::PixelType> image(InputSize);
+		return client.Connect(socketPath, OutputCount) ? client.Predict(image) : -1;
+	});
+	const bool served = predicted.wait_for(std::chrono::seconds(10)) == std::future_status::ready;
+	IDX3_CHECK(served);
+	if (!served)
+		flooder.Close();
+	IDX3_CHECK(predicted.get() == 0);
+
+	//the flooder gets what fitted in its socket buffer, then end of stream.
+	size_t received = 0;
+	while (received < Flood && flooder.IsConnected() && flooder.Receive() >= 0)
+		received++;
+	IDX3_CHECK(received < Flood);
+	server.Stop();
+}
+#endif
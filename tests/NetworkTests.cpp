@@ -0,0 +1,366 @@
+#include "TestSupport.hpp"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "../feedforwardnetmnist/Gemm.hpp"
+#include "../feedforwardnetmnist/Network.hpp"
+#include "../feedforwardnetmnist/QuantizedNetwork.hpp"
+#include "../feedforwardnetmnist/Trainer.hpp"
+#include "../feedforwardnetmnist/ThreadPool.hpp"
+
+namespace
+{
+	std::vector<float> RandomFloats(size_t count, unsigned seed)
+	{
+		std::mt19937 engine(seed);
+		std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+		std::vector<float> values(count);
+		for (auto& elem : values)
+			elem = dist(engine);
+		return values;
+	}
+
+	/// <summary>A 6-5-3 ReLU/Softmax network with every weight and bias drawn from <c>seed</c>.</summary>
+	Network TinyNetwork(unsigned seed)
+	{
+		Network network;
+		network.AddLayer(DenseLayer(6, 5, Activation::ReLU));
+		network.AddLayer(DenseLayer(5, 3, Activation::Softmax));
+		for (size_t l = 0; l < network.LayerCount(); l++)
+		{
+			DenseLayer& layer = network.Layer(l);
+			const auto weights = RandomFloats(layer.m_weights.size(), seed + 2 * static_cast<unsigned>(l));
+			const auto bias = RandomFloats(layer.m_bias.size(), seed + 2 * static_cast<unsigned>(l) + 1);
+			std::copy(weights.begin(), weights.end(), layer.m_weights.begin());
+			std::copy(bias.begin(), bias.end(), layer.m_bias.begin());
+		}
+		return network;
+	}
+
+	/// <summary>Uniformly random raw pixels, every code from 0 to 255 possible.</summary>
+	std::vector<DotKernels::PixelType> RandomPixels(size_t count, unsigned seed)
+	{
+		std::mt19937 engine(seed);
+		std::uniform_int_distribution<int> dist(0, 255);
+		std::vector<DotKernels::PixelType> pixels(count);
+		for (auto& elem : pixels)
+			elem = static_cast<DotKernels::PixelType>(dist(engine));
+		return pixels;
+	}
+
+	/// <summary>Raw pixels decoded the way <c>PixelScale::Normalized</c> does.</summary>
+	std::vector<float> NormalizedPixels(std::span<const DotKernels::PixelType> pixels)
+	{
+		std::vector<float> values(pixels.size());
+		for (size_t i = 0; i < pixels.size(); i++)
+			values[i] = pixels[i] / 255.0f;
+		return values;
+	}
+
+	/// <summary>Double precision copy of a network's parameters, for an independent loss evaluation.</summary>
+	struct ReferenceNetwork
+	{
+		std::vector<std::vector<double>> weights;
+		std::vector<std::vector<double>> bias;
+		std::vector<Activation> activations;
+		explicit ReferenceNetwork(const Network& network)
+		{
+			for (size_t l = 0; l < network.LayerCount(); l++)
+			{
+				const DenseLayer& layer = network.Layer(l);
+				weights.emplace_back(layer.m_weights.begin(), layer.m_weights.end());
+				bias.emplace_back(layer.m_bias.begin(), layer.m_bias.end());
+				activations.push_back(layer.m_activation);
+			}
+		}
+
+		/// <summary>Mean cross-entropy over a batch.</summary>
+		[[nodiscard]] double Loss(std::span<const float> input, std::span<const Trainer::LabelType> labels) const
+		{
+			const size_t batchSize = labels.size();
+			const size_t inputCount = input.size() / batchSize;
+			double loss = 0.0;
+			for (size_t n = 0; n < batchSize; n++)
+			{
+				std::vector<double> values(input.begin() + n * inputCount, input.begin() + (n + 1) * inputCount);
+				for (size_t l = 0; l < weights.size(); l++)
+				{
+					std::vector<double> outputs(bias[l].size());
+					for (size_t o = 0; o < outputs.size(); o++)
+					{
+						double sum = bias[l][o];
+						for (size_t i = 0; i < values.size(); i++)
+							sum += weights[l][o * values.size() + i] * values[i];
+						outputs[o] = activations[l] == Activation::ReLU ? std::max(sum, 0.0) : sum;
+					}
+					if (activations[l] == Activation::Softmax)
+					{
+						const double largest = *std::max_element(outputs.begin(), outputs.end());
+						double total = 0.0;
+						for (auto& elem : outputs)
+							total += (elem = std::exp(elem - largest));
+						for (auto& elem : outputs)
+							elem /= total;
+					}
+					values = std::move(outputs);
+				}
+				loss -= std::log(values[labels[n]]);
+			}
+			return loss / static_cast<double>(batchSize);
+		}
+	};
+
+	/// <summary>Compares <c>Gemm::MatMulTransposedB</c> with a double precision triple loop for one shape, with padded
+	///	leading dimensions and with and without a bias, on <c>pool</c> if it is not null.</summary>
+	void CheckMatMul(size_t m, size_t n, size_t k, ThreadPool* pool)
+	{
+		const size_t lda = k + 3;
+		const size_t ldb = k + 1;
+		const size_t ldc = n + 5;
+		const auto a = RandomFloats(m * lda, 1);
+		const auto b = RandomFloats(n * ldb, 2);
+		const auto bias = RandomFloats(n, 3);
+		Gemm::Workspace workspace;
+		for (const float* biasOrNull : { bias.data(), static_cast<const float*>(nullptr) })
+		{
+			//the padding past each row of C must be left alone.
+			std::vector<float> c(m * ldc, 42.0f);
+			if (pool != nullptr)
+				Gemm::MatMulTransposedB(a.data(), lda, b.data(), ldb, biasOrNull, c.data(), ldc, m, n, k, workspace, *pool);
+			else
+				Gemm::MatMulTransposedB(a.data(), lda, b.data(), ldb, biasOrNull, c.data(), ldc, m, n, k, workspace);
+			size_t mismatches = 0;
+			for (size_t i = 0; i < m; i++)
+			{
+				for (size_t j = 0; j < n; j++)
+				{
+					double expected = biasOrNull == nullptr ? 0.0 : biasOrNull[j];
+					double magnitude = std::abs(expected);
+					for (size_t p = 0; p < k; p++)
+					{
+						expected += static_cast<double>(a[i * lda + p]) * b[j * ldb + p];
+						magnitude += std::abs(static_cast<double>(a[i * lda + p]) * b[j * ldb + p]);
+					}
+					if (std::abs(c[i * ldc + j] - expected) > 1e-5 * magnitude + 1e-6)
+						mismatches++;
+				}
+				for (size_t j = n; j < ldc; j++)
+					mismatches += c[i * ldc + j] == 42.0f ? 0 : 1;
+			}
+			if (mismatches != 0)
+				std::cout << m << "x" << n << "x" << k << (pool != nullptr ? " on a pool" : "") << (biasOrNull != nullptr ? " with bias" : "")
+					<< ": " << mismatches << " wrong elements" << std::endl;
+			IDX3_CHECK(mismatches == 0);
+		}
+	}
+}
+
+IDX3_TEST(GemmMatchesNaiveProductAtEdgeShapes)
+{
+	//M not a multiple of MR, N not a multiple of NR, K past one KC panel, and products large enough for the pool to
+	//split by rows (M >= 2 * MC) or by columns (N >= 4 * NR).
+	const size_t shapes[][3] = { { 1, 1, 1 }, { 5, 17, 257 }, { 65, 10, 784 }, { 4, 16, 256 }, { 3, 33, 513 }, { 200, 10, 300 }, { 6, 100, 257 } };
+	ThreadPool pool(3);
+	for (const auto& shape : shapes)
+	{
+		CheckMatMul(shape[0], shape[1], shape[2], nullptr);
+		CheckMatMul(shape[0], shape[1], shape[2], &pool);
+	}
+}
+
+IDX3_TEST(TrainerGradientsMatchFiniteDifferences)
+{
+	//enough rows for several chunks whose gradients are reduced.
+	constexpr size_t BatchSize = 48;
+	const auto input = RandomFloats(BatchSize * 6, 11);
+	std::vector<Trainer::LabelType> labels(BatchSize);
+	for (size_t n = 0; n < BatchSize; n++)
+		labels[n] = static_cast<Trainer::LabelType>((n * 7) % 3);
+	ThreadPool pool(3);
+	for (ThreadPool* trainerPool : { static_cast<ThreadPool*>(nullptr), &pool })
+	{
+		//with plain SGD at a learning rate of 1 a step subtracts exactly the gradient.
+		auto network = TinyNetwork(5);
+		const auto before = TinyNetwork(5);
+		Trainer trainer(network, { .Type = OptimizerType::SGD, .LearningRate = 1.0f }, trainerPool);
+		const double loss = trainer.TrainBatch(input, labels, BatchSize);
+		ReferenceNetwork reference(before);
+		IDX3_CHECK(std::abs(loss - reference.Loss(input, labels)) < 1e-5);
+		size_t mismatches = 0;
+		for (size_t l = 0; l < network.LayerCount(); l++)
+		{
+			for (const bool isBias : { false, true })
+			{
+				auto& values = isBias ? reference.bias[l] : reference.weights[l];
+				const auto& original = isBias ? before.Layer(l).m_bias : before.Layer(l).m_weights;
+				const auto& updated = isBias ? network.Layer(l).m_bias : network.Layer(l).m_weights;
+				for (size_t i = 0; i < values.size(); i++)
+				{
+					//small enough that no row's ReLU input changes sign.
+					constexpr double Step = 1e-6;
+					values[i] = original[i] + Step;
+					const double above = reference.Loss(input, labels);
+					values[i] = original[i] - Step;
+					const double below = reference.Loss(input, labels);
+					values[i] = original[i];
+					const double numeric = (above - below) / (2.0 * Step);
+					const double analytic = static_cast<double>(original[i]) - updated[i];
+					if (std::abs(numeric - analytic) > 1e-3 * std::max(std::abs(numeric), std::abs(analytic)) + 1e-5)
+					{
+						std::cout << "layer " << l << (isBias ? " bias " : " weight ") << i << ": analytic " << analytic << ", numeric " << numeric << std::endl;
+						mismatches++;
+					}
+				}
+			}
+		}
+		IDX3_CHECK(mismatches == 0);
+	}
+}
+
+IDX3_TEST(TrainerStepIsIdenticalAcrossThreadCounts)
+{
+	constexpr size_t BatchSize = 100;
+	const auto input = RandomFloats(BatchSize * 6, 13);
+	std::vector<Trainer::LabelType> labels(BatchSize);
+	for (size_t n = 0; n < BatchSize; n++)
+		labels[n] = static_cast<Trainer::LabelType>(n % 3);
+	auto single = TinyNetwork(9);
+	Trainer singleTrainer(single, { .Type = OptimizerType::Adam, .LearningRate = 0.01f });
+	const float singleLoss = singleTrainer.TrainBatch(input, labels, BatchSize);
+	for (const size_t threads : { 2, 3, 4 })
+	{
+		ThreadPool pool(threads);
+		auto parallel = TinyNetwork(9);
+		Trainer parallelTrainer(parallel, { .Type = OptimizerType::Adam, .LearningRate = 0.01f }, &pool);
+		IDX3_CHECK(parallelTrainer.TrainBatch(input, labels, BatchSize) == singleLoss);
+		for (size_t l = 0; l < single.LayerCount(); l++)
+		{
+			IDX3_CHECK(std::equal(single.Layer(l).m_weights.begin(), single.Layer(l).m_weights.end(), parallel.Layer(l).m_weights.begin()));
+			IDX3_CHECK(std::equal(single.Layer(l).m_bias.begin(), single.Layer(l).m_bias.end(), parallel.Layer(l).m_bias.begin()));
+		}
+	}
+}
+
+IDX3_TEST(DotU8S8KernelsMatchScalarAtOddLengths)
+{
+	using namespace DotKernels;
+	std::vector<DotU8S8Fn> kernels;
+	for (const auto isa : { InstructionSet::Scalar, InstructionSet::SSE2, InstructionSet::AVX2 })
+	{
+		if (isa <= DetectInstructionSet())
+			kernels.push_back(GetDotU8S8(isa));
+	}
+	if (DetectVnni() != VnniSupport::None)
+		kernels.push_back(GetDotU8S8(DetectInstructionSet(), DetectVnni()));
+	//one past the end of the largest length, so every row can also start misaligned by a byte.
+	constexpr size_t Longest = 1000;
+	const auto values = RandomPixels(Longest + 1, 17);
+	std::vector<QuantizedWeightType> weights(Longest + 1);
+	std::mt19937 engine(19);
+	std::uniform_int_distribution<int> dist(-127, 127);
+	for (auto& elem : weights)
+		elem = static_cast<QuantizedWeightType>(dist(engine));
+	//the extremes must not saturate anywhere.
+	std::vector<DotKernels::PixelType> largest(Longest, 255);
+	std::vector<QuantizedWeightType> lowest(Longest, -127);
+	for (const size_t count : { 0, 1, 15, 17, 31, 33, 63, 65, 100, 785, 1000 })
+	{
+		for (const size_t offset : { 0, 1 })
+		{
+			if (count + offset > Longest + 1)
+				continue;
+			const std::int32_t expected = DotU8S8Scalar(values.data() + offset, weights.data() + offset, count);
+			for (const auto kernel : kernels)
+			{
+				IDX3_CHECK(kernel(values.data() + offset, weights.data() + offset, count) == expected);
+				IDX3_CHECK(kernel(largest.data(), lowest.data(), count) == -255 * 127 * static_cast<std::int32_t>(count));
+			}
+		}
+	}
+	IDX3_CHECK(DotU8S8(values, weights) == DotU8S8Scalar(values.data(), weights.data(), values.size()));
+}
+
+IDX3_TEST(QuantizedNetworkAgreesWithFloatNetwork)
+{
+	constexpr size_t Inputs = 64;
+	constexpr size_t Count = 200;
+	const auto pixels = RandomPixels(Count * Inputs, 23);
+	const auto decoded = NormalizedPixels(pixels);
+	{
+		//a single identity layer sees exact input codes, so only weight rounding, half a step per weight, separates it from
+		//the float layer: each output is off by at most weightScale * inputScale * sum(codes) / 2.
+		Network network;
+		network.AddLayer(DenseLayer(Inputs, 10, Activation::Identity));
+		DenseLayer& layer = network.Layer(0);
+		const auto weights = RandomFloats(layer.m_weights.size(), 29);
+		const auto bias = RandomFloats(layer.m_bias.size(), 31);
+		std::copy(weights.begin(), weights.end(), layer.m_weights.begin());
+		std::copy(bias.begin(), bias.end(), layer.m_bias.begin());
+		auto quantized = QuantizedNetwork::Calibrate(network, pixels, Count);
+		const QuantizedLayer& quantizedLayer = quantized.Layer(0);
+		const float weightScale = quantizedLayer.m_weightScale;
+		const float inputScale = quantizedLayer.m_input.Scale;
+		size_t misrounded = 0;
+		for (size_t i = 0; i < weights.size(); i++)
+		{
+			if (std::abs(quantizedLayer.m_weights[i] * weightScale - weights[i]) > 0.5f * weightScale * 1.0001f)
+				misrounded++;
+		}
+		IDX3_CHECK(misrounded == 0);
+		const auto expected = network.Forward(decoded, Count);
+		const auto actual = quantized.Forward(pixels, Count);
+		size_t inexact = 0;
+		size_t outside = 0;
+		for (size_t n = 0; n < Count; n++)
+		{
+			double codeSum = 0.0;
+			for (size_t i = 0; i < Inputs; i++)
+				codeSum += pixels[n * Inputs + i];
+			for (size_t o = 0; o < 10; o++)
+			{
+				//the int8 result is the dot product of the dequantized weights, exact up to the final float rescale.
+				double dequantized = bias[o];
+				for (size_t i = 0; i < Inputs; i++)
+					dequantized += static_cast<double>(quantizedLayer.m_weights[o * Inputs + i]) * weightScale * pixels[n * Inputs + i] * inputScale;
+				if (std::abs(actual[n * 10 + o] - dequantized) > 1e-5 * (1.0 + std::abs(dequantized)))
+					inexact++;
+				if (std::abs(static_cast<double>(actual[n * 10 + o]) - expected[n * 10 + o]) > 0.5 * weightScale * inputScale * codeSum + 1e-4)
+					outside++;
+			}
+		}
+		IDX3_CHECK(inexact == 0);
+		IDX3_CHECK(outside == 0);
+	}
+	//requantized hidden activations add error of their own, the predicted class should still nearly always agree. An
+	//identity hidden layer goes negative, which gives the output layer's inputs a zero point to fold in.
+	for (const auto hidden : { Activation::ReLU, Activation::Identity })
+	{
+		Network network;
+		network.AddLayer(DenseLayer(Inputs, 32, hidden));
+		network.AddLayer(DenseLayer(32, 10, Activation::Softmax));
+		for (size_t l = 0; l < network.LayerCount(); l++)
+		{
+			DenseLayer& layer = network.Layer(l);
+			const auto weights = RandomFloats(layer.m_weights.size(), 37 + 2 * static_cast<unsigned>(l));
+			const auto bias = RandomFloats(layer.m_bias.size(), 38 + 2 * static_cast<unsigned>(l));
+			std::copy(weights.begin(), weights.end(), layer.m_weights.begin());
+			std::copy(bias.begin(), bias.end(), layer.m_bias.begin());
+		}
+		//calibrated on the first half, evaluated on all of it.
+		auto quantized = QuantizedNetwork::Calibrate(network, pixels, Count / 2);
+		const auto floatOutput = network.Forward(decoded, Count);
+		const std::vector<float> expected(floatOutput.begin(), floatOutput.end());
+		const auto actual = quantized.Forward(pixels, Count);
+		size_t agreed = 0;
+		for (size_t n = 0; n < Count; n++)
+		{
+			const auto row = expected.begin() + n * 10;
+			const auto quantizedRow = actual.begin() + n * 10;
+			if (std::max_element(row, row + 10) - row == std::max_element(quantizedRow, quantizedRow + 10) - quantizedRow)
+				agreed++;
+		}
+		std::cout << ToString(hidden) << " hidden layer, int8 argmax agrees on " << agreed << " of " << Count << " inputs" << std::endl;
+		IDX3_CHECK(agreed >= Count * 95 / 100);
+	}
+}
@@ -0,0 +1,7 @@
+#include "TestSupport.hpp"
+
+/// Test driver, an optional argument runs only the tests whose name contains it.
+int main(int argc, char** argv)
+{
+	return Test::RunAll(argc, argv);
+}
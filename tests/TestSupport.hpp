@@ -0,0 +1,117 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// <summary>
+/// Minimal self registering test harness, so the tests build and run under ctest without any third party library.
+/// <c>IDX3_TEST(Name)</c> defines a test, <c>IDX3_CHECK</c> records a failure and carries on, <c>IDX3_REQUIRE</c>
+/// records a failure and leaves the test. The runner exits non-zero if any check failed.
+/// </summary>
+namespace Test
+{
+	using TestFn = void(*)();
+	struct TestCase
+	{
+		const char* name;
+		TestFn body;
+	};
+
+	inline std::vector<TestCase>& Registry()
+	{
+		static std::vector<TestCase> tests;
+		return tests;
+	}
+	inline size_t& FailureCount()
+	{
+		static size_t failures = 0;
+		return failures;
+	}
+
+	struct Registrar
+	{
+		Registrar(const char* name, TestFn body) { Registry().push_back({ name, body }); }
+	};
+
+	inline void Fail(const char* file, int line, std::string_view message)
+	{
+		FailureCount()++;
+		std::cout << file << ":" << line << ": check failed: " << message << std::endl;
+	}
+
+	/// <summary>Path of a scratch file in the system temp directory, unique per test executable.</summary>
+	inline std::filesystem::path TempPath(std::string_view name)
+	{
+		return std::filesystem::temp_directory_path() / ("idx3test-" + std::string(name));
+	}
+	inline bool WriteFile(const std::filesystem::path& path, std::span<const std::uint8_t> bytes)
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+		return file.good();
+	}
+	inline std::vector<std::uint8_t> ReadFile(const std::filesystem::path& path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		return std::vector<std::uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+	inline void AppendBigEndian32(std::vector<std::uint8_t>& bytes, std::uint32_t value)
+	{
+		for (int shift = 24; shift >= 0; shift -= 8)
+			bytes.push_back(static_cast<std::uint8_t>(value >> shift));
+	}
+	/// <summary>A complete IDX3 file image of <c>count</c> images whose pixel i of image n is <c>(n * 31 + i) % 256</c>.</summary>
+	inline std::vector<std::uint8_t> Idx3FileBytes(std::uint32_t count, std::uint32_t rows, std::uint32_t columns)
+	{
+		std::vector<std::uint8_t> bytes;
+		for (const auto field : { std::uint32_t{ 2051 }, count, rows, columns })
+			AppendBigEndian32(bytes, field);
+		for (size_t n = 0; n < count; n++)
+			for (size_t i = 0; i < static_cast<size_t>(rows) * columns; i++)
+				bytes.push_back(static_cast<std::uint8_t>((n * 31 + i) % 256));
+		return bytes;
+	}
+
+	/// <summary>Runs every registered test, or those whose name contains <c>argv[1]</c>. Returns the process exit code.</summary>
+	inline int RunAll(int argc, char** argv)
+	{
+		const std::string_view filter = argc > 1 ? argv[1] : "";
+		size_t run = 0;
+		size_t failed = 0;
+		for (const auto& test : Registry())
+		{
+			if (!filter.empty() && std::string_view(test.name).find(filter) == std::string_view::npos)
+				continue;
+			const size_t before = FailureCount();
+			try
+			{
+				test.body();
+			}
+			catch (const std::exception& e)
+			{
+				Fail(test.name, 0, std::string("unexpected exception: ") + e.what());
+			}
+			run++;
+			const bool passed = FailureCount() == before;
+			failed += passed ? 0 : 1;
+			std::cout << (passed ? "[ PASS ] " : "[ FAIL ] ") << test.name << std::endl;
+		}
+		std::cout << run - failed << "/" << run << " tests passed." << std::endl;
+		return failed == 0 && run != 0 ? 0 : 1;
+	}
+}
+
+#define IDX3_TEST(name) \
+	static void name(); \
+	static const Test::Registrar name##Registrar(#name, &name); \
+	static void name()
+#define IDX3_CHECK(condition) \
+	do { if (!(condition)) Test::Fail(__FILE__, __LINE__, #condition); } while (false)
+#define IDX3_REQUIRE(condition) \
+	do { if (!(condition)) { Test::Fail(__FILE__, __LINE__, #condition); return; } } while (false)